@@ -0,0 +1,355 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaAnimBudgetSubsystem.h"
+#include "SpartaPlayerController.h"
+
+#include "Animation/AnimationAsset.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+
+static TAutoConsoleVariable<int32> CVarSpartaAnimBudget(
+	TEXT("Sparta.Anim.Budget"),
+	0,
+	TEXT("1: SpartaPawn/SpartaDrone meshes share Sparta.Anim.BudgetMs of animation time per frame, update at intervals picked ")
+	TEXT("from their screen size and skip their pose off-screen.\n")
+	TEXT("0: every mesh updates every frame."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaAnimBudgetMs(
+	TEXT("Sparta.Anim.BudgetMs"),
+	1.0f,
+	TEXT("Game thread milliseconds per frame all budgeted meshes are held to together."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaAnimFullRateScreenSize(
+	TEXT("Sparta.Anim.FullRateScreenSize"),
+	0.25f,
+	TEXT("Meshes covering more of the screen than this update every frame while within budget. Every halving of the ")
+	TEXT("screen size adds a frame to the interval; going over budget raises the sizes."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaAnimMaxInterval(
+	TEXT("Sparta.Anim.MaxInterval"),
+	8,
+	TEXT("Most frames between updates of a visible mesh. Analytic-significance meshes always use it."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaAnimInterpolateInterval(
+	TEXT("Sparta.Anim.InterpolateInterval"),
+	4,
+	TEXT("Meshes updating less often than every this many frames hold their pose in between instead of interpolating."),
+	ECVF_Default);
+
+USpartaSkeletalMeshComponent::USpartaSkeletalMeshComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	bEnableUpdateRateOptimizations = true;
+	UnbudgetedTickOption = VisibilityBasedAnimTickOption;
+}
+
+void USpartaSkeletalMeshComponent::SetSignificance(ESpartaSignificance NewSignificance)
+{
+	if (Significance != NewSignificance)
+	{
+		Significance = NewSignificance;
+		AppliedGeneration = -1;
+	}
+}
+
+void USpartaSkeletalMeshComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UnbudgetedTickOption = VisibilityBasedAnimTickOption;
+	if (USpartaAnimBudgetSubsystem* Subsystem = GetWorld()->GetSubsystem<USpartaAnimBudgetSubsystem>())
+	{
+		Subsystem->RegisterMesh(this);
+	}
+}
+
+void USpartaSkeletalMeshComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (USpartaAnimBudgetSubsystem* Subsystem = GetWorld()->GetSubsystem<USpartaAnimBudgetSubsystem>())
+	{
+		Subsystem->UnregisterMesh(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void USpartaSkeletalMeshComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	const double StartTime = FPlatformTime::Seconds();
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	USpartaAnimBudgetSubsystem::FAnimStats& Stats = USpartaAnimBudgetSubsystem::GetStats();
+	Stats.Seconds += FPlatformTime::Seconds() - StartTime;
+	Stats.OffScreen += bRecentlyRendered ? 0 : 1;
+	const bool bSkippedUpdate = AnimUpdateRateParams && ShouldUseUpdateRateOptimizations() && AnimUpdateRateParams->ShouldSkipUpdate();
+	Stats.PoseUpdates += ShouldTickPose() && !bSkippedUpdate ? 1 : 0;
+}
+
+void USpartaSkeletalMeshComponent::FinalizeBoneTransform()
+{
+	// The game thread half of a parallel evaluation
+	const double StartTime = FPlatformTime::Seconds();
+	Super::FinalizeBoneTransform();
+	USpartaAnimBudgetSubsystem::GetStats().Seconds += FPlatformTime::Seconds() - StartTime;
+}
+
+bool USpartaAnimBudgetSubsystem::IsEnabled()
+{
+	return CVarSpartaAnimBudget.GetValueOnGameThread() != 0;
+}
+
+USpartaAnimBudgetSubsystem::FAnimStats& USpartaAnimBudgetSubsystem::GetStats()
+{
+	static FAnimStats Stats;
+	return Stats;
+}
+
+void USpartaAnimBudgetSubsystem::RegisterMesh(USpartaSkeletalMeshComponent* Mesh)
+{
+	if (!Mesh)
+	{
+		return;
+	}
+
+	Meshes.AddUnique(Mesh);
+	Mesh->AppliedGeneration = -1;
+}
+
+void USpartaAnimBudgetSubsystem::UnregisterMesh(USpartaSkeletalMeshComponent* Mesh)
+{
+	Meshes.RemoveSingleSwap(Mesh);
+}
+
+void USpartaAnimBudgetSubsystem::ApplySettings(USpartaSkeletalMeshComponent* Mesh) const
+{
+	Mesh->AppliedGeneration = Generation;
+
+	// Shared by all meshes of the owner; they all get the same values
+	FAnimUpdateRateParameters* Params = Mesh->AnimUpdateRateParams;
+
+	if (!bAppliedEnabled)
+	{
+		Mesh->VisibilityBasedAnimTickOption = Mesh->UnbudgetedTickOption;
+		if (Params)
+		{
+			Params->bShouldUseLodMap = false;
+			Params->BaseVisibleDistanceFactorThesholds.Reset();
+			Params->BaseNonRenderedUpdateRate = 1;
+		}
+		return;
+	}
+
+	// Off-screen meshes neither tick their pose nor refresh bones; nothing reads them
+	Mesh->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered;
+	if (!Params)
+	{
+		return;
+	}
+
+	// One threshold per frame added to the interval: a mesh smaller on screen than the first N updates every N + 1 frames
+	const int32 NumThresholds = AppliedMaxInterval - 1;
+	Params->bShouldUseLodMap = false;
+	Params->BaseVisibleDistanceFactorThesholds.SetNumUninitialized(NumThresholds);
+	float Threshold = AppliedFullRateScreenSize * AppliedScale;
+	for (int32 Index = 0; Index < NumThresholds; ++Index)
+	{
+		Params->BaseVisibleDistanceFactorThesholds[Index] = Mesh->Significance == ESpartaSignificance::Analytic ? TNumericLimits<float>::Max() : Threshold;
+		Threshold *= 0.5f;
+	}
+	Params->BaseNonRenderedUpdateRate = AppliedMaxInterval;
+	Params->MaxEvalRateForInterpolation = AppliedInterpolateInterval;
+}
+
+void USpartaAnimBudgetSubsystem::UpdateBudget(double FrameSeconds)
+{
+	FAnimStats& Stats = GetStats();
+	++Stats.Frames;
+	Stats.MeshFrames += Meshes.Num();
+
+	SmoothedMs = FMath::Lerp(SmoothedMs, static_cast<float>(FrameSeconds * 1000.0), 0.1f);
+
+	const bool bEnabled = IsEnabled();
+	if (bEnabled)
+	{
+		// Two percent a frame: at 60 fps a second over budget triples the screen size each interval needs
+		const float BudgetMs = FMath::Max(CVarSpartaAnimBudgetMs.GetValueOnGameThread(), 0.01f);
+		if (SmoothedMs > BudgetMs)
+		{
+			ThresholdScale = FMath::Min(ThresholdScale * 1.02f, 64.f);
+		}
+		else if (SmoothedMs < 0.8f * BudgetMs)
+		{
+			ThresholdScale = FMath::Max(ThresholdScale / 1.02f, 1.f / 64.f);
+		}
+	}
+
+	const float FullRateScreenSize = CVarSpartaAnimFullRateScreenSize.GetValueOnGameThread();
+	const int32 MaxInterval = FMath::Clamp(CVarSpartaAnimMaxInterval.GetValueOnGameThread(), 1, 30);
+	const int32 InterpolateInterval = FMath::Max(CVarSpartaAnimInterpolateInterval.GetValueOnGameThread(), 1);
+
+	// Meshes only take new settings once the scale moved by a tenth, not for every step of it
+	const bool bScaleMoved = bEnabled && FMath::Abs(ThresholdScale - AppliedScale) > 0.1f * AppliedScale;
+	if (bEnabled != bAppliedEnabled || bScaleMoved || FullRateScreenSize != AppliedFullRateScreenSize
+		|| MaxInterval != AppliedMaxInterval || InterpolateInterval != AppliedInterpolateInterval)
+	{
+		++Generation;
+		bAppliedEnabled = bEnabled;
+		AppliedScale = ThresholdScale;
+		AppliedFullRateScreenSize = FullRateScreenSize;
+		AppliedMaxInterval = MaxInterval;
+		AppliedInterpolateInterval = InterpolateInterval;
+	}
+
+	for (int32 Index = Meshes.Num() - 1; Index >= 0; --Index)
+	{
+		USpartaSkeletalMeshComponent* Mesh = Meshes[Index].Get();
+		if (!Mesh)
+		{
+			Meshes.RemoveAtSwap(Index);
+			continue;
+		}
+		if (Mesh->AppliedGeneration != Generation)
+		{
+			ApplySettings(Mesh);
+		}
+	}
+}
+
+void USpartaAnimBudgetSubsystem::StartStress(int32 Count, float Seconds)
+{
+	if (StressPhase != EStressPhase::None)
+	{
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Anim.Stress: already running"));
+		return;
+	}
+
+	UWorld* World = GetWorld();
+	const APlayerController* PlayerController = World->GetFirstPlayerController();
+	const APawn* Viewer = PlayerController ? PlayerController->GetPawn() : nullptr;
+	if (!Viewer)
+	{
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Anim.Stress: needs a local player with a pawn to copy"));
+		return;
+	}
+
+	// A square grid in front of the player, so near copies fill the screen and far ones are a few pixels
+	const int32 Columns = FMath::Max(FMath::CeilToInt(FMath::Sqrt(static_cast<float>(Count))), 1);
+	const float Spacing = 250.f;
+	const FVector Forward = Viewer->GetActorForwardVector().GetSafeNormal2D();
+	const FVector Right = FVector::CrossProduct(FVector::UpVector, Forward);
+	const FVector Origin = Viewer->GetActorLocation() + Forward * 500.f - Right * (Columns - 1) * Spacing * 0.5f;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const FVector Location = Origin + Forward * (Index / Columns) * Spacing + Right * (Index % Columns) * Spacing;
+		if (AActor* Actor = World->SpawnActor<AActor>(Viewer->GetClass(), Location, Viewer->GetActorRotation(), SpawnParams))
+		{
+			StressActors.Add(Actor);
+		}
+	}
+
+	StressSeconds = FMath::Max(Seconds, 0.1f);
+	StressPreviousBudget = CVarSpartaAnimBudget.GetValueOnGameThread();
+	CVarSpartaAnimBudget->Set(0, ECVF_SetByConsole);
+	StressPhase = EStressPhase::Unbudgeted;
+	StressPhaseTime = 0.f;
+	bStressMeasuring = false;
+
+	UE_LOG(LogAAA, Warning, TEXT("Sparta.Anim.Stress: spawned %d copies of %s, measuring %.1fs without the budget and %.1fs with it"),
+		StressActors.Num(), *Viewer->GetClass()->GetName(), StressSeconds, StressSeconds);
+}
+
+void USpartaAnimBudgetSubsystem::TickStress(float DeltaTime)
+{
+	StressPhaseTime += DeltaTime;
+
+	// A second for the spawns to settle and the budget to find its scale
+	if (!bStressMeasuring)
+	{
+		if (StressPhaseTime >= 1.f)
+		{
+			StressStart = GetStats();
+			StressPhaseTime = 0.f;
+			bStressMeasuring = true;
+		}
+		return;
+	}
+	if (StressPhaseTime < StressSeconds)
+	{
+		return;
+	}
+
+	const FAnimStats& Stats = GetStats();
+	const double Frames = FMath::Max<double>(static_cast<double>(Stats.Frames - StressStart.Frames), 1.0);
+	const double Ms = (Stats.Seconds - StressStart.Seconds) * 1000.0 / Frames;
+	const double PoseUpdates = (Stats.PoseUpdates - StressStart.PoseUpdates) / Frames;
+
+	if (StressPhase == EStressPhase::Unbudgeted)
+	{
+		StressUnbudgetedMs = Ms;
+		StressUnbudgetedPoseUpdates = PoseUpdates;
+		CVarSpartaAnimBudget->Set(1, ECVF_SetByConsole);
+		StressPhase = EStressPhase::Budgeted;
+		StressPhaseTime = 0.f;
+		bStressMeasuring = false;
+		return;
+	}
+
+	UE_LOG(LogAAA, Warning, TEXT("Sparta.Anim.Stress meshes=%d budgetms=%.2f off: anim=%.3fms/frame poseupdates/frame=%.1f on: anim=%.3fms/frame poseupdates/frame=%.1f offscreen/frame=%.1f scale=%.2f"),
+		Meshes.Num(), CVarSpartaAnimBudgetMs.GetValueOnGameThread(), StressUnbudgetedMs, StressUnbudgetedPoseUpdates, Ms, PoseUpdates,
+		(Stats.OffScreen - StressStart.OffScreen) / Frames, ThresholdScale);
+	EndStress();
+}
+
+void USpartaAnimBudgetSubsystem::EndStress()
+{
+	for (const TWeakObjectPtr<AActor>& Actor : StressActors)
+	{
+		if (Actor.IsValid())
+		{
+			Actor->Destroy();
+		}
+	}
+	StressActors.Reset();
+
+	CVarSpartaAnimBudget->Set(StressPreviousBudget, ECVF_SetByConsole);
+	StressPhase = EStressPhase::None;
+}
+
+void USpartaAnimBudgetSubsystem::Tick(float DeltaTime)
+{
+	// World subsystems tick after every tick group, so this frame's mesh ticks are all counted
+	const double Seconds = GetStats().Seconds;
+	UpdateBudget(FMath::Max(Seconds - LastSeconds, 0.0));
+	LastSeconds = Seconds;
+
+	if (StressPhase != EStressPhase::None)
+	{
+		TickStress(DeltaTime);
+	}
+}
+
+TStatId USpartaAnimBudgetSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USpartaAnimBudgetSubsystem, STATGROUP_Tickables);
+}
+
+void USpartaAnimBudgetSubsystem::Deinitialize()
+{
+	if (StressPhase != EStressPhase::None)
+	{
+		EndStress();
+	}
+	Meshes.Reset();
+
+	Super::Deinitialize();
+}
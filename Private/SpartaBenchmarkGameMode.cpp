@@ -0,0 +1,240 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaBenchmarkGameMode.h"
+#include "SpartaAnimBudgetSubsystem.h"
+#include "SpartaBotController.h"
+#include "SpartaDrone.h"
+#include "SpartaMovementDebug.h"
+#include "SpartaPawn.h"
+#include "SpartaPlayerController.h"
+#include "SpartaWorldQuery.h"
+
+#include "Engine/World.h"
+#include "HAL/PlatformTime.h"
+#include "Kismet/GameplayStatics.h"
+#include "Kismet/KismetSystemLibrary.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static const TCHAR* const GSpartaBenchmarkColumns[] =
+{
+	TEXT("frame_ms"),
+	TEXT("movement_subsystem_ms"),
+	TEXT("significance_subsystem_ms"),
+	TEXT("pawn_tick_ms"),
+	TEXT("drone_tick_ms"),
+	TEXT("anim_ms"),
+	TEXT("floor_traces"),
+	TEXT("wall_overlaps"),
+	TEXT("sweeps"),
+	TEXT("async_queries"),
+};
+
+ASpartaBenchmarkGameMode::ASpartaBenchmarkGameMode()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	BotPawnClass = ASpartaPawn::StaticClass();
+	BotDroneClass = ASpartaDrone::StaticClass();
+}
+
+void ASpartaBenchmarkGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+	Super::InitGame(MapName, Options, ErrorMessage);
+
+	NumPawns = FMath::Max(UGameplayStatics::GetIntOption(Options, TEXT("Pawns"), NumPawns), 0);
+	NumDrones = FMath::Max(UGameplayStatics::GetIntOption(Options, TEXT("Drones"), NumDrones), 0);
+	NumFrames = FMath::Max(UGameplayStatics::GetIntOption(Options, TEXT("Frames"), NumFrames), 1);
+	WarmupFrames = FMath::Max(UGameplayStatics::GetIntOption(Options, TEXT("Warmup"), WarmupFrames), 0);
+	Seed = UGameplayStatics::GetIntOption(Options, TEXT("Seed"), Seed);
+	if (UGameplayStatics::HasOption(Options, TEXT("BenchName")))
+	{
+		BenchmarkName = UGameplayStatics::ParseOption(Options, TEXT("BenchName"));
+	}
+}
+
+void ASpartaBenchmarkGameMode::StartPlay()
+{
+	Super::StartPlay();
+
+	SpawnBots();
+
+	for (TArray<float>& Column : Samples)
+	{
+		Column.Reset(NumFrames);
+	}
+	FrameIndex = 0;
+	bDone = false;
+	LastCounters = FCounters::Read();
+}
+
+void ASpartaBenchmarkGameMode::SpawnBots()
+{
+	UWorld* World = GetWorld();
+	const AActor* PlayerStart = FindPlayerStart(nullptr);
+	const FVector Origin = PlayerStart ? PlayerStart->GetActorLocation() : FVector::ZeroVector;
+
+	// One square grid, pawns first; drones start higher up and settle on their own
+	const int32 NumBots = NumPawns + NumDrones;
+	const int32 Columns = FMath::Max(FMath::CeilToInt(FMath::Sqrt(static_cast<float>(NumBots))), 1);
+	const float HalfWidth = (Columns - 1) * SpawnSpacing * 0.5f;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	int32 NumSpawned = 0;
+	for (int32 Index = 0; Index < NumBots; ++Index)
+	{
+		const bool bDrone = Index >= NumPawns;
+		UClass* BotClass = bDrone ? BotDroneClass.Get() : BotPawnClass.Get();
+		if (!BotClass)
+		{
+			continue;
+		}
+
+		const FVector Location = Origin + FVector((Index / Columns) * SpawnSpacing - HalfWidth, (Index % Columns) * SpawnSpacing - HalfWidth, bDrone ? 300.f : 100.f);
+		APawn* Bot = World->SpawnActor<APawn>(BotClass, Location, FRotator::ZeroRotator, SpawnParams);
+		if (!Bot)
+		{
+			continue;
+		}
+
+		ASpartaBotController* Controller = World->SpawnActor<ASpartaBotController>(Location, FRotator::ZeroRotator, SpawnParams);
+		if (!Controller)
+		{
+			Bot->Destroy();
+			continue;
+		}
+		Controller->SetSeed(Seed + Index);
+		Controller->Possess(Bot);
+		++NumSpawned;
+	}
+
+	UE_LOG(LogAAA, Warning, TEXT("SpartaBenchmark: spawned %d of %d pawns and %d drones, warming up for %d frames and measuring %d"),
+		NumSpawned, NumPawns, NumDrones, WarmupFrames, NumFrames);
+}
+
+ASpartaBenchmarkGameMode::FCounters ASpartaBenchmarkGameMode::FCounters::Read()
+{
+	const SpartaMovementDebug::FFrameTimings& Timings = SpartaMovementDebug::GetFrameTimings();
+	const FSpartaTraceCounts& Traces = FSpartaWorldQuery::GetTraceCounts();
+
+	FCounters Counters;
+	Counters.Time = FPlatformTime::Seconds();
+	Counters.MovementSeconds = Timings.MovementSubsystem;
+	Counters.SignificanceSeconds = Timings.SignificanceSubsystem;
+	Counters.PawnSeconds = Timings.PawnTicks;
+	Counters.DroneSeconds = Timings.DroneTicks;
+	Counters.AnimSeconds = USpartaAnimBudgetSubsystem::GetStats().Seconds;
+	Counters.FloorTraces = Traces.FloorTraces.load();
+	Counters.WallOverlaps = Traces.WallOverlaps.load();
+	Counters.Sweeps = Traces.Sweeps.load();
+	Counters.AsyncQueries = FSpartaWorldQuery::GetAsyncStats().Submitted.load();
+	return Counters;
+}
+
+void ASpartaBenchmarkGameMode::AddSample(const FCounters& Previous, const FCounters& Current)
+{
+	Samples[Column_FrameMs].Add(static_cast<float>((Current.Time - Previous.Time) * 1000.0));
+	Samples[Column_MovementMs].Add(static_cast<float>((Current.MovementSeconds - Previous.MovementSeconds) * 1000.0));
+	Samples[Column_SignificanceMs].Add(static_cast<float>((Current.SignificanceSeconds - Previous.SignificanceSeconds) * 1000.0));
+	Samples[Column_PawnTickMs].Add(static_cast<float>((Current.PawnSeconds - Previous.PawnSeconds) * 1000.0));
+	Samples[Column_DroneTickMs].Add(static_cast<float>((Current.DroneSeconds - Previous.DroneSeconds) * 1000.0));
+	Samples[Column_AnimMs].Add(static_cast<float>((Current.AnimSeconds - Previous.AnimSeconds) * 1000.0));
+	Samples[Column_FloorTraces].Add(static_cast<float>(Current.FloorTraces - Previous.FloorTraces));
+	Samples[Column_WallOverlaps].Add(static_cast<float>(Current.WallOverlaps - Previous.WallOverlaps));
+	Samples[Column_Sweeps].Add(static_cast<float>(Current.Sweeps - Previous.Sweeps));
+	Samples[Column_AsyncQueries].Add(static_cast<float>(Current.AsyncQueries - Previous.AsyncQueries));
+}
+
+void ASpartaBenchmarkGameMode::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (bDone)
+	{
+		return;
+	}
+
+	// Game mode tick to game mode tick is one whole frame: the rest of this one and the start of the next
+	const FCounters Counters = FCounters::Read();
+	if (FrameIndex >= WarmupFrames)
+	{
+		AddSample(LastCounters, Counters);
+	}
+	LastCounters = Counters;
+
+	if (++FrameIndex < WarmupFrames + NumFrames)
+	{
+		return;
+	}
+
+	bDone = true;
+	WriteResults();
+	if (bQuitWhenDone)
+	{
+		UKismetSystemLibrary::QuitGame(this, nullptr, EQuitPreference::Quit, false);
+	}
+}
+
+void ASpartaBenchmarkGameMode::WriteResults() const
+{
+	static_assert(UE_ARRAY_COUNT(GSpartaBenchmarkColumns) == Column_Num, "one name per column");
+
+	const FString Directory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SpartaBenchmarks"));
+	const FString Stem = FPaths::Combine(Directory, FString::Printf(TEXT("%s-%s"), *BenchmarkName, *FDateTime::Now().ToString(TEXT("%Y%m%d-%H%M%S"))));
+	const int32 Num = Samples[Column_FrameMs].Num();
+
+	FString Frames = TEXT("frame");
+	for (const TCHAR* Column : GSpartaBenchmarkColumns)
+	{
+		Frames += FString::Printf(TEXT(",%s"), Column);
+	}
+	Frames += LINE_TERMINATOR;
+	for (int32 Frame = 0; Frame < Num; ++Frame)
+	{
+		Frames += FString::Printf(TEXT("%d"), Frame);
+		for (int32 Column = 0; Column < Column_Num; ++Column)
+		{
+			Frames += FString::Printf(TEXT(",%.4f"), Samples[Column][Frame]);
+		}
+		Frames += LINE_TERMINATOR;
+	}
+
+	// Nearest-rank percentiles
+	FString Summary = FString::Printf(TEXT("# pawns=%d drones=%d frames=%d warmup=%d seed=%d") LINE_TERMINATOR, NumPawns, NumDrones, Num, WarmupFrames, Seed);
+	Summary += TEXT("metric,mean,p50,p90,p95,p99,max") LINE_TERMINATOR;
+	for (int32 Column = 0; Column < Column_Num; ++Column)
+	{
+		TArray<float> Sorted = Samples[Column];
+		Sorted.Sort();
+
+		double Sum = 0.0;
+		for (float Value : Sorted)
+		{
+			Sum += Value;
+		}
+		auto Percentile = [&Sorted](float Fraction)
+		{
+			return Sorted.Num() > 0 ? Sorted[FMath::Clamp(FMath::CeilToInt(Fraction * Sorted.Num()) - 1, 0, Sorted.Num() - 1)] : 0.f;
+		};
+
+		Summary += FString::Printf(TEXT("%s,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f") LINE_TERMINATOR, GSpartaBenchmarkColumns[Column],
+			Sorted.Num() > 0 ? Sum / Sorted.Num() : 0.0, Percentile(0.5f), Percentile(0.9f), Percentile(0.95f), Percentile(0.99f), Percentile(1.f));
+
+		if (Column == Column_FrameMs)
+		{
+			UE_LOG(LogAAA, Warning, TEXT("SpartaBenchmark frame_ms mean=%.3f p50=%.3f p95=%.3f p99=%.3f max=%.3f"),
+				Sorted.Num() > 0 ? Sum / Sorted.Num() : 0.0, Percentile(0.5f), Percentile(0.95f), Percentile(0.99f), Percentile(1.f));
+		}
+	}
+
+	const FString FramesPath = Stem + TEXT("-frames.csv");
+	const FString SummaryPath = Stem + TEXT("-summary.csv");
+	if (!FFileHelper::SaveStringToFile(Frames, *FramesPath) || !FFileHelper::SaveStringToFile(Summary, *SummaryPath))
+	{
+		UE_LOG(LogAAA, Warning, TEXT("SpartaBenchmark: cannot write %s"), *Stem);
+		return;
+	}
+	UE_LOG(LogAAA, Warning, TEXT("SpartaBenchmark: wrote %s and %s"), *SummaryPath, *FramesPath);
+}
@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaBotController.h"
+#include "SpartaDrone.h"
+#include "SpartaPawn.h"
+
+#include "InputActionValue.h"
+
+ASpartaBotController::ASpartaBotController()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+	bAttachToPawn = false;
+}
+
+void ASpartaBotController::OnPossess(APawn* InPawn)
+{
+	Super::OnPossess(InPawn);
+
+	// Inputs arrive before the pawn steps, as a player's do
+	if (InPawn)
+	{
+		InPawn->AddTickPrerequisiteActor(this);
+		SetControlRotation(InPawn->GetActorRotation());
+	}
+	SegmentFrames = 0;
+}
+
+void ASpartaBotController::StartSegment()
+{
+	// Half a second to three seconds at 60 fps
+	SegmentFrames = Stream.RandRange(30, 180);
+
+	// Mostly walking somewhere, sometimes standing still
+	const bool bMove = Stream.FRand() < 0.8f;
+	MoveInput = bMove ? FVector2D(Stream.RandRange(-1, 1), Stream.RandRange(-1, 1)) : FVector2D::ZeroVector;
+	LookInput = FVector2D(Stream.FRandRange(-1.f, 1.f), 0.f);
+	MoveUpInput = static_cast<float>(Stream.RandRange(-1, 1));
+	bSprint = bMove && Stream.FRand() < 0.3f;
+	bJump = Stream.FRand() < 0.2f;
+}
+
+void ASpartaBotController::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	bSegmentStarted = --SegmentFrames <= 0;
+	if (bSegmentStarted)
+	{
+		StartSegment();
+	}
+
+	if (ASpartaPawn* SpartaPawn = Cast<ASpartaPawn>(GetPawn()))
+	{
+		DrivePawn(SpartaPawn);
+	}
+	else if (ASpartaDrone* Drone = Cast<ASpartaDrone>(GetPawn()))
+	{
+		DriveDrone(Drone);
+	}
+}
+
+void ASpartaBotController::DrivePawn(ASpartaPawn* SpartaPawn)
+{
+	// Move and Look are bound to Triggered, which fires every frame while held
+	if (!MoveInput.IsZero())
+	{
+		SpartaPawn->Move(FInputActionValue(MoveInput));
+	}
+	if (!LookInput.IsZero())
+	{
+		SpartaPawn->Look(FInputActionValue(LookInput));
+
+		// AddControllerYawInput only turns player controllers; a bot turns its own control rotation the same way
+		FRotator Rotation = GetControlRotation();
+		Rotation.Yaw = FRotator::NormalizeAxis(Rotation.Yaw + LookInput.X);
+		SetControlRotation(Rotation);
+	}
+
+	// Sprint and jump are Triggered when pressed and Completed when released
+	if (bSprint != bWasSprinting)
+	{
+		if (bSprint)
+		{
+			SpartaPawn->StartSprint(FInputActionValue(true));
+		}
+		else
+		{
+			SpartaPawn->StopSprint(FInputActionValue(false));
+		}
+		bWasSprinting = bSprint;
+	}
+
+	// Held for a varying time, so some jumps are cut short
+	if (JumpFramesLeft > 0)
+	{
+		if (--JumpFramesLeft == 0)
+		{
+			SpartaPawn->StopJump(FInputActionValue(false));
+		}
+	}
+	else if (bSegmentStarted && bJump)
+	{
+		SpartaPawn->Startjump(FInputActionValue(true));
+		JumpFramesLeft = Stream.RandRange(5, 30);
+	}
+}
+
+void ASpartaBotController::DriveDrone(ASpartaDrone* Drone)
+{
+	// Every drone action is Triggered while held
+	if (MoveInput.X != 0.0)
+	{
+		Drone->MoveForward(FInputActionValue(static_cast<float>(MoveInput.X)));
+	}
+	if (MoveInput.Y != 0.0)
+	{
+		Drone->MoveRight(FInputActionValue(static_cast<float>(MoveInput.Y)));
+	}
+	if (MoveUpInput != 0.0f)
+	{
+		Drone->MoveUp(FInputActionValue(MoveUpInput));
+	}
+	if (LookInput.X != 0.0)
+	{
+		Drone->LookYaw(FInputActionValue(static_cast<float>(LookInput.X)));
+	}
+}
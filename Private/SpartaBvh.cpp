@@ -0,0 +1,567 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaBvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SPARTA_MOVEMENT_AVX2 1
+#define SPARTA_MOVEMENT_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPARTA_MOVEMENT_AVX2 0
+#define SPARTA_MOVEMENT_SSE2 1
+#else
+#define SPARTA_MOVEMENT_AVX2 0
+#define SPARTA_MOVEMENT_SSE2 0
+#endif
+
+namespace SpartaMovement
+{
+	namespace
+	{
+		/** Deeper nodes are made leaves whatever their size, so traversal stacks stay fixed */
+		constexpr int32_t MaxTreeDepth = 60;
+		constexpr int32_t TraversalStackSize = MaxTreeDepth + 2;
+		/** Triangles whose normal is this close to horizontal are walls */
+		constexpr float WallNormalZ = 1.e-4f;
+		/** How far under a probe's start a floor still counts: rounding in the plane puts a pawn standing on it there */
+		constexpr float StartTolerance = 0.1f;
+
+		struct FBounds
+		{
+			FVec3 Min = FVec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+			FVec3 Max = FVec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+
+			void Add(const FVec3& Point)
+			{
+				Min = FVec3(std::min(Min.X, Point.X), std::min(Min.Y, Point.Y), std::min(Min.Z, Point.Z));
+				Max = FVec3(std::max(Max.X, Point.X), std::max(Max.Y, Point.Y), std::max(Max.Z, Point.Z));
+			}
+
+			void Add(const FBounds& Other)
+			{
+				Add(Other.Min);
+				Add(Other.Max);
+			}
+
+			bool IsValid() const { return Min.X <= Max.X; }
+
+			/** What the SAH weighs a node by: the chance a ray enters it, up to a factor all nodes share */
+			float Cost(bool bFootprint) const
+			{
+				if (!IsValid())
+				{
+					return 0.f;
+				}
+				const FVec3 Size = Max - Min;
+				return bFootprint ? Size.X * Size.Y : Size.X * Size.Y + Size.Y * Size.Z + Size.Z * Size.X;
+			}
+		};
+
+		inline float GetAxis(const FVec3& V, int32_t Axis) { return Axis == 0 ? V.X : Axis == 1 ? V.Y : V.Z; }
+
+		/** A triangle during the build */
+		struct FBuildTriangle
+		{
+			FBounds Bounds;
+			FVec3 Centroid;
+			int32_t Index = 0;
+		};
+
+		/** Keeps every bit of a 16-bit value, one bit apart */
+		inline uint32_t SpreadBits(uint32_t Value)
+		{
+			Value &= 0xFFFFu;
+			Value = (Value | (Value << 8)) & 0x00FF00FFu;
+			Value = (Value | (Value << 4)) & 0x0F0F0F0Fu;
+			Value = (Value | (Value << 2)) & 0x33333333u;
+			Value = (Value | (Value << 1)) & 0x55555555u;
+			return Value;
+		}
+
+		/**
+		 * Lane types TracePacket runs on: one ray, or a packet of 4 or 8. Masks are whatever the compares return;
+		 * Any says whether a mask has a lane set.
+		 */
+		struct FScalarLanes
+		{
+			static constexpr int32_t Width = 1;
+			using FFloat = float;
+			using FMask = bool;
+
+			static FFloat Load(const float* Values) { return *Values; }
+			static void Store(float* Values, FFloat V) { *Values = V; }
+			static FFloat Splat(float Value) { return Value; }
+			static FFloat Add(FFloat A, FFloat B) { return A + B; }
+			static FFloat Mul(FFloat A, FFloat B) { return A * B; }
+			static FMask GreaterEqual(FFloat A, FFloat B) { return A >= B; }
+			static FMask LessEqual(FFloat A, FFloat B) { return A <= B; }
+			// Short-circuit: one ray gives up on a node at its first failed compare
+			static FMask And(FMask A, FMask B) { return A && B; }
+			static FMask Or(FMask A, FMask B) { return A | B; }
+			static FFloat Select(FMask Mask, FFloat A, FFloat B) { return Mask ? A : B; }
+			static bool Any(FMask Mask) { return Mask; }
+			static int32_t Bits(FMask Mask) { return Mask ? 1 : 0; }
+			static FMask None() { return false; }
+		};
+
+#if SPARTA_MOVEMENT_SSE2
+		struct FSseLanes
+		{
+			static constexpr int32_t Width = 4;
+			using FFloat = __m128;
+			using FMask = __m128;
+
+			static FFloat Load(const float* Values) { return _mm_loadu_ps(Values); }
+			static void Store(float* Values, FFloat V) { _mm_storeu_ps(Values, V); }
+			static FFloat Splat(float Value) { return _mm_set1_ps(Value); }
+			static FFloat Add(FFloat A, FFloat B) { return _mm_add_ps(A, B); }
+			static FFloat Mul(FFloat A, FFloat B) { return _mm_mul_ps(A, B); }
+			static FMask GreaterEqual(FFloat A, FFloat B) { return _mm_cmpge_ps(A, B); }
+			static FMask LessEqual(FFloat A, FFloat B) { return _mm_cmple_ps(A, B); }
+			static FMask And(FMask A, FMask B) { return _mm_and_ps(A, B); }
+			static FMask Or(FMask A, FMask B) { return _mm_or_ps(A, B); }
+			static FFloat Select(FMask Mask, FFloat A, FFloat B) { return _mm_or_ps(_mm_and_ps(Mask, A), _mm_andnot_ps(Mask, B)); }
+			static bool Any(FMask Mask) { return _mm_movemask_ps(Mask) != 0; }
+			static int32_t Bits(FMask Mask) { return _mm_movemask_ps(Mask); }
+			static FMask None() { return _mm_setzero_ps(); }
+		};
+#endif
+
+#if SPARTA_MOVEMENT_AVX2
+		struct FAvxLanes
+		{
+			static constexpr int32_t Width = 8;
+			using FFloat = __m256;
+			using FMask = __m256;
+
+			static FFloat Load(const float* Values) { return _mm256_loadu_ps(Values); }
+			static void Store(float* Values, FFloat V) { _mm256_storeu_ps(Values, V); }
+			static FFloat Splat(float Value) { return _mm256_set1_ps(Value); }
+			static FFloat Add(FFloat A, FFloat B) { return _mm256_add_ps(A, B); }
+			static FFloat Mul(FFloat A, FFloat B) { return _mm256_mul_ps(A, B); }
+			static FMask GreaterEqual(FFloat A, FFloat B) { return _mm256_cmp_ps(A, B, _CMP_GE_OQ); }
+			static FMask LessEqual(FFloat A, FFloat B) { return _mm256_cmp_ps(A, B, _CMP_LE_OQ); }
+			static FMask And(FMask A, FMask B) { return _mm256_and_ps(A, B); }
+			static FMask Or(FMask A, FMask B) { return _mm256_or_ps(A, B); }
+			static FFloat Select(FMask Mask, FFloat A, FFloat B) { return _mm256_blendv_ps(B, A, Mask); }
+			static bool Any(FMask Mask) { return _mm256_movemask_ps(Mask) != 0; }
+			static int32_t Bits(FMask Mask) { return _mm256_movemask_ps(Mask); }
+			static FMask None() { return _mm256_setzero_ps(); }
+		};
+#endif
+
+#if SPARTA_MOVEMENT_AVX2
+		using FPacketLanes = FAvxLanes;
+#elif SPARTA_MOVEMENT_SSE2
+		using FPacketLanes = FSseLanes;
+#else
+		using FPacketLanes = FScalarLanes;
+#endif
+	}
+
+	void FFloorBvh::Build(const FVec3* Vertices, const int32_t* Indices, int32_t NumIndices, const FBvhBuildSettings& Settings, FBvhBuildStats* OutStats)
+	{
+		const auto StartTime = std::chrono::steady_clock::now();
+
+		FBvhBuildStats Stats;
+		Nodes.clear();
+		Triangles.clear();
+
+		const int32_t MaxLeafTriangles = std::max(Settings.MaxLeafTriangles, 1);
+		const int32_t NumBins = std::clamp(Settings.NumBins, 2, 256);
+
+		// Walls out, the rest as edge functions counterclockwise seen from above
+		std::vector<FBuildTriangle> BuildTriangles;
+		std::vector<FTriangle> Unordered;
+		BuildTriangles.reserve(NumIndices / 3);
+		Unordered.reserve(NumIndices / 3);
+		for (int32_t First = 0; First + 2 < NumIndices; First += 3)
+		{
+			++Stats.NumTriangles;
+			FVec3 Corners[3] = { Vertices[Indices[First]], Vertices[Indices[First + 1]], Vertices[Indices[First + 2]] };
+
+			const FVec3 Edge1 = Corners[1] - Corners[0];
+			const FVec3 Edge2 = Corners[2] - Corners[0];
+			const FVec3 Normal(Edge1.Y * Edge2.Z - Edge1.Z * Edge2.Y, Edge1.Z * Edge2.X - Edge1.X * Edge2.Z, Edge1.X * Edge2.Y - Edge1.Y * Edge2.X);
+			const float NormalSize = std::sqrt(Normal.SizeSquared());
+			if (!(std::fabs(Normal.Z) > WallNormalZ * NormalSize))
+			{
+				++Stats.NumDroppedTriangles;
+				continue;
+			}
+			if (Normal.Z < 0.f)
+			{
+				std::swap(Corners[1], Corners[2]);
+			}
+
+			FTriangle Triangle;
+			for (int32_t Edge = 0; Edge < 3; ++Edge)
+			{
+				// Left of From -> To. The same edge of the neighbour runs To -> From and gets exactly the negated function.
+				const FVec3& From = Corners[Edge];
+				const FVec3& To = Corners[(Edge + 1) % 3];
+				Triangle.EdgeX[Edge] = From.Y - To.Y;
+				Triangle.EdgeY[Edge] = To.X - From.X;
+				Triangle.Edge0[Edge] = From.X * To.Y - To.X * From.Y;
+			}
+			Triangle.PlaneX = -Normal.X / Normal.Z;
+			Triangle.PlaneY = -Normal.Y / Normal.Z;
+			Triangle.Plane0 = Corners[0].Z - Triangle.PlaneX * Corners[0].X - Triangle.PlaneY * Corners[0].Y;
+
+			FBuildTriangle Build;
+			for (const FVec3& Corner : Corners)
+			{
+				Build.Bounds.Add(Corner);
+			}
+			Build.Centroid = (Corners[0] + Corners[1] + Corners[2]) * (1.f / 3.f);
+			Build.Index = static_cast<int32_t>(Unordered.size());
+			BuildTriangles.push_back(Build);
+			Unordered.push_back(Triangle);
+		}
+
+		const int32_t NumKept = static_cast<int32_t>(BuildTriangles.size());
+		if (NumKept == 0)
+		{
+			Stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+			if (OutStats)
+			{
+				*OutStats = Stats;
+			}
+			return;
+		}
+
+		// Children are allocated in pairs next to each other; a binary tree over N leaves has under 2N nodes
+		Nodes.reserve(2 * static_cast<size_t>(NumKept));
+		Nodes.emplace_back();
+
+		struct FPending
+		{
+			int32_t Node;
+			int32_t Begin;
+			int32_t End;
+			int32_t Depth;
+		};
+		std::vector<FPending> Pending;
+		Pending.push_back({ 0, 0, NumKept, 0 });
+
+		std::vector<FBounds> BinBounds(NumBins);
+		std::vector<int32_t> BinCounts(NumBins);
+		std::vector<float> RightCosts(NumBins);
+		std::vector<int32_t> RightCounts(NumBins);
+
+		double RootCost = 0.0;
+		while (!Pending.empty())
+		{
+			const FPending Item = Pending.back();
+			Pending.pop_back();
+
+			FBounds Bounds;
+			FBounds CentroidBounds;
+			for (int32_t Index = Item.Begin; Index < Item.End; ++Index)
+			{
+				Bounds.Add(BuildTriangles[Index].Bounds);
+				CentroidBounds.Add(BuildTriangles[Index].Centroid);
+			}
+
+			FNode& Node = Nodes[Item.Node];
+			Node.MinX = Bounds.Min.X;
+			Node.MinY = Bounds.Min.Y;
+			Node.MinZ = Bounds.Min.Z;
+			Node.MaxX = Bounds.Max.X;
+			Node.MaxY = Bounds.Max.Y;
+			Node.MaxZ = Bounds.Max.Z;
+			Stats.MaxDepth = std::max(Stats.MaxDepth, Item.Depth);
+
+			const int32_t Count = Item.End - Item.Begin;
+			const float NodeCost = Bounds.Cost(Settings.bFootprintCost);
+			if (Item.Node == 0)
+			{
+				RootCost = std::max<double>(NodeCost, 1.e-12);
+			}
+
+			// Best binned SAH split over the three axes
+			int32_t BestAxis = -1;
+			int32_t BestBin = 0;
+			float BestCost = std::numeric_limits<float>::max();
+			if (Count > 1 && Item.Depth < MaxTreeDepth)
+			{
+				for (int32_t Axis = 0; Axis < 3; ++Axis)
+				{
+					const float AxisMin = GetAxis(CentroidBounds.Min, Axis);
+					const float AxisExtent = GetAxis(CentroidBounds.Max, Axis) - AxisMin;
+					if (AxisExtent <= 0.f)
+					{
+						continue;
+					}
+
+					std::fill(BinBounds.begin(), BinBounds.end(), FBounds());
+					std::fill(BinCounts.begin(), BinCounts.end(), 0);
+					const float BinScale = NumBins / AxisExtent;
+					for (int32_t Index = Item.Begin; Index < Item.End; ++Index)
+					{
+						const int32_t Bin = std::min(static_cast<int32_t>((GetAxis(BuildTriangles[Index].Centroid, Axis) - AxisMin) * BinScale), NumBins - 1);
+						BinBounds[Bin].Add(BuildTriangles[Index].Bounds);
+						++BinCounts[Bin];
+					}
+
+					FBounds Right;
+					int32_t RightCount = 0;
+					for (int32_t Bin = NumBins - 1; Bin > 0; --Bin)
+					{
+						Right.Add(BinBounds[Bin]);
+						RightCount += BinCounts[Bin];
+						RightCosts[Bin] = Right.Cost(Settings.bFootprintCost);
+						RightCounts[Bin] = RightCount;
+					}
+
+					// Split before Bin: bins [0, Bin) go left
+					FBounds Left;
+					int32_t LeftCount = 0;
+					for (int32_t Bin = 1; Bin < NumBins; ++Bin)
+					{
+						Left.Add(BinBounds[Bin - 1]);
+						LeftCount += BinCounts[Bin - 1];
+						if (LeftCount == 0 || RightCounts[Bin] == 0)
+						{
+							continue;
+						}
+						const float SplitCost = Left.Cost(Settings.bFootprintCost) * LeftCount + RightCosts[Bin] * RightCounts[Bin];
+						if (SplitCost < BestCost)
+						{
+							BestCost = SplitCost;
+							BestAxis = Axis;
+							BestBin = Bin;
+						}
+					}
+				}
+			}
+
+			// Leaf when splitting does not pay, unless the node is over the leaf size
+			const float LeafCost = Settings.IntersectionCost * Count;
+			const float SplitTotal = BestAxis < 0 ? std::numeric_limits<float>::max()
+				: Settings.TraversalCost + Settings.IntersectionCost * BestCost / std::max(NodeCost, 1.e-12f);
+			const bool bMustSplit = Count > MaxLeafTriangles && Item.Depth < MaxTreeDepth;
+			if (BestAxis < 0 && bMustSplit)
+			{
+				// All centroids in one place: halve the range
+				BestAxis = 3;
+			}
+			else if (!bMustSplit && SplitTotal >= LeafCost)
+			{
+				BestAxis = -1;
+			}
+
+			if (BestAxis < 0)
+			{
+				Node.First = static_cast<int32_t>(Triangles.size());
+				Node.Count = Count;
+				for (int32_t Index = Item.Begin; Index < Item.End; ++Index)
+				{
+					Triangles.push_back(Unordered[BuildTriangles[Index].Index]);
+				}
+				++Stats.NumLeaves;
+				Stats.SahCost += Settings.IntersectionCost * Count * NodeCost / RootCost;
+				continue;
+			}
+
+			int32_t Middle = Item.Begin + Count / 2;
+			if (BestAxis < 3)
+			{
+				const float AxisMin = GetAxis(CentroidBounds.Min, BestAxis);
+				const float BinScale = NumBins / (GetAxis(CentroidBounds.Max, BestAxis) - AxisMin);
+				const auto Split = std::partition(BuildTriangles.begin() + Item.Begin, BuildTriangles.begin() + Item.End, [&](const FBuildTriangle& Triangle)
+				{
+					return std::min(static_cast<int32_t>((GetAxis(Triangle.Centroid, BestAxis) - AxisMin) * BinScale), NumBins - 1) < BestBin;
+				});
+				Middle = static_cast<int32_t>(Split - BuildTriangles.begin());
+			}
+
+			const int32_t Children = static_cast<int32_t>(Nodes.size());
+			Nodes[Item.Node].First = Children;
+			Nodes[Item.Node].Count = 0;
+			Nodes.emplace_back();
+			Nodes.emplace_back();
+			Stats.SahCost += Settings.TraversalCost * NodeCost / RootCost;
+
+			Pending.push_back({ Children, Item.Begin, Middle, Item.Depth + 1 });
+			Pending.push_back({ Children + 1, Middle, Item.End, Item.Depth + 1 });
+		}
+
+		Stats.NumNodes = static_cast<int32_t>(Nodes.size());
+		Stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+		if (OutStats)
+		{
+			*OutStats = Stats;
+		}
+	}
+
+	template <typename TLanes>
+	void FFloorBvh::TracePacket(const FVec3* Starts, const float* Distances, float* OutFloorZ, bool* OutHits, int32_t Num) const
+	{
+		using FFloat = typename TLanes::FFloat;
+		using FMask = typename TLanes::FMask;
+
+		// Lanes past Num probe nothing: their top is below everything
+		float LaneX[TLanes::Width];
+		float LaneY[TLanes::Width];
+		float LaneTop[TLanes::Width];
+		float LaneBottom[TLanes::Width];
+		for (int32_t Lane = 0; Lane < TLanes::Width; ++Lane)
+		{
+			const bool bActive = Lane < Num;
+			LaneX[Lane] = bActive ? Starts[Lane].X : 0.f;
+			LaneY[Lane] = bActive ? Starts[Lane].Y : 0.f;
+			LaneTop[Lane] = bActive ? Starts[Lane].Z + StartTolerance : -std::numeric_limits<float>::max();
+			LaneBottom[Lane] = bActive ? Starts[Lane].Z - Distances[Lane] : -std::numeric_limits<float>::max();
+		}
+
+		const FFloat X = TLanes::Load(LaneX);
+		const FFloat Y = TLanes::Load(LaneY);
+		const FFloat Top = TLanes::Load(LaneTop);
+		// Highest floor found so far; nothing below it matters any more
+		FFloat Best = TLanes::Load(LaneBottom);
+		FMask Hits = TLanes::None();
+
+		const auto Enters = [&](const FNode& Node)
+		{
+			return TLanes::And(
+				TLanes::And(TLanes::And(TLanes::GreaterEqual(X, TLanes::Splat(Node.MinX)), TLanes::LessEqual(X, TLanes::Splat(Node.MaxX))),
+					TLanes::And(TLanes::GreaterEqual(Y, TLanes::Splat(Node.MinY)), TLanes::LessEqual(Y, TLanes::Splat(Node.MaxY)))),
+				TLanes::And(TLanes::GreaterEqual(Top, TLanes::Splat(Node.MinZ)), TLanes::LessEqual(Best, TLanes::Splat(Node.MaxZ))));
+		};
+
+		// Nodes go on the stack once a probe enters them: children are tested from their parent
+		int32_t Stack[TraversalStackSize];
+		int32_t StackSize = 0;
+		if (TLanes::Any(Enters(Nodes[0])))
+		{
+			Stack[StackSize++] = 0;
+		}
+		while (StackSize > 0)
+		{
+			const FNode& Node = Nodes[Stack[--StackSize]];
+			// A floor found since it was pushed may be over all of it
+			if (!TLanes::Any(TLanes::LessEqual(Best, TLanes::Splat(Node.MaxZ))))
+			{
+				continue;
+			}
+
+			if (Node.Count == 0)
+			{
+				// Going down, the child reaching higher is more likely to hold the floor: it goes on top
+				const FNode& Left = Nodes[Node.First];
+				const FNode& Right = Nodes[Node.First + 1];
+				const bool bEntersLeft = TLanes::Any(Enters(Left));
+				const bool bEntersRight = TLanes::Any(Enters(Right));
+				const bool bLeftFirst = Left.MaxZ >= Right.MaxZ;
+				if (bEntersLeft && bEntersRight)
+				{
+					Stack[StackSize++] = bLeftFirst ? Node.First + 1 : Node.First;
+					Stack[StackSize++] = bLeftFirst ? Node.First : Node.First + 1;
+				}
+				else if (bEntersLeft || bEntersRight)
+				{
+					Stack[StackSize++] = bEntersLeft ? Node.First : Node.First + 1;
+				}
+				continue;
+			}
+
+			// Lanes outside the node are outside its triangles too, so every lane is tested
+			for (int32_t Index = Node.First; Index < Node.First + Node.Count; ++Index)
+			{
+				const FTriangle& Triangle = Triangles[Index];
+				FMask Inside = TLanes::GreaterEqual(
+					TLanes::Add(TLanes::Add(TLanes::Mul(X, TLanes::Splat(Triangle.EdgeX[0])), TLanes::Mul(Y, TLanes::Splat(Triangle.EdgeY[0]))), TLanes::Splat(Triangle.Edge0[0])),
+					TLanes::Splat(0.f));
+				for (int32_t Edge = 1; Edge < 3; ++Edge)
+				{
+					Inside = TLanes::And(Inside, TLanes::GreaterEqual(
+						TLanes::Add(TLanes::Add(TLanes::Mul(X, TLanes::Splat(Triangle.EdgeX[Edge])), TLanes::Mul(Y, TLanes::Splat(Triangle.EdgeY[Edge]))), TLanes::Splat(Triangle.Edge0[Edge])),
+						TLanes::Splat(0.f)));
+				}
+
+				const FFloat Z = TLanes::Add(TLanes::Add(TLanes::Mul(X, TLanes::Splat(Triangle.PlaneX)), TLanes::Mul(Y, TLanes::Splat(Triangle.PlaneY))), TLanes::Splat(Triangle.Plane0));
+				const FMask Hit = TLanes::And(Inside, TLanes::And(TLanes::LessEqual(Z, Top), TLanes::GreaterEqual(Z, Best)));
+				Best = TLanes::Select(Hit, Z, Best);
+				Hits = TLanes::Or(Hits, Hit);
+			}
+		}
+
+		float LaneBest[TLanes::Width];
+		TLanes::Store(LaneBest, Best);
+		const int32_t HitBits = TLanes::Bits(Hits);
+		for (int32_t Lane = 0; Lane < Num; ++Lane)
+		{
+			OutHits[Lane] = (HitBits >> Lane) & 1;
+			if (OutHits[Lane])
+			{
+				OutFloorZ[Lane] = LaneBest[Lane];
+			}
+		}
+	}
+
+	bool FFloorBvh::TraceDown(const FVec3& Start, float Distance, float& OutFloorZ) const
+	{
+		if (Nodes.empty())
+		{
+			return false;
+		}
+
+		bool bHit = false;
+		TracePacket<FScalarLanes>(&Start, &Distance, &OutFloorZ, &bHit, 1);
+		return bHit;
+	}
+
+	void FFloorBvh::TraceDownBatch(const FVec3* Starts, const float* Distances, float* OutFloorZ, bool* OutHits, int32_t Num) const
+	{
+		if (Nodes.empty())
+		{
+			std::fill(OutHits, OutHits + Num, false);
+			return;
+		}
+
+		for (int32_t First = 0; First < Num; First += FPacketLanes::Width)
+		{
+			TracePacket<FPacketLanes>(Starts + First, Distances + First, OutFloorZ + First, OutHits + First, std::min(Num - First, FPacketLanes::Width));
+		}
+	}
+
+	int32_t FFloorBvh::GetPacketWidth()
+	{
+		return FPacketLanes::Width;
+	}
+
+	void SortProbesForCoherence(const FVec3* Starts, int32_t Num, float Cell, std::vector<uint64_t>& OutKeys)
+	{
+		OutKeys.resize(Num);
+		if (Num == 0)
+		{
+			return;
+		}
+
+		float MinX = Starts[0].X;
+		float MinY = Starts[0].Y;
+		for (int32_t Index = 1; Index < Num; ++Index)
+		{
+			MinX = std::min(MinX, Starts[Index].X);
+			MinY = std::min(MinY, Starts[Index].Y);
+		}
+
+		// Cells past 65535 from the lowest start share the last column or row, which only costs coherence
+		const float InvCell = 1.f / std::max(Cell, 1.e-3f);
+		for (int32_t Index = 0; Index < Num; ++Index)
+		{
+			const uint32_t CellX = static_cast<uint32_t>(std::min((Starts[Index].X - MinX) * InvCell, 65535.f));
+			const uint32_t CellY = static_cast<uint32_t>(std::min((Starts[Index].Y - MinY) * InvCell, 65535.f));
+			const uint64_t Code = SpreadBits(CellX) | (SpreadBits(CellY) << 1);
+			OutKeys[Index] = (Code << 32) | static_cast<uint32_t>(Index);
+		}
+		std::sort(OutKeys.begin(), OutKeys.end());
+	}
+}
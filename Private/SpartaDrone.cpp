@@ -1,12 +1,14 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "SpartaDrone.h"
+#include "SpartaAnimBudgetSubsystem.h"
 #include "SpartaDroneController.h"
+#include "SpartaMovementCore.h"
+#include "SpartaMovementDebug.h"
+#include "SpartaMovementSubsystem.h"
 
 #include "Components/CapsuleComponent.h"
 #include "Components/SkeletalMeshComponent.h"
-#include "Camera/CameraComponent.h"
-#include "GameFramework/SpringArmComponent.h"
 
 #include "EnhancedInputComponent.h"
 
@@ -26,282 +28,673 @@ ASpartaDrone::ASpartaDrone()
 	RootComponent = CapsuleComp;
 
 	// ޽ 
-	SkeletalMeshComp = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("SkeletalMeshComp"));
+	SkeletalMeshComp = CreateDefaultSubobject<USpartaSkeletalMeshComponent>(TEXT("SkeletalMeshComp"));
 	SkeletalMeshComp->SetupAttachment(CapsuleComp);
 	//  Ȱȭ
 	//SkeletalMeshComp->SetSimulatePhysics(true);
 
-	//   
-	SpringArmComp = CreateDefaultSubobject<USpringArmComponent>(TEXT("SpringArmComp"));
-	SpringArmComp->SetupAttachment(RootComponent);
-	SpringArmComp->bUsePawnControlRotation = true;
-
-	// ī޶ 
-	CameraComp = CreateDefaultSubobject<UCameraComponent>(TEXT("CameraComp"));
-	CameraComp->SetupAttachment(SpringArmComp);
-
 	MaxDroneEnginePower = 1200.0f;
-	DroneEnginePower = 0.0f;
 	GravityAccel = 980.0f;
-	TargetRotation = GetActorRotation();
-	AccumulatedRotation = FRotator::ZeroRotator;
+
+	const FRotator TargetRotation = GetActorRotation();
+	MoveState.TargetPitch = static_cast<float>(TargetRotation.Pitch);
+	MoveState.TargetYaw = static_cast<float>(TargetRotation.Yaw);
+	MoveState.TargetRoll = static_cast<float>(TargetRotation.Roll);
 
 	//   ȸϵ 
 	//bUseControllerRotationPitch = false;
 	//bUseControllerRotationYaw = false;
 	//bUseControllerRotationRoll = false;
 
-	// SpringArm  ȸ  
-	if (SpringArmComp)
-	{
-		SpringArmComp->bUsePawnControlRotation = false;
-	}
+	// The camera rig trails the drone's rotation, tilt included, instead of the controller's
+	CameraRig.bUsePawnControlRotation = false;
+	CameraRig.RotationLagSpeed = 5.0f;
+
+	// Owning clients get ServerMove and ClientMoveSnapshot; the others only see this drone through replicated movement
+	bReplicates = true;
+	SetReplicatingMovement(true);
 }
 
 void ASpartaDrone::BeginPlay()
 {
 	Super::BeginPlay();
+
+	QueryBuffers.Init(this);
+#if SPARTA_MOVEMENT_DEBUG
+	SpartaMovementDebug::TrackTransformUpdates(this);
+#endif
+	MoveState.EnginePowerTime = GetMoveTime();
+	ResetRotationLayers(GetActorQuat());
+	UpdateMoveParams();
+
+	if (USpartaMovementSubsystem* Subsystem = GetWorld()->GetSubsystem<USpartaMovementSubsystem>())
+	{
+		Subsystem->OnFloorInvalidated.AddUObject(this, &ASpartaDrone::OnFloorInvalidated);
+	}
+
+	if (USpartaSignificanceSubsystem::IsEnabled())
+	{
+		if (USpartaSignificanceSubsystem* Significances = GetWorld()->GetSubsystem<USpartaSignificanceSubsystem>())
+		{
+			Significances->RegisterActor(this, FOnSpartaSignificanceChanged::CreateUObject(this, &ASpartaDrone::SetSignificance));
+		}
+	}
+
+	UpdateNetMoveRole();
 }
 
-// Physics Pipeline
-void ASpartaDrone::Tick(float DeltaTime)
+void ASpartaDrone::PossessedBy(AController* NewController)
 {
-	Super::Tick(DeltaTime);
+	Super::PossessedBy(NewController);
+	UpdateNetMoveRole();
+}
 
-	// ڿ ȸ    (ٷ  ȵǰ Ӹ ġ )
-	FRotator NewRotation = FMath::RInterpTo(GetActorRotation(), TargetRotation, DeltaTime, 5.0f);
-	SetActorRotation(NewRotation);
+void ASpartaDrone::UnPossessed()
+{
+	Super::UnPossessed();
+	UpdateNetMoveRole();
+}
 
-	ApplyTiltEffect(DeltaTime);
-	UpdateCamera(DeltaTime);
-	SetGravity(DeltaTime);
-	ReduceEnginePower(DeltaTime);
-	IsGrounded();
+void ASpartaDrone::PostNetReceiveRole()
+{
+	Super::PostNetReceiveRole();
+	UpdateNetMoveRole();
 }
 
-void ASpartaDrone::ApplyTiltEffect(float DeltaTime)
+void ASpartaDrone::UpdateNetMoveRole()
 {
-	if (bIsGrounded)
+	ENetMoveRole NewRole = ENetMoveRole::Local;
+	if (GetLocalRole() == ROLE_AutonomousProxy)
+	{
+		NewRole = ENetMoveRole::Predicting;
+	}
+	else if (GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		NewRole = ENetMoveRole::Simulated;
+	}
+	else if (GetRemoteRole() == ROLE_AutonomousProxy && !IsLocallyControlled())
+	{
+		NewRole = ENetMoveRole::ServerDriven;
+	}
+
+	if (NewRole != NetMoveRole)
+	{
+		// Engine power carries over into the new role's clock
+		const float EnginePower = GetEnginePower();
+		NetMoveRole = NewRole;
+		NetTicks = 0;
+		MoveState.EnginePower = EnginePower;
+		MoveState.EnginePowerTime = GetMoveTime();
+
+		// Sequences start over with every possession, on both ends
+		NetInputBuffer = SpartaMovement::TNetInputBuffer<SpartaMovement::FNetDroneInput>();
+		NetSnapshotReceiver = SpartaMovement::FNetSnapshotReceiver();
+		NetInputQueue = SpartaMovement::TNetInputQueue<SpartaMovement::FNetDroneInput>();
+		NetSnapshotSender = SpartaMovement::FNetSnapshotSender();
+		LastNetSnapshotTime = -1.0;
+		NetSavedMoves.Reset();
+		if (NetMoveRole == ENetMoveRole::Predicting)
+		{
+			NetSavedMoves.SetNum(SpartaMovement::NetInputHistory);
+		}
+	}
+
+	// Roles can arrive before BeginPlay, which comes back here
+	if (!IsNetStepped() || (!HasActorBegunPlay() && !IsActorBeginningPlay()))
 	{
-		RestoreTilt(DeltaTime);
 		return;
 	}
 
-	float MaxTiltAngle = 20.0f;
-	float MaxPitchAngle = 10.0f;
+	// Stepped once per input, never in fixed steps, and awake for the input stream
+	WakeUp();
+	bHasSimState = false;
+	MoveState.Location = FSpartaWorldQuery::ToVec3(GetActorLocation());
+	NetRotation = FSpartaWorldQuery::ToQuat4(GetActorQuat());
 
-	float TargetRoll = CurrentMoveAxisValue * MaxTiltAngle;
-	float TargetPitch = CurrentMoveForwardAxis * MaxPitchAngle;
+	// The state before the first input, for the first snapshot to correct
+	if (NetMoveRole == ENetMoveRole::Predicting && NetInputBuffer.GetNewestInput() == 0)
+	{
+		SaveNetMove(0);
+	}
+}
 
-	FRotator CurrentRotation = GetActorRotation();
-	FRotator Rotation = FRotator(CurrentRotation.Pitch + TargetPitch, CurrentRotation.Yaw, TargetRoll);
+double ASpartaDrone::GetMoveTime() const
+{
+	return IsNetStepped() ? NetTicks * 1.e-4 : GetWorld()->GetTimeSeconds();
+}
 
-	// ȸ(Rotation)  ε巴 
-	/*
-	FRotator FMath::RInterpTo(
-    FRotator Current,     //  ȸ 
-    FRotator Target,      // ǥ ȸ 
-    float DeltaTime,      //   ð (Tick ޵Ǵ DeltaTime)
-    float InterpSpeed     //  ӵ ( Ŭ  ǥ )
-	);
-	*/
-	FRotator SmoothedRotation = FMath::RInterpTo(CurrentRotation, Rotation, DeltaTime, 5.0f);
-	SetActorRotation(SmoothedRotation);
+void ASpartaDrone::StepNetInput(const SpartaMovement::FNetDroneInput& Input)
+{
+	UpdateMoveParams();
+
+	// Immediate queries: client and server must get the same answers
+	const FSpartaWorldQuery WorldQuery(GetWorld(), QueryBuffers);
+	NetRotation = SpartaMovement::StepDroneInput(MoveState, MoveParams, Input, WorldQuery, GetMoveTime());
+	NetTicks += Input.DeltaTime;
+	SpartaMovement::SnapToNetGrid(MoveState, MoveParams, GetMoveTime());
+	++GetSweepStats().Moves;
 }
 
-bool ASpartaDrone::IsGrounded()
+SpartaMovement::FQuantizedMoveState ASpartaDrone::GetQuantizedNetState() const
 {
-	FVector Start = GetActorLocation();
-	FVector End = Start - FVector(0, 0, 10.0f);
+	return SpartaMovement::QuantizeMoveState(SpartaMovement::ToNetMoveState(MoveState, MoveParams, GetMoveTime()));
+}
 
-	FHitResult HitResult;
-	FCollisionQueryParams QueryParams;
-	QueryParams.AddIgnoredActor(this);
+void ASpartaDrone::SaveNetMove(uint16 Sequence)
+{
+	FNetSavedMove& Saved = NetSavedMoves[Sequence % SpartaMovement::NetInputHistory];
+	Saved.State = MoveState;
+	Saved.Ticks = NetTicks;
+}
 
-	bool bHit = GetWorld()->LineTraceSingleByChannel(HitResult, Start, End, ECC_Visibility, QueryParams);
+void ASpartaDrone::TickNetPrediction(float DeltaTime)
+{
+	SpartaMovement::FNetDroneInput& Input = NetInputBuffer.AddInput();
+	Input.Set(MoveState, DeltaTime);
 
-	if (bHit)
+	StepNetInput(Input);
+	SaveNetMove(Input.Sequence);
+	NetInputBuffer.SetPredicted(Input.Sequence, GetQuantizedNetState());
+	CommitTransform(FSpartaWorldQuery::ToVector(MoveState.Location), FSpartaWorldQuery::ToQuat(NetRotation));
+
+	// Axis events come every frame while held
+	MoveState.Input.Reset();
+
+	SpartaMovement::FNetBitWriter Writer(NetBytes);
+	NetInputBuffer.WriteInputPacket(Writer, NetSnapshotReceiver.GetNewestSnapshot(), USpartaMovementSubsystem::GetNetInputRedundancy());
+	ServerMove(TArray<uint8>(NetBytes.data(), static_cast<int32>(NetBytes.size())));
+}
+
+void ASpartaDrone::ServerMove_Implementation(const TArray<uint8>& Packet)
+{
+	if (NetMoveRole != ENetMoveRole::ServerDriven)
 	{
-		bIsGrounded = true;
+		return;
 	}
-	else
+
+	NetInputQueue.AdvanceServerTime(GetWorld()->GetTimeSeconds());
+	SpartaMovement::FNetBitReader Reader(Packet.GetData(), Packet.Num());
+	NetInputQueue.ReadInputPacket(Reader);
+
+	SpartaMovement::FNetDroneInput Input;
+	bool bLost = false;
+	bool bStepped = false;
+	while (NetInputQueue.PopInput(Input, USpartaMovementSubsystem::GetNetInputRedundancy(), bLost))
 	{
-		bIsGrounded = false;
+		StepNetInput(Input);
+		bStepped = true;
 	}
 
-	return bIsGrounded;
+	if (bStepped)
+	{
+		CommitTransform(FSpartaWorldQuery::ToVector(MoveState.Location), FSpartaWorldQuery::ToQuat(NetRotation));
+	}
 }
 
-void ASpartaDrone::RestoreTilt(float DeltaTime)
+void ASpartaDrone::ClientMoveSnapshot_Implementation(const TArray<uint8>& Packet)
 {
-	FRotator RestoreRotation = FRotator::ZeroRotator;
+	if (NetMoveRole != ENetMoveRole::Predicting)
+	{
+		return;
+	}
 
-	AccumulatedRotation = FMath::RInterpTo(AccumulatedRotation, RestoreRotation, DeltaTime, 3.0f);
+	SpartaMovement::FNetBitReader Reader(Packet.GetData(), Packet.Num());
+	SpartaMovement::FQuantizedMoveState ServerState;
+	uint16 AckedInput = 0;
+	if (!NetSnapshotReceiver.ReadSnapshot(Reader, ServerState, AckedInput) || !NetInputBuffer.IsInHistory(AckedInput))
+	{
+		return;
+	}
 
-	FRotator CurrentRotation = GetActorRotation();
-	FRotator SmoothedRotation = FRotator(AccumulatedRotation.Pitch, CurrentRotation.Yaw, AccumulatedRotation.Roll);
+	// Mispredicted: back to the state saved after AckedInput with the server's location and engine power, then every
+	// input since stepped again, the way CharacterMovement replays its saved moves after a correction
+	const bool bCorrected = NetInputBuffer.Reconcile(AckedInput, ServerState,
+		[this, AckedInput](const SpartaMovement::FQuantizedMoveState& State)
+		{
+			const FNetSavedMove& Saved = NetSavedMoves[AckedInput % SpartaMovement::NetInputHistory];
+			MoveState = Saved.State;
+			NetTicks = Saved.Ticks;
+			SpartaMovement::ApplyNetMoveState(SpartaMovement::DequantizeMoveState(State), MoveState, GetMoveTime());
+			SaveNetMove(AckedInput);
+		},
+		[this](const SpartaMovement::FNetDroneInput& Input)
+		{
+			StepNetInput(Input);
+			SaveNetMove(Input.Sequence);
+			return GetQuantizedNetState();
+		});
 
-	SetActorRotation(SmoothedRotation);
+	if (bCorrected)
+	{
+		SPARTA_MOVEMENT_LOG(Verbose, TEXT("%s corrected after input %d"), *GetName(), AckedInput);
+		CommitTransform(FSpartaWorldQuery::ToVector(MoveState.Location), FSpartaWorldQuery::ToQuat(NetRotation));
+	}
 }
 
-void ASpartaDrone::UpdateCamera(float DeltaTime)
+void ASpartaDrone::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	if (!SpringArmComp || !CameraComp) return;
+	if (USpartaMovementSubsystem* Subsystem = GetWorld()->GetSubsystem<USpartaMovementSubsystem>())
+	{
+		Subsystem->OnFloorInvalidated.RemoveAll(this);
+	}
 
-	FRotator TargetCameraRotation = GetActorRotation();
-	FRotator SmoothedRotation = FMath::RInterpTo(SpringArmComp->GetComponentRotation(), TargetCameraRotation, DeltaTime, 5.0f);
+	if (USpartaSignificanceSubsystem* Significances = GetWorld()->GetSubsystem<USpartaSignificanceSubsystem>())
+	{
+		Significances->UnregisterActor(this);
+	}
 
-	//UE_LOG(LogTemp, Warning, TEXT("UpdateCamera[%s]"), *SmoothedRotation.ToString());
+	Super::EndPlay(EndPlayReason);
+}
 
-	SpringArmComp->SetWorldRotation(SmoothedRotation);
+void ASpartaDrone::StartRecording()
+{
+	UpdateMoveParams();
+	MoveState.Location = FSpartaWorldQuery::ToVec3(bHasSimState ? SimLocation : GetActorLocation());
+
+	Recorder = MakeUnique<SpartaMovement::FMovementRecorder>();
+	Recorder->BeginDrone(MoveParams, MoveState, GetWorld()->GetTimeSeconds());
 }
 
-void ASpartaDrone::ReduceEnginePower(float DeltaTime)
+TUniquePtr<SpartaMovement::FMovementRecorder> ASpartaDrone::StopRecording()
 {
-	//  Ŀ  
-	if (DroneEnginePower > 0.0f)
+	return MoveTemp(Recorder);
+}
+
+void ASpartaDrone::RecordInput(SpartaMovement::ERecordTag Tag, const float* Values)
+{
+	if (Recorder)
 	{
-		DroneEnginePower -= ReducingPower * DeltaTime;
-		DroneEnginePower = FMath::Max(DroneEnginePower, 0.0f);
+		Recorder->RecordInput(Tag, GetWorld()->GetTimeSeconds(), Values);
 	}
 }
 
-void ASpartaDrone::SetGravity(float DeltaTime)
+void ASpartaDrone::UpdateMoveParams()
+{
+	MoveParams.MaxEnginePower = MaxDroneEnginePower;
+	MoveParams.GravityAccel = GravityAccel;
+	MoveParams.CapsuleRadius = CapsuleComp->GetScaledCapsuleRadius();
+	MoveParams.CapsuleHalfHeight = CapsuleComp->GetScaledCapsuleHalfHeight();
+}
+
+SpartaMovement::FNetMoveState ASpartaDrone::GetNetMoveState() const
+{
+	SpartaMovement::FNetMoveState State;
+	State.Location = FSpartaWorldQuery::ToVec3(GetActorLocation());
+	const FRotator Rotation = GetActorRotation();
+	State.Yaw = static_cast<float>(Rotation.Yaw);
+	State.Pitch = static_cast<float>(Rotation.Pitch);
+	State.Roll = static_cast<float>(Rotation.Roll);
+	State.EnginePower = GetEnginePower();
+	return State;
+}
+
+void ASpartaDrone::ApplyNetMoveState(const SpartaMovement::FNetMoveState& NetState)
 {
-	float GravityValue = -GravityAccel * DeltaTime;
+	CommitTransform(FSpartaWorldQuery::ToVector(NetState.Location), FQuat(FRotator(NetState.Pitch, NetState.Yaw, NetState.Roll)));
+
+	SpartaMovement::ApplyNetMoveState(NetState, MoveState, GetMoveTime());
 
-	//  Ŀ  ߷  
-	float GravityReductionRatio = FMath::Clamp(DroneEnginePower / MaxDroneEnginePower, 0.0f, 1.0f);
-	float AdjustedGravity = GravityValue * (1.0f - GravityReductionRatio);
-	// UE_LOG(LogTemp, Warning, TEXT("SetGravity = [%f]"), GravityValue); // -16.xxx
+	// A teleport for the fixed-step simulation, see TickFixedStep, for the rotation layers and for input steps
+	bHasSimState = false;
+	ResetRotationLayers(GetActorQuat());
+	NetRotation = FSpartaWorldQuery::ToQuat4(GetActorQuat());
 
-	FVector GravityOffset(0, 0, AdjustedGravity);
-	FVector NewLocation = GetActorLocation() + GravityOffset;
+	WakeUp();
+}
 
-	if (NewLocation.Z < 0.0f)
+void ASpartaDrone::SetSignificance(ESpartaSignificance NewSignificance)
+{
+	Significance = NewSignificance;
+	SetActorTickInterval(USpartaSignificanceSubsystem::GetTickInterval(NewSignificance));
+
+	if (USpartaSkeletalMeshComponent* Mesh = Cast<USpartaSkeletalMeshComponent>(SkeletalMeshComp))
 	{
-		NewLocation.Z = 0.0f;
+		Mesh->SetSignificance(NewSignificance);
 	}
+}
 
-	SetActorLocation(NewLocation, true);
+bool ASpartaDrone::IsAtRest(const FVector& PreviousLocation, const FQuat& PreviousRotation) const
+{
+	// Engine power decays lazily, so power left on a landed drone does not keep it awake
+	if (!MoveState.bIsGrounded)
+	{
+		return false;
+	}
+	// The camera rig trails the drone from the camera manager, so it catches up with a sleeping drone on its own
+	return GetActorLocation().Equals(PreviousLocation, 0.01f) && GetActorQuat().Equals(PreviousRotation, 1.e-4f);
+}
 
-	//UE_LOG(LogTemp, Log, TEXT("GravityValue: %f, Reduction: %f, AdjustedGravity: %f, DroneEnginePower: %f"), GravityValue, GravityReductionRatio, AdjustedGravity, DroneEnginePower);
+void ASpartaDrone::GoToSleep()
+{
+	bIsAsleep = true;
+	RestSteps = 0;
+	SetActorTickEnabled(false);
 }
 
-// / ̵ (space, shift)
-void ASpartaDrone::MoveUp(const FInputActionValue& value)
+void ASpartaDrone::WakeUp()
 {
-	if (!Controller) return;
+	RestSteps = 0;
+	if (!bIsAsleep)
+	{
+		return;
+	}
 
-	const float AxisValue = value.Get<float>(); // +1, -1  ⼺ 
+	// The time asleep was spent at rest, there is nothing to catch up on
+	bIsAsleep = false;
+	LastStepTime = -1.0;
+	bHasSimState = false;
+	SetActorTickEnabled(true);
+}
 
-	//UE_LOG(LogTemp, Log, TEXT("%s"), (AxisValue == 1.0f) ? TEXT("Move Up") : (AxisValue == -1.0f) ? TEXT("Move Down") : TEXT("Idle"));
+void ASpartaDrone::OnFloorInvalidated(const FBox& Bounds)
+{
+	if (bIsAsleep && Bounds.IsInsideXY(GetActorLocation()))
+	{
+		WakeUp();
+	}
+}
+
+void ASpartaDrone::NotifyHit(UPrimitiveComponent* MyComp, AActor* Other, UPrimitiveComponent* OtherComp, bool bSelfMoved,
+	FVector HitLocation, FVector HitNormal, FVector NormalImpulse, const FHitResult& Hit)
+{
+	Super::NotifyHit(MyComp, Other, OtherComp, bSelfMoved, HitLocation, HitNormal, NormalImpulse, Hit);
+
+	WakeUp();
+}
+
+void ASpartaDrone::NotifyActorBeginOverlap(AActor* OtherActor)
+{
+	Super::NotifyActorBeginOverlap(OtherActor);
+
+	WakeUp();
+}
+
+ASpartaDrone::FSweepStats& ASpartaDrone::GetSweepStats()
+{
+	static FSweepStats Stats;
+	return Stats;
+}
+
+void ASpartaDrone::Tick(float DeltaTime)
+{
+	SpartaMovementDebug::FScopedFrameTiming Timing(SpartaMovementDebug::GetFrameTimings().DroneTicks);
+	Super::Tick(DeltaTime);
+
+	// With a tick interval the step covers all the time since the last tick
+	const float StepTime = USpartaSignificanceSubsystem::ConsumeStepTime(GetWorld(), LastStepTime, DeltaTime);
+
+	if (NetMoveRole == ENetMoveRole::Predicting)
+	{
+		TickNetPrediction(StepTime);
+		return;
+	}
+	if (NetMoveRole == ENetMoveRole::ServerDriven)
+	{
+		// Stepped by ServerMove; the owning client hears back at the snapshot rate
+		const double Now = GetWorld()->GetTimeSeconds();
+		if (Now - LastNetSnapshotTime >= USpartaMovementSubsystem::GetNetSnapshotInterval())
+		{
+			LastNetSnapshotTime = Now;
+			SpartaMovement::FNetBitWriter Writer(NetBytes);
+			NetSnapshotSender.WriteSnapshot(Writer, GetQuantizedNetState(), NetInputQueue.GetLastProcessedInput(), NetInputQueue.GetAckedSnapshot());
+			ClientMoveSnapshot(TArray<uint8>(NetBytes.data(), static_cast<int32>(NetBytes.size())));
+		}
+		return;
+	}
+	if (NetMoveRole == ENetMoveRole::Simulated)
+	{
+		return;
+	}
+
+	const FVector PreviousLocation = GetActorLocation();
+	const FQuat PreviousRotation = GetActorQuat();
+	++SpartaMovementDebug::GetTransformStats().AgentFrames;
+
+	if (bUseFixedStep)
+	{
+		TickFixedStep(StepTime);
+	}
+	else
+	{
+		bHasSimState = false;
+		FVector Location = GetActorLocation();
+		FQuat Rotation;
+		StepSimulation(GetWorld()->GetTimeSeconds() - StepTime, StepTime, Location, Rotation);
+		CommitTransform(Location, Rotation);
+
+		// Axis events come every frame while held
+		ConsumeInputCommand();
+	}
+
+	FSweepStats& Stats = GetSweepStats();
+	++Stats.DroneFrames;
+	++Stats.UncoalescedMoves; // gravity
+	Stats.Sweeps += QueryBuffers.NumSweeps;
+	QueryBuffers.NumSweeps = 0;
 
-	float DeltaTime = GetWorld()->DeltaTimeSeconds;
+	// The ground probe of the last step this frame goes out for the next frame
+	FSpartaWorldQuery::SubmitAsyncQueries(GetWorld(), QueryBuffers);
 
-	if (DroneEnginePower < MaxDroneEnginePower)
+	RestSteps = IsAtRest(PreviousLocation, PreviousRotation) ? RestSteps + 1 : 0;
+	if (RestSteps >= StepsToSleep)
 	{
-		DroneEnginePower += 10.0f;
+		GoToSleep();
 	}
+}
 
-	//UE_LOG(LogTemp, Log, TEXT("Engine Power [%f]"), DroneEnginePower);
+// Physics Pipeline
+void ASpartaDrone::StepSimulation(double StartTime, float DeltaTime, FVector& InOutLocation, FQuat& OutRotation)
+{
+	UpdateMoveParams();
+	MoveState.Location = FSpartaWorldQuery::ToVec3(InOutLocation);
 
-	FVector UpOffset(0, 0, AxisValue * DroneEnginePower * DeltaTime);
-	FVector NewLocation = GetActorLocation() + UpOffset;
+	// Analytic drones move without sweeps and check the ground against Z = 0
+	const bool bQueryWorld = Significance != ESpartaSignificance::Analytic;
+	if (Recorder)
+	{
+		Recorder->BeginStep(StartTime, DeltaTime, bQueryWorld ? SpartaMovement::StepQueriesWorld : 0);
+	}
 
-	if (FMath::IsNearlyZero(NewLocation.Z, 0.01f))
+	// Every transform update moves the whole component hierarchy, so the step works on locals
+	SpartaMovement::FQuat4 Rotation;
+	if (!bQueryWorld)
 	{
-		NewLocation.Z = 0.0f; //   
+		Rotation = SpartaMovement::StepDrone(MoveState, MoveParams, nullptr, StartTime, DeltaTime);
+	}
+	else
+	{
+		// Full-rate drones decide on last frame's async ground probe when it is close enough, see Tick
+		const bool bAsync = Significance == ESpartaSignificance::Full && FSpartaWorldQuery::IsAsyncEnabled();
+		const FSpartaWorldQuery WorldQuery(GetWorld(), QueryBuffers, nullptr, bAsync ? ESpartaQueryMode::Async : ESpartaQueryMode::Immediate);
+		if (Recorder)
+		{
+			const SpartaMovement::FRecordingWorld RecordingWorld(WorldQuery, *Recorder);
+			Rotation = SpartaMovement::StepDrone(MoveState, MoveParams, &RecordingWorld, StartTime, DeltaTime);
+		}
+		else
+		{
+			Rotation = SpartaMovement::StepDrone(MoveState, MoveParams, &WorldQuery, StartTime, DeltaTime);
+		}
+		++GetSweepStats().Moves;
 	}
 
-	SetActorLocation(NewLocation, true);
+	InOutLocation = FSpartaWorldQuery::ToVector(MoveState.Location);
+	OutRotation = FSpartaWorldQuery::ToQuat(Rotation);
+
+	if (Recorder)
+	{
+		Recorder->EndDroneStep(MoveState);
+	}
 }
 
-void ASpartaDrone::MoveForward(const FInputActionValue& value)
+void ASpartaDrone::ResetRotationLayers(const FQuat& Rotation)
 {
-	if (!Controller) return;
+	MoveState.HeadingLayer = FSpartaWorldQuery::ToQuat4(Rotation);
+	MoveState.TiltLayer = SpartaMovement::FQuat4();
+	MoveState.RestoreAlpha = 0.0f;
+}
 
-	float DeltaTime = GetWorld()->DeltaTimeSeconds;
+void ASpartaDrone::ConsumeInputCommand()
+{
+	MoveState.Input.Reset();
 
-	const float AxisValue = value.Get<float>();
-	CurrentMoveForwardAxis = AxisValue;
+	// A replay has to know which steps an input event reached
+	RecordInput(SpartaMovement::ERecordTag::DroneInputConsumed);
+}
 
-	UE_LOG(LogTemp, Warning, TEXT("MoveForward[%f]"), AxisValue);
+void ASpartaDrone::TickFixedStep(float DeltaTime)
+{
+	const float StepTime = 1.0f / FMath::Max(FixedStepRate, 1.0f);
+
+	// The actor shows the interpolated state; the simulation carries on from its own.
+	// Teleporting the drone while in this mode means setting SimLocation too, or clearing bHasSimState.
+	if (!bHasSimState)
+	{
+		SimLocation = PrevSimLocation = GetActorLocation();
+		SimRotation = PrevSimRotation = GetActorQuat();
+		StepAccumulator = 0.0f;
+		bHasSimState = true;
+	}
+
+	StepAccumulator += DeltaTime;
+
+	int32 NumSteps = 0;
+	if (StepAccumulator >= StepTime)
+	{
+		while (StepAccumulator >= StepTime && NumSteps < MaxSubsteps)
+		{
+			PrevSimLocation = SimLocation;
+			PrevSimRotation = SimRotation;
 
-	FRotator CurrentRotation = TargetRotation;
-	FVector ForwardDirection = CurrentRotation.Vector();
-	
-	FVector MoveOffset = ForwardDirection * AxisValue * DroneEnginePower * DeltaTime;
+			// The simulation lags the world clock by what is left in the accumulator. It steps the sim state, not the actor.
+			StepSimulation(GetWorld()->GetTimeSeconds() - StepAccumulator, StepTime, SimLocation, SimRotation);
 
-	float GravityFactor = FVector::DotProduct(ForwardDirection, FVector::UpVector); //  
-	MoveOffset.Z -= GravityFactor * 980.0f * DeltaTime;
+			StepAccumulator -= StepTime;
+			++NumSteps;
+		}
 
-	FVector NewLocation = GetActorLocation() + MoveOffset;
+		// Still behind after MaxSubsteps: drop the time instead of carrying it into the next frame
+		if (StepAccumulator >= StepTime)
+		{
+			StepAccumulator = FMath::Fmod(StepAccumulator, StepTime);
+		}
 
-	UE_LOG(LogTemp, Warning, TEXT("CurrentRotation[%s]"), *CurrentRotation.ToString());
-	UE_LOG(LogTemp, Warning, TEXT("MoveOffset Z [%f]"), MoveOffset.Z);
+		// Axis events come every frame while held; the frame's steps have used them
+		ConsumeInputCommand();
+	}
 
-	SetActorLocation(NewLocation, true);
+	// Nobody renders on a dedicated server, it stays on the simulated state
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		CommitTransform(SimLocation, SimRotation);
+		return;
+	}
+
+	const float Alpha = StepAccumulator / StepTime;
+	CommitTransform(FMath::Lerp(PrevSimLocation, SimLocation, Alpha), FQuat::Slerp(PrevSimRotation, SimRotation, Alpha));
 }
 
-void ASpartaDrone::MoveRight(const FInputActionValue& value)
+void ASpartaDrone::CommitTransform(const FVector& Location, const FQuat& Rotation)
+{
+	SpartaMovementDebug::FTransformStats& Stats = SpartaMovementDebug::GetTransformStats();
+	++Stats.Writes;
+	++Stats.Commits;
+	SetActorLocationAndRotation(Location, Rotation);
+}
+
+float ASpartaDrone::GetEnginePower() const
+{
+	return SpartaMovement::GetDroneEnginePower(MoveState, MoveParams, GetMoveTime());
+}
+
+void ASpartaDrone::SetEnginePower(float NewEnginePower)
+{
+	MoveState.EnginePower = FMath::Clamp(NewEnginePower, 0.0f, MaxDroneEnginePower);
+	MoveState.EnginePowerTime = GetMoveTime();
+
+	// Power holds a landed drone up, or lets an airborne one fall differently
+	WakeUp();
+}
+
+// / ̵ (space, shift)
+void ASpartaDrone::MoveUp(const FInputActionValue& value)
 {
 	if (!Controller) return;
 
-	float DeltaTime = GetWorld()->DeltaTimeSeconds;
-	const float AxisValue = value.Get<float>();
-	CurrentMoveAxisValue = AxisValue;
+	const float AxisValue = value.Get<float>(); // +1, -1  ⼺ 
+	RecordInput(SpartaMovement::ERecordTag::DroneMoveUp, &AxisValue);
+
+	//UE_LOG(LogTemp, Log, TEXT("%s"), (AxisValue == 1.0f) ? TEXT("Move Up") : (AxisValue == -1.0f) ? TEXT("Move Down") : TEXT("Idle"));
+
+	// Applied in Tick, together with the other axes and gravity; the step also spools the engine up
+	WakeUp();
+	MoveState.Input.MoveUp = AxisValue;
+	++GetSweepStats().UncoalescedMoves;
+}
 
-	UE_LOG(LogTemp, Warning, TEXT("MoveRight"));
+void ASpartaDrone::MoveForward(const FInputActionValue& value)
+{
+	if (!Controller) return;
 
-	FRotator CurrentRotation = TargetRotation;
-	FVector RightDirection = FRotationMatrix(CurrentRotation).GetUnitAxis(EAxis::Y);
+	const float AxisValue = value.Get<float>();
+	RecordInput(SpartaMovement::ERecordTag::DroneMoveForward, &AxisValue);
+	MoveState.TiltForward = AxisValue;
 
-	FVector MoveOffset = RightDirection * AxisValue * DroneEnginePower * DeltaTime;
-	FVector NewLocation = GetActorLocation() + MoveOffset;
+	SPARTA_MOVEMENT_LOG(VeryVerbose, TEXT("MoveForward[%f]"), AxisValue);
 
-	SetActorLocation(NewLocation, true);
+	WakeUp();
+	MoveState.Input.MoveForward = AxisValue;
+	++GetSweepStats().UncoalescedMoves;
 }
 
-void ASpartaDrone::LookPitch(const FInputActionValue& value)
+void ASpartaDrone::MoveRight(const FInputActionValue& value)
 {
 	if (!Controller) return;
 
-	UE_LOG(LogTemp, Warning, TEXT("LookPitch"));
+	const float AxisValue = value.Get<float>();
+	RecordInput(SpartaMovement::ERecordTag::DroneMoveRight, &AxisValue);
+	MoveState.TiltRight = AxisValue;
 
-	float AxisValue = value.Get<float>();
-	if (FMath::IsNearlyZero(AxisValue)) return;
+	SPARTA_MOVEMENT_LOG(VeryVerbose, TEXT("MoveRight"));
 
-	float CurrentPitch = TargetRotation.Pitch;
+	WakeUp();
+	MoveState.Input.MoveRight = AxisValue;
+	++GetSweepStats().UncoalescedMoves;
+}
 
-	float NewPitch = CurrentPitch + (AxisValue * PitchSpeed * GetWorld()->GetDeltaSeconds());
+void ASpartaDrone::LookPitch(const FInputActionValue& value)
+{
+	if (!Controller) return;
+
+	SPARTA_MOVEMENT_LOG(VeryVerbose, TEXT("LookPitch"));
 
-	TargetRotation.Pitch = FMath::Clamp(NewPitch, MinPitch, MaxPitch);
+	const float Values[2] = { value.Get<float>(), GetWorld()->GetDeltaSeconds() };
+	RecordInput(SpartaMovement::ERecordTag::DroneLookPitch, Values);
+	if (SpartaMovement::TurnDronePitch(MoveState, MoveParams, Values[0], Values[1]))
+	{
+		WakeUp();
+	}
 }
 
 void ASpartaDrone::LookRoll(const FInputActionValue& value)
 {
 	if (!Controller) return;
 
-	UE_LOG(LogTemp, Warning, TEXT("LookRoll"));
+	SPARTA_MOVEMENT_LOG(VeryVerbose, TEXT("LookRoll"));
 }
 
 void ASpartaDrone::LookYaw(const FInputActionValue& value)
 {
 	if (!Controller) return;
 
-	UE_LOG(LogTemp, Warning, TEXT("LookYaw"));
-
-	float AxisValue = value.Get<float>();
-	if (FMath::IsNearlyZero(AxisValue)) return;
-
-	float CurrentYaw = TargetRotation.Yaw;
+	SPARTA_MOVEMENT_LOG(VeryVerbose, TEXT("LookYaw"));
 
-	float NewYaw = CurrentYaw + (AxisValue * YawSpeed * GetWorld()->GetDeltaSeconds());
-
-	// ѵ  Ŭ
-	TargetRotation.Yaw = FMath::Clamp(NewYaw, MinYaw, MaxYaw);
-	
+	const float Values[2] = { value.Get<float>(), GetWorld()->GetDeltaSeconds() };
+	RecordInput(SpartaMovement::ERecordTag::DroneLookYaw, Values);
+	if (SpartaMovement::TurnDroneYaw(MoveState, MoveParams, Values[0], Values[1]))
+	{
+		WakeUp();
+	}
 }
 
 void ASpartaDrone::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
@@ -1,6 +1,7 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "SpartaDroneController.h"
+#include "SpartaPlayerCameraManager.h"
 
 #include "EnhancedInputSubsystems.h"
 
@@ -12,7 +13,9 @@ ASpartaDroneController::ASpartaDroneController()
 	LookPitchAction(nullptr),
 	LookRollAction(nullptr),
 	LookYawAction(nullptr)
-{}
+{
+	PlayerCameraManagerClass = ASpartaPlayerCameraManager::StaticClass();
+}
 
 void ASpartaDroneController::BeginPlay()
 {
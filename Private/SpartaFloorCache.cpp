@@ -0,0 +1,324 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaFloorCache.h"
+
+#include <algorithm>
+
+namespace SpartaMovement
+{
+	namespace
+	{
+		int32_t FloorDiv(int32_t Value, int32_t Divisor)
+		{
+			return Value >= 0 ? Value / Divisor : -((-Value + Divisor - 1) / Divisor);
+		}
+
+		uint64_t ChunkKey(int32_t ChunkX, int32_t ChunkY)
+		{
+			return (static_cast<uint64_t>(static_cast<uint32_t>(ChunkX)) << 32) | static_cast<uint32_t>(ChunkY);
+		}
+
+		size_t HashKey(uint64_t Key, size_t Mask)
+		{
+			return static_cast<size_t>((Key * 0x9E3779B97F4A7C15ull) >> 32) & Mask;
+		}
+	}
+
+	FFloorHeightCache::FFloorHeightCache(float InCellSize)
+		: CellSize(InCellSize)
+	{}
+
+	int32_t FFloorHeightCache::FindChunk(uint64_t Key) const
+	{
+		if (SlotKeys.empty())
+		{
+			return -1;
+		}
+
+		const size_t Mask = SlotKeys.size() - 1;
+		for (size_t Slot = HashKey(Key, Mask); SlotChunks[Slot] >= 0; Slot = (Slot + 1) & Mask)
+		{
+			if (SlotKeys[Slot] == Key)
+			{
+				return SlotChunks[Slot];
+			}
+		}
+		return -1;
+	}
+
+	int32_t FFloorHeightCache::FindOrAddChunk(uint64_t Key)
+	{
+		if ((Chunks.size() + 1) * 2 > SlotKeys.size())
+		{
+			Rehash(std::max<size_t>(64, SlotKeys.size() * 2));
+		}
+
+		const size_t Mask = SlotKeys.size() - 1;
+		size_t Slot = HashKey(Key, Mask);
+		for (; SlotChunks[Slot] >= 0; Slot = (Slot + 1) & Mask)
+		{
+			if (SlotKeys[Slot] == Key)
+			{
+				return SlotChunks[Slot];
+			}
+		}
+
+		SlotKeys[Slot] = Key;
+		SlotChunks[Slot] = static_cast<int32_t>(Chunks.size());
+		Chunks.emplace_back();
+		return SlotChunks[Slot];
+	}
+
+	void FFloorHeightCache::Rehash(size_t NumSlots)
+	{
+		std::vector<uint64_t> OldKeys;
+		std::vector<int32_t> OldChunks;
+		OldKeys.swap(SlotKeys);
+		OldChunks.swap(SlotChunks);
+
+		SlotKeys.assign(NumSlots, 0);
+		SlotChunks.assign(NumSlots, -1);
+
+		const size_t Mask = NumSlots - 1;
+		for (size_t OldSlot = 0; OldSlot < OldKeys.size(); ++OldSlot)
+		{
+			if (OldChunks[OldSlot] < 0)
+			{
+				continue;
+			}
+
+			size_t Slot = HashKey(OldKeys[OldSlot], Mask);
+			while (SlotChunks[Slot] >= 0)
+			{
+				Slot = (Slot + 1) & Mask;
+			}
+			SlotKeys[Slot] = OldKeys[OldSlot];
+			SlotChunks[Slot] = OldChunks[OldSlot];
+		}
+	}
+
+	void FFloorHeightCache::Reserve(int32_t MaxChunks)
+	{
+		Chunks.reserve(static_cast<size_t>(std::max(MaxChunks, 0)));
+
+		size_t NumSlots = 64;
+		while (NumSlots < static_cast<size_t>(MaxChunks) * 2)
+		{
+			NumSlots *= 2;
+		}
+		if (NumSlots > SlotKeys.size())
+		{
+			Rehash(NumSlots);
+		}
+	}
+
+	size_t FFloorHeightCache::FindOrAddSample(int32_t SampleX, int32_t SampleY)
+	{
+		const int32_t ChunkX = FloorDiv(SampleX, ChunkSize);
+		const int32_t ChunkY = FloorDiv(SampleY, ChunkSize);
+		const int32_t Chunk = FindOrAddChunk(ChunkKey(ChunkX, ChunkY));
+		return static_cast<size_t>(Chunk) * (ChunkSize * ChunkSize) + (SampleY - ChunkY * ChunkSize) * ChunkSize + (SampleX - ChunkX * ChunkSize);
+	}
+
+	const FFloorHeightCache::FSample* FFloorHeightCache::FindSample(int32_t SampleX, int32_t SampleY) const
+	{
+		const int32_t ChunkX = FloorDiv(SampleX, ChunkSize);
+		const int32_t ChunkY = FloorDiv(SampleY, ChunkSize);
+		const int32_t Chunk = FindChunk(ChunkKey(ChunkX, ChunkY));
+		return Chunk >= 0 ? &Chunks[Chunk].Samples[(SampleY - ChunkY * ChunkSize) * ChunkSize + (SampleX - ChunkX * ChunkSize)] : nullptr;
+	}
+
+	bool FFloorHeightCache::InterpolateCorners(const FSample* const Corners[4], float FracX, float FracY, const FVec3& Start, float Distance, float& OutFloorZ) const
+	{
+		const float MinZ = std::min({ Corners[0]->FloorZ, Corners[1]->FloorZ, Corners[2]->FloorZ, Corners[3]->FloorZ });
+		const float MaxZ = std::max({ Corners[0]->FloorZ, Corners[1]->FloorZ, Corners[2]->FloorZ, Corners[3]->FloorZ });
+
+		const float Bottom = Corners[0]->FloorZ + (Corners[1]->FloorZ - Corners[0]->FloorZ) * FracX;
+		const float Top = Corners[2]->FloorZ + (Corners[3]->FloorZ - Corners[2]->FloorZ) * FracX;
+		const float FloorZ = Bottom + (Top - Bottom) * FracY;
+
+		// A grounded pawn walking uphill starts slightly under the surface, where a real probe misses and
+		// the pawn sinks into the slope. The grid knows the surface, so up to LedgeHeight above is a hit.
+		if (MaxZ - MinZ <= LedgeHeight && FloorZ <= Start.Z + LedgeHeight && FloorZ >= Start.Z - Distance)
+		{
+			OutFloorZ = FloorZ;
+			return true;
+		}
+		return false;
+	}
+
+	bool FFloorHeightCache::NeedsTrace(const FSample& Sample, float StartZ) const
+	{
+		if (!(Sample.Flags & SF_Valid))
+		{
+			return true;
+		}
+
+		if (!(Sample.Flags & SF_Cacheable))
+		{
+			return Frame - Sample.Frame >= UncacheableRetryFrames;
+		}
+
+		// Traced from lower than this query, something may sit between.
+		// Or the cached floor is well above the query start (an overhang), so the floor under it is unknown.
+		return StartZ > Sample.StartZ || ((Sample.Flags & SF_Hit) && Sample.FloorZ > StartZ + LedgeHeight);
+	}
+
+	bool FFloorHeightCache::TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ, const IMovementWorld& Sampler)
+	{
+		++Stats.Lookups;
+
+		const float GridX = Start.X / CellSize;
+		const float GridY = Start.Y / CellSize;
+		const int32_t SampleX = static_cast<int32_t>(std::floor(GridX));
+		const int32_t SampleY = static_cast<int32_t>(std::floor(GridY));
+		const float FracX = GridX - SampleX;
+		const float FracY = GridY - SampleY;
+
+		// All four first: adding a chunk can move the pool
+		const size_t CornerIndices[4] = {
+			FindOrAddSample(SampleX, SampleY),
+			FindOrAddSample(SampleX + 1, SampleY),
+			FindOrAddSample(SampleX, SampleY + 1),
+			FindOrAddSample(SampleX + 1, SampleY + 1),
+		};
+		FSample* Corners[4] = {
+			&GetSample(CornerIndices[0]),
+			&GetSample(CornerIndices[1]),
+			&GetSample(CornerIndices[2]),
+			&GetSample(CornerIndices[3]),
+		};
+
+		int32_t SampleBudget = MaxSampleTracesPerLookup;
+		bool bUsable = true;
+		for (int32_t Corner = 0; Corner < 4; ++Corner)
+		{
+			FSample& Sample = *Corners[Corner];
+			if (NeedsTrace(Sample, Start.Z))
+			{
+				if (SampleBudget-- <= 0)
+				{
+					bUsable = false;
+					continue;
+				}
+
+				const FVec3 SampleStart((SampleX + (Corner & 1)) * CellSize, (SampleY + (Corner >> 1)) * CellSize, Start.Z + SampleLift);
+
+				float FloorZ = 0.f;
+				bool bCacheable = false;
+				const bool bHit = Sampler.TraceFloorSample(SampleStart, Distance + SampleLift, FloorZ, bCacheable);
+				++Stats.SampleTraces;
+
+				Sample.FloorZ = FloorZ;
+				Sample.StartZ = SampleStart.Z;
+				Sample.Frame = Frame;
+				Sample.Flags = static_cast<uint8_t>(SF_Valid | (bHit ? SF_Hit : 0) | (bCacheable ? SF_Cacheable : 0));
+			}
+
+			bUsable &= (Sample.Flags & (SF_Hit | SF_Cacheable)) == (SF_Hit | SF_Cacheable);
+		}
+
+		if (bUsable && InterpolateCorners(Corners, FracX, FracY, Start, Distance, OutFloorZ))
+		{
+			++Stats.CacheHits;
+			return true;
+		}
+
+		++Stats.FallbackTraces;
+		bool bCacheable = false;
+		return Sampler.TraceFloorSample(Start, Distance, OutFloorZ, bCacheable);
+	}
+
+	bool FFloorHeightCache::TraceFloorConcurrent(const FVec3& Start, float Distance, float& OutFloorZ, const IMovementWorld& Sampler, FFloorFillRequest& OutFill) const
+	{
+		const float GridX = Start.X / CellSize;
+		const float GridY = Start.Y / CellSize;
+		const int32_t SampleX = static_cast<int32_t>(std::floor(GridX));
+		const int32_t SampleY = static_cast<int32_t>(std::floor(GridY));
+
+		const FSample* const Corners[4] = {
+			FindSample(SampleX, SampleY),
+			FindSample(SampleX + 1, SampleY),
+			FindSample(SampleX, SampleY + 1),
+			FindSample(SampleX + 1, SampleY + 1),
+		};
+
+		bool bUsable = true;
+		bool bNeedsFill = false;
+		for (const FSample* Sample : Corners)
+		{
+			if (!Sample || NeedsTrace(*Sample, Start.Z))
+			{
+				bNeedsFill = true;
+				bUsable = false;
+				continue;
+			}
+			bUsable &= (Sample->Flags & (SF_Hit | SF_Cacheable)) == (SF_Hit | SF_Cacheable);
+		}
+
+		if (bUsable && InterpolateCorners(Corners, GridX - SampleX, GridY - SampleY, Start, Distance, OutFloorZ))
+		{
+			return true;
+		}
+
+		if (bNeedsFill)
+		{
+			OutFill.Start = Start;
+			OutFill.Distance = Distance;
+			OutFill.bPending = true;
+		}
+
+		bool bCacheable = false;
+		return Sampler.TraceFloorSample(Start, Distance, OutFloorZ, bCacheable);
+	}
+
+	void FFloorHeightCache::Fill(FFloorFillRequest& Request, const IMovementWorld& Sampler)
+	{
+		if (Request.bPending)
+		{
+			float FloorZ = 0.f;
+			TraceFloor(Request.Start, Request.Distance, FloorZ, Sampler);
+			Request.bPending = false;
+		}
+	}
+
+	void FFloorHeightCache::Invalidate(float MinX, float MinY, float MaxX, float MaxY)
+	{
+		// One cell of margin: a sample is used by the four cells around it
+		const int32_t MinSampleX = static_cast<int32_t>(std::floor(MinX / CellSize)) - 1;
+		const int32_t MinSampleY = static_cast<int32_t>(std::floor(MinY / CellSize)) - 1;
+		const int32_t MaxSampleX = static_cast<int32_t>(std::ceil(MaxX / CellSize)) + 1;
+		const int32_t MaxSampleY = static_cast<int32_t>(std::ceil(MaxY / CellSize)) + 1;
+
+		for (int32_t ChunkY = FloorDiv(MinSampleY, ChunkSize); ChunkY <= FloorDiv(MaxSampleY, ChunkSize); ++ChunkY)
+		{
+			for (int32_t ChunkX = FloorDiv(MinSampleX, ChunkSize); ChunkX <= FloorDiv(MaxSampleX, ChunkSize); ++ChunkX)
+			{
+				const int32_t Chunk = FindChunk(ChunkKey(ChunkX, ChunkY));
+				if (Chunk < 0)
+				{
+					continue;
+				}
+
+				for (int32_t LocalY = 0; LocalY < ChunkSize; ++LocalY)
+				{
+					const int32_t SampleY = ChunkY * ChunkSize + LocalY;
+					for (int32_t LocalX = 0; LocalX < ChunkSize; ++LocalX)
+					{
+						const int32_t SampleX = ChunkX * ChunkSize + LocalX;
+						if (SampleX >= MinSampleX && SampleX <= MaxSampleX && SampleY >= MinSampleY && SampleY <= MaxSampleY)
+						{
+							Chunks[Chunk].Samples[LocalY * ChunkSize + LocalX].Flags = 0;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void FFloorHeightCache::Reset()
+	{
+		Chunks.clear();
+		std::fill(SlotChunks.begin(), SlotChunks.end(), -1);
+	}
+}
@@ -0,0 +1,339 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaMovementBatch.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SPARTA_MOVEMENT_AVX2 1
+#define SPARTA_MOVEMENT_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPARTA_MOVEMENT_AVX2 0
+#define SPARTA_MOVEMENT_SSE2 1
+#else
+#define SPARTA_MOVEMENT_AVX2 0
+#define SPARTA_MOVEMENT_SSE2 0
+#endif
+
+namespace SpartaMovement
+{
+	namespace
+	{
+		/** Clears the jump flag of every lane set in LandedMask, without branching */
+		inline void ClearJumpFlags(uint8_t* __restrict Flags, int32_t LandedMask, int32_t Lanes)
+		{
+			for (int32_t Lane = 0; Lane < Lanes; ++Lane)
+			{
+				const uint8_t Clear = static_cast<uint8_t>(((LandedMask >> Lane) & 1) * PBF_Jumping);
+				Flags[Lane] = static_cast<uint8_t>(Flags[Lane] & ~Clear);
+			}
+		}
+
+		/** The same step for every body */
+		struct FUniformDeltaTime
+		{
+			float DeltaTime;
+
+			float At(int32_t) const { return DeltaTime; }
+#if SPARTA_MOVEMENT_SSE2
+			__m128 At4(int32_t) const { return _mm_set1_ps(DeltaTime); }
+#endif
+#if SPARTA_MOVEMENT_AVX2
+			__m256 At8(int32_t) const { return _mm256_set1_ps(DeltaTime); }
+#endif
+		};
+
+		/** DeltaTimes[i] for body i */
+		struct FPerBodyDeltaTime
+		{
+			const float* __restrict DeltaTimes;
+
+			float At(int32_t Index) const { return DeltaTimes[Index]; }
+#if SPARTA_MOVEMENT_SSE2
+			__m128 At4(int32_t Index) const { return _mm_loadu_ps(DeltaTimes + Index); }
+#endif
+#if SPARTA_MOVEMENT_AVX2
+			__m256 At8(int32_t Index) const { return _mm256_loadu_ps(DeltaTimes + Index); }
+#endif
+		};
+
+		/** Scalar loop over [Begin, End) shared by the scalar path and the SIMD tails */
+		template <typename FDeltaTime>
+		void IntegrateBodiesRange(FPawnBodies& Bodies, float Gravity, const FDeltaTime& DeltaTime, int32_t Begin, int32_t End)
+		{
+			float* __restrict PosX = Bodies.PosX.data();
+			float* __restrict PosY = Bodies.PosY.data();
+			float* __restrict PosZ = Bodies.PosZ.data();
+			const float* __restrict VelX = Bodies.VelX.data();
+			const float* __restrict VelY = Bodies.VelY.data();
+			float* __restrict VelZ = Bodies.VelZ.data();
+			const float* __restrict FloorZ = Bodies.FloorZ.data();
+			uint8_t* __restrict Flags = Bodies.Flags.data();
+
+			for (int32_t Index = Begin; Index < End; ++Index)
+			{
+				const float Dt = DeltaTime.At(Index);
+				const float NewVelZ = VelZ[Index] + Gravity * Dt;
+				const float NewZ = PosZ[Index] + NewVelZ * Dt;
+				const bool bLanded = NewZ <= FloorZ[Index];
+
+				PosX[Index] += VelX[Index] * Dt;
+				PosY[Index] += VelY[Index] * Dt;
+				PosZ[Index] = bLanded ? FloorZ[Index] : NewZ;
+				VelZ[Index] = bLanded ? 0.f : NewVelZ;
+				ClearJumpFlags(Flags + Index, bLanded ? 1 : 0, 1);
+			}
+		}
+
+		template <typename FDeltaTime>
+		void IntegrateBodiesSimd(FPawnBodies& Bodies, float Gravity, const FDeltaTime& DeltaTime, int32_t Begin, int32_t End)
+		{
+			int32_t Index = Begin;
+
+#if SPARTA_MOVEMENT_SSE2
+			float* __restrict PosX = Bodies.PosX.data();
+			float* __restrict PosY = Bodies.PosY.data();
+			float* __restrict PosZ = Bodies.PosZ.data();
+			const float* __restrict VelX = Bodies.VelX.data();
+			const float* __restrict VelY = Bodies.VelY.data();
+			float* __restrict VelZ = Bodies.VelZ.data();
+			const float* __restrict FloorZ = Bodies.FloorZ.data();
+			uint8_t* __restrict Flags = Bodies.Flags.data();
+
+#if SPARTA_MOVEMENT_AVX2
+			{
+				const __m256 G = _mm256_set1_ps(Gravity);
+				for (; Index + 8 <= End; Index += 8)
+				{
+					const __m256 Dt = DeltaTime.At8(Index);
+					const __m256 Floor = _mm256_loadu_ps(FloorZ + Index);
+					const __m256 NewVelZ = _mm256_add_ps(_mm256_loadu_ps(VelZ + Index), _mm256_mul_ps(G, Dt));
+					const __m256 NewZ = _mm256_add_ps(_mm256_loadu_ps(PosZ + Index), _mm256_mul_ps(NewVelZ, Dt));
+					const __m256 Landed = _mm256_cmp_ps(NewZ, Floor, _CMP_LE_OQ);
+
+					_mm256_storeu_ps(PosX + Index, _mm256_add_ps(_mm256_loadu_ps(PosX + Index), _mm256_mul_ps(_mm256_loadu_ps(VelX + Index), Dt)));
+					_mm256_storeu_ps(PosY + Index, _mm256_add_ps(_mm256_loadu_ps(PosY + Index), _mm256_mul_ps(_mm256_loadu_ps(VelY + Index), Dt)));
+					_mm256_storeu_ps(PosZ + Index, _mm256_blendv_ps(NewZ, Floor, Landed));
+					_mm256_storeu_ps(VelZ + Index, _mm256_andnot_ps(Landed, NewVelZ));
+					ClearJumpFlags(Flags + Index, _mm256_movemask_ps(Landed), 8);
+				}
+			}
+#endif
+			{
+				const __m128 G = _mm_set1_ps(Gravity);
+				for (; Index + 4 <= End; Index += 4)
+				{
+					const __m128 Dt = DeltaTime.At4(Index);
+					const __m128 Floor = _mm_loadu_ps(FloorZ + Index);
+					const __m128 NewVelZ = _mm_add_ps(_mm_loadu_ps(VelZ + Index), _mm_mul_ps(G, Dt));
+					const __m128 NewZ = _mm_add_ps(_mm_loadu_ps(PosZ + Index), _mm_mul_ps(NewVelZ, Dt));
+					const __m128 Landed = _mm_cmple_ps(NewZ, Floor);
+
+					_mm_storeu_ps(PosX + Index, _mm_add_ps(_mm_loadu_ps(PosX + Index), _mm_mul_ps(_mm_loadu_ps(VelX + Index), Dt)));
+					_mm_storeu_ps(PosY + Index, _mm_add_ps(_mm_loadu_ps(PosY + Index), _mm_mul_ps(_mm_loadu_ps(VelY + Index), Dt)));
+					_mm_storeu_ps(PosZ + Index, _mm_or_ps(_mm_and_ps(Landed, Floor), _mm_andnot_ps(Landed, NewZ)));
+					_mm_storeu_ps(VelZ + Index, _mm_andnot_ps(Landed, NewVelZ));
+					ClearJumpFlags(Flags + Index, _mm_movemask_ps(Landed), 4);
+				}
+			}
+#endif
+
+			IntegrateBodiesRange(Bodies, Gravity, DeltaTime, Index, End);
+		}
+
+		void IntegrateDroneBodiesRange(FDroneBodies& Bodies, float GravityAccel, float ReducingPower, float DeltaTime, int32_t Begin, int32_t End)
+		{
+			for (int32_t Index = Begin; Index < End; ++Index)
+			{
+				const float Offset = ComputeDroneFallOffset(Bodies.EnginePower[Index], Bodies.MaxEnginePower[Index], GravityAccel, ReducingPower, DeltaTime);
+				Bodies.PosZ[Index] = std::max(Bodies.PosZ[Index] + Offset, 0.f);
+				Bodies.EnginePower[Index] = DecayEnginePower(Bodies.EnginePower[Index], ReducingPower, DeltaTime);
+			}
+		}
+	}
+
+	void FPawnBodies::Reserve(int32_t Capacity)
+	{
+		const size_t Size = static_cast<size_t>(Capacity);
+		PosX.reserve(Size); PosY.reserve(Size); PosZ.reserve(Size);
+		VelX.reserve(Size); VelY.reserve(Size); VelZ.reserve(Size);
+		FloorZ.reserve(Size);
+		Yaw.reserve(Size);
+		Flags.reserve(Size);
+	}
+
+	int32_t FPawnBodies::Add(const FPawnMoveState& State)
+	{
+		const int32_t Index = Num();
+		PosX.push_back(0.f); PosY.push_back(0.f); PosZ.push_back(0.f);
+		VelX.push_back(0.f); VelY.push_back(0.f); VelZ.push_back(0.f);
+		FloorZ.push_back(0.f);
+		Yaw.push_back(0.f);
+		Flags.push_back(PBF_None);
+		Store(Index, State);
+		return Index;
+	}
+
+	int32_t FPawnBodies::RemoveAtSwap(int32_t Index)
+	{
+		const int32_t Last = Num() - 1;
+		if (Index < 0 || Index > Last)
+		{
+			return -1;
+		}
+
+		auto SwapPop = [Index, Last](auto& Array)
+		{
+			Array[Index] = Array[Last];
+			Array.pop_back();
+		};
+		SwapPop(PosX); SwapPop(PosY); SwapPop(PosZ);
+		SwapPop(VelX); SwapPop(VelY); SwapPop(VelZ);
+		SwapPop(FloorZ);
+		SwapPop(Yaw);
+		SwapPop(Flags);
+
+		return Index != Last ? Last : -1;
+	}
+
+	void FPawnBodies::Swap(int32_t A, int32_t B)
+	{
+		auto SwapAt = [A, B](auto& Array)
+		{
+			std::swap(Array[A], Array[B]);
+		};
+		SwapAt(PosX); SwapAt(PosY); SwapAt(PosZ);
+		SwapAt(VelX); SwapAt(VelY); SwapAt(VelZ);
+		SwapAt(FloorZ);
+		SwapAt(Yaw);
+		SwapAt(Flags);
+	}
+
+	void FPawnBodies::Load(int32_t Index, FPawnMoveState& OutState) const
+	{
+		OutState.Location = FVec3(PosX[Index], PosY[Index], PosZ[Index]);
+		OutState.Velocity = FVec3(VelX[Index], VelY[Index], VelZ[Index]);
+		OutState.CurrentFloorZ = FloorZ[Index];
+		OutState.Yaw = Yaw[Index];
+		OutState.bIsJumping = (Flags[Index] & PBF_Jumping) != 0;
+		OutState.bIsSprinting = (Flags[Index] & PBF_Sprinting) != 0;
+	}
+
+	void FPawnBodies::Store(int32_t Index, const FPawnMoveState& State)
+	{
+		PosX[Index] = State.Location.X; PosY[Index] = State.Location.Y; PosZ[Index] = State.Location.Z;
+		VelX[Index] = State.Velocity.X; VelY[Index] = State.Velocity.Y; VelZ[Index] = State.Velocity.Z;
+		FloorZ[Index] = State.CurrentFloorZ;
+		Yaw[Index] = State.Yaw;
+		Flags[Index] = static_cast<uint8_t>((State.bIsJumping ? PBF_Jumping : PBF_None) | (State.bIsSprinting ? PBF_Sprinting : PBF_None));
+	}
+
+	void IntegrateBodiesScalar(FPawnBodies& Bodies, float Gravity, float DeltaTime)
+	{
+		IntegrateBodiesRange(Bodies, Gravity, FUniformDeltaTime{DeltaTime}, 0, Bodies.Num());
+	}
+
+	void IntegrateBodies(FPawnBodies& Bodies, float Gravity, float DeltaTime)
+	{
+		IntegrateBodiesSimd(Bodies, Gravity, FUniformDeltaTime{DeltaTime}, 0, Bodies.Num());
+	}
+
+	void IntegrateBodies(FPawnBodies& Bodies, float Gravity, const float* DeltaTimes, int32_t Begin, int32_t End)
+	{
+		IntegrateBodiesSimd(Bodies, Gravity, FPerBodyDeltaTime{DeltaTimes}, Begin, End);
+	}
+
+	void IntegrateDroneBodiesScalar(FDroneBodies& Bodies, float GravityAccel, float ReducingPower, float DeltaTime)
+	{
+		IntegrateDroneBodiesRange(Bodies, GravityAccel, ReducingPower, DeltaTime, 0, Bodies.Num());
+	}
+
+	void IntegrateDroneBodies(FDroneBodies& Bodies, float GravityAccel, float ReducingPower, float DeltaTime)
+	{
+		const int32_t Num = Bodies.Num();
+		int32_t Index = 0;
+
+#if SPARTA_MOVEMENT_SSE2
+		float* __restrict PosZ = Bodies.PosZ.data();
+		float* __restrict Power = Bodies.EnginePower.data();
+		const float* __restrict MaxPower = Bodies.MaxEnginePower.data();
+
+		// Same closed form as ComputeDroneFallOffset, op for op. Without decay the scalar loop takes everything.
+		if (ReducingPower > 0.f)
+		{
+#if SPARTA_MOVEMENT_AVX2
+			{
+				const __m256 Zero = _mm256_setzero_ps();
+				const __m256 Half = _mm256_set1_ps(0.5f);
+				const __m256 T = _mm256_set1_ps(DeltaTime);
+				const __m256 R = _mm256_set1_ps(ReducingPower);
+				const __m256 NegG = _mm256_set1_ps(-GravityAccel);
+				const __m256 Decay = _mm256_set1_ps(ReducingPower * DeltaTime);
+				for (; Index + 8 <= Num; Index += 8)
+				{
+					const __m256 P = _mm256_loadu_ps(Power + Index);
+					const __m256 PMax = _mm256_loadu_ps(MaxPower + Index);
+					const __m256 Powered = _mm256_cmp_ps(P, Zero, _CMP_GT_OQ);
+
+					const __m256 Hover = _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(_mm256_sub_ps(P, PMax), R), Zero), T);
+					const __m256 Start = _mm256_min_ps(P, PMax);
+					const __m256 Ramp = _mm256_min_ps(_mm256_div_ps(Start, R), _mm256_sub_ps(T, Hover));
+					const __m256 RampPower = _mm256_sub_ps(_mm256_mul_ps(Start, Ramp), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(Half, R), Ramp), Ramp));
+					const __m256 Free = _mm256_sub_ps(_mm256_sub_ps(T, Hover), Ramp);
+					const __m256 Falling = _mm256_add_ps(_mm256_sub_ps(Ramp, _mm256_div_ps(RampPower, PMax)), Free);
+
+					// Unpowered engines fall for the whole step
+					const __m256 Offset = _mm256_mul_ps(NegG, _mm256_blendv_ps(T, Falling, Powered));
+					_mm256_storeu_ps(PosZ + Index, _mm256_max_ps(_mm256_add_ps(_mm256_loadu_ps(PosZ + Index), Offset), Zero));
+
+					// Only powered engines decay
+					_mm256_storeu_ps(Power + Index, _mm256_blendv_ps(P, _mm256_max_ps(_mm256_sub_ps(P, Decay), Zero), Powered));
+				}
+			}
+#endif
+			{
+				const __m128 Zero = _mm_setzero_ps();
+				const __m128 Half = _mm_set1_ps(0.5f);
+				const __m128 T = _mm_set1_ps(DeltaTime);
+				const __m128 R = _mm_set1_ps(ReducingPower);
+				const __m128 NegG = _mm_set1_ps(-GravityAccel);
+				const __m128 Decay = _mm_set1_ps(ReducingPower * DeltaTime);
+				for (; Index + 4 <= Num; Index += 4)
+				{
+					const __m128 P = _mm_loadu_ps(Power + Index);
+					const __m128 PMax = _mm_loadu_ps(MaxPower + Index);
+					const __m128 Powered = _mm_cmpgt_ps(P, Zero);
+
+					const __m128 Hover = _mm_min_ps(_mm_max_ps(_mm_div_ps(_mm_sub_ps(P, PMax), R), Zero), T);
+					const __m128 Start = _mm_min_ps(P, PMax);
+					const __m128 Ramp = _mm_min_ps(_mm_div_ps(Start, R), _mm_sub_ps(T, Hover));
+					const __m128 RampPower = _mm_sub_ps(_mm_mul_ps(Start, Ramp), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(Half, R), Ramp), Ramp));
+					const __m128 Free = _mm_sub_ps(_mm_sub_ps(T, Hover), Ramp);
+					const __m128 Falling = _mm_add_ps(_mm_sub_ps(Ramp, _mm_div_ps(RampPower, PMax)), Free);
+
+					const __m128 Offset = _mm_mul_ps(NegG, _mm_or_ps(_mm_and_ps(Powered, Falling), _mm_andnot_ps(Powered, T)));
+					_mm_storeu_ps(PosZ + Index, _mm_max_ps(_mm_add_ps(_mm_loadu_ps(PosZ + Index), Offset), Zero));
+
+					const __m128 Decayed = _mm_max_ps(_mm_sub_ps(P, Decay), Zero);
+					_mm_storeu_ps(Power + Index, _mm_or_ps(_mm_and_ps(Powered, Decayed), _mm_andnot_ps(Powered, P)));
+				}
+			}
+		}
+#endif
+
+		IntegrateDroneBodiesRange(Bodies, GravityAccel, ReducingPower, DeltaTime, Index, Num);
+	}
+
+	const char* GetIntegratorPathName()
+	{
+#if SPARTA_MOVEMENT_AVX2
+		return "AVX2";
+#elif SPARTA_MOVEMENT_SSE2
+		return "SSE2";
+#else
+		return "Scalar";
+#endif
+	}
+}
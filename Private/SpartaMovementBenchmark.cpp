@@ -0,0 +1,1895 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaMovementBenchmark.h"
+#include "SpartaMovementNet.h"
+#include "SpartaPawnBroadphase.h"
+#include "SpartaMovementRecording.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if SPARTA_MOVEMENT_STANDALONE
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#endif
+
+namespace SpartaMovement
+{
+	std::atomic<uint64_t> GBenchmarkAllocations{0};
+
+	namespace
+	{
+		struct FRandom
+		{
+			uint32_t State;
+
+			explicit FRandom(uint32_t Seed) : State(Seed ? Seed : 0x9E3779B9u) {}
+
+			uint32_t Next()
+			{
+				State ^= State << 13;
+				State ^= State >> 17;
+				State ^= State << 5;
+				return State;
+			}
+
+			/** [0, 1) */
+			float Frac() { return (Next() >> 8) * (1.f / 16777216.f); }
+		};
+
+		struct FBenchPawn
+		{
+			FPawnMoveState State;
+			FCollisionCoherence Coherence;
+			FRandom Random{1};
+			float InputX = 0.f;
+			float InputY = 0.f;
+			float ControlYaw = 0.f;
+			int32_t FramesUntilNewInput = 0;
+			FFloorFillRequest FloorFill;
+		};
+
+		/**
+		 * Fixed set of threads for the parallel runs, so the thread count is exactly what was asked for.
+		 * Jobs are a function pointer and a context, so running one does not allocate.
+		 */
+		class FWorkerPool
+		{
+		public:
+			/** NumThreads counts the calling thread */
+			explicit FWorkerPool(int32_t NumThreads)
+			{
+				for (int32_t Index = 1; Index < NumThreads; ++Index)
+				{
+					Threads.emplace_back([this]() { WorkerLoop(); });
+				}
+			}
+
+			~FWorkerPool()
+			{
+				{
+					std::lock_guard<std::mutex> Lock(Mutex);
+					bStop = true;
+					++Generation;
+				}
+				WakeCondition.notify_all();
+				for (std::thread& Thread : Threads)
+				{
+					Thread.join();
+				}
+			}
+
+			/** Body(Begin, End) over [0, Num) in chunks of ChunkSize, on every thread of the pool. Returns when all are done. */
+			template <typename FBody>
+			void ParallelFor(int32_t Num, int32_t ChunkSize, FBody& Body)
+			{
+				Job = [](void* Context, int32_t Begin, int32_t End) { (*static_cast<FBody*>(Context))(Begin, End); };
+				JobContext = &Body;
+				JobNum = Num;
+				JobChunkSize = std::max(ChunkSize, 1);
+				NextBegin.store(0, std::memory_order_relaxed);
+
+				{
+					std::lock_guard<std::mutex> Lock(Mutex);
+					NumBusy = static_cast<int32_t>(Threads.size());
+					++Generation;
+				}
+				WakeCondition.notify_all();
+
+				RunChunks();
+
+				std::unique_lock<std::mutex> Lock(Mutex);
+				DoneCondition.wait(Lock, [this]() { return NumBusy == 0; });
+			}
+
+		private:
+			void RunChunks()
+			{
+				for (;;)
+				{
+					const int32_t Begin = NextBegin.fetch_add(JobChunkSize, std::memory_order_relaxed);
+					if (Begin >= JobNum)
+					{
+						return;
+					}
+					Job(JobContext, Begin, std::min(Begin + JobChunkSize, JobNum));
+				}
+			}
+
+			void WorkerLoop()
+			{
+				uint64_t SeenGeneration = 0;
+				for (;;)
+				{
+					{
+						std::unique_lock<std::mutex> Lock(Mutex);
+						WakeCondition.wait(Lock, [this, SeenGeneration]() { return Generation != SeenGeneration; });
+						SeenGeneration = Generation;
+						if (bStop)
+						{
+							return;
+						}
+					}
+
+					RunChunks();
+
+					std::lock_guard<std::mutex> Lock(Mutex);
+					if (--NumBusy == 0)
+					{
+						DoneCondition.notify_one();
+					}
+				}
+			}
+
+			std::vector<std::thread> Threads;
+			std::mutex Mutex;
+			std::condition_variable WakeCondition;
+			std::condition_variable DoneCondition;
+			uint64_t Generation = 0;
+			int32_t NumBusy = 0;
+			bool bStop = false;
+
+			void (*Job)(void*, int32_t, int32_t) = nullptr;
+			void* JobContext = nullptr;
+			int32_t JobNum = 0;
+			int32_t JobChunkSize = 1;
+			std::atomic<int32_t> NextBegin{0};
+		};
+
+		/** One pawn's view of the world on a worker thread: floor probes only read the cache and queue a fill */
+		class FConcurrentWorldView : public IMovementWorld
+		{
+		public:
+			FConcurrentWorldView(const FSyntheticWorld& InWorld, FFloorFillRequest& InFloorFill)
+				: World(InWorld), FloorFill(InFloorFill)
+			{}
+
+			virtual bool TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const override
+			{
+				if (World.FloorCache)
+				{
+					return World.FloorCache->TraceFloorConcurrent(Start, Distance, OutFloorZ, World, FloorFill);
+				}
+
+				bool bCacheable = false;
+				return World.TraceFloorSample(Start, Distance, OutFloorZ, bCacheable);
+			}
+
+			virtual bool TraceFloorSample(const FVec3& Start, float Distance, float& OutFloorZ, bool& bOutCacheable) const override
+			{
+				return World.TraceFloorSample(Start, Distance, OutFloorZ, bOutCacheable);
+			}
+
+			virtual int32_t OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const override
+			{
+				return World.OverlapCapsule(Center, Radius, HalfHeight, OutContacts, MaxContacts);
+			}
+
+			virtual bool SweepCapsule(const FVec3& Start, const FVec3& End, float Radius, float HalfHeight, FSweepHit& OutHit) const override
+			{
+				return World.SweepCapsule(Start, End, Radius, HalfHeight, OutHit);
+			}
+
+		private:
+			const FSyntheticWorld& World;
+			FFloorFillRequest& FloorFill;
+		};
+
+		void DriveInput(FBenchPawn& Pawn, const FPawnMoveParams& Params)
+		{
+			if (--Pawn.FramesUntilNewInput <= 0)
+			{
+				Pawn.FramesUntilNewInput = 30 + static_cast<int32_t>(Pawn.Random.Frac() * 90.f);
+				Pawn.ControlYaw = Pawn.Random.Frac() * 360.f - 180.f;
+
+				// A quarter of the time the pawn stands still
+				const bool bIdle = Pawn.Random.Frac() < 0.25f;
+				Pawn.InputX = bIdle ? 0.f : 1.f;
+				Pawn.InputY = bIdle ? 0.f : Pawn.Random.Frac() * 2.f - 1.f;
+				Pawn.State.bIsSprinting = Pawn.Random.Frac() < 0.3f;
+			}
+
+			if (Pawn.Random.Frac() < 0.001f)
+			{
+				StartJump(Pawn.State, Params);
+			}
+		}
+	}
+
+	float FSyntheticWorld::HeightAt(float X, float Y) const
+	{
+		return Amplitude * std::sin(X * Frequency) * std::cos(Y * Frequency);
+	}
+
+	bool FSyntheticWorld::HasBox(int32_t CellX, int32_t CellY) const
+	{
+		const uint32_t Hash = static_cast<uint32_t>(CellX) * 73856093u ^ static_cast<uint32_t>(CellY) * 19349663u;
+		return Hash % 3u == 0u;
+	}
+
+	bool FSyntheticWorld::TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const
+	{
+		if (FloorCache)
+		{
+			return FloorCache->TraceFloor(Start, Distance, OutFloorZ, *this);
+		}
+
+		bool bCacheable = false;
+		return TraceFloorSample(Start, Distance, OutFloorZ, bCacheable);
+	}
+
+	bool FSyntheticWorld::TraceFloorSample(const FVec3& Start, float Distance, float& OutFloorZ, bool& bOutCacheable) const
+	{
+		FloorTraces.fetch_add(1, std::memory_order_relaxed);
+		bOutCacheable = true;
+
+		float FloorZ = HeightAt(Start.X, Start.Y);
+
+		const int32_t CellX = static_cast<int32_t>(std::floor(Start.X / BoxSpacing + 0.5f));
+		const int32_t CellY = static_cast<int32_t>(std::floor(Start.Y / BoxSpacing + 0.5f));
+		if (HasBox(CellX, CellY)
+			&& std::fabs(Start.X - CellX * BoxSpacing) <= BoxHalfExtent
+			&& std::fabs(Start.Y - CellY * BoxSpacing) <= BoxHalfExtent)
+		{
+			const float BoxTop = HeightAt(CellX * BoxSpacing, CellY * BoxSpacing) + BoxHeight;
+			if (BoxTop <= Start.Z)
+			{
+				FloorZ = std::max(FloorZ, BoxTop);
+			}
+		}
+
+		if (FloorZ > Start.Z || FloorZ < Start.Z - Distance)
+		{
+			return false;
+		}
+
+		OutFloorZ = FloorZ;
+		return true;
+	}
+
+	int32_t FSyntheticWorld::OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const
+	{
+		const float SegmentHalf = std::max(HalfHeight - Radius, 0.f);
+		const int32_t BaseX = static_cast<int32_t>(std::floor(Center.X / BoxSpacing + 0.5f));
+		const int32_t BaseY = static_cast<int32_t>(std::floor(Center.Y / BoxSpacing + 0.5f));
+
+		int32_t NumContacts = 0;
+		for (int32_t CellY = BaseY - 1; CellY <= BaseY + 1; ++CellY)
+		{
+			for (int32_t CellX = BaseX - 1; CellX <= BaseX + 1; ++CellX)
+			{
+				if (!HasBox(CellX, CellY))
+				{
+					continue;
+				}
+
+				const FVec3 BoxCenter(CellX * BoxSpacing, CellY * BoxSpacing, 0.f);
+				const float BoxBottom = HeightAt(BoxCenter.X, BoxCenter.Y) - Amplitude;
+				const float BoxTop = HeightAt(BoxCenter.X, BoxCenter.Y) + BoxHeight;
+
+				// Closest point between the capsule segment and the box
+				const float SegmentZ = std::clamp(std::clamp(Center.Z, BoxBottom, BoxTop), Center.Z - SegmentHalf, Center.Z + SegmentHalf);
+				const FVec3 OnSegment(Center.X, Center.Y, SegmentZ);
+				const FVec3 OnBox(
+					std::clamp(OnSegment.X, BoxCenter.X - BoxHalfExtent, BoxCenter.X + BoxHalfExtent),
+					std::clamp(OnSegment.Y, BoxCenter.Y - BoxHalfExtent, BoxCenter.Y + BoxHalfExtent),
+					std::clamp(OnSegment.Z, BoxBottom, BoxTop));
+
+				const FVec3 Delta = OnSegment - OnBox;
+				const float DistSq = Delta.SizeSquared();
+				if (DistSq >= Radius * Radius)
+				{
+					continue;
+				}
+
+				FWallContact Contact;
+				Contact.ImpactPoint = OnBox;
+				Contact.HitIndex = CellY * 65536 + CellX;
+				if (DistSq > 1.e-6f)
+				{
+					const float Dist = std::sqrt(DistSq);
+					Contact.Normal = Delta * (1.f / Dist);
+					Contact.Penetration = Radius - Dist;
+				}
+				else
+				{
+					Contact.Penetration = Radius;
+
+					// Segment inside the box: push out through the nearest side face
+					const float DX = OnSegment.X - BoxCenter.X;
+					const float DY = OnSegment.Y - BoxCenter.Y;
+					Contact.Normal = std::fabs(DX) > std::fabs(DY) ? FVec3(DX > 0.f ? 1.f : -1.f, 0.f, 0.f) : FVec3(0.f, DY > 0.f ? 1.f : -1.f, 0.f);
+				}
+
+				// Keep the output sorted by distance
+				if (NumContacts < MaxContacts)
+				{
+					int32_t Insert = NumContacts++;
+					while (Insert > 0 && OutContacts[Insert - 1].Distance > Contact.Distance)
+					{
+						OutContacts[Insert] = OutContacts[Insert - 1];
+						--Insert;
+					}
+					OutContacts[Insert] = Contact;
+				}
+			}
+		}
+
+		return NumContacts;
+	}
+
+	bool FSyntheticWorld::SweepCapsule(const FVec3& Start, const FVec3& End, float Radius, float HalfHeight, FSweepHit& OutHit) const
+	{
+		// Swept capsule against each box grown by the capsule (square corners, a little conservative): a ray against an AABB
+		const float Reach = BoxHalfExtent + Radius;
+		const int32_t MinCellX = static_cast<int32_t>(std::floor((std::min(Start.X, End.X) - Reach) / BoxSpacing + 0.5f));
+		const int32_t MaxCellX = static_cast<int32_t>(std::floor((std::max(Start.X, End.X) + Reach) / BoxSpacing + 0.5f));
+		const int32_t MinCellY = static_cast<int32_t>(std::floor((std::min(Start.Y, End.Y) - Reach) / BoxSpacing + 0.5f));
+		const int32_t MaxCellY = static_cast<int32_t>(std::floor((std::max(Start.Y, End.Y) + Reach) / BoxSpacing + 0.5f));
+		const FVec3 Delta = End - Start;
+
+		bool bHit = false;
+		for (int32_t CellY = MinCellY; CellY <= MaxCellY; ++CellY)
+		{
+			for (int32_t CellX = MinCellX; CellX <= MaxCellX; ++CellX)
+			{
+				if (!HasBox(CellX, CellY))
+				{
+					continue;
+				}
+
+				const float Ground = HeightAt(CellX * BoxSpacing, CellY * BoxSpacing);
+				const FVec3 Min(CellX * BoxSpacing - Reach, CellY * BoxSpacing - Reach, Ground - Amplitude - HalfHeight);
+				const FVec3 Max(CellX * BoxSpacing + Reach, CellY * BoxSpacing + Reach, Ground + BoxHeight + HalfHeight);
+
+				if (Start.X > Min.X && Start.X < Max.X && Start.Y > Min.Y && Start.Y < Max.Y && Start.Z > Min.Z && Start.Z < Max.Z)
+				{
+					// Out through the nearest side or the top
+					const float Exits[5] = { Start.X - Min.X, Max.X - Start.X, Start.Y - Min.Y, Max.Y - Start.Y, Max.Z - Start.Z };
+					const FVec3 Normals[5] = { FVec3(-1.f, 0.f, 0.f), FVec3(1.f, 0.f, 0.f), FVec3(0.f, -1.f, 0.f), FVec3(0.f, 1.f, 0.f), FVec3(0.f, 0.f, 1.f) };
+					const int32_t Nearest = static_cast<int32_t>(std::min_element(Exits, Exits + 5) - Exits);
+
+					OutHit = FSweepHit();
+					OutHit.Time = 0.f;
+					OutHit.bStartPenetrating = true;
+					OutHit.Penetration = Exits[Nearest];
+					OutHit.Normal = Normals[Nearest];
+					return true;
+				}
+
+				// Slab test, remembering which face was entered last
+				float EnterTime = 0.f;
+				float ExitTime = 1.f;
+				FVec3 EnterNormal;
+				const float Starts[3] = { Start.X, Start.Y, Start.Z };
+				const float Deltas[3] = { Delta.X, Delta.Y, Delta.Z };
+				const float Mins[3] = { Min.X, Min.Y, Min.Z };
+				const float Maxs[3] = { Max.X, Max.Y, Max.Z };
+				bool bMisses = false;
+				for (int32_t Axis = 0; Axis < 3 && !bMisses; ++Axis)
+				{
+					if (std::fabs(Deltas[Axis]) < 1.e-6f)
+					{
+						bMisses = Starts[Axis] <= Mins[Axis] || Starts[Axis] >= Maxs[Axis];
+						continue;
+					}
+
+					const float InvDelta = 1.f / Deltas[Axis];
+					float Near = (Mins[Axis] - Starts[Axis]) * InvDelta;
+					float Far = (Maxs[Axis] - Starts[Axis]) * InvDelta;
+					float Sign = -1.f;
+					if (Near > Far)
+					{
+						std::swap(Near, Far);
+						Sign = 1.f;
+					}
+
+					if (Near > EnterTime)
+					{
+						EnterTime = Near;
+						EnterNormal = FVec3(Axis == 0 ? Sign : 0.f, Axis == 1 ? Sign : 0.f, Axis == 2 ? Sign : 0.f);
+					}
+					ExitTime = std::min(ExitTime, Far);
+					bMisses = EnterTime > ExitTime;
+				}
+
+				if (!bMisses && (!bHit || EnterTime < OutHit.Time))
+				{
+					OutHit = FSweepHit();
+					OutHit.Time = EnterTime;
+					OutHit.Normal = EnterNormal;
+					bHit = true;
+				}
+			}
+		}
+
+		return bHit;
+	}
+
+	bool FSyntheticWorld::IsSolid(const FVec3& Center, float /*HalfSize*/) const
+	{
+		if (Center.Z < HeightAt(Center.X, Center.Y))
+		{
+			return true;
+		}
+
+		const int32_t CellX = static_cast<int32_t>(std::floor(Center.X / BoxSpacing + 0.5f));
+		const int32_t CellY = static_cast<int32_t>(std::floor(Center.Y / BoxSpacing + 0.5f));
+		if (!HasBox(CellX, CellY))
+		{
+			return false;
+		}
+
+		const float Ground = HeightAt(CellX * BoxSpacing, CellY * BoxSpacing);
+		return std::fabs(Center.X - CellX * BoxSpacing) <= BoxHalfExtent
+			&& std::fabs(Center.Y - CellY * BoxSpacing) <= BoxHalfExtent
+			&& Center.Z >= Ground - Amplitude && Center.Z <= Ground + BoxHeight;
+	}
+
+	ESdfRegion FSyntheticWorld::ClassifyRegion(const FVec3& Min, const FVec3& Max) const
+	{
+		if (Max.Z < -Amplitude)
+		{
+			return ESdfRegion::Solid;
+		}
+		if (Min.Z <= Amplitude)
+		{
+			return ESdfRegion::Mixed;
+		}
+
+		// Above the heightfield only boxes reach
+		const int32_t MinCellX = static_cast<int32_t>(std::floor((Min.X - BoxHalfExtent) / BoxSpacing + 0.5f));
+		const int32_t MaxCellX = static_cast<int32_t>(std::floor((Max.X + BoxHalfExtent) / BoxSpacing + 0.5f));
+		const int32_t MinCellY = static_cast<int32_t>(std::floor((Min.Y - BoxHalfExtent) / BoxSpacing + 0.5f));
+		const int32_t MaxCellY = static_cast<int32_t>(std::floor((Max.Y + BoxHalfExtent) / BoxSpacing + 0.5f));
+		for (int32_t CellY = MinCellY; CellY <= MaxCellY; ++CellY)
+		{
+			for (int32_t CellX = MinCellX; CellX <= MaxCellX; ++CellX)
+			{
+				if (HasBox(CellX, CellY) && HeightAt(CellX * BoxSpacing, CellY * BoxSpacing) + BoxHeight >= Min.Z)
+				{
+					return ESdfRegion::Mixed;
+				}
+			}
+		}
+		return ESdfRegion::Empty;
+	}
+
+	void FSyntheticWorld::Triangulate(float HalfExtent, float Spacing, std::vector<FVec3>& OutVertices, std::vector<int32_t>& OutIndices) const
+	{
+		OutVertices.clear();
+		OutIndices.clear();
+
+		const int32_t NumCells = std::max(static_cast<int32_t>(std::ceil(2.f * HalfExtent / Spacing)), 1);
+		const float Step = 2.f * HalfExtent / NumCells;
+		for (int32_t Y = 0; Y <= NumCells; ++Y)
+		{
+			for (int32_t X = 0; X <= NumCells; ++X)
+			{
+				const float PointX = -HalfExtent + X * Step;
+				const float PointY = -HalfExtent + Y * Step;
+				OutVertices.emplace_back(PointX, PointY, HeightAt(PointX, PointY));
+			}
+		}
+		for (int32_t Y = 0; Y < NumCells; ++Y)
+		{
+			for (int32_t X = 0; X < NumCells; ++X)
+			{
+				const int32_t Corner = Y * (NumCells + 1) + X;
+				OutIndices.insert(OutIndices.end(), { Corner, Corner + 1, Corner + NumCells + 2, Corner, Corner + NumCells + 2, Corner + NumCells + 1 });
+			}
+		}
+
+		// Boxes as the analytic queries see them: from Amplitude under the ground at their center up to BoxHeight over it
+		const int32_t MaxCell = static_cast<int32_t>(std::floor(HalfExtent / BoxSpacing));
+		for (int32_t CellY = -MaxCell; CellY <= MaxCell; ++CellY)
+		{
+			for (int32_t CellX = -MaxCell; CellX <= MaxCell; ++CellX)
+			{
+				if (!HasBox(CellX, CellY))
+				{
+					continue;
+				}
+
+				const float Ground = HeightAt(CellX * BoxSpacing, CellY * BoxSpacing);
+				const int32_t First = static_cast<int32_t>(OutVertices.size());
+				for (int32_t Corner = 0; Corner < 8; ++Corner)
+				{
+					OutVertices.emplace_back(
+						CellX * BoxSpacing + ((Corner & 1) ? BoxHalfExtent : -BoxHalfExtent),
+						CellY * BoxSpacing + ((Corner & 2) ? BoxHalfExtent : -BoxHalfExtent),
+						(Corner & 4) ? Ground + BoxHeight : Ground - Amplitude);
+				}
+
+				// Bottom, top, then the four sides, as quads of corner bits
+				const int32_t Faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 1, 3, 7, 5 }, { 3, 2, 6, 7 }, { 2, 0, 4, 6 } };
+				for (const int32_t* Face : Faces)
+				{
+					OutIndices.insert(OutIndices.end(), { First + Face[0], First + Face[1], First + Face[2], First + Face[0], First + Face[2], First + Face[3] });
+				}
+			}
+		}
+	}
+
+	FBenchmarkResult RunPawnBenchmark(const FBenchmarkConfig& Config)
+	{
+		using FClock = std::chrono::steady_clock;
+
+		FFloorHeightCache FloorCache;
+		FloorCache.Reserve(Config.FloorCacheChunks);
+		FSyntheticWorld World;
+		World.FloorCache = Config.bUseFloorCache ? &FloorCache : nullptr;
+		const FPawnMoveParams Params;
+
+		std::vector<FBenchPawn> Pawns(static_cast<size_t>(std::max(Config.NumPawns, 0)));
+		FRandom Placement(Config.Seed);
+		for (size_t Index = 0; Index < Pawns.size(); ++Index)
+		{
+			FBenchPawn& Pawn = Pawns[Index];
+			Pawn.Random = FRandom(Config.Seed * 7919u + static_cast<uint32_t>(Index) + 1u);
+			Pawn.State.Location = FVec3(Placement.Frac() * 20000.f - 10000.f, Placement.Frac() * 20000.f - 10000.f, 400.f);
+		}
+
+		auto StepPawn = [&](FBenchPawn& Pawn, const IMovementWorld& PawnWorld)
+		{
+			DriveInput(Pawn, Params);
+			if (Pawn.InputX != 0.f || Pawn.InputY != 0.f)
+			{
+				const FVec3 Displacement = ComputeWalkDisplacement(Pawn.State, Params, Pawn.ControlYaw, Pawn.InputX, Pawn.InputY, Config.DeltaTime);
+				if (Config.bUseSweep)
+				{
+					SlidePawn(Pawn.State, Params, Displacement, PawnWorld);
+				}
+				else
+				{
+					Pawn.State.Location += Displacement;
+				}
+			}
+			TickPawn(Pawn.State, Params, PawnWorld, Config.DeltaTime, Config.bUseCollisionCoherence ? &Pawn.Coherence : nullptr);
+		};
+
+		// Workers only read shared state; what they could not write goes through the serial commit below
+		auto StepPawnsConcurrent = [&](int32_t Begin, int32_t End)
+		{
+			for (int32_t Index = Begin; Index < End; ++Index)
+			{
+				FBenchPawn& Pawn = Pawns[static_cast<size_t>(Index)];
+				StepPawn(Pawn, FConcurrentWorldView(World, Pawn.FloorFill));
+			}
+		};
+
+		const bool bParallel = Config.NumThreads > 0;
+		FWorkerPool Pool(bParallel ? Config.NumThreads : 1);
+
+		auto StepFrame = [&]()
+		{
+			if (bParallel)
+			{
+				Pool.ParallelFor(static_cast<int32_t>(Pawns.size()), 32, StepPawnsConcurrent);
+
+				for (FBenchPawn& Pawn : Pawns)
+				{
+					FloorCache.Fill(Pawn.FloorFill, World);
+				}
+			}
+			else
+			{
+				for (FBenchPawn& Pawn : Pawns)
+				{
+					StepPawn(Pawn, World);
+				}
+			}
+			FloorCache.AdvanceFrame();
+		};
+
+		for (int32_t Frame = 0; Frame < Config.WarmupFrames; ++Frame)
+		{
+			StepFrame();
+		}
+
+		const uint64_t AllocationsBefore = GBenchmarkAllocations.load(std::memory_order_relaxed);
+		const uint64_t FloorTracesBefore = World.FloorTraces.load(std::memory_order_relaxed);
+		FCollisionQueryStats& CollisionStats = GetCollisionQueryStats();
+		const uint64_t ExecutedBefore = CollisionStats.Executed.load(std::memory_order_relaxed);
+		const uint64_t SkippedBefore = CollisionStats.Skipped.load(std::memory_order_relaxed);
+		const uint64_t DepenetrationsBefore = CollisionStats.Depenetrations.load(std::memory_order_relaxed);
+		const FClock::time_point Start = FClock::now();
+
+		int32_t AllocatingFrames = 0;
+		for (int32_t Frame = 0; Frame < Config.NumFrames; ++Frame)
+		{
+			const uint64_t FrameAllocationsBefore = GBenchmarkAllocations.load(std::memory_order_relaxed);
+			StepFrame();
+			AllocatingFrames += GBenchmarkAllocations.load(std::memory_order_relaxed) != FrameAllocationsBefore ? 1 : 0;
+		}
+
+		const FClock::time_point End = FClock::now();
+		const uint64_t Allocations = GBenchmarkAllocations.load(std::memory_order_relaxed) - AllocationsBefore;
+
+		FBenchmarkResult Result;
+		Result.PawnTicks = static_cast<uint64_t>(Pawns.size()) * static_cast<uint64_t>(std::max(Config.NumFrames, 0));
+		if (Result.PawnTicks > 0)
+		{
+			const double Ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(End - Start).count());
+			Result.NsPerPawnTick = Ns / static_cast<double>(Result.PawnTicks);
+			Result.MsPerFrame = Ns * 1.e-6 / static_cast<double>(Config.NumFrames);
+			Result.AllocationsPerTick = static_cast<double>(Allocations) / static_cast<double>(Config.NumFrames);
+			Result.FloorTracesPerTick = static_cast<double>(World.FloorTraces.load(std::memory_order_relaxed) - FloorTracesBefore) / static_cast<double>(Config.NumFrames);
+			Result.WallQueriesPerTick = static_cast<double>(CollisionStats.Executed.load(std::memory_order_relaxed) - ExecutedBefore) / static_cast<double>(Config.NumFrames);
+			Result.WallQueriesSkippedPerTick = static_cast<double>(CollisionStats.Skipped.load(std::memory_order_relaxed) - SkippedBefore) / static_cast<double>(Config.NumFrames);
+			Result.DepenetrationsPerTick = static_cast<double>(CollisionStats.Depenetrations.load(std::memory_order_relaxed) - DepenetrationsBefore) / static_cast<double>(Config.NumFrames);
+		}
+		Result.AllocatingFrames = AllocatingFrames;
+		Result.bAllocationsCounted = SPARTA_MOVEMENT_STANDALONE != 0;
+
+		for (const FBenchPawn& Pawn : Pawns)
+		{
+			Result.Checksum += Pawn.State.Location.X + Pawn.State.Location.Y + Pawn.State.Location.Z;
+		}
+
+		return Result;
+	}
+
+	FIntegratorBenchmarkResult RunIntegratorBenchmark(int32_t NumBodies, int32_t Iterations)
+	{
+		using FClock = std::chrono::steady_clock;
+
+		const float DeltaTime = 1.f / 60.f;
+		const float Gravity = FPawnMoveParams().Gravity;
+
+		FPawnBodies Pawns;
+		FDroneBodies Drones;
+		Pawns.Reserve(NumBodies);
+		FRandom Random(1);
+		for (int32_t Index = 0; Index < NumBodies; ++Index)
+		{
+			FPawnMoveState State;
+			State.Location = FVec3(Random.Frac() * 1000.f, Random.Frac() * 1000.f, Random.Frac() * 500.f);
+			State.Velocity = FVec3(Random.Frac() * 600.f - 300.f, Random.Frac() * 600.f - 300.f, Random.Frac() * 600.f);
+			State.CurrentFloorZ = Random.Frac() * 100.f;
+			State.bIsJumping = true;
+			Pawns.Add(State);
+
+			Drones.PosZ.push_back(Random.Frac() * 2000.f);
+			Drones.EnginePower.push_back(Random.Frac() * 1200.f);
+			Drones.MaxEnginePower.push_back(1200.f);
+		}
+
+		auto TimeNsPerBody = [&](auto&& Step)
+		{
+			const FClock::time_point Start = FClock::now();
+			for (int32_t Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				Step();
+			}
+			const double Ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(FClock::now() - Start).count());
+			return NumBodies > 0 && Iterations > 0 ? Ns / (static_cast<double>(NumBodies) * Iterations) : 0.0;
+		};
+
+		FPawnBodies ScalarPawns = Pawns;
+		FPawnBodies SimdPawns = Pawns;
+		FDroneBodies ScalarDrones = Drones;
+		FDroneBodies SimdDrones = Drones;
+
+		FIntegratorBenchmarkResult Result;
+		Result.PathName = GetIntegratorPathName();
+		Result.ScalarNsPerBody = TimeNsPerBody([&]() { IntegrateBodiesScalar(ScalarPawns, Gravity, DeltaTime); });
+		Result.SimdNsPerBody = TimeNsPerBody([&]() { IntegrateBodies(SimdPawns, Gravity, DeltaTime); });
+		Result.DroneScalarNsPerBody = TimeNsPerBody([&]() { IntegrateDroneBodiesScalar(ScalarDrones, 980.f, 100.f, DeltaTime); });
+		Result.DroneSimdNsPerBody = TimeNsPerBody([&]() { IntegrateDroneBodies(SimdDrones, 980.f, 100.f, DeltaTime); });
+
+		for (int32_t Index = 0; Index < NumBodies; ++Index)
+		{
+			Result.MaxError = std::max({ Result.MaxError,
+				std::fabs(ScalarPawns.PosZ[Index] - SimdPawns.PosZ[Index]),
+				std::fabs(ScalarPawns.VelZ[Index] - SimdPawns.VelZ[Index]),
+				std::fabs(ScalarDrones.PosZ[Index] - SimdDrones.PosZ[Index]),
+				std::fabs(ScalarDrones.EnginePower[Index] - SimdDrones.EnginePower[Index]),
+				ScalarPawns.Flags[Index] != SimdPawns.Flags[Index] ? 1.f : 0.f });
+		}
+
+		return Result;
+	}
+
+	FBroadphaseBenchmarkResult RunBroadphaseBenchmark(int32_t NumPawns, int32_t NumFrames, float Density)
+	{
+		FBroadphaseBenchmarkResult Result;
+		NumPawns = std::max(NumPawns, 2);
+		NumFrames = std::max(NumFrames, 1);
+
+		const FPawnMoveParams Params;
+		const float DeltaTime = 1.f / 60.f;
+		// Square meters for all of them, in cm
+		const float HalfExtent = 0.5f * std::sqrt(NumPawns / std::max(Density, 0.001f)) * 100.f;
+
+		FRandom Random(1);
+		std::vector<FVec3> Centers(NumPawns);
+		std::vector<FVec3> Velocities(NumPawns);
+		std::vector<float> Radii(NumPawns, Params.CapsuleRadius);
+		std::vector<float> HalfHeights(NumPawns, Params.CapsuleHalfHeight);
+
+		FPawnSpatialHash Hash(2.f * Params.CapsuleRadius, NumPawns * 2);
+		Hash.Reserve(NumPawns);
+		for (int32_t Index = 0; Index < NumPawns; ++Index)
+		{
+			Centers[Index] = FVec3((Random.Frac() * 2.f - 1.f) * HalfExtent, (Random.Frac() * 2.f - 1.f) * HalfExtent, Params.CollisionZOffset);
+			Hash.Add(Centers[Index], Radii[Index], HalfHeights[Index]);
+		}
+
+		std::vector<FPawnContact> Contacts;
+		std::vector<FPawnContact> ReferenceContacts;
+		Contacts.reserve(static_cast<size_t>(NumPawns) * 8);
+		ReferenceContacts.reserve(static_cast<size_t>(NumPawns) * 8);
+
+		double HashSeconds = 0.0;
+		double BruteForceSeconds = 0.0;
+		uint64_t TotalContacts = 0;
+		const uint64_t AllocationsBefore = GBenchmarkAllocations.load();
+
+		for (int32_t Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			// Walk, turning now and then, and wrap around the square
+			for (int32_t Index = 0; Index < NumPawns; ++Index)
+			{
+				if (Frame % 60 == Index % 60)
+				{
+					const float Angle = Random.Frac() * 6.2831853f;
+					const float Speed = Random.Frac() < 0.25f ? 0.f : Params.WalkingSpeed;
+					Velocities[Index] = FVec3(std::cos(Angle) * Speed, std::sin(Angle) * Speed, 0.f);
+				}
+				FVec3& Center = Centers[Index];
+				Center += Velocities[Index] * DeltaTime;
+				Center.X = Center.X > HalfExtent ? Center.X - 2.f * HalfExtent : Center.X < -HalfExtent ? Center.X + 2.f * HalfExtent : Center.X;
+				Center.Y = Center.Y > HalfExtent ? Center.Y - 2.f * HalfExtent : Center.Y < -HalfExtent ? Center.Y + 2.f * HalfExtent : Center.Y;
+			}
+
+			const auto HashStart = std::chrono::steady_clock::now();
+			for (int32_t Index = 0; Index < NumPawns; ++Index)
+			{
+				Hash.Update(Index, Centers[Index]);
+			}
+			Contacts.clear();
+			Hash.FindContacts(Contacts);
+			HashSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - HashStart).count();
+
+			const auto BruteForceStart = std::chrono::steady_clock::now();
+			ReferenceContacts.clear();
+			FindContactsBruteForce(Centers.data(), Radii.data(), HalfHeights.data(), NumPawns, ReferenceContacts);
+			BruteForceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - BruteForceStart).count();
+
+			const auto ByPair = [](const FPawnContact& X, const FPawnContact& Y) { return X.A != Y.A ? X.A < Y.A : X.B < Y.B; };
+			std::sort(Contacts.begin(), Contacts.end(), ByPair);
+			const bool bSamePairs = Contacts.size() == ReferenceContacts.size()
+				&& std::equal(Contacts.begin(), Contacts.end(), ReferenceContacts.begin(), [](const FPawnContact& X, const FPawnContact& Y) { return X.A == Y.A && X.B == Y.B; });
+			Result.MismatchedFrames += bSamePairs ? 0 : 1;
+			TotalContacts += Contacts.size();
+
+			// Half the separation each, as USpartaMovementSubsystem does
+			for (const FPawnContact& Contact : Contacts)
+			{
+				Centers[Contact.A] += Contact.Separation * -0.5f;
+				Centers[Contact.B] += Contact.Separation * 0.5f;
+			}
+		}
+
+		const double PawnFrames = static_cast<double>(NumPawns) * NumFrames;
+		Result.HashNsPerPawn = HashSeconds * 1.e9 / PawnFrames;
+		Result.BruteForceNsPerPawn = BruteForceSeconds * 1.e9 / PawnFrames;
+		Result.ContactsPerFrame = static_cast<double>(TotalContacts) / NumFrames;
+		Result.RelinkRatio = Hash.NumUpdates ? static_cast<double>(Hash.NumRelinks) / Hash.NumUpdates : 0.0;
+		Result.bAllocationFree = GBenchmarkAllocations.load() == AllocationsBefore;
+		return Result;
+	}
+
+	FSdfBenchmarkResult RunSdfBenchmark(float VoxelSize, int32_t NumQueries)
+	{
+		using FClock = std::chrono::steady_clock;
+
+		FSdfBenchmarkResult Result;
+		Result.VoxelSize = VoxelSize;
+		NumQueries = std::max(NumQueries, 1);
+
+		const FSyntheticWorld World;
+		const FPawnMoveParams Params;
+		// The wall query as CheckCollision makes it with collision coherence on
+		const float WallRadius = Params.CapsuleRadius + Params.CollisionSafeMargin;
+		const float WallHalfHeight = Params.CapsuleHalfHeight + Params.CollisionSafeMargin;
+
+		const float HalfExtent = 2400.f;
+		FSdfBakeSettings Settings;
+		Settings.Min = FVec3(-HalfExtent, -HalfExtent, -World.Amplitude - 100.f);
+		Settings.Max = FVec3(HalfExtent, HalfExtent, World.Amplitude + World.BoxHeight + 200.f);
+		Settings.VoxelSize = VoxelSize;
+		// The field has to reach past the wall query's radius
+		Settings.BandVoxels = static_cast<int32_t>(std::ceil(WallRadius / VoxelSize)) + 1;
+
+		FSdfBakeStats Stats;
+		const FSdfVolume Volume = BakeSdf(World, Settings, &Stats);
+		const FSdfWorld SdfWorld(Volume);
+		Result.BakeSeconds = Stats.Seconds;
+		Result.NumBricks = Stats.NumBricks;
+		Result.MemoryBytes = Volume.GetMemoryBytes();
+		Result.NumSolidQueries = Stats.NumSolidQueries;
+
+		// Away from the bounds, where the bake sees the geometry cut off
+		const float QueryExtent = HalfExtent - 200.f;
+		FRandom Random(1);
+		const auto RandomFeet = [&]()
+		{
+			FVec3 Feet;
+			do
+			{
+				Feet.X = (Random.Frac() * 2.f - 1.f) * QueryExtent;
+				Feet.Y = (Random.Frac() * 2.f - 1.f) * QueryExtent;
+				Feet.Z = World.HeightAt(Feet.X, Feet.Y);
+			}
+			while (World.IsSolid(Feet + FVec3(0.f, 0.f, Params.CollisionZOffset), 0.f));
+			return Feet;
+		};
+
+		// Floor probes: a quarter from right on the floor, as for a standing pawn, the rest from up to a meter above it
+		std::vector<FVec3> FloorStarts(NumQueries);
+		for (FVec3& Start : FloorStarts)
+		{
+			Start.X = (Random.Frac() * 2.f - 1.f) * QueryExtent;
+			Start.Y = (Random.Frac() * 2.f - 1.f) * QueryExtent;
+			bool bCacheable = false;
+			World.TraceFloorSample(FVec3(Start.X, Start.Y, 10000.f), 20000.f, Start.Z, bCacheable);
+			Start.Z += Random.Frac() < 0.25f ? 0.f : Random.Frac() * 100.f;
+		}
+
+		const float ProbeDistance = Params.MinFloorTraceDistance;
+		std::vector<float> AnalyticFloors(NumQueries, 0.f);
+		std::vector<float> SdfFloors(NumQueries, 0.f);
+		std::vector<float> BatchFloors(NumQueries, 0.f);
+		std::vector<uint8_t> AnalyticHits(NumQueries, 0);
+		std::vector<uint8_t> SdfHits(NumQueries, 0);
+		std::unique_ptr<bool[]> BatchHits(new bool[NumQueries]);
+
+		FClock::time_point Start = FClock::now();
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			bool bCacheable = false;
+			AnalyticHits[Index] = World.TraceFloorSample(FloorStarts[Index], ProbeDistance, AnalyticFloors[Index], bCacheable) ? 1 : 0;
+		}
+		Result.AnalyticFloorNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumQueries;
+
+		Start = FClock::now();
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			SdfHits[Index] = SdfWorld.TraceFloor(FloorStarts[Index], ProbeDistance, SdfFloors[Index]) ? 1 : 0;
+		}
+		Result.SdfFloorNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumQueries;
+
+		const std::vector<float> ProbeDistances(NumQueries, ProbeDistance);
+		Start = FClock::now();
+		TraceFloorBatch(Volume, FloorStarts.data(), ProbeDistances.data(), BatchFloors.data(), BatchHits.get(), NumQueries);
+		Result.SdfBatchFloorNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumQueries;
+
+		std::vector<float> FloorErrors;
+		FloorErrors.reserve(NumQueries);
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			if (AnalyticHits[Index] && SdfHits[Index])
+			{
+				FloorErrors.push_back(std::fabs(SdfFloors[Index] - AnalyticFloors[Index]));
+			}
+			else if (AnalyticHits[Index] != SdfHits[Index])
+			{
+				++Result.FloorMismatches;
+			}
+		}
+		if (!FloorErrors.empty())
+		{
+			double Sum = 0.0;
+			for (const float Error : FloorErrors)
+			{
+				Sum += Error;
+			}
+			Result.FloorMeanError = Sum / FloorErrors.size();
+			const size_t P99 = FloorErrors.size() * 99 / 100;
+			std::nth_element(FloorErrors.begin(), FloorErrors.begin() + P99, FloorErrors.end());
+			Result.FloorP99Error = FloorErrors[P99];
+		}
+
+		// Wall overlaps and sweeps from where pawns would stand
+		std::vector<FVec3> Feet(NumQueries);
+		std::vector<FVec3> Moves(NumQueries);
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			Feet[Index] = RandomFeet();
+			const float Angle = Random.Frac() * 6.2831853f;
+			Moves[Index] = FVec3(std::cos(Angle), std::sin(Angle), 0.f) * 100.f;
+		}
+
+		// Deepest wall contact; ground contacts are not walls to CheckCollision either
+		const auto DeepestWall = [&Params](const FWallContact* Contacts, int32_t NumContacts) -> const FWallContact*
+		{
+			const FWallContact* Deepest = nullptr;
+			for (int32_t Index = 0; Index < NumContacts; ++Index)
+			{
+				if (Contacts[Index].Normal.Z <= Params.GroundNormalZ && (!Deepest || Contacts[Index].Penetration > Deepest->Penetration))
+				{
+					Deepest = &Contacts[Index];
+				}
+			}
+			return Deepest;
+		};
+
+		std::vector<FWallContact> AnalyticContacts(static_cast<size_t>(NumQueries) * MaxWallContacts);
+		std::vector<FWallContact> SdfContacts(static_cast<size_t>(NumQueries) * MaxWallContacts);
+		std::vector<int32_t> NumAnalyticContacts(NumQueries);
+		std::vector<int32_t> NumSdfContacts(NumQueries);
+
+		Start = FClock::now();
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			NumAnalyticContacts[Index] = World.OverlapCapsule(Feet[Index] + FVec3(0.f, 0.f, Params.CollisionZOffset), WallRadius, WallHalfHeight,
+				AnalyticContacts.data() + static_cast<size_t>(Index) * MaxWallContacts, MaxWallContacts);
+		}
+		Result.AnalyticOverlapNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumQueries;
+
+		Start = FClock::now();
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			NumSdfContacts[Index] = SdfWorld.OverlapCapsule(Feet[Index] + FVec3(0.f, 0.f, Params.CollisionZOffset), WallRadius, WallHalfHeight,
+				SdfContacts.data() + static_cast<size_t>(Index) * MaxWallContacts, MaxWallContacts);
+		}
+		Result.SdfOverlapNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumQueries;
+
+		int32_t NumCompared = 0;
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			const FWallContact* Analytic = DeepestWall(AnalyticContacts.data() + static_cast<size_t>(Index) * MaxWallContacts, NumAnalyticContacts[Index]);
+			const FWallContact* Sdf = DeepestWall(SdfContacts.data() + static_cast<size_t>(Index) * MaxWallContacts, NumSdfContacts[Index]);
+			if (Analytic && Sdf)
+			{
+				++NumCompared;
+				Result.PenetrationMeanError += std::fabs(Analytic->Penetration - Sdf->Penetration);
+				Result.NormalMeanErrorDegrees += std::acos(std::clamp(Analytic->Normal.Dot(Sdf->Normal), -1.f, 1.f)) * (180.f / 3.14159265f);
+			}
+			else if ((Analytic && Analytic->Penetration > VoxelSize) || (Sdf && Sdf->Penetration > VoxelSize))
+			{
+				++Result.ContactMismatches;
+			}
+		}
+		if (NumCompared > 0)
+		{
+			Result.PenetrationMeanError /= NumCompared;
+			Result.NormalMeanErrorDegrees /= NumCompared;
+		}
+
+		float SweepCenterZ = 0.f;
+		float SweepHalfHeight = 0.f;
+		GetPawnSweepCapsule(Params, SweepCenterZ, SweepHalfHeight);
+		std::vector<FSweepHit> AnalyticSweeps(NumQueries);
+		std::vector<FSweepHit> SdfSweeps(NumQueries);
+
+		Start = FClock::now();
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			const FVec3 Center = Feet[Index] + FVec3(0.f, 0.f, SweepCenterZ);
+			AnalyticHits[Index] = World.SweepCapsule(Center, Center + Moves[Index], Params.CapsuleRadius, SweepHalfHeight, AnalyticSweeps[Index]) ? 1 : 0;
+		}
+		Result.AnalyticSweepNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumQueries;
+
+		Start = FClock::now();
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			const FVec3 Center = Feet[Index] + FVec3(0.f, 0.f, SweepCenterZ);
+			SdfHits[Index] = SdfWorld.SweepCapsule(Center, Center + Moves[Index], Params.CapsuleRadius, SweepHalfHeight, SdfSweeps[Index]) ? 1 : 0;
+		}
+		Result.SdfSweepNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumQueries;
+
+		NumCompared = 0;
+		for (int32_t Index = 0; Index < NumQueries; ++Index)
+		{
+			// The analytic sweep does not see the heightfield
+			if (SdfHits[Index] && SdfSweeps[Index].Normal.Z > Params.GroundNormalZ)
+			{
+				++Result.SweepGroundHits;
+				continue;
+			}
+
+			const float MoveLength = Moves[Index].Size();
+			const float AnalyticDistance = AnalyticHits[Index] ? AnalyticSweeps[Index].Time * MoveLength : MoveLength;
+			const float SdfDistance = SdfHits[Index] ? SdfSweeps[Index].Time * MoveLength : MoveLength;
+			if (AnalyticHits[Index] && SdfHits[Index])
+			{
+				++NumCompared;
+				Result.SweepMeanError += std::fabs(AnalyticDistance - SdfDistance);
+			}
+			else if (std::fabs(AnalyticDistance - SdfDistance) > VoxelSize)
+			{
+				++Result.SweepMismatches;
+			}
+		}
+		if (NumCompared > 0)
+		{
+			Result.SweepMeanError /= NumCompared;
+		}
+
+		// SampleBatch against Sample over the whole volume, outside included
+		{
+			const int32_t NumSamples = 4096;
+			std::vector<float> X(NumSamples);
+			std::vector<float> Y(NumSamples);
+			std::vector<float> Z(NumSamples);
+			std::vector<float> Distances(NumSamples);
+			const FVec3 Min = Volume.GetMin() - FVec3(50.f, 50.f, 50.f);
+			const FVec3 Size = Volume.GetMax() - Volume.GetMin() + FVec3(100.f, 100.f, 100.f);
+			for (int32_t Index = 0; Index < NumSamples; ++Index)
+			{
+				X[Index] = Min.X + Random.Frac() * Size.X;
+				Y[Index] = Min.Y + Random.Frac() * Size.Y;
+				Z[Index] = Min.Z + Random.Frac() * Size.Z;
+			}
+			Volume.SampleBatch(X.data(), Y.data(), Z.data(), Distances.data(), NumSamples);
+			for (int32_t Index = 0; Index < NumSamples; ++Index)
+			{
+				Result.MaxBatchError = std::max(Result.MaxBatchError, std::fabs(Distances[Index] - Volume.Sample(FVec3(X[Index], Y[Index], Z[Index]))));
+			}
+		}
+
+		return Result;
+	}
+	FBvhBenchmarkResult RunBvhBenchmark(const FBvhBuildSettings& Settings, int32_t NumProbes)
+	{
+		using FClock = std::chrono::steady_clock;
+
+		FBvhBenchmarkResult Result;
+		Result.Settings = Settings;
+		Result.PacketWidth = FFloorBvh::GetPacketWidth();
+		NumProbes = std::max(NumProbes, 1);
+
+		const FSyntheticWorld World;
+		const FPawnMoveParams Params;
+		const float HalfExtent = 2400.f;
+
+		std::vector<FVec3> Vertices;
+		std::vector<int32_t> Indices;
+		World.Triangulate(HalfExtent, 25.f, Vertices, Indices);
+
+		FFloorBvh Bvh;
+		Bvh.Build(Vertices.data(), Indices.data(), static_cast<int32_t>(Indices.size()), Settings, &Result.Build);
+		Result.MemoryBytes = Bvh.GetMemoryBytes();
+		const FBvhFloorWorld BvhWorld(Bvh, World);
+
+		// Floor probes as UpdateFloorZ makes them: a quarter from right on the floor, the rest from up to a meter
+		// above it, a twentieth falling fast enough for a longer probe
+		const float QueryExtent = HalfExtent - 100.f;
+		FRandom Random(1);
+		std::vector<FVec3> Starts(NumProbes);
+		std::vector<float> Distances(NumProbes);
+		for (int32_t Index = 0; Index < NumProbes; ++Index)
+		{
+			FVec3& Start = Starts[Index];
+			Start.X = (Random.Frac() * 2.f - 1.f) * QueryExtent;
+			Start.Y = (Random.Frac() * 2.f - 1.f) * QueryExtent;
+			bool bCacheable = false;
+			World.TraceFloorSample(FVec3(Start.X, Start.Y, 10000.f), 20000.f, Start.Z, bCacheable);
+			Start.Z += Random.Frac() < 0.25f ? 0.f : Random.Frac() * 100.f;
+			Distances[Index] = ComputeFloorTraceDistance(Random.Frac() < 0.05f ? -Random.Frac() * 5000.f : 0.f, Params);
+		}
+
+		std::vector<float> AnalyticFloors(NumProbes, 0.f);
+		std::vector<float> SingleFloors(NumProbes, 0.f);
+		std::vector<float> PacketFloors(NumProbes, 0.f);
+		std::vector<uint8_t> AnalyticHits(NumProbes, 0);
+		std::vector<uint8_t> SingleHits(NumProbes, 0);
+		std::unique_ptr<bool[]> PacketHits(new bool[NumProbes]);
+
+		FClock::time_point Start = FClock::now();
+		for (int32_t Index = 0; Index < NumProbes; ++Index)
+		{
+			bool bCacheable = false;
+			AnalyticHits[Index] = World.TraceFloorSample(Starts[Index], Distances[Index], AnalyticFloors[Index], bCacheable) ? 1 : 0;
+		}
+		Result.AnalyticNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumProbes;
+
+		Start = FClock::now();
+		for (int32_t Index = 0; Index < NumProbes; ++Index)
+		{
+			SingleHits[Index] = BvhWorld.TraceFloor(Starts[Index], Distances[Index], SingleFloors[Index]) ? 1 : 0;
+		}
+		Result.SingleNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumProbes;
+
+		Start = FClock::now();
+		Bvh.TraceDownBatch(Starts.data(), Distances.data(), PacketFloors.data(), PacketHits.get(), NumProbes);
+		Result.PacketNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumProbes;
+
+		for (int32_t Index = 0; Index < NumProbes; ++Index)
+		{
+			if (PacketHits[Index] != (SingleHits[Index] != 0) || (PacketHits[Index] && PacketFloors[Index] != SingleFloors[Index]))
+			{
+				++Result.PacketMismatches;
+			}
+		}
+
+		// Sorted into packets of neighbours, then back in probe order
+		std::vector<uint64_t> Keys;
+		std::vector<FVec3> SortedStarts(NumProbes);
+		std::vector<float> SortedDistances(NumProbes);
+		std::vector<float> SortedFloors(NumProbes, 0.f);
+		std::unique_ptr<bool[]> SortedHits(new bool[NumProbes]);
+		Start = FClock::now();
+		SortProbesForCoherence(Starts.data(), NumProbes, Params.CapsuleRadius, Keys);
+		for (int32_t Index = 0; Index < NumProbes; ++Index)
+		{
+			const uint32_t Probe = static_cast<uint32_t>(Keys[Index]);
+			SortedStarts[Index] = Starts[Probe];
+			SortedDistances[Index] = Distances[Probe];
+		}
+		Bvh.TraceDownBatch(SortedStarts.data(), SortedDistances.data(), SortedFloors.data(), SortedHits.get(), NumProbes);
+		for (int32_t Index = 0; Index < NumProbes; ++Index)
+		{
+			const uint32_t Probe = static_cast<uint32_t>(Keys[Index]);
+			PacketFloors[Probe] = SortedFloors[Index];
+			PacketHits[Probe] = SortedHits[Index];
+		}
+		Result.SortedPacketNs = std::chrono::duration<double>(FClock::now() - Start).count() * 1.e9 / NumProbes;
+
+		int32_t NumCompared = 0;
+		for (int32_t Index = 0; Index < NumProbes; ++Index)
+		{
+			if (PacketHits[Index] != (SingleHits[Index] != 0) || (PacketHits[Index] && PacketFloors[Index] != SingleFloors[Index]))
+			{
+				++Result.PacketMismatches;
+			}
+
+			if (AnalyticHits[Index] != SingleHits[Index])
+			{
+				++Result.Mismatches;
+			}
+			else if (AnalyticHits[Index])
+			{
+				const double Error = std::fabs(AnalyticFloors[Index] - SingleFloors[Index]);
+				Result.MeanError += Error;
+				Result.MaxError = std::max(Result.MaxError, Error);
+				++NumCompared;
+			}
+		}
+		Result.MeanError /= std::max(NumCompared, 1);
+		return Result;
+	}
+
+	void RecordSyntheticPawn(FMovementRecorder& Recorder, const FBenchmarkConfig& Config)
+	{
+		FFloorHeightCache FloorCache;
+		FloorCache.Reserve(Config.FloorCacheChunks);
+		FSyntheticWorld World;
+		World.FloorCache = Config.bUseFloorCache ? &FloorCache : nullptr;
+		const FRecordingWorld RecordingWorld(World, Recorder);
+		const FPawnMoveParams Params;
+
+		FBenchPawn Pawn;
+		Pawn.Random = FRandom(Config.Seed);
+		Pawn.State.Location = FVec3(0.f, 0.f, 400.f);
+
+		double Time = 0.0;
+		Recorder.BeginPawn(Params, Pawn.State, Time);
+		const uint8_t StepFlags = StepQueriesWorld | (Config.bUseCollisionCoherence ? StepCollisionCoherence : 0);
+
+		for (int32_t Frame = 0; Frame < Config.NumFrames; ++Frame)
+		{
+			// DriveInput sets the state directly; record the input events that would have done the same
+			const bool bWasSprinting = Pawn.State.bIsSprinting;
+			const bool bWasJumping = Pawn.State.bIsJumping;
+			DriveInput(Pawn, Params);
+			if (Pawn.State.bIsSprinting != bWasSprinting)
+			{
+				Recorder.RecordInput(Pawn.State.bIsSprinting ? ERecordTag::PawnSprintStart : ERecordTag::PawnSprintStop, Time);
+			}
+			if (Pawn.State.bIsJumping && !bWasJumping)
+			{
+				Recorder.RecordInput(ERecordTag::PawnJumpStart, Time);
+			}
+
+			if (Pawn.InputX != 0.f || Pawn.InputY != 0.f)
+			{
+				const float Move[] = { Pawn.InputX, Pawn.InputY, Pawn.ControlYaw, Config.DeltaTime };
+				Recorder.RecordInput(ERecordTag::PawnMove, Time, Move);
+				const FVec3 Displacement = ComputeWalkDisplacement(Pawn.State, Params, Pawn.ControlYaw, Pawn.InputX, Pawn.InputY, Config.DeltaTime);
+				SlidePawn(Pawn.State, Params, Displacement, RecordingWorld);
+			}
+
+			Recorder.BeginStep(Time, Config.DeltaTime, StepFlags);
+			TickPawn(Pawn.State, Params, RecordingWorld, Config.DeltaTime, Config.bUseCollisionCoherence ? &Pawn.Coherence : nullptr);
+			Recorder.EndPawnStep(Pawn.State);
+
+			FloorCache.AdvanceFrame();
+			Time += Config.DeltaTime;
+		}
+	}
+
+	void RecordSyntheticDrone(FMovementRecorder& Recorder, const FBenchmarkConfig& Config)
+	{
+		FSyntheticWorld World;
+		const FRecordingWorld RecordingWorld(World, Recorder);
+		const FDroneMoveParams Params;
+		FRandom Random(Config.Seed);
+
+		FDroneMoveState State;
+		State.Location = FVec3(0.f, 0.f, 400.f);
+
+		double Time = 0.0;
+		Recorder.BeginDrone(Params, State, Time);
+
+		float Axes[5] = {};
+		const ERecordTag AxisTags[5] = { ERecordTag::DroneMoveUp, ERecordTag::DroneMoveForward, ERecordTag::DroneMoveRight, ERecordTag::DroneLookPitch, ERecordTag::DroneLookYaw };
+		for (int32_t Frame = 0; Frame < Config.NumFrames; ++Frame)
+		{
+			// A new stick position every second, held in between; held axes send an event every frame like the input bindings
+			if (Frame % 60 == 0)
+			{
+				for (float& Axis : Axes)
+				{
+					Axis = static_cast<float>(static_cast<int32_t>(Random.Next() % 3u)) - 1.f;
+				}
+			}
+
+			for (int32_t Index = 0; Index < 5; ++Index)
+			{
+				if (Axes[Index] == 0.f)
+				{
+					continue;
+				}
+				const float Values[2] = { Axes[Index], Config.DeltaTime };
+				Recorder.RecordInput(AxisTags[Index], Time, Values);
+				switch (AxisTags[Index])
+				{
+				case ERecordTag::DroneMoveUp:
+					State.Input.MoveUp = Values[0];
+					break;
+				case ERecordTag::DroneMoveForward:
+					State.Input.MoveForward = State.TiltForward = Values[0];
+					break;
+				case ERecordTag::DroneMoveRight:
+					State.Input.MoveRight = State.TiltRight = Values[0];
+					break;
+				case ERecordTag::DroneLookPitch:
+					TurnDronePitch(State, Params, Values[0], Values[1]);
+					break;
+				default:
+					TurnDroneYaw(State, Params, Values[0], Values[1]);
+					break;
+				}
+			}
+
+			Recorder.BeginStep(Time, Config.DeltaTime, StepQueriesWorld);
+			StepDrone(State, Params, &RecordingWorld, Time, Config.DeltaTime);
+			Recorder.EndDroneStep(State);
+
+			State.Input.Reset();
+			Recorder.RecordInput(ERecordTag::DroneInputConsumed, Time);
+			Time += Config.DeltaTime;
+		}
+	}
+
+	namespace
+	{
+		struct FNetPacket
+		{
+			double DeliverTime = 0.0;
+			int32_t Client = 0;
+			bool bToServer = false;
+			std::vector<uint8_t> Bytes;
+		};
+
+		/** Drops, delays and reorders packets; delivers them in arrival order */
+		class FNetLink
+		{
+		public:
+			explicit FNetLink(const FNetLoopbackConfig& InConfig) : Config(InConfig), Random(InConfig.Seed * 7919u + 1u) {}
+
+			void Send(double Now, int32_t Client, bool bToServer, const std::vector<uint8_t>& Bytes)
+			{
+				if (Random.Frac() < Config.PacketLoss)
+				{
+					return;
+				}
+
+				FNetPacket Packet;
+				Packet.DeliverTime = Now + (Config.LatencyMs + (Random.Frac() * 2.f - 1.f) * Config.JitterMs) * 1.e-3;
+				Packet.Client = Client;
+				Packet.bToServer = bToServer;
+				Packet.Bytes = Bytes;
+				InFlight.push_back(std::move(Packet));
+			}
+
+			/** Packets that have arrived by Now, earliest first */
+			void Receive(double Now, std::vector<FNetPacket>& OutArrived)
+			{
+				OutArrived.clear();
+				const auto Arrived = std::stable_partition(InFlight.begin(), InFlight.end(), [Now](const FNetPacket& Packet) { return Packet.DeliverTime > Now; });
+				std::move(Arrived, InFlight.end(), std::back_inserter(OutArrived));
+				InFlight.erase(Arrived, InFlight.end());
+				std::stable_sort(OutArrived.begin(), OutArrived.end(), [](const FNetPacket& A, const FNetPacket& B) { return A.DeliverTime < B.DeliverTime; });
+			}
+
+		private:
+			const FNetLoopbackConfig& Config;
+			FRandom Random;
+			std::vector<FNetPacket> InFlight;
+		};
+
+		struct FNetServerClient
+		{
+			FPawnMoveState State;
+			TNetInputQueue<FNetPawnInput> Inputs;
+		};
+
+		struct FNetClient
+		{
+			/** Own pawn, predicted ahead of the server */
+			FPawnMoveState Predicted;
+			FRandom Random{1};
+			float MoveX = 0.f;
+			float MoveY = 0.f;
+			float ControlYaw = 0.f;
+			bool bSprint = false;
+			int32_t FramesUntilNewInput = 0;
+
+			TNetInputBuffer<FNetPawnInput> Inputs;
+
+			/** Received snapshots, every pawn's state each, kept as delta baselines */
+			std::vector<FQuantizedMoveState> Snapshots;
+			uint16_t SnapshotSequences[NetSnapshotHistory] = {};
+			bool bSnapshotValid[NetSnapshotHistory] = {};
+			uint16_t NewestSnapshot = 0;
+			bool bHasSnapshot = false;
+		};
+
+		/** Same input pattern as DriveInput, as commands instead of state changes */
+		void DriveNetInput(FNetClient& Client, FNetPawnInput& OutInput, float DeltaTime)
+		{
+			if (--Client.FramesUntilNewInput <= 0)
+			{
+				Client.FramesUntilNewInput = 30 + static_cast<int32_t>(Client.Random.Frac() * 90.f);
+				Client.ControlYaw = Client.Random.Frac() * 360.f - 180.f;
+
+				const bool bIdle = Client.Random.Frac() < 0.25f;
+				Client.MoveX = bIdle ? 0.f : 1.f;
+				Client.MoveY = bIdle ? 0.f : Client.Random.Frac() * 2.f - 1.f;
+				Client.bSprint = Client.Random.Frac() < 0.3f;
+			}
+
+			OutInput.Set(Client.MoveX, Client.MoveY, Client.ControlYaw, DeltaTime, Client.Random.Frac() < 0.005f, false, Client.bSprint);
+		}
+
+		void StepAndSnap(FPawnMoveState& State, const FPawnMoveParams& Params, const FNetPawnInput& Input, const IMovementWorld& World)
+		{
+			StepPawnInput(State, Params, Input, World);
+			SnapToNetGrid(State);
+		}
+	}
+
+	FNetLoopbackResult RunNetLoopback(const FNetLoopbackConfig& Config)
+	{
+		FNetLoopbackResult Result;
+		const int32_t NumClients = std::max(Config.NumClients, 1);
+		const int32_t NumFrames = std::max(static_cast<int32_t>(Config.Seconds / Config.DeltaTime), 1);
+		const int32_t SnapshotInterval = std::max(static_cast<int32_t>(1.f / (Config.DeltaTime * Config.SnapshotRate) + 0.5f), 1);
+		const int32_t Redundancy = std::max(1, std::min(Config.InputRedundancy, NetMaxInputsPerPacket));
+
+		// No floor cache: its interpolated answers depend on fill order, and client and server must query alike
+		const FSyntheticWorld World;
+		const FPawnMoveParams Params;
+		FNetLink Link(Config);
+
+		std::vector<FNetServerClient> Server(NumClients);
+		std::vector<FNetClient> Clients(NumClients);
+		std::vector<FQuantizedMoveState> ServerSnapshots(static_cast<size_t>(NetSnapshotHistory) * NumClients);
+		uint16_t SnapshotSequence = 0;
+
+		for (int32_t Index = 0; Index < NumClients; ++Index)
+		{
+			FPawnMoveState Spawn;
+			Spawn.Location = FVec3(static_cast<float>(Index % 8) * 1000.f, static_cast<float>(Index / 8) * 1000.f, 400.f);
+			SnapToNetGrid(Spawn);
+
+			Server[Index].State = Spawn;
+			FNetClient& Client = Clients[Index];
+			Client.Predicted = Spawn;
+			Client.Random = FRandom(Config.Seed + static_cast<uint32_t>(Index) * 977u);
+			Client.Inputs.SetPredicted(0, QuantizeMoveState(ToNetMoveState(Spawn)));
+			Client.Snapshots.resize(static_cast<size_t>(NetSnapshotHistory) * NumClients);
+		}
+
+		std::vector<FNetPacket> Arrived;
+		std::vector<FQuantizedMoveState> Decoded(NumClients);
+		std::vector<uint8_t> Bytes;
+		uint64_t DownBytes = 0;
+		uint64_t UpBytes = 0;
+		uint64_t StateBits = 0;
+		uint64_t NumStatesWritten = 0;
+		double CorrectionSum = 0.0;
+
+		for (int32_t Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			const double Now = Frame * static_cast<double>(Config.DeltaTime);
+
+			Link.Receive(Now, Arrived);
+			for (const FNetPacket& Packet : Arrived)
+			{
+				FNetBitReader Reader(Packet.Bytes.data(), Packet.Bytes.size());
+				if (Packet.bToServer)
+				{
+					Server[Packet.Client].Inputs.ReadInputPacket(Reader);
+					continue;
+				}
+
+				FNetClient& Client = Clients[Packet.Client];
+				FNetSnapshotHeader Header;
+				ReadSnapshotHeader(Reader, Header);
+				const FQuantizedMoveState* Baseline = nullptr;
+				if (Header.bHasBaseline)
+				{
+					const int32_t Slot = Header.Baseline % NetSnapshotHistory;
+					if (!Client.bSnapshotValid[Slot] || Client.SnapshotSequences[Slot] != Header.Baseline)
+					{
+						// The server only deltas against acknowledged snapshots, which are still here
+						continue;
+					}
+					Baseline = &Client.Snapshots[static_cast<size_t>(Slot) * NumClients];
+				}
+				const uint16_t Sequence = Header.Sequence;
+				const uint16_t AckedInput = Header.AckedInput;
+
+				const int32_t Slot = Sequence % NetSnapshotHistory;
+				FQuantizedMoveState* States = &Client.Snapshots[static_cast<size_t>(Slot) * NumClients];
+				for (int32_t Index = 0; Index < NumClients; ++Index)
+				{
+					ReadMoveState(Reader, Decoded[Index], Baseline ? &Baseline[Index] : nullptr);
+				}
+				if (Reader.IsOverflowed())
+				{
+					continue;
+				}
+				std::copy(Decoded.begin(), Decoded.end(), States);
+				Client.SnapshotSequences[Slot] = Sequence;
+				Client.bSnapshotValid[Slot] = true;
+				++Result.SnapshotsReceived;
+				Result.DeltaSnapshotsReceived += Baseline ? 1 : 0;
+
+				if (Client.bHasSnapshot && !IsSequenceNewer(Sequence, Client.NewestSnapshot))
+				{
+					continue;
+				}
+				Client.NewestSnapshot = Sequence;
+				Client.bHasSnapshot = true;
+
+				// Reconcile: the server's state after AckedInput against what was predicted for it
+				if (!Client.Inputs.IsInHistory(AckedInput))
+				{
+					continue;
+				}
+				const FQuantizedMoveState& ServerState = States[Packet.Client];
+				const FQuantizedMoveState PredictedState = Client.Inputs.GetPredicted(AckedInput);
+				++Result.PredictionsChecked;
+				const bool bCorrected = Client.Inputs.Reconcile(AckedInput, ServerState,
+					[&Client](const FQuantizedMoveState& State) { ApplyNetMoveState(DequantizeMoveState(State), Client.Predicted); },
+					[&Client, &Params, &World](const FNetPawnInput& Input)
+					{
+						StepAndSnap(Client.Predicted, Params, Input, World);
+						return QuantizeMoveState(ToNetMoveState(Client.Predicted));
+					});
+				if (!bCorrected)
+				{
+					continue;
+				}
+
+				const float Correction = (DequantizeMoveState(ServerState).Location - DequantizeMoveState(PredictedState).Location).Size();
+				++Result.Corrections;
+				Result.MaxCorrection = std::max(Result.MaxCorrection, Correction);
+				CorrectionSum += Correction;
+			}
+
+			// Clients: new input, predicted at once, sent with the last few for redundancy
+			for (int32_t Index = 0; Index < NumClients; ++Index)
+			{
+				FNetClient& Client = Clients[Index];
+				FNetPawnInput& Input = Client.Inputs.AddInput();
+				DriveNetInput(Client, Input, Config.DeltaTime);
+
+				StepAndSnap(Client.Predicted, Params, Input, World);
+				Client.Inputs.SetPredicted(Input.Sequence, QuantizeMoveState(ToNetMoveState(Client.Predicted)));
+
+				FNetBitWriter Writer(Bytes);
+				Client.Inputs.WriteInputPacket(Writer, Client.bHasSnapshot ? &Client.NewestSnapshot : nullptr, Redundancy);
+				UpBytes += Bytes.size();
+				Link.Send(Now, Index, true, Bytes);
+			}
+
+			// Server: step every input that has arrived, in order, see TNetInputQueue::PopInput
+			for (FNetServerClient& Connection : Server)
+			{
+				Connection.Inputs.AdvanceServerTime(Now);
+				FNetPawnInput Input;
+				bool bLost = false;
+				while (Connection.Inputs.PopInput(Input, Redundancy, bLost))
+				{
+					Result.InputsLost += bLost ? 1 : 0;
+					StepAndSnap(Connection.State, Params, Input, World);
+				}
+			}
+
+			if (Frame % SnapshotInterval != 0)
+			{
+				continue;
+			}
+
+			++SnapshotSequence;
+			const int32_t SnapshotSlot = SnapshotSequence % NetSnapshotHistory;
+			FQuantizedMoveState* Snapshot = &ServerSnapshots[static_cast<size_t>(SnapshotSlot) * NumClients];
+			for (int32_t Index = 0; Index < NumClients; ++Index)
+			{
+				Snapshot[Index] = QuantizeMoveState(ToNetMoveState(Server[Index].State));
+			}
+
+			for (int32_t Index = 0; Index < NumClients; ++Index)
+			{
+				const FNetServerClient& Connection = Server[Index];
+				const uint16_t* AckedSnapshot = Connection.Inputs.GetAckedSnapshot();
+				FNetSnapshotHeader Header;
+				Header.Sequence = SnapshotSequence;
+				Header.bHasBaseline = Config.bDeltaCompression && AckedSnapshot
+					&& static_cast<uint16_t>(SnapshotSequence - *AckedSnapshot) < NetSnapshotHistory;
+				Header.Baseline = Header.bHasBaseline ? *AckedSnapshot : 0;
+				Header.AckedInput = Connection.Inputs.GetLastProcessedInput();
+				const FQuantizedMoveState* Baseline = Header.bHasBaseline ? &ServerSnapshots[static_cast<size_t>(Header.Baseline % NetSnapshotHistory) * NumClients] : nullptr;
+
+				FNetBitWriter Writer(Bytes);
+				WriteSnapshotHeader(Writer, Header);
+
+				const int32_t HeaderBits = Writer.GetNumBits();
+				for (int32_t Actor = 0; Actor < NumClients; ++Actor)
+				{
+					WriteMoveState(Writer, Snapshot[Actor], Baseline ? &Baseline[Actor] : nullptr);
+				}
+				StateBits += static_cast<uint64_t>(Writer.GetNumBits() - HeaderBits);
+				NumStatesWritten += static_cast<uint64_t>(NumClients);
+
+				DownBytes += Bytes.size();
+				++Result.SnapshotsSent;
+				Link.Send(Now, Index, false, Bytes);
+			}
+		}
+
+		const double Seconds = NumFrames * static_cast<double>(Config.DeltaTime);
+		Result.DownBytesPerActorPerSecond = DownBytes / (Seconds * NumClients * NumClients);
+		Result.UpBytesPerClientPerSecond = UpBytes / (Seconds * NumClients);
+		Result.BitsPerActorState = NumStatesWritten ? static_cast<double>(StateBits) / NumStatesWritten : 0.0;
+		Result.MeanCorrection = Result.Corrections ? CorrectionSum / Result.Corrections : 0.0;
+		for (const FNetServerClient& Connection : Server)
+		{
+			Result.Checksum += Connection.State.Location.X + Connection.State.Location.Y + Connection.State.Location.Z;
+		}
+		return Result;
+	}
+}
+
+#if SPARTA_MOVEMENT_STANDALONE
+
+namespace
+{
+	int RunRecordCommand(int Argc, char** Argv)
+	{
+		SpartaMovement::FBenchmarkConfig Config;
+		Config.NumFrames = Argc > 3 ? std::atoi(Argv[3]) : 3600;
+
+		const bool bDrone = Argc > 4 && std::strcmp(Argv[4], "drone") == 0;
+
+		SpartaMovement::FMovementRecorder Recorder;
+		if (bDrone)
+		{
+			SpartaMovement::RecordSyntheticDrone(Recorder, Config);
+		}
+		else
+		{
+			SpartaMovement::RecordSyntheticPawn(Recorder, Config);
+		}
+
+		const std::vector<uint8_t>& Data = Recorder.GetData();
+		FILE* File = std::fopen(Argv[2], "wb");
+		if (!File || std::fwrite(Data.data(), 1, Data.size(), File) != Data.size())
+		{
+			std::printf("record: cannot write %s\n", Argv[2]);
+			return 1;
+		}
+		std::fclose(File);
+
+		std::printf("record actor=%s frames=%d bytes=%zu bytes/frame=%.1f file=%s\n", bDrone ? "drone" : "pawn", Config.NumFrames, Data.size(),
+			static_cast<double>(Data.size()) / std::max(Config.NumFrames, 1), Argv[2]);
+		return 0;
+	}
+
+	int RunNetCommand(int Argc, char** Argv)
+	{
+		SpartaMovement::FNetLoopbackConfig Config;
+		if (Argc > 2) Config.NumClients = std::atoi(Argv[2]);
+		if (Argc > 3) Config.LatencyMs = static_cast<float>(std::atof(Argv[3]));
+		if (Argc > 4) Config.PacketLoss = static_cast<float>(std::atof(Argv[4])) / 100.f;
+		if (Argc > 5) Config.Seconds = static_cast<float>(std::atof(Argv[5]));
+
+		for (const bool bDelta : { false, true })
+		{
+			Config.bDeltaCompression = bDelta;
+			const SpartaMovement::FNetLoopbackResult Result = SpartaMovement::RunNetLoopback(Config);
+			std::printf("net clients=%d latency=%.0fms loss=%.1f%% delta=%d down bytes/actor/s=%.1f up bytes/client/s=%.1f bits/state=%.1f snapshots sent=%llu received=%llu delta=%llu inputslost=%llu predictions=%llu corrections=%llu maxcorrection=%.2f meancorrection=%.2f checksum=%.3f\n",
+				Config.NumClients, Config.LatencyMs, Config.PacketLoss * 100.f, bDelta ? 1 : 0, Result.DownBytesPerActorPerSecond, Result.UpBytesPerClientPerSecond,
+				Result.BitsPerActorState, static_cast<unsigned long long>(Result.SnapshotsSent), static_cast<unsigned long long>(Result.SnapshotsReceived),
+				static_cast<unsigned long long>(Result.DeltaSnapshotsReceived), static_cast<unsigned long long>(Result.InputsLost),
+				static_cast<unsigned long long>(Result.PredictionsChecked), static_cast<unsigned long long>(Result.Corrections),
+				Result.MaxCorrection, Result.MeanCorrection, Result.Checksum);
+		}
+		return 0;
+	}
+
+	/** Prints one SDF run; false when the batched floor probes disagree with the single ones */
+	bool PrintSdfResult(const SpartaMovement::FSdfBenchmarkResult& Result)
+	{
+		std::printf("sdf voxel=%.0f bake=%.2fs bricks=%d memory=%.2fMB solidqueries=%llu | floor analytic=%.1f sdf=%.1f batch=%.1f ns, error mean=%.2f p99=%.2f cm, mismatches=%d"
+			" | overlap analytic=%.1f sdf=%.1f ns, penetration error=%.2f cm, normal error=%.1f deg, mismatches=%d"
+			" | sweep analytic=%.1f sdf=%.1f ns, distance error=%.2f cm, mismatches=%d groundhits=%d | batch max error=%g\n",
+			Result.VoxelSize, Result.BakeSeconds, Result.NumBricks, Result.MemoryBytes / (1024.0 * 1024.0), static_cast<unsigned long long>(Result.NumSolidQueries),
+			Result.AnalyticFloorNs, Result.SdfFloorNs, Result.SdfBatchFloorNs, Result.FloorMeanError, Result.FloorP99Error, Result.FloorMismatches,
+			Result.AnalyticOverlapNs, Result.SdfOverlapNs, Result.PenetrationMeanError, Result.NormalMeanErrorDegrees, Result.ContactMismatches,
+			Result.AnalyticSweepNs, Result.SdfSweepNs, Result.SweepMeanError, Result.SweepMismatches, Result.SweepGroundHits, Result.MaxBatchError);
+
+		// The analytic mismatches are the SDF's resolution showing at corners; batch and single must agree exactly
+		if (Result.MaxBatchError > 1e-3f)
+		{
+			std::printf("FAILED: sdf batch max error=%g\n", Result.MaxBatchError);
+			return false;
+		}
+		return true;
+	}
+
+	int RunSdfCommand(int Argc, char** Argv)
+	{
+		const int32_t NumQueries = Argc > 3 ? std::atoi(Argv[3]) : 20000;
+		if (Argc > 2)
+		{
+			return PrintSdfResult(SpartaMovement::RunSdfBenchmark(static_cast<float>(std::atof(Argv[2])), NumQueries)) ? 0 : 1;
+		}
+
+		bool bPassed = true;
+		for (const float VoxelSize : { 10.f, 20.f, 40.f })
+		{
+			bPassed &= PrintSdfResult(SpartaMovement::RunSdfBenchmark(VoxelSize, NumQueries));
+		}
+		return bPassed ? 0 : 1;
+	}
+
+	/** Prints one BVH run; false when a probe disagrees with the analytic floor */
+	bool PrintBvhResult(const SpartaMovement::FBvhBenchmarkResult& Result)
+	{
+		std::printf("bvh leaf=%d bins=%d cost=%s build=%.1fms triangles=%d walls=%d nodes=%d leaves=%d depth=%d sah=%.2f memory=%.2fMB"
+			" | probe analytic=%.1f single=%.1f packet%d=%.1f sorted=%.1f ns, error mean=%.3f max=%.3f cm, mismatches=%d packetmismatches=%d\n",
+			Result.Settings.MaxLeafTriangles, Result.Settings.NumBins, Result.Settings.bFootprintCost ? "footprint" : "surface", Result.Build.Seconds * 1000.0,
+			Result.Build.NumTriangles, Result.Build.NumDroppedTriangles, Result.Build.NumNodes, Result.Build.NumLeaves, Result.Build.MaxDepth, Result.Build.SahCost,
+			Result.MemoryBytes / (1024.0 * 1024.0), Result.AnalyticNs, Result.SingleNs, Result.PacketWidth, Result.PacketNs, Result.SortedPacketNs,
+			Result.MeanError, Result.MaxError, Result.Mismatches, Result.PacketMismatches);
+
+		if (Result.Mismatches != 0 || Result.PacketMismatches != 0)
+		{
+			std::printf("FAILED: bvh mismatches=%d packetmismatches=%d\n", Result.Mismatches, Result.PacketMismatches);
+			return false;
+		}
+		return true;
+	}
+
+	int RunBvhCommand(int Argc, char** Argv)
+	{
+		const int32_t NumProbes = Argc > 4 ? std::atoi(Argv[4]) : 100000;
+		SpartaMovement::FBvhBuildSettings Settings;
+		Settings.bFootprintCost = !(Argc > 5 && std::strcmp(Argv[5], "surface") == 0);
+		if (Argc > 2)
+		{
+			Settings.MaxLeafTriangles = std::atoi(Argv[2]);
+			Settings.NumBins = Argc > 3 ? std::atoi(Argv[3]) : Settings.NumBins;
+			return PrintBvhResult(SpartaMovement::RunBvhBenchmark(Settings, NumProbes)) ? 0 : 1;
+		}
+
+		// Leaf sizes under both cost models
+		bool bPassed = true;
+		for (const bool bFootprint : { true, false })
+		{
+			for (const int32_t MaxLeafTriangles : { 1, 2, 4, 8, 16 })
+			{
+				Settings.bFootprintCost = bFootprint;
+				Settings.MaxLeafTriangles = MaxLeafTriangles;
+				bPassed &= PrintBvhResult(SpartaMovement::RunBvhBenchmark(Settings, NumProbes));
+			}
+		}
+		return bPassed ? 0 : 1;
+	}
+
+	int RunReplayCommand(int Argc, char** Argv)
+	{
+		std::vector<uint8_t> Data;
+		if (FILE* File = std::fopen(Argv[2], "rb"))
+		{
+			uint8_t Buffer[65536];
+			size_t Read = 0;
+			while ((Read = std::fread(Buffer, 1, sizeof(Buffer), File)) > 0)
+			{
+				Data.insert(Data.end(), Buffer, Buffer + Read);
+			}
+			std::fclose(File);
+		}
+		else
+		{
+			std::printf("replay: cannot read %s\n", Argv[2]);
+			return 1;
+		}
+
+		const int32_t Repeat = Argc > 3 ? std::atoi(Argv[3]) : 1;
+		const bool bResync = Argc > 4 && std::strcmp(Argv[4], "resync") == 0;
+		const SpartaMovement::FReplayResult Result = SpartaMovement::ReplayRecording(Data.data(), Data.size(), Repeat, bResync);
+		if (Result.Error)
+		{
+			std::printf("replay: %s: %s\n", Argv[2], Result.Error);
+			return 1;
+		}
+
+		std::printf("replay actor=%s resimulated=%d inputs=%d steps=%d recorded=%.2fs ns/step=%.1f divergentstep=%d maxerror=%g querymismatches=%d checksum=%.3f\n",
+			Result.Actor == SpartaMovement::ERecordedActor::Pawn ? "pawn" : "drone", Result.bResimulated ? 1 : 0, Result.NumInputs, Result.NumSteps,
+			Result.RecordedSeconds, Result.NsPerStep, Result.FirstDivergentStep, Result.MaxLocationError, Result.QueryMismatches, Result.Checksum);
+		return Result.FirstDivergentStep < 0 ? 0 : 2;
+	}
+}
+
+// GCC inlines the deletes below into callers and then pairs the std::vector's operator new with free
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t Size)
+{
+	SpartaMovement::GBenchmarkAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* Ptr = std::malloc(Size ? Size : 1))
+	{
+		return Ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* Ptr) noexcept
+{
+	std::free(Ptr);
+}
+
+void operator delete(void* Ptr, std::size_t) noexcept
+{
+	std::free(Ptr);
+}
+
+int main(int Argc, char** Argv)
+{
+	if (Argc > 2 && std::strcmp(Argv[1], "record") == 0)
+	{
+		return RunRecordCommand(Argc, Argv);
+	}
+	if (Argc > 2 && std::strcmp(Argv[1], "replay") == 0)
+	{
+		return RunReplayCommand(Argc, Argv);
+	}
+	if (Argc > 1 && std::strcmp(Argv[1], "net") == 0)
+	{
+		return RunNetCommand(Argc, Argv);
+	}
+	if (Argc > 1 && std::strcmp(Argv[1], "sdf") == 0)
+	{
+		return RunSdfCommand(Argc, Argv);
+	}
+	if (Argc > 1 && std::strcmp(Argv[1], "bvh") == 0)
+	{
+		return RunBvhCommand(Argc, Argv);
+	}
+
+	SpartaMovement::FBenchmarkConfig Config;
+	if (Argc > 1) Config.NumPawns = std::atoi(Argv[1]);
+	if (Argc > 2) Config.NumFrames = std::atoi(Argv[2]);
+	if (Argc > 3 && std::atoi(Argv[3]) > 0) Config.DeltaTime = 1.f / static_cast<float>(std::atoi(Argv[3]));
+
+	// Every check below that fails prints a FAILED line and makes the exit code 1
+	int32_t NumFailed = 0;
+	auto Check = [&NumFailed](bool bPassed, const char* What)
+	{
+		if (!bPassed)
+		{
+			std::printf("FAILED: %s\n", What);
+			++NumFailed;
+		}
+	};
+
+	// Caches off/on with the sweep, then the old direct moves for reference
+	const bool Runs[3][2] = { { false, true }, { true, true }, { true, false } };
+	for (const bool* Run : Runs)
+	{
+		Config.bUseFloorCache = Run[0];
+		Config.bUseCollisionCoherence = Run[0];
+		Config.bUseSweep = Run[1];
+		const SpartaMovement::FBenchmarkResult Result = SpartaMovement::RunPawnBenchmark(Config);
+
+		std::printf("pawns=%d frames=%d hz=%.0f caches=%d sweep=%d ns/pawn/tick=%.1f allocs/tick=%.2f allocframes=%d floortraces/tick=%.1f wallqueries/tick=%.1f skipped/tick=%.1f depen/tick=%.2f checksum=%.3f\n",
+			Config.NumPawns, Config.NumFrames, 1.f / Config.DeltaTime, Run[0] ? 1 : 0, Run[1] ? 1 : 0, Result.NsPerPawnTick, Result.AllocationsPerTick, Result.AllocatingFrames,
+			Result.FloorTracesPerTick, Result.WallQueriesPerTick, Result.WallQueriesSkippedPerTick, Result.DepenetrationsPerTick, Result.Checksum);
+		Check(Result.AllocatingFrames == 0, "pawn frames allocated after warmup");
+	}
+
+	// Thread scaling of the parallel frame on 2000 pawns, caches and sweeps on
+	{
+		SpartaMovement::FBenchmarkConfig Scaling = Config;
+		Scaling.NumPawns = 2000;
+		Scaling.bUseFloorCache = true;
+		Scaling.bUseCollisionCoherence = true;
+		Scaling.bUseSweep = true;
+
+		double SingleThreadMs = 0.0;
+		for (const int32_t NumThreads : { 1, 2, 4, 8, 16 })
+		{
+			Scaling.NumThreads = NumThreads;
+			const SpartaMovement::FBenchmarkResult Result = SpartaMovement::RunPawnBenchmark(Scaling);
+			SingleThreadMs = NumThreads == 1 ? Result.MsPerFrame : SingleThreadMs;
+
+			std::printf("scaling pawns=%d threads=%d ms/frame=%.3f ns/pawn/tick=%.1f speedup=%.2f allocframes=%d checksum=%.3f\n",
+				Scaling.NumPawns, NumThreads, Result.MsPerFrame, Result.NsPerPawnTick,
+				Result.MsPerFrame > 0.0 ? SingleThreadMs / Result.MsPerFrame : 0.0, Result.AllocatingFrames, Result.Checksum);
+			Check(Result.AllocatingFrames == 0, "parallel frames allocated after warmup");
+		}
+		std::printf("scaling: %u hardware threads available\n", std::thread::hardware_concurrency());
+	}
+
+	const SpartaMovement::FIntegratorBenchmarkResult Integrator = SpartaMovement::RunIntegratorBenchmark();
+	std::printf("integrator path=%s pawn scalar=%.2f simd=%.2f ns/body, drone scalar=%.2f simd=%.2f ns/body, max error=%g\n",
+		Integrator.PathName, Integrator.ScalarNsPerBody, Integrator.SimdNsPerBody,
+		Integrator.DroneScalarNsPerBody, Integrator.DroneSimdNsPerBody, Integrator.MaxError);
+	Check(Integrator.MaxError <= 1e-3, "SIMD integrator disagrees with the scalar one");
+
+	for (const int32_t NumPawns : { 500, 2000, 8000 })
+	{
+		const SpartaMovement::FBroadphaseBenchmarkResult Broadphase = SpartaMovement::RunBroadphaseBenchmark(NumPawns);
+		std::printf("broadphase pawns=%d hash=%.1f ns/pawn bruteforce=%.1f ns/pawn contacts/frame=%.1f relinks=%.3f mismatchedframes=%d allocationfree=%d\n",
+			NumPawns, Broadphase.HashNsPerPawn, Broadphase.BruteForceNsPerPawn, Broadphase.ContactsPerFrame, Broadphase.RelinkRatio,
+			Broadphase.MismatchedFrames, Broadphase.bAllocationFree ? 1 : 0);
+		Check(Broadphase.MismatchedFrames == 0, "broadphase contacts differ from brute force");
+		Check(Broadphase.bAllocationFree, "broadphase allocated after warmup");
+	}
+
+	Check(PrintSdfResult(SpartaMovement::RunSdfBenchmark()), "sdf");
+	Check(PrintBvhResult(SpartaMovement::RunBvhBenchmark()), "bvh");
+	return NumFailed == 0 ? 0 : 1;
+}
+
+#endif
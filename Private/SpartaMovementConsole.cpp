@@ -0,0 +1,545 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Console commands for the Sparta movement code.
+
+#include "SpartaAnimBudgetSubsystem.h"
+#include "SpartaMovementBenchmark.h"
+#include "SpartaMovementDebug.h"
+#include "SpartaMovementRecording.h"
+#include "SpartaMovementSubsystem.h"
+#include "SpartaSignificanceSubsystem.h"
+#include "SpartaPlayerController.h"
+#include "SpartaPlayerCameraManager.h"
+#include "SpartaDrone.h"
+#include "SpartaPawn.h"
+#include "SpartaWorldQuery.h"
+
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static FAutoConsoleCommand GSpartaMovementBenchCommand(
+	TEXT("Sparta.Movement.Bench"),
+	TEXT("Steps N pawns over M frames against a synthetic world and logs ns/pawn/tick. Usage: Sparta.Movement.Bench [NumPawns] [NumFrames] [TickRateHz] [NumThreads]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		SpartaMovement::FBenchmarkConfig Config;
+		if (Args.Num() > 0) Config.NumPawns = FCString::Atoi(*Args[0]);
+		if (Args.Num() > 1) Config.NumFrames = FCString::Atoi(*Args[1]);
+		if (Args.Num() > 2 && FCString::Atoi(*Args[2]) > 0) Config.DeltaTime = 1.f / FCString::Atoi(*Args[2]);
+		if (Args.Num() > 3) Config.NumThreads = FMath::Max(FCString::Atoi(*Args[3]), 0);
+
+		const SpartaMovement::FBenchmarkResult Result = SpartaMovement::RunPawnBenchmark(Config);
+
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.Bench pawns=%d frames=%d threads=%d ns/pawn/tick=%.1f ms/frame=%.3f floortraces/tick=%.1f wallqueries/tick=%.1f skipped/tick=%.1f depen/tick=%.2f checksum=%.3f"),
+			Config.NumPawns, Config.NumFrames, Config.NumThreads, Result.NsPerPawnTick, Result.MsPerFrame, Result.FloorTracesPerTick, Result.WallQueriesPerTick,
+			Result.WallQueriesSkippedPerTick, Result.DepenetrationsPerTick, Result.Checksum);
+	}));
+
+static FAutoConsoleCommand GSpartaMovementBenchIntegratorCommand(
+	TEXT("Sparta.Movement.BenchIntegrator"),
+	TEXT("Compares the SIMD gravity/floor-clamp integrator with the scalar one. Usage: Sparta.Movement.BenchIntegrator [NumBodies] [Iterations]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumBodies = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000;
+		const int32 Iterations = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 1000;
+
+		const SpartaMovement::FIntegratorBenchmarkResult Result = SpartaMovement::RunIntegratorBenchmark(NumBodies, Iterations);
+
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.BenchIntegrator path=%hs pawn scalar=%.2f simd=%.2f ns/body, drone scalar=%.2f simd=%.2f ns/body, max error=%g"),
+			Result.PathName, Result.ScalarNsPerBody, Result.SimdNsPerBody, Result.DroneScalarNsPerBody, Result.DroneSimdNsPerBody, Result.MaxError);
+	}));
+
+static FAutoConsoleCommand GSpartaMovementBenchBroadphaseCommand(
+	TEXT("Sparta.Movement.BenchBroadphase"),
+	TEXT("Separates a crowd of pawns through the spatial hash and compares with testing every pair. Usage: Sparta.Movement.BenchBroadphase [NumPawns] [NumFrames] [PawnsPerSquareMeter]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumPawns = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 2000;
+		const int32 NumFrames = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 300;
+		const float Density = Args.Num() > 2 ? FCString::Atof(*Args[2]) : 0.25f;
+
+		const SpartaMovement::FBroadphaseBenchmarkResult Result = SpartaMovement::RunBroadphaseBenchmark(NumPawns, NumFrames, Density);
+
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.BenchBroadphase pawns=%d hash=%.1f ns/pawn bruteforce=%.1f ns/pawn contacts/frame=%.1f relinks=%.3f mismatchedframes=%d"),
+			NumPawns, Result.HashNsPerPawn, Result.BruteForceNsPerPawn, Result.ContactsPerFrame, Result.RelinkRatio, Result.MismatchedFrames);
+	}));
+
+static FAutoConsoleCommand GSpartaMovementBenchSdfCommand(
+	TEXT("Sparta.Movement.BenchSdf"),
+	TEXT("Bakes the synthetic world into a distance field and compares its floor probes, capsule overlaps and sweeps with the analytic ones. Usage: Sparta.Movement.BenchSdf [VoxelSize] [NumQueries]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const float VoxelSize = Args.Num() > 0 ? FCString::Atof(*Args[0]) : 20.f;
+		const int32 NumQueries = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 20000;
+
+		const SpartaMovement::FSdfBenchmarkResult Result = SpartaMovement::RunSdfBenchmark(VoxelSize, NumQueries);
+
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.BenchSdf voxel=%.1f bake=%.2fs bricks=%d memory=%.2fMB floor analytic=%.1f sdf=%.1f batch=%.1f ns error mean=%.2f p99=%.2f mismatches=%d")
+			TEXT(" overlap analytic=%.1f sdf=%.1f ns penetration error=%.2f normal error=%.1fdeg mismatches=%d sweep analytic=%.1f sdf=%.1f ns error=%.2f mismatches=%d batch max error=%g"),
+			Result.VoxelSize, Result.BakeSeconds, Result.NumBricks, Result.MemoryBytes / (1024.0 * 1024.0), Result.AnalyticFloorNs, Result.SdfFloorNs, Result.SdfBatchFloorNs,
+			Result.FloorMeanError, Result.FloorP99Error, Result.FloorMismatches, Result.AnalyticOverlapNs, Result.SdfOverlapNs, Result.PenetrationMeanError,
+			Result.NormalMeanErrorDegrees, Result.ContactMismatches, Result.AnalyticSweepNs, Result.SdfSweepNs, Result.SweepMeanError, Result.SweepMismatches, Result.MaxBatchError);
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaMovementBakeSdfCommand(
+	TEXT("Sparta.Movement.BakeSdf"),
+	TEXT("Bakes this world's static distance field now, e.g. after changing Sparta.Movement.SdfVoxelSize. Queries use it while Sparta.Movement.Sdf is 1."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (USpartaMovementSubsystem* Subsystem = World ? World->GetSubsystem<USpartaMovementSubsystem>() : nullptr)
+		{
+			Subsystem->BakeStaticSdf();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaMovementCompareSdfCommand(
+	TEXT("Sparta.Movement.CompareSdf"),
+	TEXT("Compares floor probes and pawn-sized capsule overlaps against this world's static distance field with the same queries against physics, at random points in it. Usage: Sparta.Movement.CompareSdf [NumQueries]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const USpartaMovementSubsystem* Subsystem = World ? World->GetSubsystem<USpartaMovementSubsystem>() : nullptr;
+		if (!Subsystem || Subsystem->GetStaticSdf().IsEmpty())
+		{
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.CompareSdf: nothing baked, see Sparta.Movement.BakeSdf"));
+			return;
+		}
+
+		const int32 NumQueries = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 2000;
+		const SpartaMovement::FSdfVolume& Sdf = Subsystem->GetStaticSdf();
+		const SpartaMovement::FSdfWorld SdfWorld(Sdf);
+
+		// Physics alone: buffers without the field
+		FSpartaQueryBuffers Buffers;
+		Buffers.Init(nullptr);
+		Buffers.StaticSdf = nullptr;
+		const FSpartaWorldQuery PhysicsWorld(World, Buffers);
+
+		const SpartaMovement::FPawnMoveParams Params;
+		const float FloorDistance = 500.f;
+		const FVector Min = FSpartaWorldQuery::ToVector(Sdf.GetMin());
+		const FVector Max = FSpartaWorldQuery::ToVector(Sdf.GetMax());
+		FRandomStream Random(1234);
+		TArray<SpartaMovement::FVec3> Points;
+		Points.Reserve(NumQueries);
+		for (int32 Index = 0; Index < NumQueries; ++Index)
+		{
+			Points.Add(FSpartaWorldQuery::ToVec3(FVector(Random.FRandRange(Min.X, Max.X), Random.FRandRange(Min.Y, Max.Y), Random.FRandRange(Min.Z, Max.Z))));
+		}
+
+		// Floors: only probes whose physics hit is static geometry are compared, the field knows nothing else
+		double PhysicsFloorSeconds = 0.0;
+		double SdfFloorSeconds = 0.0;
+		double FloorErrorSum = 0.0;
+		int32 NumFloorsCompared = 0;
+		int32 FloorMismatches = 0;
+		for (const SpartaMovement::FVec3& Point : Points)
+		{
+			float PhysicsZ = 0.f;
+			bool bStatic = false;
+			double Time = FPlatformTime::Seconds();
+			const bool bPhysicsHit = PhysicsWorld.TraceFloorSample(Point, FloorDistance, PhysicsZ, bStatic);
+			PhysicsFloorSeconds += FPlatformTime::Seconds() - Time;
+
+			float SdfZ = 0.f;
+			Time = FPlatformTime::Seconds();
+			const bool bSdfHit = SdfWorld.TraceFloor(Point, FloorDistance, SdfZ);
+			SdfFloorSeconds += FPlatformTime::Seconds() - Time;
+
+			if (bPhysicsHit && !bStatic)
+			{
+				continue;
+			}
+			if (bPhysicsHit != bSdfHit)
+			{
+				++FloorMismatches;
+			}
+			else if (bPhysicsHit)
+			{
+				FloorErrorSum += FMath::Abs(PhysicsZ - SdfZ);
+				++NumFloorsCompared;
+			}
+		}
+
+		// Overlaps: whether the capsule touches static geometry, and how deep the deepest static contact is
+		double PhysicsOverlapSeconds = 0.0;
+		double SdfOverlapSeconds = 0.0;
+		double PenetrationErrorSum = 0.0;
+		int32 NumOverlapsCompared = 0;
+		int32 OverlapMismatches = 0;
+		SpartaMovement::FWallContact Contacts[SpartaMovement::MaxWallContacts];
+		for (const SpartaMovement::FVec3& Point : Points)
+		{
+			double Time = FPlatformTime::Seconds();
+			const int32 NumPhysics = PhysicsWorld.OverlapCapsule(Point, Params.CapsuleRadius, Params.CapsuleHalfHeight, Contacts, SpartaMovement::MaxWallContacts);
+			PhysicsOverlapSeconds += FPlatformTime::Seconds() - Time;
+
+			float PhysicsPenetration = -1.f;
+			for (int32 Index = 0; Index < NumPhysics; ++Index)
+			{
+				if (!Contacts[Index].bMovable)
+				{
+					PhysicsPenetration = FMath::Max(PhysicsPenetration, Contacts[Index].Penetration);
+				}
+			}
+
+			Time = FPlatformTime::Seconds();
+			const int32 NumSdf = SdfWorld.OverlapCapsule(Point, Params.CapsuleRadius, Params.CapsuleHalfHeight, Contacts, SpartaMovement::MaxWallContacts);
+			SdfOverlapSeconds += FPlatformTime::Seconds() - Time;
+
+			float SdfPenetration = -1.f;
+			for (int32 Index = 0; Index < NumSdf; ++Index)
+			{
+				SdfPenetration = FMath::Max(SdfPenetration, Contacts[Index].Penetration);
+			}
+
+			if ((PhysicsPenetration >= 0.f) != (SdfPenetration >= 0.f))
+			{
+				++OverlapMismatches;
+			}
+			else if (PhysicsPenetration >= 0.f)
+			{
+				PenetrationErrorSum += FMath::Abs(PhysicsPenetration - SdfPenetration);
+				++NumOverlapsCompared;
+			}
+		}
+
+		const double ToNs = 1.e9 / NumQueries;
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.CompareSdf queries=%d voxel=%.1f memory=%.2fMB floor physics=%.1f sdf=%.1f ns error=%.2f cm over %d mismatches=%d")
+			TEXT(" overlap physics=%.1f sdf=%.1f ns penetration error=%.2f cm over %d mismatches=%d"),
+			NumQueries, Sdf.GetVoxelSize(), Sdf.GetMemoryBytes() / (1024.0 * 1024.0), PhysicsFloorSeconds * ToNs, SdfFloorSeconds * ToNs,
+			FloorErrorSum / FMath::Max(NumFloorsCompared, 1), NumFloorsCompared, FloorMismatches, PhysicsOverlapSeconds * ToNs, SdfOverlapSeconds * ToNs,
+			PenetrationErrorSum / FMath::Max(NumOverlapsCompared, 1), NumOverlapsCompared, OverlapMismatches);
+	}));
+
+static FAutoConsoleCommand GSpartaMovementBenchBvhCommand(
+	TEXT("Sparta.Movement.BenchBvh"),
+	TEXT("Builds a floor BVH over the synthetic world's triangles and times its floor probes, one at a time and in packets, against the analytic ones. Usage: Sparta.Movement.BenchBvh [MaxLeafTriangles] [NumBins] [NumProbes]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		SpartaMovement::FBvhBuildSettings Settings;
+		if (Args.Num() > 0) Settings.MaxLeafTriangles = FMath::Max(FCString::Atoi(*Args[0]), 1);
+		if (Args.Num() > 1) Settings.NumBins = FMath::Max(FCString::Atoi(*Args[1]), 2);
+		const int32 NumProbes = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 100000;
+
+		const SpartaMovement::FBvhBenchmarkResult Result = SpartaMovement::RunBvhBenchmark(Settings, NumProbes);
+
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.BenchBvh leaf=%d bins=%d build=%.1fms triangles=%d nodes=%d depth=%d sah=%.2f memory=%.2fMB")
+			TEXT(" probe analytic=%.1f single=%.1f packet%d=%.1f sorted=%.1f ns error mean=%.3f max=%.3f cm mismatches=%d packetmismatches=%d"),
+			Settings.MaxLeafTriangles, Settings.NumBins, Result.Build.Seconds * 1000.0, Result.Build.NumTriangles, Result.Build.NumNodes, Result.Build.MaxDepth,
+			Result.Build.SahCost, Result.MemoryBytes / (1024.0 * 1024.0), Result.AnalyticNs, Result.SingleNs, Result.PacketWidth, Result.PacketNs,
+			Result.SortedPacketNs, Result.MeanError, Result.MaxError, Result.Mismatches, Result.PacketMismatches);
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaMovementBuildBvhCommand(
+	TEXT("Sparta.Movement.BuildBvh"),
+	TEXT("Builds this world's static floor BVH now, e.g. after changing Sparta.Movement.FloorBvhLeafSize. Floor probes use it while Sparta.Movement.FloorBvh is 1."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (USpartaMovementSubsystem* Subsystem = World ? World->GetSubsystem<USpartaMovementSubsystem>() : nullptr)
+		{
+			Subsystem->BuildStaticBvh();
+		}
+	}));
+
+static FAutoConsoleCommand GSpartaNetLoopbackCommand(
+	TEXT("Sparta.Net.Loopback"),
+	TEXT("Runs replicated, predicted pawns over a simulated lossy link and logs bytes per actor per second, full and delta-compressed. Usage: Sparta.Net.Loopback [NumClients] [LatencyMs] [LossPercent] [Seconds]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		SpartaMovement::FNetLoopbackConfig Config;
+		if (Args.Num() > 0) Config.NumClients = FMath::Max(FCString::Atoi(*Args[0]), 1);
+		if (Args.Num() > 1) Config.LatencyMs = FCString::Atof(*Args[1]);
+		if (Args.Num() > 2) Config.PacketLoss = FMath::Clamp(FCString::Atof(*Args[2]) / 100.f, 0.f, 1.f);
+		if (Args.Num() > 3) Config.Seconds = FCString::Atof(*Args[3]);
+
+		for (const bool bDelta : { false, true })
+		{
+			Config.bDeltaCompression = bDelta;
+			const SpartaMovement::FNetLoopbackResult Result = SpartaMovement::RunNetLoopback(Config);
+
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Net.Loopback clients=%d latency=%.0fms loss=%.1f%% delta=%d down bytes/actor/s=%.1f up bytes/client/s=%.1f bits/state=%.1f snapshots sent=%llu received=%llu inputslost=%llu corrections=%llu/%llu maxcorrection=%.2f"),
+				Config.NumClients, Config.LatencyMs, Config.PacketLoss * 100.f, bDelta ? 1 : 0, Result.DownBytesPerActorPerSecond, Result.UpBytesPerClientPerSecond,
+				Result.BitsPerActorState, static_cast<uint64>(Result.SnapshotsSent), static_cast<uint64>(Result.SnapshotsReceived), static_cast<uint64>(Result.InputsLost),
+				static_cast<uint64>(Result.Corrections), static_cast<uint64>(Result.PredictionsChecked), Result.MaxCorrection);
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaMovementFloorCacheStatsCommand(
+	TEXT("Sparta.Movement.FloorCacheStats"),
+	TEXT("Logs the floor-height cache counters of this world. Pass 'reset' to clear them afterwards."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		USpartaMovementSubsystem* Subsystem = World ? World->GetSubsystem<USpartaMovementSubsystem>() : nullptr;
+		SpartaMovement::FFloorHeightCache* FloorCache = Subsystem ? Subsystem->GetFloorCache() : nullptr;
+		if (!FloorCache)
+		{
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.FloorCacheStats: floor cache disabled"));
+			return;
+		}
+
+		const SpartaMovement::FFloorCacheStats& Stats = FloorCache->GetStats();
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.FloorCacheStats lookups=%llu hits=%llu sampletraces=%llu fallbacktraces=%llu"),
+			static_cast<uint64>(Stats.Lookups), static_cast<uint64>(Stats.CacheHits), static_cast<uint64>(Stats.SampleTraces), static_cast<uint64>(Stats.FallbackTraces));
+
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			FloorCache->ResetStats();
+		}
+	}));
+
+static FAutoConsoleCommand GSpartaMovementCollisionStatsCommand(
+	TEXT("Sparta.Movement.CollisionStats"),
+	TEXT("Logs how many SpartaPawn wall queries ran, how many were skipped by coherence and how many walls pawns had to be pushed out of. Pass 'reset' to clear the counters afterwards."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		SpartaMovement::FCollisionQueryStats& Stats = SpartaMovement::GetCollisionQueryStats();
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.CollisionStats executed=%llu skipped=%llu depenetrations=%llu"),
+			static_cast<uint64>(Stats.Executed.load()), static_cast<uint64>(Stats.Skipped.load()), static_cast<uint64>(Stats.Depenetrations.load()));
+
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Stats.Executed = 0;
+			Stats.Skipped = 0;
+			Stats.Depenetrations = 0;
+		}
+	}));
+
+static FAutoConsoleCommand GSpartaMovementTransformStatsCommand(
+	TEXT("Sparta.Movement.TransformStats"),
+	TEXT("Logs actor transform writes movement asked for, writes that reached the actor and scene component transform updates, per SpartaPawn or SpartaDrone per frame. ")
+	TEXT("Toggle Sparta.Movement.DeferredTransforms in between to compare. Pass 'reset' to clear the counters afterwards. ")
+	TEXT("Component updates are only counted in builds with SPARTA_MOVEMENT_DEBUG."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		SpartaMovementDebug::FTransformStats& Stats = SpartaMovementDebug::GetTransformStats();
+		const double AgentFrames = FMath::Max<double>(static_cast<double>(Stats.AgentFrames), 1.0);
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.TransformStats deferred=%d agentframes=%llu writes/frame=%.2f commits/frame=%.2f componentupdates/frame=%.2f"),
+			USpartaMovementSubsystem::IsDeferredTransformsEnabled() ? 1 : 0, Stats.AgentFrames, Stats.Writes / AgentFrames, Stats.Commits / AgentFrames,
+			Stats.ComponentUpdates / AgentFrames);
+
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Stats = SpartaMovementDebug::FTransformStats();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaMovementCameraStatsCommand(
+	TEXT("Sparta.Movement.CameraStats"),
+	TEXT("Logs how many camera updates the shared camera rig handled and the collision probes it ran, and how many SpartaPawns and SpartaDrones are in the world. ")
+	TEXT("Pass 'reset' to clear the counters afterwards."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		int32 NumActors = 0;
+		if (World)
+		{
+			for (TActorIterator<APawn> It(World); It; ++It)
+			{
+				if (ASpartaPlayerCameraManager::GetRigSettings(*It))
+				{
+					++NumActors;
+				}
+			}
+		}
+
+		ASpartaPlayerCameraManager::FRigStats& Stats = ASpartaPlayerCameraManager::GetRigStats();
+		const double Frames = FMath::Max<double>(static_cast<double>(Stats.Frames), 1.0);
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.CameraStats actors=%d cameraframes=%llu rigupdates/frame=%.2f probes/frame=%.2f"),
+			NumActors, Stats.Frames, Stats.RigUpdates / Frames, Stats.Probes / Frames);
+
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Stats = ASpartaPlayerCameraManager::FRigStats();
+		}
+	}));
+
+static FAutoConsoleCommand GSpartaMovementAsyncStatsCommand(
+	TEXT("Sparta.Movement.AsyncStats"),
+	TEXT("Logs how many floor probes and wall queries were answered by last frame's async traces, why the rest blocked, the async queue depth and the completion latency. Pass 'reset' to clear the counters afterwards."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FSpartaAsyncQueryStats& Stats = FSpartaWorldQuery::GetAsyncStats();
+		const double Completed = FMath::Max<double>(static_cast<double>(Stats.Completed.load()), 1.0);
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.AsyncStats submitted=%llu used=%llu late=%llu stale=%llu cold=%llu queuedepth=%u maxqueuedepth=%u latency=%.3fms (%.2f frames)"),
+			static_cast<uint64>(Stats.Submitted.load()), static_cast<uint64>(Stats.Used.load()), static_cast<uint64>(Stats.Late.load()),
+			static_cast<uint64>(Stats.Stale.load()), static_cast<uint64>(Stats.Cold.load()), Stats.QueueDepth, Stats.MaxQueueDepth,
+			Stats.LatencyMicros.load() / Completed / 1000.0, Stats.LatencyFrames.load() / Completed);
+
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Stats.Submitted = 0;
+			Stats.Used = 0;
+			Stats.Late = 0;
+			Stats.Stale = 0;
+			Stats.Cold = 0;
+			Stats.Completed = 0;
+			Stats.LatencyMicros = 0;
+			Stats.LatencyFrames = 0;
+			Stats.MaxQueueDepth = 0;
+		}
+	}));
+
+static FAutoConsoleCommand GSpartaDroneSweepStatsCommand(
+	TEXT("Sparta.Drone.SweepStats"),
+	TEXT("Logs swept moves and sweep queries per drone per frame, next to the moves per-event input would have made. Pass 'reset' to clear the counters afterwards."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		ASpartaDrone::FSweepStats& Stats = ASpartaDrone::GetSweepStats();
+		const double DroneFrames = FMath::Max<double>(static_cast<double>(Stats.DroneFrames), 1.0);
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Drone.SweepStats droneframes=%llu moves/frame=%.2f sweeps/frame=%.2f uncoalesced moves/frame=%.2f"),
+			Stats.DroneFrames, Stats.Moves / DroneFrames, Stats.Sweeps / DroneFrames, Stats.UncoalescedMoves / DroneFrames);
+
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Stats = ASpartaDrone::FSweepStats();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaSignificanceStatsCommand(
+	TEXT("Sparta.Significance.Stats"),
+	TEXT("Logs how many pawns and drones are in each significance bucket, and how many batched pawns are asleep."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const USpartaSignificanceSubsystem* Subsystem = World ? World->GetSubsystem<USpartaSignificanceSubsystem>() : nullptr;
+		if (!Subsystem)
+		{
+			return;
+		}
+
+		const USpartaMovementSubsystem* MovementSubsystem = World->GetSubsystem<USpartaMovementSubsystem>();
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Significance.Stats full=%d reduced=%d analytic=%d asleep=%d"),
+			Subsystem->GetNumInBucket(ESpartaSignificance::Full), Subsystem->GetNumInBucket(ESpartaSignificance::Reduced),
+			Subsystem->GetNumInBucket(ESpartaSignificance::Analytic), MovementSubsystem ? MovementSubsystem->GetNumSleepingPawns() : 0);
+	}));
+
+static FAutoConsoleCommand GSpartaAnimStatsCommand(
+	TEXT("Sparta.Anim.Stats"),
+	TEXT("Logs game thread animation time of SpartaPawn and SpartaDrone meshes per frame, and how many of them updated their pose or were off-screen. ")
+	TEXT("Toggle Sparta.Anim.Budget in between to compare. Pass 'reset' to clear the counters afterwards."),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		USpartaAnimBudgetSubsystem::FAnimStats& Stats = USpartaAnimBudgetSubsystem::GetStats();
+		const double Frames = FMath::Max<double>(static_cast<double>(Stats.Frames), 1.0);
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Anim.Stats budget=%d frames=%llu meshes/frame=%.1f anim=%.3fms/frame poseupdates/frame=%.1f offscreen/frame=%.1f"),
+			USpartaAnimBudgetSubsystem::IsEnabled() ? 1 : 0, Stats.Frames, Stats.MeshFrames / Frames, Stats.Seconds * 1000.0 / Frames,
+			Stats.PoseUpdates / Frames, Stats.OffScreen / Frames);
+
+		if (Args.Num() > 0 && Args[0] == TEXT("reset"))
+		{
+			Stats = USpartaAnimBudgetSubsystem::FAnimStats();
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaAnimStressCommand(
+	TEXT("Sparta.Anim.Stress"),
+	TEXT("Sparta.Anim.Stress [Count=500] [Seconds=5]: spawns Count copies of the player's pawn in front of it and logs animation time ")
+	TEXT("per frame over Seconds with Sparta.Anim.Budget off, then over Seconds with it on, then removes them."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		USpartaAnimBudgetSubsystem* Subsystem = World ? World->GetSubsystem<USpartaAnimBudgetSubsystem>() : nullptr;
+		if (!Subsystem)
+		{
+			return;
+		}
+
+		const int32 Count = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 500;
+		const float Seconds = Args.Num() > 1 ? FCString::Atof(*Args[1]) : 5.f;
+		Subsystem->StartStress(FMath::Max(Count, 1), Seconds);
+	}));
+
+static FString GetRecordingPath(const FString& Name)
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SpartaRecordings"), Name.EndsWith(TEXT(".sprl")) ? Name : Name + TEXT(".sprl"));
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaRecordStartCommand(
+	TEXT("Sparta.Record.Start"),
+	TEXT("Starts recording the input, world query answers and steps of the first local player's SpartaPawn or SpartaDrone."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+		APawn* Pawn = PlayerController ? PlayerController->GetPawn() : nullptr;
+		if (ASpartaPawn* SpartaPawn = Cast<ASpartaPawn>(Pawn))
+		{
+			SpartaPawn->StartRecording();
+		}
+		else if (ASpartaDrone* Drone = Cast<ASpartaDrone>(Pawn))
+		{
+			Drone->StartRecording();
+		}
+		else
+		{
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Record.Start: the local player controls no SpartaPawn or SpartaDrone"));
+			return;
+		}
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Record.Start: recording %s"), *GetNameSafe(Pawn));
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs GSpartaRecordStopCommand(
+	TEXT("Sparta.Record.Stop"),
+	TEXT("Stops the recording and writes it to Saved/SpartaRecordings. Usage: Sparta.Record.Stop [Name]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		APlayerController* PlayerController = World ? World->GetFirstPlayerController() : nullptr;
+		APawn* Pawn = PlayerController ? PlayerController->GetPawn() : nullptr;
+
+		TUniquePtr<SpartaMovement::FMovementRecorder> Recorder;
+		if (ASpartaPawn* SpartaPawn = Cast<ASpartaPawn>(Pawn))
+		{
+			Recorder = SpartaPawn->StopRecording();
+		}
+		else if (ASpartaDrone* Drone = Cast<ASpartaDrone>(Pawn))
+		{
+			Recorder = Drone->StopRecording();
+		}
+		if (!Recorder)
+		{
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Record.Stop: nothing is recording"));
+			return;
+		}
+
+		const FString Path = GetRecordingPath(Args.Num() > 0 ? Args[0] : FDateTime::Now().ToString());
+		const std::vector<uint8>& Data = Recorder->GetData();
+		if (!FFileHelper::SaveArrayToFile(TArrayView<const uint8>(Data.data(), static_cast<int32>(Data.size())), *Path))
+		{
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Record.Stop: cannot write %s"), *Path);
+			return;
+		}
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Record.Stop: %llu bytes to %s"), static_cast<uint64>(Data.size()), *Path);
+	}));
+
+static FAutoConsoleCommand GSpartaReplayCommand(
+	TEXT("Sparta.Replay"),
+	TEXT("Re-runs a recording from Saved/SpartaRecordings through the movement code, without the level, and logs where it diverges and how fast it ran. Usage: Sparta.Replay Name [Repeat] [resync]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		if (Args.Num() == 0)
+		{
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Replay: usage Sparta.Replay Name [Repeat] [resync]"));
+			return;
+		}
+
+		const FString Path = GetRecordingPath(Args[0]);
+		TArray<uint8> Data;
+		if (!FFileHelper::LoadFileToArray(Data, *Path))
+		{
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Replay: cannot read %s"), *Path);
+			return;
+		}
+
+		const int32 Repeat = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 1;
+		const bool bResync = Args.Num() > 2 && Args[2] == TEXT("resync");
+		const SpartaMovement::FReplayResult Result = SpartaMovement::ReplayRecording(Data.GetData(), Data.Num(), Repeat, bResync);
+		if (Result.Error)
+		{
+			UE_LOG(LogAAA, Warning, TEXT("Sparta.Replay %s: %hs"), *Path, Result.Error);
+			return;
+		}
+
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Replay %s actor=%s resimulated=%d inputs=%d steps=%d recorded=%.2fs ns/step=%.1f divergentstep=%d maxerror=%g querymismatches=%d checksum=%.3f"),
+			*Path, Result.Actor == SpartaMovement::ERecordedActor::Pawn ? TEXT("pawn") : TEXT("drone"), Result.bResimulated ? 1 : 0, Result.NumInputs, Result.NumSteps,
+			Result.RecordedSeconds, Result.NsPerStep, Result.FirstDivergentStep, Result.MaxLocationError, Result.QueryMismatches, Result.Checksum);
+	}));
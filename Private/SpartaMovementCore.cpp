@@ -0,0 +1,515 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaMovementCore.h"
+
+#include <algorithm>
+
+namespace SpartaMovement
+{
+	namespace
+	{
+		constexpr float DegToRad = 3.14159265358979f / 180.f;
+		constexpr float RadToDeg = 180.f / 3.14159265358979f;
+
+		float NormalizeAxis(float Angle)
+		{
+			Angle = std::fmod(Angle, 360.f);
+			if (Angle > 180.f) Angle -= 360.f;
+			else if (Angle < -180.f) Angle += 360.f;
+			return Angle;
+		}
+
+		/** FRotator::Vector */
+		FVec3 RotatorForward(float Pitch, float Yaw)
+		{
+			const float P = std::fmod(Pitch, 360.f) * DegToRad;
+			const float Y = std::fmod(Yaw, 360.f) * DegToRad;
+			return FVec3(std::cos(P) * std::cos(Y), std::cos(P) * std::sin(Y), std::sin(P));
+		}
+
+		/** FRotationMatrix(FRotator(Pitch, Yaw, Roll)).GetUnitAxis(EAxis::Y) */
+		FVec3 RotatorRight(float Pitch, float Yaw, float Roll)
+		{
+			const float P = std::fmod(Pitch, 360.f) * DegToRad;
+			const float Y = std::fmod(Yaw, 360.f) * DegToRad;
+			const float R = std::fmod(Roll, 360.f) * DegToRad;
+			const float SP = std::sin(P), CP = std::cos(P);
+			const float SY = std::sin(Y), CY = std::cos(Y);
+			const float SR = std::sin(R), CR = std::cos(R);
+			return FVec3(SR * SP * CY - CR * SY, SR * SP * SY + CR * CY, -SR * CP);
+		}
+	}
+
+	FQuat4 MakeQuat(float Pitch, float Yaw, float Roll)
+	{
+		const float HalfDegToRad = DegToRad * 0.5f;
+		const float SP = std::sin(std::fmod(Pitch, 360.f) * HalfDegToRad), CP = std::cos(std::fmod(Pitch, 360.f) * HalfDegToRad);
+		const float SY = std::sin(std::fmod(Yaw, 360.f) * HalfDegToRad), CY = std::cos(std::fmod(Yaw, 360.f) * HalfDegToRad);
+		const float SR = std::sin(std::fmod(Roll, 360.f) * HalfDegToRad), CR = std::cos(std::fmod(Roll, 360.f) * HalfDegToRad);
+		return FQuat4(
+			CR * SP * SY - SR * CP * CY,
+			-CR * SP * CY - SR * CP * SY,
+			CR * CP * SY - SR * SP * CY,
+			CR * CP * CY + SR * SP * SY);
+	}
+
+	FQuat4 SlerpQuat(const FQuat4& A, const FQuat4& B, float Alpha)
+	{
+		// Flip B's sign if that is closer, so the blend takes the short way round
+		const float RawCosom = A.Dot(B);
+		const float Cosom = RawCosom >= 0.f ? RawCosom : -RawCosom;
+
+		float Scale0 = 1.f - Alpha;
+		float Scale1 = Alpha;
+		if (Cosom < 0.9999f)
+		{
+			const float Omega = std::acos(Cosom);
+			const float InvSin = 1.f / std::sin(Omega);
+			Scale0 = std::sin((1.f - Alpha) * Omega) * InvSin;
+			Scale1 = std::sin(Alpha * Omega) * InvSin;
+		}
+		Scale1 = RawCosom >= 0.f ? Scale1 : -Scale1;
+
+		const FQuat4 Blend(Scale0 * A.X + Scale1 * B.X, Scale0 * A.Y + Scale1 * B.Y, Scale0 * A.Z + Scale1 * B.Z, Scale0 * A.W + Scale1 * B.W);
+		const float SizeSq = Blend.Dot(Blend);
+		if (SizeSq < 1.e-8f)
+		{
+			return FQuat4();
+		}
+		const float InvSize = 1.f / std::sqrt(SizeSq);
+		return FQuat4(Blend.X * InvSize, Blend.Y * InvSize, Blend.Z * InvSize, Blend.W * InvSize);
+	}
+
+	FQuat4 InterpQuat(const FQuat4& Current, const FQuat4& Target, float DeltaTime, float InterpSpeed)
+	{
+		if (InterpSpeed <= 0.f || Current.Equals(Target))
+		{
+			return Target;
+		}
+		return SlerpQuat(Current, Target, std::clamp(InterpSpeed * DeltaTime, 0.f, 1.f));
+	}
+
+	float InterpFloat(float Current, float Target, float DeltaTime, float InterpSpeed)
+	{
+		if (InterpSpeed <= 0.f)
+		{
+			return Target;
+		}
+		const float Dist = Target - Current;
+		if (Dist * Dist < 1.e-8f)
+		{
+			return Target;
+		}
+		return Current + Dist * std::clamp(DeltaTime * InterpSpeed, 0.f, 1.f);
+	}
+
+	float ComputeFloorTraceDistance(float VelocityZ, const FPawnMoveParams& Params)
+	{
+		// Probe deeper the faster we fall
+		const float FallSpeed = std::fabs(VelocityZ);
+		return std::clamp(FallSpeed * Params.FloorTraceSpeedScale, Params.MinFloorTraceDistance, Params.MaxFloorTraceDistance);
+	}
+
+	bool UpdateFloorZ(FPawnMoveState& State, const FPawnMoveParams& Params, const IMovementWorld& World)
+	{
+		const float TraceDistance = ComputeFloorTraceDistance(State.Velocity.Z, Params);
+
+		float FloorZ = 0.f;
+		if (!World.TraceFloor(State.Location, TraceDistance, FloorZ))
+		{
+			return false;
+		}
+
+		State.CurrentFloorZ = FloorZ;
+		return true;
+	}
+
+	FCollisionQueryStats& GetCollisionQueryStats()
+	{
+		static FCollisionQueryStats Stats;
+		return Stats;
+	}
+
+	int32_t CheckCollision(FPawnMoveState& State, const FPawnMoveParams& Params, const IMovementWorld& World, FCollisionCoherence* Coherence)
+	{
+		FVec3 Center = State.Location;
+		Center.Z += Params.CollisionZOffset;
+
+		if (Coherence && Coherence->FreeDistance > 0.f
+			&& Coherence->FramesSinceQuery < Params.MaxCoherentCollisionFrames
+			&& (Center - Coherence->LastCenter).SizeSquared() < Coherence->FreeDistance * Coherence->FreeDistance)
+		{
+			++Coherence->FramesSinceQuery;
+			GetCollisionQueryStats().Skipped.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+
+		// Inflate by the margin only when the result is remembered
+		const float Margin = Coherence ? Params.CollisionSafeMargin : 0.f;
+
+		FWallContact Contacts[MaxWallContacts];
+		const int32_t NumContacts = World.OverlapCapsule(Center, Params.CapsuleRadius + Margin, Params.CapsuleHalfHeight + Margin, Contacts, MaxWallContacts);
+		GetCollisionQueryStats().Executed.fetch_add(1, std::memory_order_relaxed);
+
+		float FreeDistance = Margin;
+		bool bMovableNearby = false;
+
+		int32_t NumWalls = 0;
+		for (int32_t Index = 0; Index < NumContacts; ++Index)
+		{
+			const FWallContact& Contact = Contacts[Index];
+
+			// Ground contact, not a wall (the pawn only yaws, so actor up is world up)
+			if (Contact.Normal.Z > Params.GroundNormalZ)
+			{
+				continue;
+			}
+
+			bMovableNearby |= Contact.bMovable;
+			FreeDistance = std::min(FreeDistance, Margin - Contact.Penetration);
+
+			// Within the margin only, the real capsule does not touch it
+			const float Depth = Contact.Penetration - Margin;
+			if (Coherence && Depth <= 0.f)
+			{
+				continue;
+			}
+
+			// Push out by the overlap, not a fixed step: no jitter against the wall
+			State.Location += Contact.Normal * (std::max(Depth, 0.f) + Params.SlideSkinDistance);
+			GetCollisionQueryStats().Depenetrations.fetch_add(1, std::memory_order_relaxed);
+			++NumWalls;
+
+			World.OnWallContact(Contact);
+		}
+
+		if (Coherence)
+		{
+			Coherence->LastCenter = Center;
+			Coherence->FramesSinceQuery = 0;
+			Coherence->FreeDistance = (NumWalls == 0 && !bMovableNearby) ? FreeDistance : -1.f;
+		}
+
+		return NumWalls;
+	}
+
+	void Integrate(FPawnMoveState& State, const FPawnMoveParams& Params, float DeltaTime)
+	{
+		// Gravity
+		State.Velocity.Z += Params.Gravity * DeltaTime;
+
+		// Integrate
+		State.Location += State.Velocity * DeltaTime;
+
+		// Floor clamp
+		if (State.Location.Z <= State.CurrentFloorZ)
+		{
+			State.Location.Z = State.CurrentFloorZ;
+			State.bIsJumping = false;
+			State.Velocity.Z = 0.f;
+		}
+	}
+
+	bool IsAtRest(const FPawnMoveState& State, const FPawnMoveParams& Params, const FVec3& PreviousLocation)
+	{
+		const float Tolerance = Params.RestTolerance;
+		return !State.bIsJumping
+			&& State.Location.Z <= State.CurrentFloorZ + Tolerance
+			&& State.Velocity.IsNearlyZero(Tolerance)
+			&& (State.Location - PreviousLocation).SizeSquared() <= Tolerance * Tolerance;
+	}
+
+	void TickPawn(FPawnMoveState& State, const FPawnMoveParams& Params, const IMovementWorld& World, float DeltaTime, FCollisionCoherence* Coherence)
+	{
+		UpdateFloorZ(State, Params, World);
+		CheckCollision(State, Params, World, Coherence);
+		Integrate(State, Params, DeltaTime);
+	}
+
+	FVec3 ComputeMoveDirection(float ControlYaw, float InputX, float InputY)
+	{
+		const float YawRad = ControlYaw * DegToRad;
+		const float CosYaw = std::cos(YawRad);
+		const float SinYaw = std::sin(YawRad);
+
+		// Forward = (cos, sin, 0), Right = (-sin, cos, 0)
+		return FVec3(CosYaw * InputX - SinYaw * InputY, SinYaw * InputX + CosYaw * InputY, 0.f);
+	}
+
+	float ComputeMoveSpeed(const FPawnMoveState& State, const FPawnMoveParams& Params)
+	{
+		const float BaseSpeed = State.bIsSprinting ? Params.SprintSpeed : Params.WalkingSpeed;
+		return State.bIsJumping ? BaseSpeed / 2 : BaseSpeed;
+	}
+
+	int32_t SlideMove(FVec3& Center, const FVec3& Delta, float Radius, float HalfHeight, const IMovementWorld& World, int32_t MaxIterations, float SkinDistance)
+	{
+		FVec3 Remaining = Delta;
+		FVec3 PrevNormal;
+		bool bHasPrevNormal = false;
+		int32_t NumHits = 0;
+
+		for (int32_t Iteration = 0; Iteration < MaxIterations && !Remaining.IsNearlyZero(); ++Iteration)
+		{
+			FSweepHit Hit;
+			if (!World.SweepCapsule(Center, Center + Remaining, Radius, HalfHeight, Hit))
+			{
+				Center += Remaining;
+				return NumHits;
+			}
+			++NumHits;
+
+			// Already inside: get out first, then retry the same move
+			if (Hit.bStartPenetrating)
+			{
+				Center += Hit.Normal * (Hit.Penetration + SkinDistance);
+				continue;
+			}
+
+			// Advance to the time of impact, minus the skin
+			const float Length = Remaining.Size();
+			const float Time = std::max(Hit.Time - SkinDistance / Length, 0.f);
+			Center += Remaining * Time;
+			Remaining = Remaining * (1.f - Time);
+
+			// Slide: drop the part of the rest of the move that goes into the surface
+			FVec3 Slide = Remaining - Hit.Normal * Remaining.Dot(Hit.Normal);
+			if (bHasPrevNormal && PrevNormal.Dot(Hit.Normal) < 0.99f)
+			{
+				// Second wall: sliding along one would push into the other, follow their crease instead
+				const FVec3 Crease = PrevNormal.Cross(Hit.Normal).GetSafeNormal();
+				Slide = Crease * Remaining.Dot(Crease);
+			}
+
+			// Never slide back against the requested move
+			if (Slide.Dot(Delta) <= 0.f)
+			{
+				break;
+			}
+
+			Remaining = Slide;
+			PrevNormal = Hit.Normal;
+			bHasPrevNormal = true;
+		}
+
+		return NumHits;
+	}
+
+	void GetPawnSweepCapsule(const FPawnMoveParams& Params, float& OutCenterZOffset, float& OutHalfHeight)
+	{
+		const float Top = Params.CollisionZOffset + Params.CapsuleHalfHeight;
+		const float Bottom = Params.MaxStepHeight;
+		OutHalfHeight = std::max((Top - Bottom) * 0.5f, Params.CapsuleRadius);
+		OutCenterZOffset = Bottom + OutHalfHeight;
+	}
+
+	int32_t SlidePawn(FPawnMoveState& State, const FPawnMoveParams& Params, const FVec3& Delta, const IMovementWorld& World)
+	{
+		float CenterZOffset = 0.f;
+		float HalfHeight = 0.f;
+		GetPawnSweepCapsule(Params, CenterZOffset, HalfHeight);
+
+		FVec3 Center = State.Location;
+		Center.Z += CenterZOffset;
+		const int32_t NumHits = SlideMove(Center, Delta, Params.CapsuleRadius, HalfHeight, World, Params.MaxSlideIterations, Params.SlideSkinDistance);
+
+		State.Location = Center;
+		State.Location.Z -= CenterZOffset;
+		return NumHits;
+	}
+
+	FVec3 ComputeWalkDisplacement(FPawnMoveState& State, const FPawnMoveParams& Params, float ControlYaw, float InputX, float InputY, float DeltaTime)
+	{
+		const FVec3 MoveDirection = ComputeMoveDirection(ControlYaw, InputX, InputY);
+
+		if (!MoveDirection.IsNearlyZero())
+		{
+			const float TargetYaw = std::atan2(MoveDirection.Y, MoveDirection.X) * RadToDeg;
+			State.Yaw = InterpYaw(State.Yaw, TargetYaw, DeltaTime, Params.RotationInterpSpeed);
+		}
+
+		return MoveDirection * (ComputeMoveSpeed(State, Params) * DeltaTime);
+	}
+
+	float InterpYaw(float Current, float Target, float DeltaTime, float InterpSpeed)
+	{
+		if (InterpSpeed <= 0.f)
+		{
+			return Target;
+		}
+
+		const float Delta = NormalizeAxis(Target - Current);
+		if (std::fabs(Delta) <= 1.e-4f)
+		{
+			return Target;
+		}
+
+		const float Alpha = std::clamp(DeltaTime * InterpSpeed, 0.f, 1.f);
+		return NormalizeAxis(Current + Delta * Alpha);
+	}
+
+	bool StartJump(FPawnMoveState& State, const FPawnMoveParams& Params)
+	{
+		if (State.bIsJumping)
+		{
+			return false;
+		}
+
+		State.bIsJumping = true;
+		State.Velocity.Z = Params.JumpVelocity;
+		return true;
+	}
+
+	void StopJump(FPawnMoveState& State, const FPawnMoveParams& Params)
+	{
+		if (State.bIsJumping && State.Velocity.Z > Params.JumpCutVelocity)
+		{
+			State.Velocity.Z = Params.JumpCutVelocity;
+		}
+	}
+
+	float ComputeDroneGravityOffset(float EnginePower, float MaxEnginePower, float GravityAccel, float DeltaTime)
+	{
+		const float GravityReductionRatio = std::clamp(EnginePower / MaxEnginePower, 0.f, 1.f);
+		return -GravityAccel * DeltaTime * (1.f - GravityReductionRatio);
+	}
+
+	float DecayEnginePower(float EnginePower, float ReducingPower, float DeltaTime)
+	{
+		return EnginePower > 0.f ? std::max(EnginePower - ReducingPower * DeltaTime, 0.f) : EnginePower;
+	}
+
+	float ComputeDroneFallOffset(float EnginePower, float MaxEnginePower, float GravityAccel, float ReducingPower, float Elapsed)
+	{
+		// Power that does not change gives a constant fall rate
+		if (EnginePower <= 0.f || ReducingPower <= 0.f || MaxEnginePower <= 0.f)
+		{
+			return ComputeDroneGravityOffset(EnginePower, MaxEnginePower, GravityAccel, Elapsed);
+		}
+
+		// Above max power gravity is cancelled completely
+		const float Hover = std::min(std::max((EnginePower - MaxEnginePower) / ReducingPower, 0.f), Elapsed);
+
+		// Then the power ramps down to 0 and the share of gravity that acts ramps up with it
+		const float StartPower = std::min(EnginePower, MaxEnginePower);
+		const float Ramp = std::min(StartPower / ReducingPower, Elapsed - Hover);
+		const float RampPowerIntegral = StartPower * Ramp - 0.5f * ReducingPower * Ramp * Ramp;
+
+		// After that it is free fall
+		const float Free = Elapsed - Hover - Ramp;
+
+		return -GravityAccel * ((Ramp - RampPowerIntegral / MaxEnginePower) + Free);
+	}
+
+	float GetDroneEnginePower(const FDroneMoveState& State, const FDroneMoveParams& Params, double Time)
+	{
+		// Linear, so it is evaluated when needed instead of every step
+		return DecayEnginePower(State.EnginePower, Params.ReducingPower, static_cast<float>(std::max(Time - State.EnginePowerTime, 0.0)));
+	}
+
+	void RestampDroneEnginePower(FDroneMoveState& State, const FDroneMoveParams& Params, double Time)
+	{
+		State.EnginePower = GetDroneEnginePower(State, Params, Time);
+		State.EnginePowerTime = Time;
+	}
+
+	FQuat4 StepDroneRotation(FDroneMoveState& State, const FDroneMoveParams& Params, float DeltaTime)
+	{
+		// Eased rather than set, so the drone turns over a few frames
+		State.HeadingLayer = InterpQuat(State.HeadingLayer, MakeQuat(State.TargetPitch, State.TargetYaw, State.TargetRoll), DeltaTime, Params.HeadingInterpSpeed);
+
+		const FQuat4 TargetTilt = State.bIsGrounded ? FQuat4()
+			: MakeQuat(State.TiltForward * Params.MaxPitchAngle, 0.f, State.TiltRight * Params.MaxTiltAngle);
+		State.TiltLayer = InterpQuat(State.TiltLayer, TargetTilt, DeltaTime, Params.TiltInterpSpeed);
+
+		State.RestoreAlpha = InterpFloat(State.RestoreAlpha, State.bIsGrounded ? 1.f : 0.f, DeltaTime, Params.RestoreInterpSpeed);
+
+		// Tilt is in the drone's own frame, so it goes on after the heading
+		const FQuat4 Flying = State.HeadingLayer * State.TiltLayer;
+		if (State.RestoreAlpha <= 0.f)
+		{
+			return Flying;
+		}
+
+		const FVec3 Forward = State.HeadingLayer.RotateVector(FVec3(1.f, 0.f, 0.f));
+		const float HalfYaw = 0.5f * std::atan2(Forward.Y, Forward.X);
+		return SlerpQuat(Flying, FQuat4(0.f, 0.f, std::sin(HalfYaw), std::cos(HalfYaw)), State.RestoreAlpha);
+	}
+
+	FVec3 ComputeDroneMoveOffset(FDroneMoveState& State, const FDroneMoveParams& Params, float DeltaTime)
+	{
+		FVec3 Offset;
+		if (State.Input.MoveUp != 0.f)
+		{
+			if (State.EnginePower < Params.MaxEnginePower)
+			{
+				State.EnginePower += Params.EnginePowerPerStep;
+			}
+			Offset.Z += State.Input.MoveUp * State.EnginePower * DeltaTime;
+		}
+		if (State.Input.MoveForward != 0.f)
+		{
+			// Forward follows the target pitch, and climbing that way works against gravity
+			const FVec3 Forward = RotatorForward(State.TargetPitch, State.TargetYaw);
+			Offset += Forward * (State.Input.MoveForward * State.EnginePower * DeltaTime);
+			Offset.Z -= Forward.Z * 980.f * DeltaTime;
+		}
+		if (State.Input.MoveRight != 0.f)
+		{
+			Offset += RotatorRight(State.TargetPitch, State.TargetYaw, State.TargetRoll) * (State.Input.MoveRight * State.EnginePower * DeltaTime);
+		}
+
+		// Closed form over the whole step while the power decays, so the fall does not depend on the step length
+		Offset.Z += ComputeDroneFallOffset(State.EnginePower, Params.MaxEnginePower, Params.GravityAccel, Params.ReducingPower, DeltaTime);
+		return Offset;
+	}
+
+	FQuat4 StepDrone(FDroneMoveState& State, const FDroneMoveParams& Params, const IMovementWorld* World, double StartTime, float DeltaTime)
+	{
+		// The offsets read the power as of the start of the step
+		RestampDroneEnginePower(State, Params, StartTime);
+
+		const FQuat4 Rotation = StepDroneRotation(State, Params, DeltaTime);
+
+		// Input and gravity add up to one displacement and one sweep
+		FVec3 NewLocation = State.Location + ComputeDroneMoveOffset(State, Params, DeltaTime);
+		if (NewLocation.Z < 0.f || std::fabs(NewLocation.Z) <= 0.01f)
+		{
+			NewLocation.Z = 0.f;
+		}
+
+		if (!World)
+		{
+			State.Location = NewLocation;
+			State.bIsGrounded = State.Location.Z <= 0.f;
+			return Rotation;
+		}
+
+		SlideMove(State.Location, NewLocation - State.Location, Params.CapsuleRadius, Params.CapsuleHalfHeight, *World, Params.MaxSlideIterations, Params.SlideSkinDistance);
+
+		float FloorZ = 0.f;
+		State.bIsGrounded = World->TraceFloor(State.Location, Params.GroundProbeDistance, FloorZ);
+		return Rotation;
+	}
+
+	bool TurnDronePitch(FDroneMoveState& State, const FDroneMoveParams& Params, float AxisValue, float DeltaSeconds)
+	{
+		if (std::fabs(AxisValue) <= 1.e-8f)
+		{
+			return false;
+		}
+		State.TargetPitch = std::clamp(State.TargetPitch + AxisValue * Params.PitchSpeed * DeltaSeconds, Params.MinPitch, Params.MaxPitch);
+		return true;
+	}
+
+	bool TurnDroneYaw(FDroneMoveState& State, const FDroneMoveParams& Params, float AxisValue, float DeltaSeconds)
+	{
+		if (std::fabs(AxisValue) <= 1.e-8f)
+		{
+			return false;
+		}
+		// Wrapped, not clamped: the heading layer turns the short way round, so the drone can keep turning
+		State.TargetYaw = NormalizeAxis(State.TargetYaw + AxisValue * Params.YawSpeed * DeltaSeconds);
+		return true;
+	}
+}
@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaMovementDebug.h"
+
+#include "Components/SceneComponent.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY(LogSpartaMovement);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementDebugDraw(
+	TEXT("Sparta.Movement.DebugDraw"),
+	0,
+	TEXT("Bitmask of movement debug drawing, 0 draws nothing.\n")
+	TEXT("1: floor probes\n")
+	TEXT("2: wall contacts\n")
+	TEXT("4: move sweeps\n")
+	TEXT("Compiled out in Shipping and Test builds."),
+	ECVF_Cheat);
+
+namespace SpartaMovementDebug
+{
+	bool IsDrawEnabled(EDrawChannel Channel)
+	{
+		return (CVarSpartaMovementDebugDraw.GetValueOnGameThread() & Channel) != 0;
+	}
+
+	FTransformStats& GetTransformStats()
+	{
+		static FTransformStats Stats;
+		return Stats;
+	}
+
+	FFrameTimings& GetFrameTimings()
+	{
+		static FFrameTimings Timings;
+		return Timings;
+	}
+
+	void TrackTransformUpdates(AActor* Actor)
+	{
+		TInlineComponentArray<USceneComponent*> Components(Actor);
+		for (USceneComponent* Component : Components)
+		{
+			// Broadcast once per component whose world transform changed, also when a parent's move carries it along
+			Component->TransformUpdated.AddLambda([](USceneComponent*, EUpdateTransformFlags, ETeleportType)
+			{
+				++GetTransformStats().ComponentUpdates;
+			});
+		}
+	}
+}
@@ -0,0 +1,512 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaMovementNet.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SpartaMovement
+{
+	namespace
+	{
+		enum ENetStateFlags : uint8_t
+		{
+			NSF_Jumping = 1 << 0,
+			NSF_Sprinting = 1 << 1,
+		};
+		constexpr int32_t NumNetStateFlags = 2;
+
+		/** Payload bits of WriteSigned's four size classes */
+		constexpr int32_t SignedClassBits[4] = { 4, 9, 13, 32 };
+
+		int32_t QuantizeFloat(float Value, float Quantum)
+		{
+			return static_cast<int32_t>(std::lround(Value / Quantum));
+		}
+
+		int8_t QuantizeAxis(float Value)
+		{
+			return static_cast<int8_t>(std::lround(std::max(-1.f, std::min(Value, 1.f)) * 127.f));
+		}
+
+		uint16_t QuantizeDeltaTime(float Seconds)
+		{
+			return static_cast<uint16_t>(std::max(0L, std::min(std::lround(Seconds * 1.e4f), static_cast<long>(NetMaxInputDeltaTime))));
+		}
+
+		uint16_t QuantizeAngle(float Degrees)
+		{
+			const float Wrapped = Degrees - 360.f * std::floor(Degrees / 360.f);
+			return static_cast<uint16_t>(static_cast<uint32_t>(std::lround(Wrapped * (65536.f / 360.f))) & 0xFFFFu);
+		}
+
+		float DequantizeAngle(uint16_t Angle)
+		{
+			// -180..180, like FRotator::Normalize
+			const float Degrees = Angle * (360.f / 65536.f);
+			return Degrees > 180.f ? Degrees - 360.f : Degrees;
+		}
+
+		void WriteChangedInts(FNetBitWriter& Writer, const int32_t* Values, const int32_t* BaseValues, int32_t Num)
+		{
+			bool bChanged = false;
+			for (int32_t Index = 0; Index < Num; ++Index)
+			{
+				bChanged |= Values[Index] != BaseValues[Index];
+			}
+
+			Writer.WriteBool(bChanged);
+			if (bChanged)
+			{
+				for (int32_t Index = 0; Index < Num; ++Index)
+				{
+					// Wraps like the receiver's addition, so it stays exact for any pair of values
+					Writer.WriteSigned(static_cast<int32_t>(static_cast<uint32_t>(Values[Index]) - static_cast<uint32_t>(BaseValues[Index])));
+				}
+			}
+		}
+
+		void ReadChangedInts(FNetBitReader& Reader, int32_t* OutValues, const int32_t* BaseValues, int32_t Num)
+		{
+			const bool bChanged = Reader.ReadBool();
+			for (int32_t Index = 0; Index < Num; ++Index)
+			{
+				const int32_t Delta = bChanged ? Reader.ReadSigned() : 0;
+				OutValues[Index] = static_cast<int32_t>(static_cast<uint32_t>(BaseValues[Index]) + static_cast<uint32_t>(Delta));
+			}
+		}
+	}
+
+	void FNetBitWriter::WriteBits(uint32_t Value, int32_t Count)
+	{
+		for (int32_t Bit = 0; Bit < Count; ++Bit, ++NumBits)
+		{
+			if ((NumBits & 7) == 0)
+			{
+				Bytes.push_back(0);
+			}
+			Bytes.back() = static_cast<uint8_t>(Bytes.back() | (((Value >> Bit) & 1u) << (NumBits & 7)));
+		}
+	}
+
+	void FNetBitWriter::WriteSigned(int32_t Value)
+	{
+		const uint32_t Zigzag = (static_cast<uint32_t>(Value) << 1) ^ static_cast<uint32_t>(Value >> 31);
+		uint32_t SizeClass = 0;
+		while (SizeClass < 3 && (Zigzag >> SignedClassBits[SizeClass]) != 0)
+		{
+			++SizeClass;
+		}
+		WriteBits(SizeClass, 2);
+		WriteBits(Zigzag, SignedClassBits[SizeClass]);
+	}
+
+	uint32_t FNetBitReader::ReadBits(int32_t Count)
+	{
+		uint32_t Value = 0;
+		for (int32_t Bit = 0; Bit < Count; ++Bit, ++BitPos)
+		{
+			if ((BitPos >> 3) >= Size)
+			{
+				bOverflowed = true;
+				return 0;
+			}
+			Value |= static_cast<uint32_t>((Data[BitPos >> 3] >> (BitPos & 7)) & 1u) << Bit;
+		}
+		return Value;
+	}
+
+	int32_t FNetBitReader::ReadSigned()
+	{
+		const uint32_t Zigzag = ReadBits(SignedClassBits[ReadBits(2)]);
+		return static_cast<int32_t>(Zigzag >> 1) ^ -static_cast<int32_t>(Zigzag & 1u);
+	}
+
+	bool FQuantizedMoveState::operator==(const FQuantizedMoveState& Other) const
+	{
+		return std::equal(Location, Location + 3, Other.Location)
+			&& std::equal(Velocity, Velocity + 3, Other.Velocity)
+			&& std::equal(Rotation, Rotation + 3, Other.Rotation)
+			&& EnginePower == Other.EnginePower
+			&& Flags == Other.Flags;
+	}
+
+	FQuantizedMoveState QuantizeMoveState(const FNetMoveState& State)
+	{
+		FQuantizedMoveState Quantized;
+		Quantized.Location[0] = QuantizeFloat(State.Location.X, NetLocationQuantum);
+		Quantized.Location[1] = QuantizeFloat(State.Location.Y, NetLocationQuantum);
+		Quantized.Location[2] = QuantizeFloat(State.Location.Z, NetLocationQuantum);
+		Quantized.Velocity[0] = QuantizeFloat(State.Velocity.X, NetVelocityQuantum);
+		Quantized.Velocity[1] = QuantizeFloat(State.Velocity.Y, NetVelocityQuantum);
+		Quantized.Velocity[2] = QuantizeFloat(State.Velocity.Z, NetVelocityQuantum);
+		Quantized.Rotation[0] = QuantizeAngle(State.Yaw);
+		Quantized.Rotation[1] = QuantizeAngle(State.Pitch);
+		Quantized.Rotation[2] = QuantizeAngle(State.Roll);
+		Quantized.EnginePower = QuantizeFloat(State.EnginePower, NetEnginePowerQuantum);
+		Quantized.Flags = static_cast<uint8_t>((State.bIsJumping ? NSF_Jumping : 0) | (State.bIsSprinting ? NSF_Sprinting : 0));
+		return Quantized;
+	}
+
+	FNetMoveState DequantizeMoveState(const FQuantizedMoveState& Quantized)
+	{
+		FNetMoveState State;
+		State.Location = FVec3(Quantized.Location[0] * NetLocationQuantum, Quantized.Location[1] * NetLocationQuantum, Quantized.Location[2] * NetLocationQuantum);
+		State.Velocity = FVec3(Quantized.Velocity[0] * NetVelocityQuantum, Quantized.Velocity[1] * NetVelocityQuantum, Quantized.Velocity[2] * NetVelocityQuantum);
+		State.Yaw = DequantizeAngle(Quantized.Rotation[0]);
+		State.Pitch = DequantizeAngle(Quantized.Rotation[1]);
+		State.Roll = DequantizeAngle(Quantized.Rotation[2]);
+		State.EnginePower = Quantized.EnginePower * NetEnginePowerQuantum;
+		State.bIsJumping = (Quantized.Flags & NSF_Jumping) != 0;
+		State.bIsSprinting = (Quantized.Flags & NSF_Sprinting) != 0;
+		return State;
+	}
+
+	void WriteMoveState(FNetBitWriter& Writer, const FQuantizedMoveState& State, const FQuantizedMoveState* Baseline)
+	{
+		const FQuantizedMoveState Zero;
+		const FQuantizedMoveState& Base = Baseline ? *Baseline : Zero;
+
+		WriteChangedInts(Writer, State.Location, Base.Location, 3);
+		WriteChangedInts(Writer, State.Velocity, Base.Velocity, 3);
+
+		// Angles wrap, so their delta is taken in 16 bits
+		const bool bRotationChanged = !std::equal(State.Rotation, State.Rotation + 3, Base.Rotation);
+		Writer.WriteBool(bRotationChanged);
+		if (bRotationChanged)
+		{
+			for (int32_t Index = 0; Index < 3; ++Index)
+			{
+				Writer.WriteSigned(static_cast<int16_t>(static_cast<uint16_t>(State.Rotation[Index] - Base.Rotation[Index])));
+			}
+		}
+
+		WriteChangedInts(Writer, &State.EnginePower, &Base.EnginePower, 1);
+
+		Writer.WriteBool(State.Flags != Base.Flags);
+		if (State.Flags != Base.Flags)
+		{
+			Writer.WriteBits(State.Flags, NumNetStateFlags);
+		}
+	}
+
+	void ReadMoveState(FNetBitReader& Reader, FQuantizedMoveState& OutState, const FQuantizedMoveState* Baseline)
+	{
+		const FQuantizedMoveState Zero;
+		const FQuantizedMoveState& Base = Baseline ? *Baseline : Zero;
+
+		ReadChangedInts(Reader, OutState.Location, Base.Location, 3);
+		ReadChangedInts(Reader, OutState.Velocity, Base.Velocity, 3);
+
+		const bool bRotationChanged = Reader.ReadBool();
+		for (int32_t Index = 0; Index < 3; ++Index)
+		{
+			const int32_t Delta = bRotationChanged ? Reader.ReadSigned() : 0;
+			OutState.Rotation[Index] = static_cast<uint16_t>(Base.Rotation[Index] + Delta);
+		}
+
+		ReadChangedInts(Reader, &OutState.EnginePower, &Base.EnginePower, 1);
+
+		OutState.Flags = Reader.ReadBool() ? static_cast<uint8_t>(Reader.ReadBits(NumNetStateFlags)) : Base.Flags;
+	}
+
+	FNetMoveState ToNetMoveState(const FPawnMoveState& State)
+	{
+		FNetMoveState NetState;
+		NetState.Location = State.Location;
+		NetState.Velocity = State.Velocity;
+		NetState.Yaw = State.Yaw;
+		NetState.bIsJumping = State.bIsJumping;
+		NetState.bIsSprinting = State.bIsSprinting;
+		return NetState;
+	}
+
+	void ApplyNetMoveState(const FNetMoveState& NetState, FPawnMoveState& OutState)
+	{
+		OutState.Location = NetState.Location;
+		OutState.Velocity = NetState.Velocity;
+		OutState.Yaw = NetState.Yaw;
+		OutState.bIsJumping = NetState.bIsJumping;
+		OutState.bIsSprinting = NetState.bIsSprinting;
+	}
+
+	void SnapToNetGrid(FPawnMoveState& State)
+	{
+		ApplyNetMoveState(DequantizeMoveState(QuantizeMoveState(ToNetMoveState(State))), State);
+	}
+
+	void FNetPawnInput::Set(float InMoveX, float InMoveY, float InControlYaw, float InDeltaTime, bool bInJump, bool bInJumpRelease, bool bInSprint)
+	{
+		MoveX = QuantizeAxis(InMoveX);
+		MoveY = QuantizeAxis(InMoveY);
+		ControlYaw = QuantizeAngle(InControlYaw);
+		DeltaTime = QuantizeDeltaTime(InDeltaTime);
+		bJump = bInJump;
+		bJumpRelease = bInJumpRelease;
+		bSprint = bInSprint;
+	}
+
+	void WriteInput(FNetBitWriter& Writer, const FNetPawnInput& Input, const FNetPawnInput* Newer)
+	{
+		if (Newer)
+		{
+			const bool bSame = Input.MoveX == Newer->MoveX && Input.MoveY == Newer->MoveY && Input.ControlYaw == Newer->ControlYaw
+				&& Input.DeltaTime == Newer->DeltaTime && Input.bJump == Newer->bJump && Input.bJumpRelease == Newer->bJumpRelease
+				&& Input.bSprint == Newer->bSprint;
+			Writer.WriteBool(bSame);
+			if (bSame)
+			{
+				return;
+			}
+		}
+		else
+		{
+			Writer.WriteBits(Input.Sequence, 16);
+		}
+
+		Writer.WriteBits(static_cast<uint8_t>(Input.MoveX), 8);
+		Writer.WriteBits(static_cast<uint8_t>(Input.MoveY), 8);
+		Writer.WriteBits(Input.ControlYaw, 16);
+		Writer.WriteBits(Input.DeltaTime, 16);
+		Writer.WriteBool(Input.bJump);
+		Writer.WriteBool(Input.bJumpRelease);
+		Writer.WriteBool(Input.bSprint);
+	}
+
+	void ReadInput(FNetBitReader& Reader, FNetPawnInput& OutInput, const FNetPawnInput* Newer)
+	{
+		if (Newer)
+		{
+			const uint16_t Sequence = static_cast<uint16_t>(Newer->Sequence - 1);
+			if (Reader.ReadBool())
+			{
+				OutInput = *Newer;
+				OutInput.Sequence = Sequence;
+				return;
+			}
+			OutInput.Sequence = Sequence;
+		}
+		else
+		{
+			OutInput.Sequence = static_cast<uint16_t>(Reader.ReadBits(16));
+		}
+
+		OutInput.MoveX = static_cast<int8_t>(Reader.ReadBits(8));
+		OutInput.MoveY = static_cast<int8_t>(Reader.ReadBits(8));
+		OutInput.ControlYaw = static_cast<uint16_t>(Reader.ReadBits(16));
+		OutInput.DeltaTime = static_cast<uint16_t>(Reader.ReadBits(16));
+		OutInput.bJump = Reader.ReadBool();
+		OutInput.bJumpRelease = Reader.ReadBool();
+		OutInput.bSprint = Reader.ReadBool();
+	}
+
+	void StepPawnInput(FPawnMoveState& State, const FPawnMoveParams& Params, const FNetPawnInput& Input, const IMovementWorld& World)
+	{
+		const float DeltaTime = Input.GetDeltaTime();
+		if (Input.bJump)
+		{
+			StartJump(State, Params);
+		}
+		if (Input.bJumpRelease)
+		{
+			// Only cuts a jump still rising faster than JumpCutVelocity
+			StopJump(State, Params);
+		}
+		State.bIsSprinting = Input.bSprint;
+
+		if (Input.MoveX != 0 || Input.MoveY != 0)
+		{
+			const FVec3 Displacement = ComputeWalkDisplacement(State, Params, Input.GetControlYaw(), Input.GetMoveX(), Input.GetMoveY(), DeltaTime);
+			SlidePawn(State, Params, Displacement, World);
+		}
+
+		// No coherence: its memory is not replicated, and client and server must query alike
+		TickPawn(State, Params, World, DeltaTime);
+	}
+
+	FNetMoveState ToNetMoveState(const FDroneMoveState& State, const FDroneMoveParams& Params, double Time)
+	{
+		FNetMoveState NetState;
+		NetState.Location = State.Location;
+		NetState.EnginePower = GetDroneEnginePower(State, Params, Time);
+		return NetState;
+	}
+
+	void ApplyNetMoveState(const FNetMoveState& NetState, FDroneMoveState& OutState, double Time)
+	{
+		OutState.Location = NetState.Location;
+		OutState.EnginePower = NetState.EnginePower;
+		OutState.EnginePowerTime = Time;
+	}
+
+	void SnapToNetGrid(FDroneMoveState& State, const FDroneMoveParams& Params, double Time)
+	{
+		ApplyNetMoveState(DequantizeMoveState(QuantizeMoveState(ToNetMoveState(State, Params, Time))), State, Time);
+	}
+
+	void FNetDroneInput::Set(const FDroneMoveState& State, float InDeltaTime)
+	{
+		MoveUp = QuantizeAxis(State.Input.MoveUp);
+		MoveForward = QuantizeAxis(State.Input.MoveForward);
+		MoveRight = QuantizeAxis(State.Input.MoveRight);
+		TiltForward = QuantizeAxis(State.TiltForward);
+		TiltRight = QuantizeAxis(State.TiltRight);
+		TargetPitch = QuantizeAngle(State.TargetPitch);
+		TargetYaw = QuantizeAngle(State.TargetYaw);
+		DeltaTime = QuantizeDeltaTime(InDeltaTime);
+	}
+
+	void WriteInput(FNetBitWriter& Writer, const FNetDroneInput& Input, const FNetDroneInput* Newer)
+	{
+		if (Newer)
+		{
+			const bool bSame = Input.MoveUp == Newer->MoveUp && Input.MoveForward == Newer->MoveForward && Input.MoveRight == Newer->MoveRight
+				&& Input.TiltForward == Newer->TiltForward && Input.TiltRight == Newer->TiltRight
+				&& Input.TargetPitch == Newer->TargetPitch && Input.TargetYaw == Newer->TargetYaw && Input.DeltaTime == Newer->DeltaTime;
+			Writer.WriteBool(bSame);
+			if (bSame)
+			{
+				return;
+			}
+		}
+		else
+		{
+			Writer.WriteBits(Input.Sequence, 16);
+		}
+
+		Writer.WriteBits(static_cast<uint8_t>(Input.MoveUp), 8);
+		Writer.WriteBits(static_cast<uint8_t>(Input.MoveForward), 8);
+		Writer.WriteBits(static_cast<uint8_t>(Input.MoveRight), 8);
+		Writer.WriteBits(static_cast<uint8_t>(Input.TiltForward), 8);
+		Writer.WriteBits(static_cast<uint8_t>(Input.TiltRight), 8);
+		Writer.WriteBits(Input.TargetPitch, 16);
+		Writer.WriteBits(Input.TargetYaw, 16);
+		Writer.WriteBits(Input.DeltaTime, 16);
+	}
+
+	void ReadInput(FNetBitReader& Reader, FNetDroneInput& OutInput, const FNetDroneInput* Newer)
+	{
+		if (Newer)
+		{
+			const uint16_t Sequence = static_cast<uint16_t>(Newer->Sequence - 1);
+			if (Reader.ReadBool())
+			{
+				OutInput = *Newer;
+				OutInput.Sequence = Sequence;
+				return;
+			}
+			OutInput.Sequence = Sequence;
+		}
+		else
+		{
+			OutInput.Sequence = static_cast<uint16_t>(Reader.ReadBits(16));
+		}
+
+		OutInput.MoveUp = static_cast<int8_t>(Reader.ReadBits(8));
+		OutInput.MoveForward = static_cast<int8_t>(Reader.ReadBits(8));
+		OutInput.MoveRight = static_cast<int8_t>(Reader.ReadBits(8));
+		OutInput.TiltForward = static_cast<int8_t>(Reader.ReadBits(8));
+		OutInput.TiltRight = static_cast<int8_t>(Reader.ReadBits(8));
+		OutInput.TargetPitch = static_cast<uint16_t>(Reader.ReadBits(16));
+		OutInput.TargetYaw = static_cast<uint16_t>(Reader.ReadBits(16));
+		OutInput.DeltaTime = static_cast<uint16_t>(Reader.ReadBits(16));
+	}
+
+	FQuat4 StepDroneInput(FDroneMoveState& State, const FDroneMoveParams& Params, const FNetDroneInput& Input, const IMovementWorld& World, double StartTime)
+	{
+		State.Input.MoveUp = Input.MoveUp / 127.f;
+		State.Input.MoveForward = Input.MoveForward / 127.f;
+		State.Input.MoveRight = Input.MoveRight / 127.f;
+		State.TiltForward = Input.TiltForward / 127.f;
+		State.TiltRight = Input.TiltRight / 127.f;
+		State.TargetPitch = DequantizeAngle(Input.TargetPitch);
+		State.TargetYaw = DequantizeAngle(Input.TargetYaw);
+
+		// Always swept: client and server must query alike, so significance does not apply
+		return StepDrone(State, Params, &World, StartTime, Input.GetDeltaTime());
+	}
+
+	void WriteSnapshotHeader(FNetBitWriter& Writer, const FNetSnapshotHeader& Header)
+	{
+		Writer.WriteBits(Header.Sequence, 16);
+		Writer.WriteBool(Header.bHasBaseline);
+		if (Header.bHasBaseline)
+		{
+			Writer.WriteBits(Header.Baseline, 16);
+		}
+		Writer.WriteBits(Header.AckedInput, 16);
+	}
+
+	void ReadSnapshotHeader(FNetBitReader& Reader, FNetSnapshotHeader& OutHeader)
+	{
+		OutHeader.Sequence = static_cast<uint16_t>(Reader.ReadBits(16));
+		OutHeader.bHasBaseline = Reader.ReadBool();
+		OutHeader.Baseline = OutHeader.bHasBaseline ? static_cast<uint16_t>(Reader.ReadBits(16)) : 0;
+		OutHeader.AckedInput = static_cast<uint16_t>(Reader.ReadBits(16));
+	}
+
+	void FNetSnapshotRing::Add(uint16_t Sequence, const FQuantizedMoveState& State)
+	{
+		const int32_t Slot = Sequence % NetSnapshotHistory;
+		States[Slot] = State;
+		Sequences[Slot] = Sequence;
+		bValid[Slot] = true;
+	}
+
+	const FQuantizedMoveState* FNetSnapshotRing::Find(uint16_t Sequence) const
+	{
+		const int32_t Slot = Sequence % NetSnapshotHistory;
+		return bValid[Slot] && Sequences[Slot] == Sequence ? &States[Slot] : nullptr;
+	}
+
+	void FNetSnapshotSender::WriteSnapshot(FNetBitWriter& Writer, const FQuantizedMoveState& State, uint16_t AckedInput, const uint16_t* AckedSnapshot)
+	{
+		++Sequence;
+
+		// The slot the new snapshot takes may still hold the acknowledged one, so the delta is written before Add
+		const bool bInHistory = AckedSnapshot && static_cast<uint16_t>(Sequence - *AckedSnapshot) < NetSnapshotHistory;
+		const FQuantizedMoveState* Baseline = bInHistory ? Sent.Find(*AckedSnapshot) : nullptr;
+
+		FNetSnapshotHeader Header;
+		Header.Sequence = Sequence;
+		Header.bHasBaseline = Baseline != nullptr;
+		Header.Baseline = Baseline ? *AckedSnapshot : 0;
+		Header.AckedInput = AckedInput;
+		WriteSnapshotHeader(Writer, Header);
+		WriteMoveState(Writer, State, Baseline);
+
+		Sent.Add(Sequence, State);
+	}
+
+	bool FNetSnapshotReceiver::ReadSnapshot(FNetBitReader& Reader, FQuantizedMoveState& OutState, uint16_t& OutAckedInput)
+	{
+		FNetSnapshotHeader Header;
+		ReadSnapshotHeader(Reader, Header);
+
+		// The server only deltas against acknowledged snapshots, which are still here
+		const FQuantizedMoveState* Baseline = Header.bHasBaseline ? Received.Find(Header.Baseline) : nullptr;
+		if (Header.bHasBaseline && !Baseline)
+		{
+			return false;
+		}
+
+		FQuantizedMoveState State;
+		ReadMoveState(Reader, State, Baseline);
+		if (Reader.IsOverflowed())
+		{
+			return false;
+		}
+		Received.Add(Header.Sequence, State);
+
+		if (bHasSnapshot && !IsSequenceNewer(Header.Sequence, NewestSnapshot))
+		{
+			return false;
+		}
+		NewestSnapshot = Header.Sequence;
+		bHasSnapshot = true;
+
+		OutState = State;
+		OutAckedInput = Header.AckedInput;
+		return true;
+	}
+}
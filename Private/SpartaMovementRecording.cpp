@@ -0,0 +1,733 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaMovementRecording.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace SpartaMovement
+{
+	namespace
+	{
+		const uint8_t RecordingMagic[4] = { 'S', 'P', 'R', 'L' };
+		constexpr uint8_t RecordingVersion = 2;
+
+		/** Replayed locations further than this (cm) from the recorded ones count as diverged */
+		constexpr float DivergenceTolerance = 1.e-3f;
+
+		enum EPawnStateFlags : uint8_t
+		{
+			PSF_Jumping = 1 << 0,
+			PSF_Sprinting = 1 << 1,
+		};
+
+		/** Bounds-checked little-endian reads; a short read latches bBad and returns zeros */
+		struct FRecordReader
+		{
+			const uint8_t* Cursor = nullptr;
+			const uint8_t* End = nullptr;
+			bool bBad = false;
+			double Time = 0.0;
+
+			bool AtEnd() const { return Cursor >= End; }
+
+			ERecordTag PeekTag() const { return AtEnd() ? ERecordTag(0) : static_cast<ERecordTag>(*Cursor); }
+
+			uint8_t ReadByte()
+			{
+				if (AtEnd())
+				{
+					bBad = true;
+					return 0;
+				}
+				return *Cursor++;
+			}
+
+			void ReadBytes(void* Out, size_t Count)
+			{
+				if (static_cast<size_t>(End - Cursor) < Count)
+				{
+					bBad = true;
+					std::memset(Out, 0, Count);
+					Cursor = End;
+					return;
+				}
+				std::memcpy(Out, Cursor, Count);
+				Cursor += Count;
+			}
+
+			float ReadFloat()
+			{
+				float Value = 0.f;
+				ReadBytes(&Value, sizeof(Value));
+				return Value;
+			}
+
+			FVec3 ReadVec3()
+			{
+				FVec3 Value;
+				Value.X = ReadFloat();
+				Value.Y = ReadFloat();
+				Value.Z = ReadFloat();
+				return Value;
+			}
+
+			/** Zigzag LEB128 microseconds since the previous timestamp */
+			void ReadTime()
+			{
+				uint64_t Encoded = 0;
+				for (int32_t Shift = 0; Shift < 64; Shift += 7)
+				{
+					const uint8_t Byte = ReadByte();
+					Encoded |= static_cast<uint64_t>(Byte & 0x7F) << Shift;
+					if (!(Byte & 0x80))
+					{
+						break;
+					}
+				}
+				const int64_t Micros = static_cast<int64_t>(Encoded >> 1) ^ -static_cast<int64_t>(Encoded & 1);
+				Time += static_cast<double>(Micros) * 1.e-6;
+			}
+
+			void ReadPawnState(FPawnMoveState& OutState)
+			{
+				OutState.Location = ReadVec3();
+				OutState.Velocity = ReadVec3();
+				OutState.Yaw = ReadFloat();
+				OutState.CurrentFloorZ = ReadFloat();
+				const uint8_t Flags = ReadByte();
+				OutState.bIsJumping = (Flags & PSF_Jumping) != 0;
+				OutState.bIsSprinting = (Flags & PSF_Sprinting) != 0;
+			}
+
+			FQuat4 ReadQuat()
+			{
+				FQuat4 Value;
+				Value.X = ReadFloat();
+				Value.Y = ReadFloat();
+				Value.Z = ReadFloat();
+				Value.W = ReadFloat();
+				return Value;
+			}
+
+			void ReadDroneState(FDroneMoveState& OutState)
+			{
+				OutState.Location = ReadVec3();
+				OutState.HeadingLayer = ReadQuat();
+				OutState.TiltLayer = ReadQuat();
+				OutState.RestoreAlpha = ReadFloat();
+				OutState.TargetPitch = ReadFloat();
+				OutState.TargetYaw = ReadFloat();
+				OutState.TargetRoll = ReadFloat();
+				OutState.EnginePower = ReadFloat();
+				ReadBytes(&OutState.EnginePowerTime, sizeof(OutState.EnginePowerTime));
+				OutState.Input.MoveUp = ReadFloat();
+				OutState.Input.MoveForward = ReadFloat();
+				OutState.Input.MoveRight = ReadFloat();
+				OutState.TiltForward = ReadFloat();
+				OutState.TiltRight = ReadFloat();
+				OutState.bIsGrounded = ReadByte() != 0;
+			}
+
+			/** Raw tunables, refused unless the recorded size matches */
+			bool ReadParams(void* OutParams, uint16_t Size)
+			{
+				uint16_t RecordedSize = 0;
+				ReadBytes(&RecordedSize, sizeof(RecordedSize));
+				if (RecordedSize != Size)
+				{
+					return false;
+				}
+				ReadBytes(OutParams, Size);
+				return true;
+			}
+
+			/** Consumes one world answer. Returns false if the next record is not one. */
+			bool SkipAnswer()
+			{
+				FWallContact Contacts[MaxWallContacts];
+				FSweepHit Hit;
+				float FloorZ = 0.f;
+				switch (PeekTag())
+				{
+				case ERecordTag::FloorAnswer:
+					ReadByte();
+					ReadFloorAnswer(FloorZ);
+					return true;
+				case ERecordTag::OverlapAnswer:
+					ReadByte();
+					ReadOverlapAnswer(Contacts, MaxWallContacts);
+					return true;
+				case ERecordTag::SweepAnswer:
+					ReadByte();
+					ReadSweepAnswer(Hit);
+					return true;
+				default:
+					return false;
+				}
+			}
+
+			bool ReadFloorAnswer(float& OutFloorZ)
+			{
+				const bool bHit = ReadByte() != 0;
+				if (bHit)
+				{
+					OutFloorZ = ReadFloat();
+				}
+				return bHit;
+			}
+
+			int32_t ReadOverlapAnswer(FWallContact* OutContacts, int32_t MaxContacts)
+			{
+				const int32_t NumRecorded = ReadByte();
+				int32_t NumContacts = 0;
+				for (int32_t Index = 0; Index < NumRecorded; ++Index)
+				{
+					FWallContact Contact;
+					Contact.ImpactPoint = ReadVec3();
+					Contact.Normal = ReadVec3();
+					Contact.Distance = ReadFloat();
+					Contact.Penetration = ReadFloat();
+					Contact.bMovable = ReadByte() != 0;
+					if (NumContacts < MaxContacts)
+					{
+						OutContacts[NumContacts++] = Contact;
+					}
+				}
+				return NumContacts;
+			}
+
+			bool ReadSweepAnswer(FSweepHit& OutHit)
+			{
+				const bool bHit = ReadByte() != 0;
+				if (bHit)
+				{
+					OutHit.Time = ReadFloat();
+					OutHit.Normal = ReadVec3();
+					OutHit.bStartPenetrating = ReadByte() != 0;
+					OutHit.Penetration = ReadFloat();
+				}
+				return bHit;
+			}
+		};
+
+		/** Answers queries from the recording, in the order they were recorded */
+		class FReplayWorld : public IMovementWorld
+		{
+		public:
+			FReplayWorld(FRecordReader& InReader, int32_t& InMismatches) : Reader(InReader), Mismatches(InMismatches) {}
+
+			virtual bool TraceFloor(const FVec3& /*Start*/, float /*Distance*/, float& OutFloorZ) const override
+			{
+				if (!Expect(ERecordTag::FloorAnswer))
+				{
+					return false;
+				}
+				return Reader.ReadFloorAnswer(OutFloorZ);
+			}
+
+			virtual int32_t OverlapCapsule(const FVec3& /*Center*/, float /*Radius*/, float /*HalfHeight*/, FWallContact* OutContacts, int32_t MaxContacts) const override
+			{
+				if (!Expect(ERecordTag::OverlapAnswer))
+				{
+					return 0;
+				}
+				return Reader.ReadOverlapAnswer(OutContacts, MaxContacts);
+			}
+
+			virtual bool SweepCapsule(const FVec3& /*Start*/, const FVec3& /*End*/, float /*Radius*/, float /*HalfHeight*/, FSweepHit& OutHit) const override
+			{
+				if (!Expect(ERecordTag::SweepAnswer))
+				{
+					return false;
+				}
+				return Reader.ReadSweepAnswer(OutHit);
+			}
+
+		private:
+			bool Expect(ERecordTag Tag) const
+			{
+				if (Reader.PeekTag() != Tag)
+				{
+					// Nothing recorded for this query here: answer "nothing there" and leave the log alone
+					++Mismatches;
+					return false;
+				}
+				Reader.ReadByte();
+				return true;
+			}
+
+			FRecordReader& Reader;
+			int32_t& Mismatches;
+		};
+
+		void ReplayPawnInput(ERecordTag Tag, const float* Values, FPawnMoveState& State, const FPawnMoveParams& Params, const IMovementWorld& World)
+		{
+			// Same as the ASpartaPawn input handlers past the point they record
+			switch (Tag)
+			{
+			case ERecordTag::PawnMove:
+			{
+				const FVec3 Offset = ComputeWalkDisplacement(State, Params, Values[2], Values[0], Values[1], Values[3]);
+				SlidePawn(State, Params, Offset, World);
+				break;
+			}
+			case ERecordTag::PawnJumpStart:
+				StartJump(State, Params);
+				break;
+			case ERecordTag::PawnJumpStop:
+				if (State.bIsJumping && Values[0] == 0.f && State.Velocity.Z > Params.JumpCutVelocity)
+				{
+					StopJump(State, Params);
+				}
+				break;
+			case ERecordTag::PawnSprintStart:
+				State.bIsSprinting = true;
+				break;
+			case ERecordTag::PawnSprintStop:
+				State.bIsSprinting = false;
+				break;
+			default:
+				// Look turns the controller, which Move records as ControlYaw
+				break;
+			}
+		}
+
+		void ReplayDroneInput(ERecordTag Tag, const float* Values, FDroneMoveState& State, const FDroneMoveParams& Params)
+		{
+			// Same as the ASpartaDrone input handlers past the point they record
+			switch (Tag)
+			{
+			case ERecordTag::DroneMoveUp:
+				State.Input.MoveUp = Values[0];
+				break;
+			case ERecordTag::DroneMoveForward:
+				State.Input.MoveForward = State.TiltForward = Values[0];
+				break;
+			case ERecordTag::DroneMoveRight:
+				State.Input.MoveRight = State.TiltRight = Values[0];
+				break;
+			case ERecordTag::DroneLookPitch:
+				TurnDronePitch(State, Params, Values[0], Values[1]);
+				break;
+			case ERecordTag::DroneLookYaw:
+				TurnDroneYaw(State, Params, Values[0], Values[1]);
+				break;
+			case ERecordTag::DroneInputConsumed:
+				State.Input.Reset();
+				break;
+			default:
+				break;
+			}
+		}
+
+		/** Adds one step's replayed-vs-recorded location error to Result */
+		void CheckStep(const FVec3& Replayed, const FVec3& Recorded, int32_t Step, FReplayResult& Result)
+		{
+			const float Error = (Replayed - Recorded).Size();
+			Result.MaxLocationError = std::max(Result.MaxLocationError, Error);
+			if (Error > DivergenceTolerance && Result.FirstDivergentStep < 0)
+			{
+				Result.FirstDivergentStep = Step;
+			}
+		}
+
+		void ReplayPass(const uint8_t* Data, size_t Size, bool bResync, FReplayResult& Result)
+		{
+			FRecordReader Reader;
+			Reader.Cursor = Data;
+			Reader.End = Data + Size;
+
+			uint8_t Magic[4] = {};
+			Reader.ReadBytes(Magic, sizeof(Magic));
+			if (std::memcmp(Magic, RecordingMagic, sizeof(Magic)) != 0 || Reader.ReadByte() != RecordingVersion)
+			{
+				Result.Error = "not a movement recording, or another version";
+				return;
+			}
+
+			Result.Actor = static_cast<ERecordedActor>(Reader.ReadByte());
+			Result.bResimulated = true;
+
+			FPawnMoveParams Params;
+			FDroneMoveParams DroneParams;
+			if (Result.Actor == ERecordedActor::Pawn ? !Reader.ReadParams(&Params, sizeof(Params)) : !Reader.ReadParams(&DroneParams, sizeof(DroneParams)))
+			{
+				Result.Error = Result.Actor == ERecordedActor::Pawn ? "recorded with another FPawnMoveParams layout" : "recorded with another FDroneMoveParams layout";
+				return;
+			}
+			Reader.ReadBytes(&Reader.Time, sizeof(Reader.Time));
+			const double FirstTime = Reader.Time;
+
+			FPawnMoveState State;
+			FPawnMoveState Recorded;
+			FDroneMoveState DroneState;
+			FDroneMoveState RecordedDrone;
+			FCollisionCoherence Coherence;
+			const FReplayWorld World(Reader, Result.QueryMismatches);
+
+			while (!Reader.AtEnd() && !Reader.bBad)
+			{
+				const ERecordTag Tag = static_cast<ERecordTag>(Reader.ReadByte());
+				switch (Tag)
+				{
+				case ERecordTag::PawnState:
+					// Outside a step: the state recording started from
+					Reader.ReadPawnState(State);
+					break;
+
+				case ERecordTag::DroneState:
+					Reader.ReadDroneState(DroneState);
+					break;
+
+				case ERecordTag::StepBegin:
+				{
+					Reader.ReadBytes(&Reader.Time, sizeof(Reader.Time));
+					const float DeltaTime = Reader.ReadFloat();
+					const uint8_t Flags = Reader.ReadByte();
+					const int32_t Step = Result.NumSteps++;
+
+					if (Result.Actor == ERecordedActor::Pawn)
+					{
+						if (Flags & StepQueriesWorld)
+						{
+							UpdateFloorZ(State, Params, World);
+							CheckCollision(State, Params, World, (Flags & StepCollisionCoherence) ? &Coherence : nullptr);
+						}
+						Integrate(State, Params, DeltaTime);
+					}
+					else
+					{
+						StepDrone(DroneState, DroneParams, (Flags & StepQueriesWorld) ? &World : nullptr, Reader.Time, DeltaTime);
+					}
+
+					// Answers the replay did not ask for
+					while (Reader.SkipAnswer())
+					{
+						++Result.QueryMismatches;
+					}
+
+					const ERecordTag EndTag = static_cast<ERecordTag>(Reader.ReadByte());
+					if (EndTag == ERecordTag::PawnState)
+					{
+						Reader.ReadPawnState(Recorded);
+						CheckStep(State.Location, Recorded.Location, Step, Result);
+						if (bResync)
+						{
+							State = Recorded;
+						}
+					}
+					else if (EndTag == ERecordTag::DroneState)
+					{
+						Reader.ReadDroneState(RecordedDrone);
+						CheckStep(DroneState.Location, RecordedDrone.Location, Step, Result);
+						if (bResync)
+						{
+							DroneState = RecordedDrone;
+						}
+					}
+					else
+					{
+						Result.Error = "step without an end state";
+						return;
+					}
+					break;
+				}
+
+				case ERecordTag::FloorAnswer:
+				case ERecordTag::OverlapAnswer:
+				case ERecordTag::SweepAnswer:
+					--Reader.Cursor;
+					Reader.SkipAnswer();
+					++Result.QueryMismatches;
+					break;
+
+				default:
+				{
+					const int32_t NumValues = GetNumRecordValues(Tag);
+					if (NumValues < 0)
+					{
+						Result.Error = "unknown record";
+						return;
+					}
+
+					Reader.ReadTime();
+					float Values[4] = {};
+					for (int32_t Index = 0; Index < NumValues; ++Index)
+					{
+						Values[Index] = Reader.ReadFloat();
+					}
+					++Result.NumInputs;
+
+					if (Result.Actor == ERecordedActor::Pawn)
+					{
+						ReplayPawnInput(Tag, Values, State, Params, World);
+					}
+					else
+					{
+						ReplayDroneInput(Tag, Values, DroneState, DroneParams);
+					}
+					break;
+				}
+				}
+			}
+
+			if (Reader.bBad)
+			{
+				Result.Error = "truncated";
+			}
+
+			Result.RecordedSeconds = Reader.Time - FirstTime;
+			const FVec3 Final = Result.Actor == ERecordedActor::Pawn ? State.Location : DroneState.Location;
+			Result.Checksum = static_cast<double>(Final.X) + Final.Y + Final.Z;
+		}
+	}
+
+	int32_t GetNumRecordValues(ERecordTag Tag)
+	{
+		switch (Tag)
+		{
+		case ERecordTag::PawnMove:
+			return 4;
+		case ERecordTag::PawnLook:
+			return 2;
+		case ERecordTag::PawnJumpStart:
+		case ERecordTag::PawnSprintStart:
+		case ERecordTag::PawnSprintStop:
+		case ERecordTag::DroneInputConsumed:
+			return 0;
+		case ERecordTag::PawnJumpStop:
+		case ERecordTag::DroneMoveUp:
+		case ERecordTag::DroneMoveForward:
+		case ERecordTag::DroneMoveRight:
+			return 1;
+		case ERecordTag::DroneLookPitch:
+		case ERecordTag::DroneLookYaw:
+			return 2;
+		default:
+			return -1;
+		}
+	}
+
+	void FMovementRecorder::BeginPawn(const FPawnMoveParams& Params, const FPawnMoveState& State, double Time)
+	{
+		Data.clear();
+		Data.insert(Data.end(), RecordingMagic, RecordingMagic + sizeof(RecordingMagic));
+		WriteByte(RecordingVersion);
+		WriteByte(static_cast<uint8_t>(ERecordedActor::Pawn));
+		WriteParams(&Params, sizeof(Params));
+
+		const uint8_t* TimeBytes = reinterpret_cast<const uint8_t*>(&Time);
+		Data.insert(Data.end(), TimeBytes, TimeBytes + sizeof(Time));
+		LastTime = Time;
+
+		WriteByte(static_cast<uint8_t>(ERecordTag::PawnState));
+		WritePawnState(State);
+	}
+
+	void FMovementRecorder::BeginDrone(const FDroneMoveParams& Params, const FDroneMoveState& State, double Time)
+	{
+		Data.clear();
+		Data.insert(Data.end(), RecordingMagic, RecordingMagic + sizeof(RecordingMagic));
+		WriteByte(RecordingVersion);
+		WriteByte(static_cast<uint8_t>(ERecordedActor::Drone));
+		WriteParams(&Params, sizeof(Params));
+
+		const uint8_t* TimeBytes = reinterpret_cast<const uint8_t*>(&Time);
+		Data.insert(Data.end(), TimeBytes, TimeBytes + sizeof(Time));
+		LastTime = Time;
+
+		EndDroneStep(State);
+	}
+
+	void FMovementRecorder::RecordInput(ERecordTag Tag, double Time, const float* Values)
+	{
+		WriteByte(static_cast<uint8_t>(Tag));
+		WriteTime(Time);
+		for (int32_t Index = 0; Index < GetNumRecordValues(Tag); ++Index)
+		{
+			WriteFloat(Values[Index]);
+		}
+	}
+
+	void FMovementRecorder::BeginStep(double Time, float DeltaTime, uint8_t Flags)
+	{
+		WriteByte(static_cast<uint8_t>(ERecordTag::StepBegin));
+
+		// Exact: drone steps decay the engine power over the time since the last step
+		const uint8_t* TimeBytes = reinterpret_cast<const uint8_t*>(&Time);
+		Data.insert(Data.end(), TimeBytes, TimeBytes + sizeof(Time));
+		LastTime = Time;
+		WriteFloat(DeltaTime);
+		WriteByte(Flags);
+	}
+
+	void FMovementRecorder::EndPawnStep(const FPawnMoveState& State)
+	{
+		WriteByte(static_cast<uint8_t>(ERecordTag::PawnState));
+		WritePawnState(State);
+	}
+
+	void FMovementRecorder::EndDroneStep(const FDroneMoveState& State)
+	{
+		WriteByte(static_cast<uint8_t>(ERecordTag::DroneState));
+		WriteDroneState(State);
+	}
+
+	void FMovementRecorder::RecordFloor(bool bHit, float FloorZ)
+	{
+		WriteByte(static_cast<uint8_t>(ERecordTag::FloorAnswer));
+		WriteByte(bHit ? 1 : 0);
+		if (bHit)
+		{
+			WriteFloat(FloorZ);
+		}
+	}
+
+	void FMovementRecorder::RecordOverlap(const FWallContact* Contacts, int32_t NumContacts)
+	{
+		WriteByte(static_cast<uint8_t>(ERecordTag::OverlapAnswer));
+		WriteByte(static_cast<uint8_t>(NumContacts));
+		for (int32_t Index = 0; Index < NumContacts; ++Index)
+		{
+			const FWallContact& Contact = Contacts[Index];
+			WriteVec3(Contact.ImpactPoint);
+			WriteVec3(Contact.Normal);
+			WriteFloat(Contact.Distance);
+			WriteFloat(Contact.Penetration);
+			WriteByte(Contact.bMovable ? 1 : 0);
+		}
+	}
+
+	void FMovementRecorder::RecordSweep(bool bHit, const FSweepHit& Hit)
+	{
+		WriteByte(static_cast<uint8_t>(ERecordTag::SweepAnswer));
+		WriteByte(bHit ? 1 : 0);
+		if (bHit)
+		{
+			WriteFloat(Hit.Time);
+			WriteVec3(Hit.Normal);
+			WriteByte(Hit.bStartPenetrating ? 1 : 0);
+			WriteFloat(Hit.Penetration);
+		}
+	}
+
+	void FMovementRecorder::WriteTime(double Time)
+	{
+		// Drone steps start before the inputs of their frame, so deltas can be negative
+		const int64_t Micros = static_cast<int64_t>(std::llround((Time - LastTime) * 1.e6));
+		LastTime += static_cast<double>(Micros) * 1.e-6;
+
+		uint64_t Encoded = (static_cast<uint64_t>(Micros) << 1) ^ static_cast<uint64_t>(Micros >> 63);
+		do
+		{
+			const uint8_t Byte = static_cast<uint8_t>(Encoded & 0x7F);
+			Encoded >>= 7;
+			WriteByte(Encoded ? (Byte | 0x80) : Byte);
+		}
+		while (Encoded);
+	}
+
+	void FMovementRecorder::WriteFloat(float Value)
+	{
+		const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(&Value);
+		Data.insert(Data.end(), Bytes, Bytes + sizeof(Value));
+	}
+
+	void FMovementRecorder::WriteVec3(const FVec3& Value)
+	{
+		WriteFloat(Value.X);
+		WriteFloat(Value.Y);
+		WriteFloat(Value.Z);
+	}
+
+	void FMovementRecorder::WritePawnState(const FPawnMoveState& State)
+	{
+		WriteVec3(State.Location);
+		WriteVec3(State.Velocity);
+		WriteFloat(State.Yaw);
+		WriteFloat(State.CurrentFloorZ);
+		WriteByte(static_cast<uint8_t>((State.bIsJumping ? PSF_Jumping : 0) | (State.bIsSprinting ? PSF_Sprinting : 0)));
+	}
+
+	void FMovementRecorder::WriteDroneState(const FDroneMoveState& State)
+	{
+		// Everything the next step reads, so a resync can start it from here
+		WriteVec3(State.Location);
+		WriteQuat(State.HeadingLayer);
+		WriteQuat(State.TiltLayer);
+		WriteFloat(State.RestoreAlpha);
+		WriteFloat(State.TargetPitch);
+		WriteFloat(State.TargetYaw);
+		WriteFloat(State.TargetRoll);
+		WriteFloat(State.EnginePower);
+		const uint8_t* TimeBytes = reinterpret_cast<const uint8_t*>(&State.EnginePowerTime);
+		Data.insert(Data.end(), TimeBytes, TimeBytes + sizeof(State.EnginePowerTime));
+		WriteFloat(State.Input.MoveUp);
+		WriteFloat(State.Input.MoveForward);
+		WriteFloat(State.Input.MoveRight);
+		WriteFloat(State.TiltForward);
+		WriteFloat(State.TiltRight);
+		WriteByte(State.bIsGrounded ? 1 : 0);
+	}
+
+	void FMovementRecorder::WriteQuat(const FQuat4& Value)
+	{
+		WriteFloat(Value.X);
+		WriteFloat(Value.Y);
+		WriteFloat(Value.Z);
+		WriteFloat(Value.W);
+	}
+
+	void FMovementRecorder::WriteParams(const void* Params, uint16_t Size)
+	{
+		const uint8_t* SizeBytes = reinterpret_cast<const uint8_t*>(&Size);
+		const uint8_t* ParamsBytes = static_cast<const uint8_t*>(Params);
+		Data.insert(Data.end(), SizeBytes, SizeBytes + sizeof(Size));
+		Data.insert(Data.end(), ParamsBytes, ParamsBytes + Size);
+	}
+
+	bool FRecordingWorld::TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const
+	{
+		const bool bHit = Inner.TraceFloor(Start, Distance, OutFloorZ);
+		Recorder.RecordFloor(bHit, OutFloorZ);
+		return bHit;
+	}
+
+	int32_t FRecordingWorld::OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const
+	{
+		const int32_t NumContacts = Inner.OverlapCapsule(Center, Radius, HalfHeight, OutContacts, MaxContacts);
+		Recorder.RecordOverlap(OutContacts, NumContacts);
+		return NumContacts;
+	}
+
+	bool FRecordingWorld::SweepCapsule(const FVec3& Start, const FVec3& End, float Radius, float HalfHeight, FSweepHit& OutHit) const
+	{
+		const bool bHit = Inner.SweepCapsule(Start, End, Radius, HalfHeight, OutHit);
+		Recorder.RecordSweep(bHit, OutHit);
+		return bHit;
+	}
+
+	FReplayResult ReplayRecording(const uint8_t* Data, size_t Size, int32_t Repeat, bool bResync)
+	{
+		FReplayResult Result;
+		Repeat = std::max(Repeat, 1);
+
+		const auto StartTime = std::chrono::steady_clock::now();
+		for (int32_t Pass = 0; Pass < Repeat; ++Pass)
+		{
+			Result = FReplayResult();
+			ReplayPass(Data, Size, bResync, Result);
+			if (Result.Error)
+			{
+				return Result;
+			}
+		}
+		const double Ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - StartTime).count();
+
+		Result.NsPerStep = Ns / Repeat / std::max(Result.NumSteps, 1);
+		return Result;
+	}
+}
@@ -0,0 +1,920 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaMovementSubsystem.h"
+#include "SpartaMovementDebug.h"
+#include "SpartaPawn.h"
+#include "SpartaPlayerController.h"
+#include "SpartaWorldQuery.h"
+
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "StaticMeshResources.h"
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementBatched(
+	TEXT("Sparta.Movement.Batched"),
+	1,
+	TEXT("1: SpartaPawns register with USpartaMovementSubsystem and are stepped in one batch per frame.\n")
+	TEXT("0: every SpartaPawn ticks on its own. Read at BeginPlay."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementFloorCache(
+	TEXT("Sparta.Movement.FloorCache"),
+	1,
+	TEXT("1: SpartaPawn floor probes are answered from a cached floor-height grid where possible.\n")
+	TEXT("0: every floor probe is a line trace."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementFloorCacheChunks(
+	TEXT("Sparta.Movement.FloorCacheChunks"),
+	256,
+	TEXT("Floor cache chunks (16x16 cells, 4 KB each) allocated up front. Lookups allocate only once the pawns have touched more than this.\n")
+	TEXT("Read when the world starts."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementCollisionCoherence(
+	TEXT("Sparta.Movement.CollisionCoherence"),
+	1,
+	TEXT("1: SpartaPawn wall queries are skipped while the pawn stays inside the free space found by the last one.\n")
+	TEXT("0: the wall query runs every frame."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementParallel(
+	TEXT("Sparta.Movement.Parallel"),
+	1,
+	TEXT("1: batched SpartaPawn queries and integration run on worker threads, in chunks; transforms are committed on the game thread afterwards.\n")
+	TEXT("0: everything runs on the game thread."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementParallelChunkSize(
+	TEXT("Sparta.Movement.ParallelChunkSize"),
+	32,
+	TEXT("Pawns per worker task in Sparta.Movement.Parallel mode. Buckets with no more than this many pawns run on the game thread."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementPawnCollision(
+	TEXT("Sparta.Movement.PawnCollision"),
+	1,
+	TEXT("1: batched SpartaPawns that overlap are pushed apart once per frame, found through a spatial hash, and fill OverlappingActors.\n")
+	TEXT("0: pawns walk through each other."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementDeferredTransforms(
+	TEXT("Sparta.Movement.DeferredTransforms"),
+	1,
+	TEXT("1: SpartaPawn input moves, steps and pawn pushes only record where the pawn ends up, and each pawn's transform is written once\n")
+	TEXT("at the end of the movement subsystem's tick, as one move with one overlap update. SpartaDrones already write theirs once per tick.\n")
+	TEXT("0: every move writes the transform at once. Sparta.Movement.TransformStats compares the two."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementSdf(
+	TEXT("Sparta.Movement.Sdf"),
+	0,
+	TEXT("1: the world's static geometry is baked into a distance field at BeginPlay and when levels stream, and SpartaPawn and SpartaDrone\n")
+	TEXT("floor probes, wall queries and sweeps read static geometry from it; physics is only asked about WorldDynamic objects.\n")
+	TEXT("Turned on later, Sparta.Movement.BakeSdf bakes it. 0: every query goes to physics."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaMovementSdfVoxelSize(
+	TEXT("Sparta.Movement.SdfVoxelSize"),
+	20.f,
+	TEXT("Voxel size (cm) of the Sparta.Movement.Sdf bake. Halving it takes about eight times the bake time and four times the memory."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementFloorBvh(
+	TEXT("Sparta.Movement.FloorBvh"),
+	0,
+	TEXT("1: the triangles of the world's static meshes are put in a BVH at BeginPlay and when levels stream, and SpartaPawn and SpartaDrone\n")
+	TEXT("floor probes read static geometry from it; physics is only asked about WorldDynamic objects. Takes floors over Sparta.Movement.Sdf.\n")
+	TEXT("Turned on later, Sparta.Movement.BuildBvh builds it. 0: floor probes go to physics."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementFloorBvhLeafSize(
+	TEXT("Sparta.Movement.FloorBvhLeafSize"),
+	8,
+	TEXT("Most triangles in a leaf of the Sparta.Movement.FloorBvh tree. Sparta.Movement.BenchBvh compares leaf sizes."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaMovementNetSnapshotRate(
+	TEXT("Sparta.Movement.NetSnapshotRate"),
+	20.f,
+	TEXT("Movement snapshots per second the server sends the owning client of each SpartaPawn and SpartaDrone a remote player controls.\n")
+	TEXT("Each carries the newest input stepped, for the client to reconcile its prediction with."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementNetInputRedundancy(
+	TEXT("Sparta.Movement.NetInputRedundancy"),
+	3,
+	TEXT("Inputs per ServerMove packet from a predicting SpartaPawn or SpartaDrone: the newest and the ones before it, so a lost packet\n")
+	TEXT("costs nothing. The server also gives an input up as lost after this many newer ones have arrived. 1 to 15."),
+	ECVF_Default);
+
+/** Widest capsule the field has to answer for, pawn or drone, plus CollisionSafeMargin: the band the bake keeps exact */
+static constexpr float SdfQueryReach = 80.f;
+
+/** What the SDF and the BVH take in: static primitives blocking as WorldStatic. The rest is left to physics. */
+static bool IsStaticCollision(const UPrimitiveComponent* Component)
+{
+	return Component->Mobility == EComponentMobility::Static && Component->IsCollisionEnabled() && Component->GetCollisionObjectType() == ECC_WorldStatic;
+}
+
+/** Static primitives as the physics scene has them: whole-voxel box overlaps against WorldStatic */
+class FSpartaSdfBakeSource : public SpartaMovement::ISdfBakeSource
+{
+public:
+	explicit FSpartaSdfBakeSource(const UWorld* InWorld)
+		: World(InWorld),
+		ObjectQueryParams(ECC_WorldStatic),
+		QueryParams(SCENE_QUERY_STAT(SpartaSdfBake), false)
+	{}
+
+	virtual bool IsSolid(const SpartaMovement::FVec3& Center, float HalfSize) const override
+	{
+		return OverlapsStatic(FSpartaWorldQuery::ToVector(Center), FVector(HalfSize));
+	}
+
+	virtual bool TestsWholeVoxel() const override { return true; }
+
+	// Overlaps cannot tell a region inside geometry from one that only touches it, so Solid is never returned
+	virtual SpartaMovement::ESdfRegion ClassifyRegion(const SpartaMovement::FVec3& Min, const SpartaMovement::FVec3& Max) const override
+	{
+		const FVector Center = FSpartaWorldQuery::ToVector((Min + Max) * 0.5f);
+		const FVector HalfExtent = FSpartaWorldQuery::ToVector((Max - Min) * 0.5f);
+		return OverlapsStatic(Center, HalfExtent) ? SpartaMovement::ESdfRegion::Mixed : SpartaMovement::ESdfRegion::Empty;
+	}
+
+private:
+	/** Movable components can be of the WorldStatic type too; they are left to physics */
+	bool OverlapsStatic(const FVector& Center, const FVector& HalfExtent) const
+	{
+		Overlaps.Reset();
+		World->OverlapMultiByObjectType(Overlaps, Center, FQuat::Identity, ObjectQueryParams, FCollisionShape::MakeBox(HalfExtent), QueryParams);
+		for (const FOverlapResult& Overlap : Overlaps)
+		{
+			const UPrimitiveComponent* Component = Overlap.GetComponent();
+			if (Component && Component->Mobility == EComponentMobility::Static)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const UWorld* World;
+	FCollisionObjectQueryParams ObjectQueryParams;
+	FCollisionQueryParams QueryParams;
+	mutable TArray<FOverlapResult> Overlaps;
+};
+
+bool USpartaMovementSubsystem::IsBatchingEnabled()
+{
+	return CVarSpartaMovementBatched.GetValueOnGameThread() != 0;
+}
+
+bool USpartaMovementSubsystem::IsCollisionCoherenceEnabled()
+{
+	return CVarSpartaMovementCollisionCoherence.GetValueOnGameThread() != 0;
+}
+
+bool USpartaMovementSubsystem::IsSdfEnabled()
+{
+	return CVarSpartaMovementSdf.GetValueOnAnyThread() != 0;
+}
+
+bool USpartaMovementSubsystem::IsFloorBvhEnabled()
+{
+	return CVarSpartaMovementFloorBvh.GetValueOnAnyThread() != 0;
+}
+
+bool USpartaMovementSubsystem::IsDeferredTransformsEnabled()
+{
+	return CVarSpartaMovementDeferredTransforms.GetValueOnGameThread() != 0;
+}
+
+float USpartaMovementSubsystem::GetNetSnapshotInterval()
+{
+	return 1.f / FMath::Max(CVarSpartaMovementNetSnapshotRate.GetValueOnGameThread(), 1.f);
+}
+
+int32 USpartaMovementSubsystem::GetNetInputRedundancy()
+{
+	return FMath::Clamp(CVarSpartaMovementNetInputRedundancy.GetValueOnGameThread(), 1, SpartaMovement::NetMaxInputsPerPacket);
+}
+
+void USpartaMovementSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	FloorCache.Reserve(CVarSpartaMovementFloorCacheChunks.GetValueOnGameThread());
+
+	// Static geometry only changes with streaming or when a static actor goes away
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &USpartaMovementSubsystem::OnLevelChanged);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &USpartaMovementSubsystem::OnLevelChanged);
+	ActorDestroyedHandle = GetWorld()->AddOnActorDestroyedHandler(FOnActorDestroyed::FDelegate::CreateUObject(this, &USpartaMovementSubsystem::OnActorDestroyed));
+}
+
+void USpartaMovementSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	if (IsSdfEnabled())
+	{
+		BakeStaticSdf();
+	}
+	if (IsFloorBvhEnabled())
+	{
+		BuildStaticBvh();
+	}
+}
+
+void USpartaMovementSubsystem::BakeStaticSdf()
+{
+	UWorld* World = GetWorld();
+
+	FBox Bounds(ForceInit);
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		It->ForEachComponent<UPrimitiveComponent>(false, [&Bounds](const UPrimitiveComponent* Component)
+		{
+			if (IsStaticCollision(Component))
+			{
+				Bounds += Component->Bounds.GetBox();
+			}
+		});
+	}
+
+	StaticSdf = SpartaMovement::FSdfVolume();
+	if (!Bounds.IsValid)
+	{
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.Sdf: no static geometry to bake"));
+		return;
+	}
+
+	SpartaMovement::FSdfBakeSettings Settings;
+	Settings.VoxelSize = FMath::Max(CVarSpartaMovementSdfVoxelSize.GetValueOnGameThread(), 1.f);
+	Settings.BandVoxels = FMath::CeilToInt(SdfQueryReach / Settings.VoxelSize) + 1;
+	// Room for a capsule's reach past the outermost geometry
+	const FBox Baked = Bounds.ExpandBy(Settings.BandVoxels * Settings.VoxelSize);
+	Settings.Min = FSpartaWorldQuery::ToVec3(Baked.Min);
+	Settings.Max = FSpartaWorldQuery::ToVec3(Baked.Max);
+
+	SpartaMovement::FSdfBakeStats Stats;
+	StaticSdf = SpartaMovement::BakeSdf(FSpartaSdfBakeSource(World), Settings, &Stats);
+	if (StaticSdf.IsEmpty())
+	{
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.Sdf: %s is too large to bake at %.1f cm voxels; queries stay on physics"),
+			*Baked.GetSize().ToString(), Settings.VoxelSize);
+		return;
+	}
+
+	// Floors cached from physics may differ from the field's by a few centimeters
+	FloorCache.Reset();
+
+	UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.Sdf: baked %s at %.1f cm in %.2fs, bricks=%d skipped=%d dropped=%d overlaps=%llu memory=%.2fMB"),
+		*Baked.GetSize().ToString(), Settings.VoxelSize, Stats.Seconds, Stats.NumBricks, Stats.NumSkippedBricks, Stats.NumDroppedBricks,
+		static_cast<uint64>(Stats.NumSolidQueries), StaticSdf.GetMemoryBytes() / (1024.0 * 1024.0));
+}
+
+void USpartaMovementSubsystem::BuildStaticBvh()
+{
+	TArray<SpartaMovement::FVec3> Vertices;
+	TArray<int32> Indices;
+	int32 NumMeshes = 0;
+	int32 NumSkippedMeshes = 0;
+	for (TActorIterator<AActor> It(GetWorld()); It; ++It)
+	{
+		It->ForEachComponent<UStaticMeshComponent>(false, [&](const UStaticMeshComponent* Component)
+		{
+			const UStaticMesh* Mesh = Component->GetStaticMesh();
+			const FStaticMeshRenderData* RenderData = Mesh ? Mesh->GetRenderData() : nullptr;
+			if (!IsStaticCollision(Component) || !RenderData || RenderData->LODResources.Num() == 0)
+			{
+				return;
+			}
+
+			// Cooked meshes only keep their vertices on the CPU with bAllowCPUAccess
+			const FStaticMeshLODResources& LOD = RenderData->LODResources[0];
+			const FPositionVertexBuffer& Positions = LOD.VertexBuffers.PositionVertexBuffer;
+			const FIndexArrayView MeshIndices = LOD.IndexBuffer.GetArrayView();
+			if (!Positions.GetVertexData() || MeshIndices.Num() == 0)
+			{
+				++NumSkippedMeshes;
+				return;
+			}
+
+			const UInstancedStaticMeshComponent* Instanced = Cast<UInstancedStaticMeshComponent>(Component);
+			const int32 NumInstances = Instanced ? Instanced->GetInstanceCount() : 1;
+			for (int32 Instance = 0; Instance < NumInstances; ++Instance)
+			{
+				FTransform Transform = Component->GetComponentTransform();
+				if (Instanced)
+				{
+					Instanced->GetInstanceTransform(Instance, Transform, true);
+				}
+
+				const int32 FirstVertex = Vertices.Num();
+				for (uint32 Vertex = 0; Vertex < Positions.GetNumVertices(); ++Vertex)
+				{
+					Vertices.Add(FSpartaWorldQuery::ToVec3(Transform.TransformPosition(FVector(Positions.VertexPosition(Vertex)))));
+				}
+				for (int32 Index = 0; Index < MeshIndices.Num(); ++Index)
+				{
+					Indices.Add(FirstVertex + static_cast<int32>(MeshIndices[Index]));
+				}
+				++NumMeshes;
+			}
+		});
+	}
+
+	SpartaMovement::FBvhBuildSettings Settings;
+	Settings.MaxLeafTriangles = FMath::Max(CVarSpartaMovementFloorBvhLeafSize.GetValueOnGameThread(), 1);
+
+	SpartaMovement::FBvhBuildStats Stats;
+	StaticBvh.Build(Vertices.GetData(), Indices.GetData(), Indices.Num(), Settings, &Stats);
+	if (StaticBvh.IsEmpty())
+	{
+		UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.FloorBvh: no static mesh triangles to build from (%d meshes without CPU vertex data); floor probes stay on physics"),
+			NumSkippedMeshes);
+		return;
+	}
+
+	// Floors cached from physics may differ from the mesh triangles' where collision is simplified
+	FloorCache.Reset();
+
+	UE_LOG(LogAAA, Warning, TEXT("Sparta.Movement.FloorBvh: built from %d meshes (%d skipped, no CPU vertex data) in %.1fms, triangles=%d walls=%d nodes=%d depth=%d memory=%.2fMB"),
+		NumMeshes, NumSkippedMeshes, Stats.Seconds * 1000.0, Stats.NumTriangles, Stats.NumDroppedTriangles, Stats.NumNodes, Stats.MaxDepth,
+		StaticBvh.GetMemoryBytes() / (1024.0 * 1024.0));
+}
+
+SpartaMovement::FFloorHeightCache* USpartaMovementSubsystem::GetFloorCache()
+{
+	return CVarSpartaMovementFloorCache.GetValueOnGameThread() != 0 ? &FloorCache : nullptr;
+}
+
+void USpartaMovementSubsystem::InvalidateFloorCache(const FBox& Bounds)
+{
+	if (Bounds.IsValid)
+	{
+		FloorCache.Invalidate(Bounds.Min.X, Bounds.Min.Y, Bounds.Max.X, Bounds.Max.Y);
+		OnFloorInvalidated.Broadcast(Bounds);
+	}
+}
+
+void USpartaMovementSubsystem::OnLevelChanged(ULevel* Level, UWorld* World)
+{
+	if (World == GetWorld())
+	{
+		FloorCache.Reset();
+		if (IsSdfEnabled() && World->HasBegunPlay())
+		{
+			BakeStaticSdf();
+		}
+		if (IsFloorBvhEnabled() && World->HasBegunPlay())
+		{
+			BuildStaticBvh();
+		}
+		OnFloorInvalidated.Broadcast(FBox(FVector(-UE_BIG_NUMBER), FVector(UE_BIG_NUMBER)));
+	}
+}
+
+void USpartaMovementSubsystem::OnActorDestroyed(AActor* Actor)
+{
+	const USceneComponent* Root = Actor ? Actor->GetRootComponent() : nullptr;
+	if (Root && Root->Mobility == EComponentMobility::Static)
+	{
+		InvalidateFloorCache(Actor->GetComponentsBoundingBox());
+	}
+}
+
+void USpartaMovementSubsystem::RegisterPawn(ASpartaPawn* Pawn)
+{
+	if (!Pawn || Pawn->MovementHandle != INDEX_NONE)
+	{
+		return;
+	}
+
+	Pawn->MoveState.Location = FSpartaWorldQuery::ToVec3(Pawn->GetMoveLocation());
+
+	// Appended bodies land at the end of the last range
+	const int32 Handle = Bodies.Add(Pawn->MoveState);
+	Pawns.Add(Pawn);
+	PendingTimes.Add(0.f);
+	SpartaMovement::FVec3 Center = Pawn->MoveState.Location;
+	Center.Z += Pawn->MoveParams.CollisionZOffset;
+	PawnHash.Add(Center, Pawn->MoveParams.CapsuleRadius, Pawn->MoveParams.CapsuleHalfHeight);
+	check(Pawns.Num() == Bodies.Num() && PendingTimes.Num() == Bodies.Num() && PawnHash.Num() == Bodies.Num());
+	RangeEnds[NetRange] = Bodies.Num();
+
+	Pawn->MovementHandle = Handle;
+	Pawn->MovementSubsystem = this;
+	Pawn->SetActorTickEnabled(false);
+
+	MoveToRange(Pawn, Pawn->bIsAsleep ? SleepRange : static_cast<int32>(Pawn->Significance));
+}
+
+void USpartaMovementSubsystem::UnregisterPawn(ASpartaPawn* Pawn)
+{
+	if (!Pawn || !Pawns.IsValidIndex(Pawn->MovementHandle) || Pawns[Pawn->MovementHandle] != Pawn)
+	{
+		return;
+	}
+
+	// Only the last range can give up a slot with a plain swap-remove
+	MoveToRange(Pawn, NetRange);
+
+	const int32 Handle = Pawn->MovementHandle;
+	Bodies.Load(Handle, Pawn->MoveState);
+	// The pawn catches up on the time it was waiting for its bucket when it next ticks itself
+	Pawn->LastStepTime = GetWorld()->GetTimeSeconds() - PendingTimes[Handle];
+
+	Bodies.RemoveAtSwap(Handle);
+	Pawns.RemoveAtSwap(Handle);
+	PendingTimes.RemoveAtSwap(Handle);
+	PawnHash.RemoveAtSwap(Handle);
+	if (Pawns.IsValidIndex(Handle))
+	{
+		Pawns[Handle]->MovementHandle = Handle;
+	}
+	RangeEnds[NetRange] = Bodies.Num();
+
+	Pawn->MovementHandle = INDEX_NONE;
+	Pawn->MovementSubsystem = nullptr;
+
+	// Nobody is overlapping it any more as far as this subsystem knows
+	if (OverlappingPawns.RemoveSingleSwap(Pawn) > 0)
+	{
+		for (ASpartaPawn* Other : Pawn->OverlappingActors.Array())
+		{
+			if (ASpartaPawn* OtherPawn = Cast<ASpartaPawn>(Other))
+			{
+				OtherPawn->OverlappingActors.Remove(Pawn);
+			}
+		}
+		Pawn->OverlappingActors.Reset();
+	}
+}
+
+void USpartaMovementSubsystem::SetPawnSignificance(ASpartaPawn* Pawn, ESpartaSignificance Significance)
+{
+	if (Pawn && !Pawn->bIsAsleep && !IsNetStepped(Pawn))
+	{
+		MoveToRange(Pawn, static_cast<int32>(Significance));
+	}
+}
+
+void USpartaMovementSubsystem::SetPawnAsleep(ASpartaPawn* Pawn, bool bAsleep)
+{
+	if (!Pawn || IsNetStepped(Pawn))
+	{
+		return;
+	}
+
+	MoveToRange(Pawn, bAsleep ? SleepRange : static_cast<int32>(Pawn->Significance));
+
+	// Time spent asleep was spent at rest, there is nothing to catch up on
+	if (!bAsleep && PendingTimes.IsValidIndex(Pawn->MovementHandle))
+	{
+		PendingTimes[Pawn->MovementHandle] = 0.f;
+	}
+}
+
+void USpartaMovementSubsystem::SetPawnNetStepped(ASpartaPawn* Pawn, bool bNetStepped)
+{
+	if (!Pawn || !Pawns.IsValidIndex(Pawn->MovementHandle) || IsNetStepped(Pawn) == bNetStepped)
+	{
+		return;
+	}
+
+	MoveToRange(Pawn, bNetStepped ? NetRange : Pawn->bIsAsleep ? SleepRange : static_cast<int32>(Pawn->Significance));
+
+	// Either way there is no time to catch up on: the inputs bring their own, and a bucket starts over
+	PendingTimes[Pawn->MovementHandle] = 0.f;
+	Pawn->LastStepTime = -1.0;
+	Pawn->SetActorTickEnabled(bNetStepped);
+}
+
+bool USpartaMovementSubsystem::IsNetStepped(const ASpartaPawn* Pawn) const
+{
+	return Pawns.IsValidIndex(Pawn->MovementHandle) && Pawn->MovementHandle >= RangeEnds[SleepRange];
+}
+
+void USpartaMovementSubsystem::MoveToRange(ASpartaPawn* Pawn, int32 Target)
+{
+	if (!Pawn || !Pawns.IsValidIndex(Pawn->MovementHandle) || Pawns[Pawn->MovementHandle] != Pawn)
+	{
+		return;
+	}
+
+	int32 Index = Pawn->MovementHandle;
+	int32 Range = GetRange(Index);
+
+	// Each step crosses one range border: swap with the body at the border, then move the border past it
+	while (Range < Target)
+	{
+		const int32 Last = RangeEnds[Range] - 1;
+		SwapBodies(Index, Last);
+		Index = Last;
+		--RangeEnds[Range];
+		++Range;
+	}
+	while (Range > Target)
+	{
+		const int32 First = RangeEnds[Range - 1];
+		SwapBodies(Index, First);
+		Index = First;
+		++RangeEnds[Range - 1];
+		--Range;
+	}
+}
+
+void USpartaMovementSubsystem::SwapBodies(int32 A, int32 B)
+{
+	if (A == B)
+	{
+		return;
+	}
+
+	Bodies.Swap(A, B);
+	Pawns.Swap(A, B);
+	PendingTimes.Swap(A, B);
+	PawnHash.Swap(A, B);
+	Pawns[A]->MovementHandle = A;
+	Pawns[B]->MovementHandle = B;
+}
+
+int32 USpartaMovementSubsystem::GetRange(int32 Index) const
+{
+	int32 Range = 0;
+	while (Index >= RangeEnds[Range])
+	{
+		++Range;
+	}
+	return Range;
+}
+
+void USpartaMovementSubsystem::LoadState(int32 Handle, SpartaMovement::FPawnMoveState& OutState) const
+{
+	Bodies.Load(Handle, OutState);
+}
+
+void USpartaMovementSubsystem::StoreState(int32 Handle, const SpartaMovement::FPawnMoveState& State)
+{
+	Bodies.Store(Handle, State);
+}
+
+void USpartaMovementSubsystem::Tick(float DeltaTime)
+{
+	SpartaMovementDebug::FScopedFrameTiming Timing(SpartaMovementDebug::GetFrameTimings().MovementSubsystem);
+
+	FloorCache.AdvanceFrame();
+
+	const int32 NumPawns = Pawns.Num();
+	if (NumPawns == 0)
+	{
+		// Pawns that tick themselves may have moved
+		FlushPendingTransforms();
+		return;
+	}
+	SpartaMovementDebug::GetTransformStats().AgentFrames += NumPawns;
+
+	// Sleeping bodies are not owed any time
+	const int32 NumAwake = RangeEnds[SleepRange - 1];
+	for (int32 Index = 0; Index < NumAwake; ++Index)
+	{
+		PendingTimes[Index] += DeltaTime;
+	}
+
+	// A bucket runs once its interval has passed. Every body then steps by its own pending time,
+	// which stays right for bodies that changed buckets in between.
+	int32 Begin = 0;
+	for (int32 Bucket = 0; Bucket < SleepRange; ++Bucket)
+	{
+		const ESpartaSignificance Significance = static_cast<ESpartaSignificance>(Bucket);
+		const int32 End = RangeEnds[Bucket];
+
+		BucketTimes[Bucket] += DeltaTime;
+		if (BucketTimes[Bucket] >= USpartaSignificanceSubsystem::GetTickInterval(Significance))
+		{
+			BucketTimes[Bucket] = 0.f;
+			if (End > Begin)
+			{
+				StepBodies(Begin, End, Significance);
+			}
+		}
+		Begin = End;
+	}
+
+	for (ASpartaPawn* Pawn : SettledPawns)
+	{
+		Pawn->GoToSleep();
+	}
+	SettledPawns.Reset();
+
+	ResolvePawnContacts();
+	FlushPendingTransforms();
+}
+
+void USpartaMovementSubsystem::AddPendingTransform(ASpartaPawn* Pawn)
+{
+	PendingTransformPawns.Add(Pawn);
+}
+
+void USpartaMovementSubsystem::FlushPendingTransforms()
+{
+	for (ASpartaPawn* Pawn : PendingTransformPawns)
+	{
+		if (Pawn)
+		{
+			Pawn->FlushPendingTransform();
+		}
+	}
+	PendingTransformPawns.Reset();
+}
+
+void USpartaMovementSubsystem::ResolvePawnContacts()
+{
+	// Overlaps are found anew every frame
+	for (ASpartaPawn* Pawn : OverlappingPawns)
+	{
+		Pawn->OverlappingActors.Reset();
+	}
+	OverlappingPawns.Reset();
+
+	if (CVarSpartaMovementPawnCollision.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
+
+	// Bodies hold every pawn's current position: steps, input moves and network corrections all store it.
+	// Only pawns that crossed a cell border are relinked.
+	for (int32 Index = 0; Index < Pawns.Num(); ++Index)
+	{
+		const SpartaMovement::FVec3 Center(Bodies.PosX[Index], Bodies.PosY[Index], Bodies.PosZ[Index] + Pawns[Index]->MoveParams.CollisionZOffset);
+		PawnHash.Update(Index, Center);
+	}
+
+	PawnContacts.clear();
+	PawnHash.FindContacts(PawnContacts);
+
+	// Each pawn of a pair takes half the separation, in the plane. A pawn in several contacts takes all of them;
+	// what that leaves overlapping is resolved over the next frames.
+	ContactPushes.SetNumUninitialized(Pawns.Num());
+	for (const SpartaMovement::FPawnContact& Contact : PawnContacts)
+	{
+		ASpartaPawn* PawnA = Pawns[Contact.A];
+		ASpartaPawn* PawnB = Pawns[Contact.B];
+		for (const int32 Index : { Contact.A, Contact.B })
+		{
+			if (Pawns[Index]->OverlappingActors.Num() == 0)
+			{
+				OverlappingPawns.Add(Pawns[Index]);
+				ContactPushes[Index] = SpartaMovement::FVec3();
+			}
+		}
+		PawnA->OverlappingActors.Add(PawnB);
+		PawnB->OverlappingActors.Add(PawnA);
+
+		const SpartaMovement::FVec3 Half(Contact.Separation.X * 0.5f, Contact.Separation.Y * 0.5f, 0.f);
+		ContactPushes[Contact.A] = ContactPushes[Contact.A] - Half;
+		ContactPushes[Contact.B] += Half;
+	}
+
+	// The push is a move like any other: it slides along walls instead of shoving the pawn into them
+	UWorld* World = GetWorld();
+	SpartaMovement::FPawnMoveState State;
+	for (ASpartaPawn* Pawn : OverlappingPawns)
+	{
+		const int32 Index = Pawn->MovementHandle;
+		Bodies.Load(Index, State);
+		SpartaMovement::SlidePawn(State, Pawn->MoveParams, ContactPushes[Index], FSpartaWorldQuery(World, Pawn->QueryBuffers));
+		Bodies.Store(Index, State);
+		Pawn->MoveActorTo(FSpartaWorldQuery::ToVector(State.Location));
+	}
+
+	// Waking a pawn moves its body to another slot, which would leave ContactPushes behind, so only once all have moved
+	for (ASpartaPawn* Pawn : OverlappingPawns)
+	{
+		Pawn->WakeUp();
+	}
+}
+
+void USpartaMovementSubsystem::StepBodies(int32 Begin, int32 End, ESpartaSignificance Significance)
+{
+	UWorld* World = GetWorld();
+	SpartaMovement::FFloorHeightCache* SharedFloorCache = GetFloorCache();
+	const bool bUseCoherence = IsCollisionCoherenceEnabled();
+	const int32 ChunkSize = FMath::Max(CVarSpartaMovementParallelChunkSize.GetValueOnGameThread(), 1);
+	const int32 NumChunks = FMath::DivideAndRoundUp(End - Begin, ChunkSize);
+	const bool bParallel = CVarSpartaMovementParallel.GetValueOnGameThread() != 0 && NumChunks > 1;
+
+	// Analytic bodies keep their last floor and skip the wall query. Async results only live for a frame,
+	// so only the bucket that steps every frame can use them.
+	const bool bQueryWorld = Significance != ESpartaSignificance::Analytic;
+	const bool bAsync = Significance == ESpartaSignificance::Full && FSpartaWorldQuery::IsAsyncEnabled();
+	const ESpartaQueryMode QueryMode = bAsync ? ESpartaQueryMode::Async : bParallel ? ESpartaQueryMode::Concurrent : ESpartaQueryMode::Immediate;
+
+	const uint8 RecordedStepFlags = (bQueryWorld ? SpartaMovement::StepQueriesWorld : 0) | (bUseCoherence ? SpartaMovement::StepCollisionCoherence : 0);
+
+	// Input moves the actors directly, so positions are gathered first, on the game thread
+	for (int32 Index = Begin; Index < End; ++Index)
+	{
+		ASpartaPawn* Pawn = Pawns[Index];
+		const FVector Location = Pawn->GetMoveLocation();
+		Bodies.PosX[Index] = static_cast<float>(Location.X);
+		Bodies.PosY[Index] = static_cast<float>(Location.Y);
+		Bodies.PosZ[Index] = static_cast<float>(Location.Z);
+
+		if (Pawn->Recorder)
+		{
+			Pawn->Recorder->BeginStep(World->GetTimeSeconds(), PendingTimes[Index], RecordedStepFlags);
+		}
+	}
+
+	// The static floors of the whole bucket in one go, while the BVH or field answers them. With the floor cache on
+	// most probes never get that far, and the misses go one at a time.
+	if (bQueryWorld && !SharedFloorCache)
+	{
+		const SpartaMovement::FFloorBvh* BatchBvh = !StaticBvh.IsEmpty() && IsFloorBvhEnabled() ? &StaticBvh : nullptr;
+		const SpartaMovement::FSdfVolume* BatchSdf = !BatchBvh && !StaticSdf.IsEmpty() && IsSdfEnabled() ? &StaticSdf : nullptr;
+		if (BatchBvh || BatchSdf)
+		{
+			BatchFloorProbes(Begin, End, BatchBvh, BatchSdf, ChunkSize, bParallel);
+		}
+	}
+
+	auto QueryBody = [bUseCoherence](ASpartaPawn* Pawn, SpartaMovement::FPawnMoveState& State, const SpartaMovement::IMovementWorld& PawnWorld)
+	{
+		SpartaMovement::UpdateFloorZ(State, Pawn->MoveParams, PawnWorld);
+		SpartaMovement::CheckCollision(State, Pawn->MoveParams, PawnWorld, bUseCoherence ? &Pawn->CollisionCoherence : nullptr);
+
+		// Good for this step's probe only
+		Pawn->QueryBuffers.BatchedFloor.bValid = false;
+	};
+
+	// World queries and integration. Every body only touches its own slots and its pawn's buffers,
+	// and the floor cache is read-only while this runs in parallel.
+	auto StepChunk = [&](int32 ChunkBegin, int32 ChunkEnd)
+	{
+		if (bQueryWorld)
+		{
+			SpartaMovement::FPawnMoveState State;
+			for (int32 Index = ChunkBegin; Index < ChunkEnd; ++Index)
+			{
+				ASpartaPawn* Pawn = Pawns[Index];
+				Bodies.Load(Index, State);
+
+				Pawn->QueryBuffers.bNearMovable = false;
+				const FSpartaWorldQuery WorldQuery(World, Pawn->QueryBuffers, SharedFloorCache, QueryMode);
+				if (Pawn->Recorder)
+				{
+					QueryBody(Pawn, State, SpartaMovement::FRecordingWorld(WorldQuery, *Pawn->Recorder));
+				}
+				else
+				{
+					QueryBody(Pawn, State, WorldQuery);
+				}
+
+				Bodies.Store(Index, State);
+			}
+		}
+
+		// Gravity is not tunable per pawn, every pawn uses the default
+		SpartaMovement::IntegrateBodies(Bodies, SpartaMovement::FPawnMoveParams().Gravity, PendingTimes.GetData(), ChunkBegin, ChunkEnd);
+	};
+
+	if (bParallel)
+	{
+		ParallelFor(NumChunks, [&](int32 Chunk)
+		{
+			const int32 ChunkBegin = Begin + Chunk * ChunkSize;
+			StepChunk(ChunkBegin, FMath::Min(ChunkBegin + ChunkSize, End));
+		});
+	}
+	else
+	{
+		StepChunk(Begin, End);
+	}
+
+	// Commit on the game thread: cache fills, next frame's async queries, transforms, and who has come to rest
+	SpartaMovement::FPawnMoveState State;
+	for (int32 Index = Begin; Index < End; ++Index)
+	{
+		ASpartaPawn* Pawn = Pawns[Index];
+		const SpartaMovement::FVec3 PreviousLocation = FSpartaWorldQuery::ToVec3(Pawn->GetMoveLocation());
+
+		if (SharedFloorCache && Pawn->QueryBuffers.FloorFill.bPending)
+		{
+			SharedFloorCache->Fill(Pawn->QueryBuffers.FloorFill, FSpartaWorldQuery(World, Pawn->QueryBuffers));
+		}
+
+		Bodies.Load(Index, State);
+		if (Pawn->Recorder)
+		{
+			Pawn->Recorder->EndPawnStep(State);
+		}
+
+		const FVector NewLocation = FSpartaWorldQuery::ToVector(State.Location);
+		if (bAsync)
+		{
+			FSpartaWorldQuery::SubmitAsyncQueries(World, Pawn->QueryBuffers, NewLocation - FSpartaWorldQuery::ToVector(PreviousLocation));
+		}
+		Pawn->MoveActorTo(NewLocation);
+		PendingTimes[Index] = 0.f;
+
+		if (Pawn->NoteStep(SpartaMovement::IsAtRest(State, Pawn->MoveParams, PreviousLocation)))
+		{
+			SettledPawns.Add(Pawn);
+		}
+	}
+}
+
+void USpartaMovementSubsystem::BatchFloorProbes(int32 Begin, int32 End, const SpartaMovement::FFloorBvh* Bvh, const SpartaMovement::FSdfVolume* Sdf, int32 ChunkSize, bool bParallel)
+{
+	const int32 Num = End - Begin;
+	FFloorProbeBatch& Batch = FloorProbes;
+	Batch.Starts.SetNumUninitialized(Num);
+	Batch.SortedStarts.SetNumUninitialized(Num);
+	Batch.SortedDistances.SetNumUninitialized(Num);
+	Batch.FloorZ.SetNumUninitialized(Num);
+	Batch.Hits.SetNumUninitialized(Num);
+
+	// The probes UpdateFloorZ will make, from the positions just gathered
+	for (int32 Probe = 0; Probe < Num; ++Probe)
+	{
+		const int32 Index = Begin + Probe;
+		Batch.Starts[Probe] = SpartaMovement::FVec3(Bodies.PosX[Index], Bodies.PosY[Index], Bodies.PosZ[Index]);
+	}
+
+	// Neighbours share packets and go down the same branches; the field's bricks stay in cache the same way.
+	// Capsule-sized cells, as pawns closer than that are in contact anyway.
+	SpartaMovement::SortProbesForCoherence(Batch.Starts.GetData(), Num, SpartaMovement::FPawnMoveParams().CapsuleRadius, Batch.Keys);
+	for (int32 Sorted = 0; Sorted < Num; ++Sorted)
+	{
+		const int32 Index = Begin + static_cast<int32>(static_cast<uint32>(Batch.Keys[Sorted]));
+		Batch.SortedStarts[Sorted] = SpartaMovement::FVec3(Bodies.PosX[Index], Bodies.PosY[Index], Bodies.PosZ[Index]);
+		Batch.SortedDistances[Sorted] = SpartaMovement::ComputeFloorTraceDistance(Bodies.VelZ[Index], Pawns[Index]->MoveParams);
+	}
+
+	// Both only read the BVH or field, so slices of the sorted order can go to workers
+	auto TraceSlice = [&Batch, Bvh, Sdf](int32 SliceBegin, int32 SliceEnd)
+	{
+		const int32 SliceNum = SliceEnd - SliceBegin;
+		if (Bvh)
+		{
+			Bvh->TraceDownBatch(Batch.SortedStarts.GetData() + SliceBegin, Batch.SortedDistances.GetData() + SliceBegin,
+				Batch.FloorZ.GetData() + SliceBegin, Batch.Hits.GetData() + SliceBegin, SliceNum);
+		}
+		else
+		{
+			SpartaMovement::TraceFloorBatch(*Sdf, Batch.SortedStarts.GetData() + SliceBegin, Batch.SortedDistances.GetData() + SliceBegin,
+				Batch.FloorZ.GetData() + SliceBegin, Batch.Hits.GetData() + SliceBegin, SliceNum);
+		}
+	};
+
+	const int32 NumChunks = FMath::DivideAndRoundUp(Num, ChunkSize);
+	if (bParallel && NumChunks > 1)
+	{
+		ParallelFor(NumChunks, [&](int32 Chunk)
+		{
+			const int32 SliceBegin = Chunk * ChunkSize;
+			TraceSlice(SliceBegin, FMath::Min(SliceBegin + ChunkSize, Num));
+		});
+	}
+	else
+	{
+		TraceSlice(0, Num);
+	}
+
+	for (int32 Sorted = 0; Sorted < Num; ++Sorted)
+	{
+		FSpartaQueryBuffers::FBatchedFloor& Batched = Pawns[Begin + static_cast<int32>(static_cast<uint32>(Batch.Keys[Sorted]))]->QueryBuffers.BatchedFloor;
+		Batched.Start = Batch.SortedStarts[Sorted];
+		Batched.Distance = Batch.SortedDistances[Sorted];
+		Batched.FloorZ = Batch.FloorZ[Sorted];
+		Batched.bHit = Batch.Hits[Sorted];
+		Batched.bValid = true;
+	}
+}
+
+TStatId USpartaMovementSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USpartaMovementSubsystem, STATGROUP_Tickables);
+}
+
+void USpartaMovementSubsystem::Deinitialize()
+{
+	while (Pawns.Num() > 0)
+	{
+		UnregisterPawn(Pawns.Last());
+	}
+
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+	GetWorld()->RemoveOnActorDestroyededHandler(ActorDestroyedHandle);
+
+	Super::Deinitialize();
+}
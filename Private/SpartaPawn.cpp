@@ -1,12 +1,14 @@
 ﻿// Fill out your copyright notice in the Description page of Project Settings.
 
 #include "SpartaPawn.h"
+#include "SpartaAnimBudgetSubsystem.h"
 #include "SpartaPlayerController.h"
+#include "SpartaWorldQuery.h"
+#include "SpartaMovementSubsystem.h"
+#include "SpartaMovementDebug.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/SkeletalMeshComponent.h"
 #include "EnhancedInputComponent.h"
-#include "Camera/CameraComponent.h"
-#include "GameFramework/SpringArmComponent.h"
 
 DEFINE_LOG_CATEGORY(LogAAA);
 
@@ -23,33 +25,25 @@ ASpartaPawn::ASpartaPawn()
 	// 캡슐의 물리 시뮬레이션 비활성화
 	CapsuleComp->SetSimulatePhysics(false);
 	CapsuleComp->SetEnableGravity(false);
-	CapsuleComp->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	// Movement queries the world itself and never collides through the capsule. The capsule only overlaps
+	// WorldDynamic, and only generates overlap events while asleep (see GoToSleep), so something movable pushing
+	// into a sleeping pawn wakes it through NotifyActorBeginOverlap without every move paying for an overlap query.
+	CapsuleComp->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+	CapsuleComp->SetCollisionObjectType(ECC_Pawn);
+	CapsuleComp->SetCollisionResponseToAllChannels(ECR_Ignore);
+	CapsuleComp->SetCollisionResponseToChannel(ECC_WorldDynamic, ECR_Overlap);
+	CapsuleComp->SetGenerateOverlapEvents(false);
 
     // 메쉬 생성
-    SkeletalMeshComp = CreateDefaultSubobject<USkeletalMeshComponent>(TEXT("SkeletalMeshComp"));
+    SkeletalMeshComp = CreateDefaultSubobject<USpartaSkeletalMeshComponent>(TEXT("SkeletalMeshComp"));
     SkeletalMeshComp->SetupAttachment(CapsuleComp);
 
-    // 스프링 암 생성
-    SpringArmComp = CreateDefaultSubobject<USpringArmComponent>(TEXT("SpringArmComp"));
-    SpringArmComp->SetupAttachment(RootComponent);
-    SpringArmComp->bUsePawnControlRotation = true;
+    // The camera follows the controller's view rotation; the rig itself lives in the player's camera manager
+    CameraRig.bUsePawnControlRotation = true;
 
-    // 카메라 생성
-    CameraComp = CreateDefaultSubobject<UCameraComponent>(TEXT("CameraComp"));
-    CameraComp->SetupAttachment(SpringArmComp);
-
-	WalkingSpeed = 600.0f;
-	SprintSpeed = 1200.0f;
-
-	bIsJumping = false;
-	Velocity = FVector::ZeroVector;
-	Gravity = -980.f;
-	bIsMoving = false;
-
-	// Collision
-	CapsuleRadius = 50.0f;
-	CapsuleHalfHeight = 50.0f;
-	BlockedPosition = FVector::ZeroVector;
+	// Owning clients get ServerMove and ClientMoveSnapshot; the others only see this pawn through replicated movement
+	bReplicates = true;
+	SetReplicatingMovement(true);
 }
 
 void ASpartaPawn::BeginPlay()
@@ -63,169 +57,540 @@ void ASpartaPawn::BeginPlay()
 	{
 		UE_LOG(LogAAA, Warning, TEXT("UCapsuleComponent Found"));
 
-		CapsuleRadius = CollisionCapsuleComp->GetScaledCapsuleRadius();
-		CapsuleHalfHeight = CollisionCapsuleComp->GetScaledCapsuleHalfHeight();
+		MoveParams.CapsuleRadius = CollisionCapsuleComp->GetScaledCapsuleRadius();
+		MoveParams.CapsuleHalfHeight = CollisionCapsuleComp->GetScaledCapsuleHalfHeight();
 	}
+
+	QueryBuffers.Init(this);
+#if SPARTA_MOVEMENT_DEBUG
+	SpartaMovementDebug::TrackTransformUpdates(this);
+#endif
+
+	if (USpartaMovementSubsystem* Subsystem = GetWorld()->GetSubsystem<USpartaMovementSubsystem>())
+	{
+		Subsystem->OnFloorInvalidated.AddUObject(this, &ASpartaPawn::OnFloorInvalidated);
+
+		// Batched movement: the subsystem steps this pawn, our own Tick is turned off
+		if (USpartaMovementSubsystem::IsBatchingEnabled())
+		{
+			Subsystem->RegisterPawn(this);
+		}
+	}
+
+	if (USpartaSignificanceSubsystem::IsEnabled())
+	{
+		if (USpartaSignificanceSubsystem* Significances = GetWorld()->GetSubsystem<USpartaSignificanceSubsystem>())
+		{
+			Significances->RegisterActor(this, FOnSpartaSignificanceChanged::CreateUObject(this, &ASpartaPawn::SetSignificance));
+		}
+	}
+
+	UpdateNetMoveRole();
 }
 
-void ASpartaPawn::Tick(float DeltaTime)
+void ASpartaPawn::PossessedBy(AController* NewController)
 {
-	Super::Tick(DeltaTime);
+	Super::PossessedBy(NewController);
+	UpdateNetMoveRole();
+}
 
-	// damping 
+void ASpartaPawn::UnPossessed()
+{
+	Super::UnPossessed();
+	UpdateNetMoveRole();
+}
 
-	UpdateFloorZ();   // 바닥 충돌 감지 -> LineTrace
-	CheckCollision(); // 벽충돌 감지 -> SweepMultiByObjectType
+void ASpartaPawn::PostNetReceiveRole()
+{
+	Super::PostNetReceiveRole();
+	UpdateNetMoveRole();
+}
 
-	// 중력 적용
-	Velocity.Z += Gravity * DeltaTime;
+void ASpartaPawn::UpdateNetMoveRole()
+{
+	ENetMoveRole NewRole = ENetMoveRole::Local;
+	if (GetLocalRole() == ROLE_AutonomousProxy)
+	{
+		NewRole = ENetMoveRole::Predicting;
+	}
+	else if (GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		NewRole = ENetMoveRole::Simulated;
+	}
+	else if (GetRemoteRole() == ROLE_AutonomousProxy && !IsLocallyControlled())
+	{
+		NewRole = ENetMoveRole::ServerDriven;
+	}
 
-	// 이동 계산
-	FVector NewLocation = GetActorLocation() + Velocity * DeltaTime;
+	if (NewRole != NetMoveRole)
+	{
+		NetMoveRole = NewRole;
+
+		// Sequences start over with every possession, on both ends
+		NetInputBuffer = SpartaMovement::TNetInputBuffer<SpartaMovement::FNetPawnInput>();
+		NetSnapshotReceiver = SpartaMovement::FNetSnapshotReceiver();
+		NetInputQueue = SpartaMovement::TNetInputQueue<SpartaMovement::FNetPawnInput>();
+		NetSnapshotSender = SpartaMovement::FNetSnapshotSender();
+		LastNetSnapshotTime = -1.0;
+		NetMoveInput = FVector2D::ZeroVector;
+		bNetJump = false;
+		bNetJumpRelease = false;
+		bNetSprint = false;
+	}
 
-	// 바닥 충돌 감지
-	if (NewLocation.Z <= CurrentFloorZ)
+	// Roles can arrive before BeginPlay, which comes back here
+	if (!HasActorBegunPlay() && !IsActorBeginningPlay())
 	{
-		//UE_LOG(LogAAA, Warning, TEXT("바닥 충돌: %f"), NewLocation.Z);
+		return;
+	}
+
+	// A networked pawn steps once per input, in Tick or ServerMove, and stays awake for the input stream
+	WakeUp();
 
-		NewLocation.Z = CurrentFloorZ;
-		bIsJumping = false;
-		Velocity.Z = 0.f;
+	// Replicated movement places a simulated proxy; everything else keeps a body, for the pushes between pawns
+	if (NetMoveRole == ENetMoveRole::Simulated)
+	{
+		if (MovementSubsystem)
+		{
+			MovementSubsystem->UnregisterPawn(this);
+			SetActorTickEnabled(true);
+		}
+		return;
+	}
+	if (!MovementSubsystem && USpartaMovementSubsystem::IsBatchingEnabled())
+	{
+		if (USpartaMovementSubsystem* Subsystem = GetWorld()->GetSubsystem<USpartaMovementSubsystem>())
+		{
+			Subsystem->RegisterPawn(this);
+		}
+	}
+	if (MovementSubsystem)
+	{
+		MovementSubsystem->SetPawnNetStepped(this, NetMoveRole != ENetMoveRole::Local);
+	}
+	if (NetMoveRole == ENetMoveRole::Local)
+	{
+		return;
 	}
 
-	//UE_LOG(LogAAA, Warning, TEXT("Tick NewLocation: %s"), *NewLocation.ToString());
+	PullMoveState();
+	MoveState.Location = FSpartaWorldQuery::ToVec3(GetMoveLocation());
+	MoveState.Yaw = GetMoveRotation().Yaw;
+	PushMoveState();
+}
 
-	SetActorLocation(NewLocation);
+void ASpartaPawn::StepNetInput(const SpartaMovement::FNetPawnInput& Input)
+{
+	// Immediate queries, no floor cache: client and server must get the same answers
+	const FSpartaWorldQuery WorldQuery(GetWorld(), QueryBuffers);
+	SpartaMovement::StepPawnInput(MoveState, MoveParams, Input, WorldQuery);
+	SpartaMovement::SnapToNetGrid(MoveState);
 }
 
-// 충돌 확인 함수
-bool ASpartaPawn::CheckCollision()
+void ASpartaPawn::TickNetPrediction(float DeltaTime)
 {
-	FVector StartLocation = GetActorLocation();
-	FVector MoveDirection = GetVelocity().GetSafeNormal();
+	SpartaMovement::FNetPawnInput& Input = NetInputBuffer.AddInput();
+	Input.Set(NetMoveInput.X, NetMoveInput.Y, NetControlYaw, DeltaTime, bNetJump, bNetJumpRelease, bNetSprint);
+	NetMoveInput = FVector2D::ZeroVector;
+	bNetJump = false;
+	bNetJumpRelease = false;
+
+	PullMoveState();
+	StepNetInput(Input);
+	PushMoveState();
+	NetInputBuffer.SetPredicted(Input.Sequence, SpartaMovement::QuantizeMoveState(SpartaMovement::ToNetMoveState(MoveState)));
+	MoveActorToState();
+
+	SpartaMovement::FNetBitWriter Writer(NetBytes);
+	NetInputBuffer.WriteInputPacket(Writer, NetSnapshotReceiver.GetNewestSnapshot(), USpartaMovementSubsystem::GetNetInputRedundancy());
+	ServerMove(TArray<uint8>(NetBytes.data(), static_cast<int32>(NetBytes.size())));
+}
 
-	if (MoveDirection.IsNearlyZero()) {
-		MoveDirection = GetActorForwardVector();
+void ASpartaPawn::ServerMove_Implementation(const TArray<uint8>& Packet)
+{
+	if (NetMoveRole != ENetMoveRole::ServerDriven)
+	{
+		return;
 	}
 
-	float ZOffset = 80.0f; // 지면충돌떄문에 올렸다 라인 트레이스 꾸역꾸역 쓰려면 어쩔수 없음
-	StartLocation.Z += ZOffset;
-	FVector EndLocation = StartLocation;
+	// The client's inputs only ever step as much time as has passed here
+	NetInputQueue.AdvanceServerTime(GetWorld()->GetTimeSeconds());
+	SpartaMovement::FNetBitReader Reader(Packet.GetData(), Packet.Num());
+	NetInputQueue.ReadInputPacket(Reader);
+
+	// Every input that can be stepped now, in order; one all its packets were lost for repeats the one before
+	SpartaMovement::FNetPawnInput Input;
+	bool bLost = false;
+	bool bStepped = false;
+	PullMoveState();
+	while (NetInputQueue.PopInput(Input, USpartaMovementSubsystem::GetNetInputRedundancy(), bLost))
+	{
+		StepNetInput(Input);
+		bStepped = true;
+	}
 
-	// 캡슐 콜리전 사용
-	float DetectionRadius = CapsuleRadius;
-	float DetectionHalfHeight = CapsuleHalfHeight;
-	FCollisionShape CollisionShape = FCollisionShape::MakeCapsule(DetectionRadius, DetectionHalfHeight);
+	if (bStepped)
+	{
+		PushMoveState();
+		MoveActorToState();
+	}
+}
 
-	TArray<FHitResult> HitResults;
+void ASpartaPawn::ClientMoveSnapshot_Implementation(const TArray<uint8>& Packet)
+{
+	if (NetMoveRole != ENetMoveRole::Predicting)
+	{
+		return;
+	}
 
-	FCollisionQueryParams QueryParams;
-	QueryParams.AddIgnoredActor(this); // 자기 자신 무시
+	SpartaMovement::FNetBitReader Reader(Packet.GetData(), Packet.Num());
+	SpartaMovement::FQuantizedMoveState ServerState;
+	uint16 AckedInput = 0;
+	if (!NetSnapshotReceiver.ReadSnapshot(Reader, ServerState, AckedInput) || !NetInputBuffer.IsInHistory(AckedInput))
+	{
+		return;
+	}
 
-	FCollisionObjectQueryParams ObjectQueryParams;
-	ObjectQueryParams.AddObjectTypesToQuery(ECC_WorldDynamic);
-	ObjectQueryParams.AddObjectTypesToQuery(ECC_WorldStatic);
+	// Mispredicted: back to the server's state after AckedInput, then every input since stepped again, the way
+	// CharacterMovement replays its saved moves after a correction
+	PullMoveState();
+	const bool bCorrected = NetInputBuffer.Reconcile(AckedInput, ServerState,
+		[this](const SpartaMovement::FQuantizedMoveState& State)
+		{
+			SpartaMovement::ApplyNetMoveState(SpartaMovement::DequantizeMoveState(State), MoveState);
+		},
+		[this](const SpartaMovement::FNetPawnInput& Input)
+		{
+			StepNetInput(Input);
+			return SpartaMovement::QuantizeMoveState(SpartaMovement::ToNetMoveState(MoveState));
+		});
 
-	bool bHit = GetWorld()->SweepMultiByObjectType(
-		HitResults,
-		StartLocation,
-		EndLocation,
-		FQuat::Identity,
-		ObjectQueryParams,
-		CollisionShape,
-		QueryParams
-	);
+	if (bCorrected)
+	{
+		SPARTA_MOVEMENT_LOG(Verbose, TEXT("%s corrected after input %d"), *GetName(), AckedInput);
+		PushMoveState();
+		MoveActorToState();
+	}
+}
 
-	// 디버그: 탐지 범위 시각화
-	//DrawDebugCapsule(
-	//	GetWorld(),
-	//	StartLocation,            // 캡슐 중심
-	//	DetectionHalfHeight,      // 반 높이
-	//	DetectionRadius,          // 반지름
-	//	FQuat::Identity,          // 회전 (없음)
-	//	FColor::Green,            // 색상 (녹색)
-	//	false,                    // 영구 표시 여부
-	//	2.0f,                     // 지속 시간 (2초)
-	//	0,                        // 깊이 우선 순위
-	//	1.0f                      // 선 두께
-	//);
+void ASpartaPawn::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (USpartaSignificanceSubsystem* Significances = GetWorld()->GetSubsystem<USpartaSignificanceSubsystem>())
+	{
+		Significances->UnregisterActor(this);
+	}
 
-	FVector CurrentVelocity = GetVelocity();
+	if (USpartaMovementSubsystem* Subsystem = GetWorld()->GetSubsystem<USpartaMovementSubsystem>())
+	{
+		Subsystem->OnFloorInvalidated.RemoveAll(this);
+	}
 
-	HitResults.Sort([](const FHitResult& A, const FHitResult& B) {
-		return A.Distance < B.Distance;
-	});
+	if (MovementSubsystem)
+	{
+		MovementSubsystem->UnregisterPawn(this);
+	}
 
-	if (bHit) {
-		for (const FHitResult& Hit : HitResults) {
-			if (Hit.bBlockingHit) {
-				FVector Normal = Hit.ImpactNormal;
-				FVector ActorUp = GetActorUpVector();
+	FlushPendingTransform();
 
-				float DotWithUp = FVector::DotProduct(Normal, ActorUp);
+	Super::EndPlay(EndPlayReason);
+}
 
-				// 지면 판별
-				if (DotWithUp > 0.7f) {
-					//UE_LOG(LogAAA, Warning, TEXT("지면충돌 무시: %f"), DotWithUp);
-					continue;  // 지면 충돌 무시
-				}
+void ASpartaPawn::StartRecording()
+{
+	PullMoveState();
+	MoveState.Location = FSpartaWorldQuery::ToVec3(GetMoveLocation());
+	MoveState.Yaw = GetMoveRotation().Yaw;
 
-				// 디버그 시각화
-				DrawDebugCapsule(GetWorld(), Hit.ImpactPoint + FVector(0, 0, ZOffset), 100.0f, 50.0f, FQuat::Identity, FColor::Red, false, 2.0f);
+	Recorder = MakeUnique<SpartaMovement::FMovementRecorder>();
+	Recorder->BeginPawn(MoveParams, MoveState, GetWorld()->GetTimeSeconds());
+}
 
-				// 반사 벡터 계산
-				FVector ReflectedVelocity = CurrentVelocity - 2 * FVector::DotProduct(CurrentVelocity, Normal) * Normal;
+TUniquePtr<SpartaMovement::FMovementRecorder> ASpartaPawn::StopRecording()
+{
+	return MoveTemp(Recorder);
+}
 
-				// 속도 감소 적용
-				float Elasticity = 0.5f;  // 탄성 계수 감소
-				ReflectedVelocity *= Elasticity;
+SpartaMovement::FNetMoveState ASpartaPawn::GetNetMoveState() const
+{
+	SpartaMovement::FPawnMoveState State = MoveState;
+	if (MovementSubsystem)
+	{
+		MovementSubsystem->LoadState(MovementHandle, State);
+	}
 
-				// 속도 업데이트 (벽 충돌 시 속도 제한)
-				CurrentVelocity = ReflectedVelocity;
+	// The actor transform is authoritative for location and facing
+	State.Location = FSpartaWorldQuery::ToVec3(GetMoveLocation());
+	State.Yaw = GetMoveRotation().Yaw;
+	return SpartaMovement::ToNetMoveState(State);
+}
 
-				// **속도 제한 - 벽에 닿으면 해당 방향 속도 제거**
-				FVector ProjectedVelocity = FVector::VectorPlaneProject(CurrentVelocity, Normal);
+void ASpartaPawn::ApplyNetMoveState(const SpartaMovement::FNetMoveState& NetState)
+{
+	PullMoveState();
+	SpartaMovement::ApplyNetMoveState(NetState, MoveState);
+	PushMoveState();
 
-				//UE_LOG(LogAAA, Warning, TEXT("속도: %s"), *ProjectedVelocity.ToString());
+	// The pawn may have been moved anywhere; what the last wall query found no longer holds
+	CollisionCoherence.Invalidate();
 
-				CurrentVelocity = ProjectedVelocity;
+	MoveActorToState();
 
-				// 밀어내기
-				FVector PushOut = Normal * 10.0f;
-				SetActorLocation(GetActorLocation() + PushOut);
+	WakeUp();
+}
 
-				// 디버그 로그
-				UE_LOG(LogAAA, Warning, TEXT("충돌한 액터: %s"), *Hit.GetActor()->GetName());
-				UE_LOG(LogAAA, Warning, TEXT("법선: %s, 제한 후 속도: %s"), *Normal.ToString(), *CurrentVelocity.ToString());
-				UE_LOG(LogAAA, Warning, TEXT("거리: %f"), Hit.Distance);
-			}
-		}
+void ASpartaPawn::MoveActorToState()
+{
+	FRotator ActorRotation = GetMoveRotation();
+	ActorRotation.Yaw = MoveState.Yaw;
+	MoveActorTo(FSpartaWorldQuery::ToVector(MoveState.Location), ActorRotation);
+}
+
+void ASpartaPawn::MoveActorTo(const FVector& Location, const FRotator& Rotation)
+{
+	SpartaMovementDebug::FTransformStats& Stats = SpartaMovementDebug::GetTransformStats();
+	++Stats.Writes;
+
+	USpartaMovementSubsystem* Subsystem = USpartaMovementSubsystem::IsDeferredTransformsEnabled() ? GetWorld()->GetSubsystem<USpartaMovementSubsystem>() : nullptr;
+	if (!Subsystem)
+	{
+		bHasPendingTransform = false;
+		++Stats.Commits;
+		SetActorLocationAndRotation(Location, Rotation);
+		return;
+	}
+
+	if (!bHasPendingTransform)
+	{
+		Subsystem->AddPendingTransform(this);
+		bHasPendingTransform = true;
+	}
+	PendingLocation = Location;
+	PendingRotation = Rotation;
+}
+
+void ASpartaPawn::FlushPendingTransform()
+{
+	if (!bHasPendingTransform)
+	{
+		return;
+	}
+	bHasPendingTransform = false;
+	++SpartaMovementDebug::GetTransformStats().Commits;
+
+	// One move already updates children and overlaps once; there is nothing left to batch with a scoped update
+	SetActorLocationAndRotation(PendingLocation, PendingRotation);
+}
+
+void ASpartaPawn::RecordInput(SpartaMovement::ERecordTag Tag, const float* Values)
+{
+	if (Recorder)
+	{
+		Recorder->RecordInput(Tag, GetWorld()->GetTimeSeconds(), Values);
+	}
+}
+
+bool ASpartaPawn::NoteStep(bool bAtRest)
+{
+	// Next to something that can move, or on it, the pawn stays awake to react when it does
+	RestSteps = bAtRest && !QueryBuffers.bNearMovable ? RestSteps + 1 : 0;
+	return RestSteps >= MoveParams.StepsToSleep;
+}
+
+void ASpartaPawn::GoToSleep()
+{
+	if (bIsAsleep)
+	{
+		return;
+	}
+
+	bIsAsleep = true;
+	RestSteps = 0;
+
+	// A sleeping pawn does not move, so it can afford overlap events to hear about movers pushing into it
+	CapsuleComp->SetGenerateOverlapEvents(true);
+
+	if (MovementSubsystem)
+	{
+		MovementSubsystem->SetPawnAsleep(this, true);
 	}
+	else
+	{
+		SetActorTickEnabled(false);
+	}
+}
 
-	return bHit;
+void ASpartaPawn::WakeUp()
+{
+	RestSteps = 0;
+	if (!bIsAsleep)
+	{
+		return;
+	}
+
+	bIsAsleep = false;
+	CapsuleComp->SetGenerateOverlapEvents(false);
+
+	if (MovementSubsystem)
+	{
+		MovementSubsystem->SetPawnAsleep(this, false);
+	}
+	else
+	{
+		// 잠든 동안은 정지 상태였으므로 그 시간을 따라잡지 않는다
+		LastStepTime = -1.0;
+		SetActorTickEnabled(true);
+	}
+}
+
+void ASpartaPawn::OnFloorInvalidated(const FBox& Bounds)
+{
+	if (bIsAsleep && Bounds.IsInsideXY(GetMoveLocation()))
+	{
+		WakeUp();
+	}
 }
 
-void ASpartaPawn::UpdateFloorZ()
+void ASpartaPawn::NotifyHit(UPrimitiveComponent* MyComp, AActor* Other, UPrimitiveComponent* OtherComp, bool bSelfMoved,
+	FVector HitLocation, FVector HitNormal, FVector NormalImpulse, const FHitResult& Hit)
 {
-	FVector Start = GetActorLocation();
+	Super::NotifyHit(MyComp, Other, OtherComp, bSelfMoved, HitLocation, HitNormal, NormalImpulse, Hit);
+
+	WakeUp();
+}
 
-	// 속도에 따라 동적으로 바닥 감지 거리 설정
-	float FallSpeed = FMath::Abs(Velocity.Z);  // 현재 Z축 속도의 절댓값
-	float TraceDistance = FMath::Clamp(FallSpeed * 0.1f, 500.f, 10000.f);
-	// 속도가 클수록 더 깊이 검사 (최소 100 ~ 최대 1000)
+void ASpartaPawn::NotifyActorBeginOverlap(AActor* OtherActor)
+{
+	Super::NotifyActorBeginOverlap(OtherActor);
 
-	FVector End = Start - FVector(0.f, 0.f, TraceDistance);
-	FHitResult HitResult;
+	WakeUp();
+}
+
+void ASpartaPawn::PullMoveState()
+{
+	if (MovementSubsystem)
+	{
+		MovementSubsystem->LoadState(MovementHandle, MoveState);
+	}
+}
 
-	bool bHit = GetWorld()->LineTraceSingleByChannel(HitResult, Start, End, ECC_Visibility);
+void ASpartaPawn::PushMoveState()
+{
+	if (MovementSubsystem)
+	{
+		MovementSubsystem->StoreState(MovementHandle, MoveState);
+	}
+}
 
-	DrawDebugLine(GetWorld(), Start, End, bHit ? FColor::Green : FColor::Red, false, 1.f, 0, 2.f);
+void ASpartaPawn::SetSignificance(ESpartaSignificance NewSignificance)
+{
+	Significance = NewSignificance;
 
-	if (bHit)
+	if (USpartaSkeletalMeshComponent* Mesh = Cast<USpartaSkeletalMeshComponent>(SkeletalMeshComp))
 	{
-		CurrentFloorZ = HitResult.Location.Z;
+		Mesh->SetSignificance(NewSignificance);
+	}
 
-		DrawDebugSphere(GetWorld(), HitResult.Location, 5.f, 12, FColor::Blue, false, 1.f);
+	if (MovementSubsystem)
+	{
+		MovementSubsystem->SetPawnSignificance(this, NewSignificance);
+	}
+	else
+	{
+		SetActorTickInterval(USpartaSignificanceSubsystem::GetTickInterval(NewSignificance));
+	}
+}
+
+void ASpartaPawn::Tick(float DeltaTime)
+{
+	SpartaMovementDebug::FScopedFrameTiming Timing(SpartaMovementDebug::GetFrameTimings().PawnTicks);
+	Super::Tick(DeltaTime);
+
+	// 틱 간격이 있으면 DeltaTime은 놓친 시간과 다르므로 직접 잰다
+	const float StepTime = USpartaSignificanceSubsystem::ConsumeStepTime(GetWorld(), LastStepTime, DeltaTime);
+
+	if (NetMoveRole == ENetMoveRole::Predicting)
+	{
+		TickNetPrediction(StepTime);
+		return;
+	}
+	if (NetMoveRole == ENetMoveRole::ServerDriven)
+	{
+		// Stepped by ServerMove; the owning client hears back at the snapshot rate
+		const double Now = GetWorld()->GetTimeSeconds();
+		if (Now - LastNetSnapshotTime >= USpartaMovementSubsystem::GetNetSnapshotInterval())
+		{
+			LastNetSnapshotTime = Now;
+			// Pushes from other pawns land in the body
+			PullMoveState();
+			SpartaMovement::FNetBitWriter Writer(NetBytes);
+			NetSnapshotSender.WriteSnapshot(Writer, SpartaMovement::QuantizeMoveState(SpartaMovement::ToNetMoveState(MoveState)),
+				NetInputQueue.GetLastProcessedInput(), NetInputQueue.GetAckedSnapshot());
+			ClientMoveSnapshot(TArray<uint8>(NetBytes.data(), static_cast<int32>(NetBytes.size())));
+		}
+		return;
+	}
+	if (NetMoveRole == ENetMoveRole::Simulated)
+	{
+		return;
+	}
+
+	// 바닥 감지 -> LineTrace, 벽충돌 감지 -> Sweep, 중력 적용 -> SpartaMovement::TickPawn
+	SpartaMovementDebug::GetTransformStats().AgentFrames += 1;
+
+	MoveState.Location = FSpartaWorldQuery::ToVec3(GetMoveLocation());
+
+	const bool bUseCoherence = USpartaMovementSubsystem::IsCollisionCoherenceEnabled();
+	if (Recorder)
+	{
+		const uint8 StepFlags = (Significance != ESpartaSignificance::Analytic ? SpartaMovement::StepQueriesWorld : 0)
+			| (bUseCoherence ? SpartaMovement::StepCollisionCoherence : 0);
+		Recorder->BeginStep(GetWorld()->GetTimeSeconds(), StepTime, StepFlags);
+	}
+
+	if (Significance == ESpartaSignificance::Analytic)
+	{
+		SpartaMovement::Integrate(MoveState, MoveParams, StepTime);
+	}
+	else
+	{
+		USpartaMovementSubsystem* Subsystem = GetWorld()->GetSubsystem<USpartaMovementSubsystem>();
+		SpartaMovement::FFloorHeightCache* FloorCache = Subsystem ? Subsystem->GetFloorCache() : nullptr;
+
+		// Async results only live for a frame, so only a pawn that steps every frame can use them
+		const bool bAsync = Significance == ESpartaSignificance::Full && FSpartaWorldQuery::IsAsyncEnabled();
+		const FSpartaWorldQuery WorldQuery(GetWorld(), QueryBuffers, FloorCache, bAsync ? ESpartaQueryMode::Async : ESpartaQueryMode::Immediate);
+		SpartaMovement::FCollisionCoherence* Coherence = bUseCoherence ? &CollisionCoherence : nullptr;
+		QueryBuffers.bNearMovable = false;
+		if (Recorder)
+		{
+			SpartaMovement::TickPawn(MoveState, MoveParams, SpartaMovement::FRecordingWorld(WorldQuery, *Recorder), StepTime, Coherence);
+		}
+		else
+		{
+			SpartaMovement::TickPawn(MoveState, MoveParams, WorldQuery, StepTime, Coherence);
+		}
+
+		if (bAsync)
+		{
+			if (FloorCache && QueryBuffers.FloorFill.bPending)
+			{
+				FloorCache->Fill(QueryBuffers.FloorFill, FSpartaWorldQuery(GetWorld(), QueryBuffers));
+			}
+			FSpartaWorldQuery::SubmitAsyncQueries(GetWorld(), QueryBuffers, FSpartaWorldQuery::ToVector(MoveState.Location) - GetMoveLocation());
+		}
+	}
+
+	if (Recorder)
+	{
+		Recorder->EndPawnStep(MoveState);
+	}
+
+	const SpartaMovement::FVec3 PreviousLocation = FSpartaWorldQuery::ToVec3(GetMoveLocation());
+	MoveActorTo(FSpartaWorldQuery::ToVector(MoveState.Location));
+
+	if (NoteStep(SpartaMovement::IsAtRest(MoveState, MoveParams, PreviousLocation)))
+	{
+		GoToSleep();
 	}
 }
 
@@ -236,6 +601,16 @@ void ASpartaPawn::Move(const FInputActionValue& value)
 	const FVector2D MoveInput = value.Get<FVector2D>();
 	if (MoveInput.IsNearlyZero()) return;
 
+	WakeUp();
+
+	if (NetMoveRole == ENetMoveRole::Predicting)
+	{
+		// Stepped in Tick, as one input with the rest of the frame's
+		NetMoveInput = MoveInput;
+		NetControlYaw = Controller->GetControlRotation().Yaw;
+		return;
+	}
+
 	MovementByActorWorldOffset(MoveInput);
 
 	/*
@@ -248,68 +623,82 @@ void ASpartaPawn::Move(const FInputActionValue& value)
 void ASpartaPawn::MovementByActorWorldOffset(const FVector2D moveInput)
 {
 	// 컨트롤러의 회전값 가져오기 (Yaw만 사용)
-	FRotator ControlRotation = Controller->GetControlRotation();
-	FRotator YawRotation(0, ControlRotation.Yaw, 0);
-
-	// 컨트롤러의 Forward(앞), Right(오른쪽) 벡터 계산
-	FVector ForwardDirection = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::X);
-	FVector RightDirection = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::Y);
-
-	// 이동 벡터 계산
-	FVector MoveDirection = (ForwardDirection * moveInput.X) + (RightDirection * moveInput.Y);
-	
-	if (!MoveDirection.IsNearlyZero())
-	{
-		SetActorRotate(MoveDirection);
-	}
-
-	float BaseSpeed = bIsSprinting ? SprintSpeed : WalkingSpeed;
-	CurrentSpeed = bIsJumping ? BaseSpeed / 2 : BaseSpeed;
+	const float ControlYaw = Controller->GetControlRotation().Yaw;
 
+	FRotator ActorRotation = GetMoveRotation();
+	PullMoveState();
+	MoveState.Yaw = ActorRotation.Yaw;
 
-	// 이동 적용 (Tick)
-	AddActorWorldOffset(MoveDirection * CurrentSpeed * GetWorld()->GetDeltaSeconds(), true);
-}
+	// The controller's yaw goes in with the move, so a replay does not need the controller
+	const float DeltaSeconds = GetWorld()->GetDeltaSeconds();
+	const float MoveValues[] = { static_cast<float>(moveInput.X), static_cast<float>(moveInput.Y), ControlYaw, DeltaSeconds };
+	RecordInput(SpartaMovement::ERecordTag::PawnMove, MoveValues);
 
-void ASpartaPawn::SetActorRotate(FVector MoveDirection)
-{
-	MoveDirection.Normalize(); // 이동 방향 정규화
+	// 이동 벡터 계산 + 이동 방향으로 회전
+	const SpartaMovement::FVec3 Offset = SpartaMovement::ComputeWalkDisplacement(
+		MoveState, MoveParams, ControlYaw, moveInput.X, moveInput.Y, DeltaSeconds);
 
-	// 현재 속도 계산 (이동량 기반)
-	float Speed = MoveDirection.Size(); // 이동 벡터의 크기 → 속도 판단 기준
-	float SpeedThreshold = 10.0f;
+	// 이동 적용: 캡슐 스윕 후 벽을 따라 미끄러짐 (빠른 이동에도 벽을 통과하지 않음)
+	MoveState.Location = FSpartaWorldQuery::ToVec3(GetMoveLocation());
+	const FSpartaWorldQuery WorldQuery(GetWorld(), QueryBuffers);
+	if (Recorder)
+	{
+		SpartaMovement::SlidePawn(MoveState, MoveParams, Offset, SpartaMovement::FRecordingWorld(WorldQuery, *Recorder));
+	}
+	else
+	{
+		SpartaMovement::SlidePawn(MoveState, MoveParams, Offset, WorldQuery);
+	}
 
-	// 이동 방향을 Rotator로 변환
-	FRotator TargetRotation = MoveDirection.Rotation();
+	PushMoveState();
 
-	float RotationSpeed = 5.0f;  // 회전 속도 (값이 클수록 빠르게 회전)
-	FRotator NewRotation = FMath::RInterpTo(GetActorRotation(), TargetRotation, GetWorld()->GetDeltaSeconds(), RotationSpeed);
-	SetActorRotation(NewRotation);
+	ActorRotation.Yaw = MoveState.Yaw;
+	MoveActorTo(FSpartaWorldQuery::ToVector(MoveState.Location), ActorRotation);
 }
 
 void ASpartaPawn::Startjump(const FInputActionValue& value)
 {
 	if (value.Get<bool>())
 	{
-		if (!bIsJumping)
+		if (NetMoveRole == ENetMoveRole::Predicting)
 		{
-			UE_LOG(LogAAA, Warning, TEXT("Startjump"));
-			bIsJumping = true;
-			Velocity.Z = 600.f;
+			bNetJump = true;
+			return;
+		}
+
+		RecordInput(SpartaMovement::ERecordTag::PawnJumpStart);
+		WakeUp();
+		PullMoveState();
+		if (SpartaMovement::StartJump(MoveState, MoveParams))
+		{
+			SPARTA_MOVEMENT_LOG(Verbose, TEXT("Startjump"));
+			PushMoveState();
 		}
 	}
 }
 
 void ASpartaPawn::StopJump(const FInputActionValue& value)
 {
-	if (!bIsJumping) return;
+	if (NetMoveRole == ENetMoveRole::Predicting)
+	{
+		// StepPawnInput cuts the jump, on both ends
+		bNetJumpRelease |= !value.Get<bool>();
+		return;
+	}
+
+	const float Pressed = value.Get<bool>() ? 1.f : 0.f;
+	RecordInput(SpartaMovement::ERecordTag::PawnJumpStop, &Pressed);
+
+	PullMoveState();
+	if (!MoveState.bIsJumping) return;
 
 	if (!value.Get<bool>())
 	{
-		if (Velocity.Z > 300.f)
+		if (MoveState.Velocity.Z > MoveParams.JumpCutVelocity)
 		{
-			UE_LOG(LogAAA, Warning, TEXT("StopJump Triggered"));
-			Velocity.Z = 300.f;
+			SPARTA_MOVEMENT_LOG(Verbose, TEXT("StopJump Triggered"));
+			SpartaMovement::StopJump(MoveState, MoveParams);
+			PushMoveState();
 		}
 	}
 }
@@ -318,6 +707,9 @@ void ASpartaPawn::Look(const FInputActionValue& value)
 {
 	FVector2D LookInput = value.Get<FVector2D>();
 
+	const float LookValues[] = { static_cast<float>(LookInput.X), static_cast<float>(LookInput.Y) };
+	RecordInput(SpartaMovement::ERecordTag::PawnLook, LookValues);
+
 	if (Controller)
 	{
 		AddControllerYawInput(LookInput.X);
@@ -325,18 +717,36 @@ void ASpartaPawn::Look(const FInputActionValue& value)
 	}
 	else
 	{
-		UE_LOG(LogAAA, Warning, TEXT("No Controller"));
+		SPARTA_MOVEMENT_LOG(Verbose, TEXT("No Controller"));
 	}
 }
 
 void ASpartaPawn::StartSprint(const FInputActionValue& value)
 {
-	bIsSprinting = true;
+	if (NetMoveRole == ENetMoveRole::Predicting)
+	{
+		bNetSprint = true;
+		return;
+	}
+
+	RecordInput(SpartaMovement::ERecordTag::PawnSprintStart);
+	PullMoveState();
+	MoveState.bIsSprinting = true;
+	PushMoveState();
 }
 
 void ASpartaPawn::StopSprint(const FInputActionValue& value)
 {
-	bIsSprinting = false;
+	if (NetMoveRole == ENetMoveRole::Predicting)
+	{
+		bNetSprint = false;
+		return;
+	}
+
+	RecordInput(SpartaMovement::ERecordTag::PawnSprintStop);
+	PullMoveState();
+	MoveState.bIsSprinting = false;
+	PushMoveState();
 }
 
 void ASpartaPawn::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
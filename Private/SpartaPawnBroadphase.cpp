@@ -0,0 +1,259 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaPawnBroadphase.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SpartaMovement
+{
+	namespace
+	{
+		/** Overlap, in cm, below which capsules count as touching rather than overlapping, so separated pairs stay separated */
+		constexpr float ContactTolerance = 0.01f;
+
+		/**
+		 * Upright capsules A and B: whether they overlap, and the horizontal move of B that separates them.
+		 * The push is exact for capsules offset in height too: it restores the full radius sum along the
+		 * line between the closest points of the two core segments.
+		 */
+		bool TestCapsules(const FVec3& CenterA, float RadiusA, float HalfHeightA, const FVec3& CenterB, float RadiusB, float HalfHeightB, FVec3& OutSeparation)
+		{
+			const float RadiusSum = RadiusA + RadiusB;
+			const float DX = CenterB.X - CenterA.X;
+			const float DY = CenterB.Y - CenterA.Y;
+			const float DistXYSquared = DX * DX + DY * DY;
+			if (DistXYSquared >= RadiusSum * RadiusSum)
+			{
+				return false;
+			}
+
+			// Vertical gap between the core segments, zero while they overlap in height
+			const float SegmentHalfHeights = std::max(HalfHeightA - RadiusA, 0.f) + std::max(HalfHeightB - RadiusB, 0.f);
+			const float GapZ = std::max(std::fabs(CenterB.Z - CenterA.Z) - SegmentHalfHeights, 0.f);
+			if (GapZ >= RadiusSum)
+			{
+				return false;
+			}
+
+			// Horizontal distance at which the capsules just touch
+			const float TouchDistXY = std::sqrt(RadiusSum * RadiusSum - GapZ * GapZ);
+			const float DistXY = std::sqrt(DistXYSquared);
+			if (DistXY >= TouchDistXY - ContactTolerance)
+			{
+				return false;
+			}
+
+			// Exactly on top of each other: any direction will do, as long as it is the same every time
+			const FVec3 Direction = DistXY > 1.e-3f ? FVec3(DX / DistXY, DY / DistXY, 0.f) : FVec3(1.f, 0.f, 0.f);
+			OutSeparation = Direction * (TouchDistXY - DistXY);
+			return true;
+		}
+
+		int32_t ToCell(float Coordinate, float InvCellSize)
+		{
+			return static_cast<int32_t>(std::floor(Coordinate * InvCellSize));
+		}
+	}
+
+	FPawnSpatialHash::FPawnSpatialHash(float InCellSize, int32_t InNumBuckets)
+		: CellSize(std::max(InCellSize, 1.f))
+		, InvCellSize(1.f / std::max(InCellSize, 1.f))
+	{
+		uint32_t NumBuckets = 1;
+		while (NumBuckets < static_cast<uint32_t>(std::max(InNumBuckets, 1)))
+		{
+			NumBuckets <<= 1;
+		}
+		BucketMask = NumBuckets - 1;
+		Heads.assign(NumBuckets, -1);
+	}
+
+	void FPawnSpatialHash::Reserve(int32_t Capacity)
+	{
+		Centers.reserve(Capacity);
+		Radii.reserve(Capacity);
+		HalfHeights.reserve(Capacity);
+		CellXs.reserve(Capacity);
+		CellYs.reserve(Capacity);
+		Next.reserve(Capacity);
+		Prev.reserve(Capacity);
+	}
+
+	int32_t FPawnSpatialHash::GetBucket(int32_t CellX, int32_t CellY) const
+	{
+		const uint32_t Hash = static_cast<uint32_t>(CellX) * 73856093u ^ static_cast<uint32_t>(CellY) * 19349663u;
+		return static_cast<int32_t>(Hash & BucketMask);
+	}
+
+	void FPawnSpatialHash::Link(int32_t Index)
+	{
+		const int32_t Bucket = GetBucket(CellXs[Index], CellYs[Index]);
+		Prev[Index] = -1;
+		Next[Index] = Heads[Bucket];
+		if (Heads[Bucket] >= 0)
+		{
+			Prev[Heads[Bucket]] = Index;
+		}
+		Heads[Bucket] = Index;
+	}
+
+	void FPawnSpatialHash::Unlink(int32_t Index)
+	{
+		if (Prev[Index] >= 0)
+		{
+			Next[Prev[Index]] = Next[Index];
+		}
+		else
+		{
+			Heads[GetBucket(CellXs[Index], CellYs[Index])] = Next[Index];
+		}
+		if (Next[Index] >= 0)
+		{
+			Prev[Next[Index]] = Prev[Index];
+		}
+	}
+
+	void FPawnSpatialHash::SetCellSize(float InCellSize)
+	{
+		CellSize = InCellSize;
+		InvCellSize = 1.f / InCellSize;
+
+		std::fill(Heads.begin(), Heads.end(), -1);
+		for (int32_t Index = 0; Index < Num(); ++Index)
+		{
+			CellXs[Index] = ToCell(Centers[Index].X, InvCellSize);
+			CellYs[Index] = ToCell(Centers[Index].Y, InvCellSize);
+			Link(Index);
+		}
+	}
+
+	int32_t FPawnSpatialHash::Add(const FVec3& Center, float Radius, float HalfHeight)
+	{
+		const int32_t Index = Num();
+		Centers.push_back(Center);
+		Radii.push_back(Radius);
+		HalfHeights.push_back(HalfHeight);
+		CellXs.push_back(ToCell(Center.X, InvCellSize));
+		CellYs.push_back(ToCell(Center.Y, InvCellSize));
+		Next.push_back(-1);
+		Prev.push_back(-1);
+		Link(Index);
+
+		if (2.f * Radius > CellSize)
+		{
+			SetCellSize(2.f * Radius);
+		}
+		return Index;
+	}
+
+	void FPawnSpatialHash::RemoveAtSwap(int32_t Index)
+	{
+		const int32_t Last = Num() - 1;
+		Unlink(Index);
+		if (Index != Last)
+		{
+			Unlink(Last);
+			Centers[Index] = Centers[Last];
+			Radii[Index] = Radii[Last];
+			HalfHeights[Index] = HalfHeights[Last];
+			CellXs[Index] = CellXs[Last];
+			CellYs[Index] = CellYs[Last];
+			Link(Index);
+		}
+
+		Centers.pop_back();
+		Radii.pop_back();
+		HalfHeights.pop_back();
+		CellXs.pop_back();
+		CellYs.pop_back();
+		Next.pop_back();
+		Prev.pop_back();
+	}
+
+	void FPawnSpatialHash::Swap(int32_t A, int32_t B)
+	{
+		if (A == B)
+		{
+			return;
+		}
+
+		Unlink(A);
+		Unlink(B);
+		std::swap(Centers[A], Centers[B]);
+		std::swap(Radii[A], Radii[B]);
+		std::swap(HalfHeights[A], HalfHeights[B]);
+		std::swap(CellXs[A], CellXs[B]);
+		std::swap(CellYs[A], CellYs[B]);
+		Link(A);
+		Link(B);
+	}
+
+	void FPawnSpatialHash::Update(int32_t Index, const FVec3& Center)
+	{
+		++NumUpdates;
+		Centers[Index] = Center;
+
+		const int32_t CellX = ToCell(Center.X, InvCellSize);
+		const int32_t CellY = ToCell(Center.Y, InvCellSize);
+		if (CellX == CellXs[Index] && CellY == CellYs[Index])
+		{
+			return;
+		}
+
+		++NumRelinks;
+		Unlink(Index);
+		CellXs[Index] = CellX;
+		CellYs[Index] = CellY;
+		Link(Index);
+	}
+
+	void FPawnSpatialHash::FindContacts(std::vector<FPawnContact>& OutContacts) const
+	{
+		FPawnContact Contact;
+		for (int32_t Index = 0; Index < Num(); ++Index)
+		{
+			for (int32_t OffsetY = -1; OffsetY <= 1; ++OffsetY)
+			{
+				for (int32_t OffsetX = -1; OffsetX <= 1; ++OffsetX)
+				{
+					const int32_t CellX = CellXs[Index] + OffsetX;
+					const int32_t CellY = CellYs[Index] + OffsetY;
+
+					// Buckets are shared between cells; the cell check makes every pair come up exactly once
+					for (int32_t Other = Heads[GetBucket(CellX, CellY)]; Other >= 0; Other = Next[Other])
+					{
+						if (Other <= Index || CellXs[Other] != CellX || CellYs[Other] != CellY)
+						{
+							continue;
+						}
+
+						if (TestCapsules(Centers[Index], Radii[Index], HalfHeights[Index], Centers[Other], Radii[Other], HalfHeights[Other], Contact.Separation))
+						{
+							Contact.A = Index;
+							Contact.B = Other;
+							OutContacts.push_back(Contact);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void FindContactsBruteForce(const FVec3* Centers, const float* Radii, const float* HalfHeights, int32_t Num, std::vector<FPawnContact>& OutContacts)
+	{
+		FPawnContact Contact;
+		for (int32_t Index = 0; Index < Num; ++Index)
+		{
+			for (int32_t Other = Index + 1; Other < Num; ++Other)
+			{
+				if (TestCapsules(Centers[Index], Radii[Index], HalfHeights[Index], Centers[Other], Radii[Other], HalfHeights[Other], Contact.Separation))
+				{
+					Contact.A = Index;
+					Contact.B = Other;
+					OutContacts.push_back(Contact);
+				}
+			}
+		}
+	}
+}
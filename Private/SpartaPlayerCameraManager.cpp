@@ -0,0 +1,92 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaPlayerCameraManager.h"
+#include "SpartaDrone.h"
+#include "SpartaPawn.h"
+
+#include "Engine/World.h"
+
+const FSpartaCameraRigSettings* ASpartaPlayerCameraManager::GetRigSettings(const AActor* Target)
+{
+	if (const ASpartaPawn* Pawn = Cast<ASpartaPawn>(Target))
+	{
+		return &Pawn->CameraRig;
+	}
+	if (const ASpartaDrone* Drone = Cast<ASpartaDrone>(Target))
+	{
+		return &Drone->CameraRig;
+	}
+	return nullptr;
+}
+
+ASpartaPlayerCameraManager::FRigStats& ASpartaPlayerCameraManager::GetRigStats()
+{
+	static FRigStats Stats;
+	return Stats;
+}
+
+void ASpartaPlayerCameraManager::UpdateViewTarget(FTViewTarget& OutVT, float DeltaTime)
+{
+	++GetRigStats().Frames;
+
+	// Other view targets and blends between view targets keep the engine's handling
+	const FSpartaCameraRigSettings* Rig = OutVT.Target && !PendingViewTarget.Target ? GetRigSettings(OutVT.Target) : nullptr;
+	if (!Rig)
+	{
+		RigTarget.Reset();
+		Super::UpdateViewTarget(OutVT, DeltaTime);
+		return;
+	}
+
+	UpdateRig(OutVT, *Rig, DeltaTime);
+
+	// Modifiers and shakes on top, as the engine does after CalcCamera
+	ApplyCameraModifiers(DeltaTime, OutVT.POV);
+	SetActorLocationAndRotation(OutVT.POV.Location, OutVT.POV.Rotation, false);
+	UpdateCameraLensEffects(OutVT);
+}
+
+void ASpartaPlayerCameraManager::UpdateRig(FTViewTarget& OutVT, const FSpartaCameraRigSettings& Rig, float DeltaTime)
+{
+	const AActor* Target = OutVT.Target;
+	++GetRigStats().RigUpdates;
+
+	FQuat DesiredRotation = Target->GetActorQuat();
+	if (Rig.bUsePawnControlRotation)
+	{
+		if (const APawn* Pawn = Cast<APawn>(Target))
+		{
+			DesiredRotation = Pawn->GetViewRotation().Quaternion();
+		}
+	}
+	const FVector DesiredPivot = Target->GetActorLocation() + Rig.TargetOffset;
+
+	// A new target starts settled instead of swinging over from the last one
+	if (RigTarget.Get() != Target)
+	{
+		RigTarget = Target;
+		RigPivot = DesiredPivot;
+		RigRotation = DesiredRotation;
+	}
+
+	RigRotation = Rig.RotationLagSpeed > 0.0f ? FMath::QInterpTo(RigRotation, DesiredRotation, DeltaTime, Rig.RotationLagSpeed) : DesiredRotation;
+	RigPivot = Rig.LocationLagSpeed > 0.0f ? FMath::VInterpTo(RigPivot, DesiredPivot, DeltaTime, Rig.LocationLagSpeed) : DesiredPivot;
+
+	FVector CameraLocation = RigPivot - RigRotation.GetForwardVector() * Rig.ArmLength + RigRotation.RotateVector(Rig.SocketOffset);
+
+	if (Rig.bDoCollisionTest && Rig.ArmLength > 0.0f)
+	{
+		++GetRigStats().Probes;
+
+		FCollisionQueryParams Params(SCENE_QUERY_STAT(SpartaCameraProbe), false, Target);
+		FHitResult Hit;
+		if (GetWorld()->SweepSingleByChannel(Hit, RigPivot, CameraLocation, FQuat::Identity, Rig.ProbeChannel, FCollisionShape::MakeSphere(Rig.ProbeSize), Params))
+		{
+			CameraLocation = Hit.Location;
+		}
+	}
+
+	OutVT.POV.Location = CameraLocation;
+	OutVT.POV.Rotation = RigRotation.Rotator();
+	OutVT.POV.FOV = Rig.FieldOfView;
+}
@@ -2,6 +2,7 @@
 
 
 #include "SpartaPlayerController.h"
+#include "SpartaPlayerCameraManager.h"
 #include "EnhancedInputSubsystems.h"
 
 ASpartaPlayerController::ASpartaPlayerController()
@@ -10,7 +11,9 @@ ASpartaPlayerController::ASpartaPlayerController()
 	JumpAction(nullptr),
 	LookAction(nullptr),
 	SprintAction(nullptr)
-{}
+{
+	PlayerCameraManagerClass = ASpartaPlayerCameraManager::StaticClass();
+}
 
 void ASpartaPlayerController::BeginPlay()
 {
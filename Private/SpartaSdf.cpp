@@ -0,0 +1,1116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaSdf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SPARTA_MOVEMENT_AVX2 1
+#define SPARTA_MOVEMENT_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPARTA_MOVEMENT_AVX2 0
+#define SPARTA_MOVEMENT_SSE2 1
+#else
+#define SPARTA_MOVEMENT_AVX2 0
+#define SPARTA_MOVEMENT_SSE2 0
+#endif
+
+namespace SpartaMovement
+{
+	namespace
+	{
+		constexpr int32_t BrickVolume = FSdfVolume::BrickSamples * FSdfVolume::BrickSamples * FSdfVolume::BrickSamples;
+		/** Samples a brick owns for voxelizing: all but its last layer on each axis, which the next brick owns */
+		constexpr int32_t OwnedVolume = FSdfVolume::BrickCells * FSdfVolume::BrickCells * FSdfVolume::BrickCells;
+		/** Corners of a cell, from its first sample: X, then Y, then Z neighbours */
+		constexpr int32_t CornerOffsets[8] = { 0, 1, 8, 9, 64, 65, 72, 73 };
+		/** Float positions of bricks and samples are converted to indices exactly up to here */
+		constexpr int64_t MaxBricks = 1 << 24;
+		/** Distance transform input for samples that are not seeds; finite, so differences never make a NaN */
+		constexpr float NotASeed = 1.e20f;
+
+		/** Floor probe tuning, in voxels */
+		constexpr float ProbeHitTolerance = 0.02f;
+		constexpr float ProbeMinStep = 0.25f;
+		constexpr float ProbeLift = 1.f;
+		constexpr int32_t ProbeMaxSamples = 64;
+		constexpr int32_t ProbeRefineSamples = 2;
+		/** Probes TraceFloorBatch samples together */
+		constexpr int32_t ProbeBatchSize = 64;
+
+		/** Sweep tuning: hit clearance in voxels, and how far into the surface a move must point to be stopped */
+		constexpr float SweepHitTolerance = 0.05f;
+		constexpr float SweepMinApproach = 0.05f;
+		constexpr int32_t SweepMaxSamples = 64;
+
+		/** Contacts whose normals are closer than this are the same contact */
+		constexpr float SameContactNormalDot = 0.9f;
+
+		inline float Lerp(float A, float B, float Alpha) { return A + (B - A) * Alpha; }
+
+		/**
+		 * Squared distance transform of one row (Felzenszwalb and Huttenlocher): Out[I] = min over J of (I - J)^2 + In[J].
+		 * Hull holds N ints and Bounds N + 1 floats.
+		 */
+		void DistanceTransformRow(const float* In, float* Out, int32_t N, int32_t* Hull, float* Bounds)
+		{
+			const float Infinity = std::numeric_limits<float>::infinity();
+
+			int32_t K = 0;
+			Hull[0] = 0;
+			Bounds[0] = -Infinity;
+			Bounds[1] = Infinity;
+			for (int32_t Q = 1; Q < N; ++Q)
+			{
+				float S = 0.f;
+				for (;;)
+				{
+					const int32_t P = Hull[K];
+					S = ((In[Q] + static_cast<float>(Q * Q)) - (In[P] + static_cast<float>(P * P))) / static_cast<float>(2 * (Q - P));
+					if (S > Bounds[K])
+					{
+						break;
+					}
+					--K;
+				}
+				++K;
+				Hull[K] = Q;
+				Bounds[K] = S;
+				Bounds[K + 1] = Infinity;
+			}
+
+			K = 0;
+			for (int32_t Q = 0; Q < N; ++Q)
+			{
+				while (Bounds[K + 1] < static_cast<float>(Q))
+				{
+					++K;
+				}
+				const float Offset = static_cast<float>(Q - Hull[K]);
+				Out[Q] = Offset * Offset + In[Hull[K]];
+			}
+		}
+
+		/** Rows for DistanceTransformBlock */
+		struct FDistanceTransformScratch
+		{
+			std::vector<float> In;
+			std::vector<float> Out;
+			std::vector<int32_t> Hull;
+			std::vector<float> Bounds;
+		};
+
+		/**
+		 * Squared distance, in voxels, to the nearest seed, in place, for the BrickSamples^3 samples Band in from every
+		 * side of a Size^3 block. Each pass only covers the rows the later passes read.
+		 */
+		void DistanceTransformBlock(std::vector<float>& Block, int32_t Size, int32_t Band, FDistanceTransformScratch& Scratch)
+		{
+			Scratch.In.resize(Size);
+			Scratch.Out.resize(Size);
+			Scratch.Hull.resize(Size);
+			Scratch.Bounds.resize(Size + 1);
+
+			const int32_t Strides[3] = { 1, Size, Size * Size };
+			const int32_t CenterEnd = Band + FSdfVolume::BrickSamples;
+			for (int32_t Axis = 0; Axis < 3; ++Axis)
+			{
+				const int32_t Stride = Strides[Axis];
+				// Rows run along Axis; A and B are the other two axes, lower one first
+				const int32_t AxisA = Axis == 0 ? 1 : 0;
+				const int32_t AxisB = Axis == 2 ? 1 : 2;
+				const int32_t BeginA = AxisA < Axis ? Band : 0;
+				const int32_t EndA = AxisA < Axis ? CenterEnd : Size;
+				const int32_t BeginB = AxisB < Axis ? Band : 0;
+				const int32_t EndB = AxisB < Axis ? CenterEnd : Size;
+
+				for (int32_t B = BeginB; B < EndB; ++B)
+				{
+					for (int32_t A = BeginA; A < EndA; ++A)
+					{
+						float* Row = Block.data() + A * Strides[AxisA] + B * Strides[AxisB];
+						bool bHasSeed = false;
+						for (int32_t I = 0; I < Size; ++I)
+						{
+							Scratch.In[I] = Row[I * Stride];
+							bHasSeed |= Scratch.In[I] < NotASeed;
+						}
+						// Nothing to spread: the row stays as it is
+						if (!bHasSeed)
+						{
+							continue;
+						}
+
+						DistanceTransformRow(Scratch.In.data(), Scratch.Out.data(), Size, Scratch.Hull.data(), Scratch.Bounds.data());
+						for (int32_t I = 0; I < Size; ++I)
+						{
+							Row[I * Stride] = std::min(Scratch.Out[I], NotASeed);
+						}
+					}
+				}
+			}
+		}
+
+		/**
+		 * Which samples are solid, kept per brick of owned samples over the grid plus one brick on each upper side,
+		 * so the last sample layer has an owner too. Each brick is voxelized the first time it is asked for.
+		 */
+		class FOccupancyGrid
+		{
+		public:
+			static constexpr int32_t Unknown = -1;
+			static constexpr int32_t AllEmpty = -2;
+			static constexpr int32_t AllSolid = -3;
+
+			FOccupancyGrid(const ISdfBakeSource& InSource, const FVec3& InOrigin, float InVoxelSize, int32_t InBricksX, int32_t InBricksY, int32_t InBricksZ)
+				: Source(InSource),
+				Origin(InOrigin),
+				VoxelSize(InVoxelSize),
+				BricksX(InBricksX + 1),
+				BricksY(InBricksY + 1),
+				BricksZ(InBricksZ + 1),
+				Entries(static_cast<size_t>(BricksX) * BricksY * BricksZ, Unknown)
+			{}
+
+			/**
+			 * Whether the Size^3 samples from (X, Y, Z) are all empty or all solid, without voxelizing bricks the source
+			 * classifies. OutEntry is AllEmpty or AllSolid if so.
+			 */
+			bool IsUniform(int32_t X, int32_t Y, int32_t Z, int32_t Size, int32_t& OutEntry)
+			{
+				const int32_t Firsts[3] = { X, Y, Z };
+				const int32_t Counts[3] = { BricksX, BricksY, BricksZ };
+				int32_t MinOwner[3];
+				int32_t MaxOwner[3];
+				for (int32_t Axis = 0; Axis < 3; ++Axis)
+				{
+					const int32_t LastSample = Counts[Axis] * FSdfVolume::BrickCells - 1;
+					MinOwner[Axis] = std::clamp(Firsts[Axis], 0, LastSample) / FSdfVolume::BrickCells;
+					MaxOwner[Axis] = std::clamp(Firsts[Axis] + Size - 1, 0, LastSample) / FSdfVolume::BrickCells;
+				}
+
+				OutEntry = Unknown;
+				for (int32_t BrickZ = MinOwner[2]; BrickZ <= MaxOwner[2]; ++BrickZ)
+				{
+					for (int32_t BrickY = MinOwner[1]; BrickY <= MaxOwner[1]; ++BrickY)
+					{
+						for (int32_t BrickX = MinOwner[0]; BrickX <= MaxOwner[0]; ++BrickX)
+						{
+							const int32_t Entry = GetBrick(BrickX, BrickY, BrickZ);
+							if (Entry >= 0 || (OutEntry != Unknown && Entry != OutEntry))
+							{
+								return false;
+							}
+							OutEntry = Entry;
+						}
+					}
+				}
+				return true;
+			}
+
+			/** IsSolid for the Size^3 samples from (X, Y, Z), X fastest */
+			void FillBlock(int32_t X, int32_t Y, int32_t Z, int32_t Size, uint8_t* OutSolid)
+			{
+				const int32_t Firsts[3] = { X, Y, Z };
+				const int32_t Counts[3] = { BricksX, BricksY, BricksZ };
+				// Owner brick and sample inside it, per coordinate along each axis
+				Owners.resize(3 * Size);
+				Locals.resize(3 * Size);
+				for (int32_t Axis = 0; Axis < 3; ++Axis)
+				{
+					const int32_t LastSample = Counts[Axis] * FSdfVolume::BrickCells - 1;
+					for (int32_t Index = 0; Index < Size; ++Index)
+					{
+						const int32_t Sample = std::clamp(Firsts[Axis] + Index, 0, LastSample);
+						Owners[Axis * Size + Index] = Sample / FSdfVolume::BrickCells;
+						Locals[Axis * Size + Index] = Sample - Owners[Axis * Size + Index] * FSdfVolume::BrickCells;
+					}
+				}
+
+				const int32_t* OwnersX = Owners.data();
+				const int32_t* OwnersY = Owners.data() + Size;
+				const int32_t* OwnersZ = Owners.data() + 2 * Size;
+				// Owners only grow along each axis: the first and last are the range to voxelize
+				for (int32_t BrickZ = OwnersZ[0]; BrickZ <= OwnersZ[Size - 1]; ++BrickZ)
+				{
+					for (int32_t BrickY = OwnersY[0]; BrickY <= OwnersY[Size - 1]; ++BrickY)
+					{
+						for (int32_t BrickX = OwnersX[0]; BrickX <= OwnersX[Size - 1]; ++BrickX)
+						{
+							GetBrick(BrickX, BrickY, BrickZ);
+						}
+					}
+				}
+
+				const int32_t* LocalsX = Locals.data();
+				const int32_t* LocalsY = Locals.data() + Size;
+				const int32_t* LocalsZ = Locals.data() + 2 * Size;
+				for (int32_t IndexZ = 0; IndexZ < Size; ++IndexZ)
+				{
+					for (int32_t IndexY = 0; IndexY < Size; ++IndexY)
+					{
+						const int32_t* Row = Entries.data() + (static_cast<size_t>(OwnersZ[IndexZ]) * BricksY + OwnersY[IndexY]) * BricksX;
+						const int32_t LocalRow = (LocalsZ[IndexZ] * FSdfVolume::BrickCells + LocalsY[IndexY]) * FSdfVolume::BrickCells;
+						for (int32_t IndexX = 0; IndexX < Size; ++IndexX)
+						{
+							const int32_t Entry = Row[OwnersX[IndexX]];
+							*OutSolid++ = Entry >= 0 ? Pool[Entry + LocalRow + LocalsX[IndexX]] : (Entry == AllSolid ? 1 : 0);
+						}
+					}
+				}
+			}
+
+			/** AllEmpty, AllSolid or where the brick's samples start in Pool. Bricks past the grid read as empty. */
+			int32_t GetBrick(int32_t BrickX, int32_t BrickY, int32_t BrickZ)
+			{
+				if (BrickX < 0 || BrickY < 0 || BrickZ < 0 || BrickX >= BricksX || BrickY >= BricksY || BrickZ >= BricksZ)
+				{
+					return AllEmpty;
+				}
+
+				int32_t& Entry = Entries[(static_cast<size_t>(BrickZ) * BricksY + BrickY) * BricksX + BrickX];
+				if (Entry == Unknown)
+				{
+					Entry = Voxelize(BrickX, BrickY, BrickZ);
+				}
+				return Entry;
+			}
+
+			uint64_t NumSolidQueries = 0;
+			int32_t NumClassifiedBricks = 0;
+
+		private:
+			int32_t Voxelize(int32_t BrickX, int32_t BrickY, int32_t BrickZ)
+			{
+				const float BrickSize = FSdfVolume::BrickCells * VoxelSize;
+				const float HalfVoxel = VoxelSize * 0.5f;
+				const FVec3 First = Origin + FVec3(BrickX * BrickSize, BrickY * BrickSize, BrickZ * BrickSize);
+				const FVec3 Last = First + FVec3(BrickSize - VoxelSize, BrickSize - VoxelSize, BrickSize - VoxelSize);
+
+				switch (Source.ClassifyRegion(First - FVec3(HalfVoxel, HalfVoxel, HalfVoxel), Last + FVec3(HalfVoxel, HalfVoxel, HalfVoxel)))
+				{
+				case ESdfRegion::Empty:
+					++NumClassifiedBricks;
+					return AllEmpty;
+				case ESdfRegion::Solid:
+					++NumClassifiedBricks;
+					return AllSolid;
+				default:
+					break;
+				}
+
+				const int32_t Entry = static_cast<int32_t>(Pool.size());
+				Pool.resize(Pool.size() + OwnedVolume);
+
+				int32_t NumSolid = 0;
+				uint8_t* Owned = Pool.data() + Entry;
+				for (int32_t Z = 0; Z < FSdfVolume::BrickCells; ++Z)
+				{
+					for (int32_t Y = 0; Y < FSdfVolume::BrickCells; ++Y)
+					{
+						for (int32_t X = 0; X < FSdfVolume::BrickCells; ++X)
+						{
+							const bool bSolid = Source.IsSolid(First + FVec3(X * VoxelSize, Y * VoxelSize, Z * VoxelSize), HalfVoxel);
+							*Owned++ = bSolid ? 1 : 0;
+							NumSolid += bSolid ? 1 : 0;
+						}
+					}
+				}
+				NumSolidQueries += OwnedVolume;
+
+				// Uniform bricks are answered like classified ones, and their samples are not needed
+				if (NumSolid == 0 || NumSolid == OwnedVolume)
+				{
+					Pool.resize(Entry);
+					return NumSolid == 0 ? AllEmpty : AllSolid;
+				}
+				return Entry;
+			}
+
+			const ISdfBakeSource& Source;
+			FVec3 Origin;
+			float VoxelSize;
+			int32_t BricksX;
+			int32_t BricksY;
+			int32_t BricksZ;
+			std::vector<int32_t> Entries;
+			std::vector<uint8_t> Pool;
+			std::vector<int32_t> Owners;
+			std::vector<int32_t> Locals;
+		};
+
+		/**
+		 * One floor probe: sphere tracing down by the sampled distance, then a few false-position steps once the
+		 * surface is bracketed. Shared by FSdfWorld::TraceFloor and TraceFloorBatch, which differ only in how they sample.
+		 */
+		struct FFloorProbe
+		{
+			enum EPhase : uint8_t
+			{
+				First,
+				/** The start was inside: sampling a lift above it */
+				Lifted,
+				Descending,
+				Bracketed,
+				Hit,
+				Missed,
+			};
+
+			float X = 0.f;
+			float Y = 0.f;
+			/** Where to sample next */
+			float Z = 0.f;
+			float EndZ = 0.f;
+			float VoxelSize = 1.f;
+			/** Last sample above the surface and first below it */
+			float AboveZ = 0.f;
+			float AboveDistance = 0.f;
+			float BelowZ = 0.f;
+			float BelowDistance = 0.f;
+			float FloorZ = 0.f;
+			int32_t NumSamples = 0;
+			int32_t NumRefines = 0;
+			EPhase Phase = First;
+
+			void Begin(const FVec3& Start, float Distance, float InVoxelSize)
+			{
+				X = Start.X;
+				Y = Start.Y;
+				Z = Start.Z;
+				EndZ = Start.Z - Distance;
+				VoxelSize = InVoxelSize;
+				NumSamples = 0;
+				NumRefines = 0;
+				Phase = First;
+			}
+
+			bool IsDone() const { return Phase == Hit || Phase == Missed; }
+
+			/** Takes the distance sampled at Z and picks the next Z. Returns true once done. */
+			bool Advance(float Distance)
+			{
+				if (++NumSamples >= ProbeMaxSamples)
+				{
+					Phase = Missed;
+					return true;
+				}
+
+				switch (Phase)
+				{
+				case First:
+					if (Distance < 0.f)
+					{
+						BelowZ = Z;
+						BelowDistance = Distance;
+						Z += ProbeLift * VoxelSize;
+						Phase = Lifted;
+						return false;
+					}
+					return Descend(Distance);
+
+				case Lifted:
+					if (Distance <= 0.f)
+					{
+						// Buried deeper than the lift
+						Phase = Missed;
+						return true;
+					}
+					AboveZ = Z;
+					AboveDistance = Distance;
+					return Refine();
+
+				case Descending:
+					if (Distance < 0.f)
+					{
+						BelowZ = Z;
+						BelowDistance = Distance;
+						return Refine();
+					}
+					return Descend(Distance);
+
+				case Bracketed:
+					if (std::fabs(Distance) <= ProbeHitTolerance * VoxelSize)
+					{
+						return Finish(Z - Distance);
+					}
+					if (Distance > 0.f)
+					{
+						AboveZ = Z;
+						AboveDistance = Distance;
+					}
+					else
+					{
+						BelowZ = Z;
+						BelowDistance = Distance;
+					}
+					return Refine();
+
+				default:
+					return true;
+				}
+			}
+
+		private:
+			bool Descend(float Distance)
+			{
+				if (Distance <= ProbeHitTolerance * VoxelSize)
+				{
+					return Finish(Z - Distance);
+				}
+				if (Z <= EndZ)
+				{
+					Phase = Missed;
+					return true;
+				}
+
+				AboveZ = Z;
+				AboveDistance = Distance;
+				// The distance is to the nearest surface in any direction, so it never steps through the floor
+				Z = std::max(Z - std::max(Distance, ProbeMinStep * VoxelSize), EndZ);
+				Phase = Descending;
+				return false;
+			}
+
+			bool Refine()
+			{
+				// False position: the field is close to linear across the bracket
+				const float Estimate = BelowZ + (AboveZ - BelowZ) * (-BelowDistance / (AboveDistance - BelowDistance));
+				if (NumRefines++ >= ProbeRefineSamples || AboveZ - BelowZ <= ProbeHitTolerance * VoxelSize)
+				{
+					return Finish(Estimate);
+				}
+				Z = Estimate;
+				Phase = Bracketed;
+				return false;
+			}
+
+			bool Finish(float InFloorZ)
+			{
+				FloorZ = InFloorZ;
+				Phase = InFloorZ >= EndZ ? Hit : Missed;
+				return true;
+			}
+		};
+
+#if SPARTA_MOVEMENT_SSE2
+		inline __m128 Lerp4(__m128 A, __m128 B, __m128 Alpha) { return _mm_add_ps(A, _mm_mul_ps(_mm_sub_ps(B, A), Alpha)); }
+		inline __m128 Trunc4(__m128 V) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(V)); }
+#endif
+#if SPARTA_MOVEMENT_AVX2
+		inline __m256 Lerp8(__m256 A, __m256 B, __m256 Alpha) { return _mm256_add_ps(A, _mm256_mul_ps(_mm256_sub_ps(B, A), Alpha)); }
+#endif
+	}
+
+	FVec3 FSdfVolume::GetMax() const
+	{
+		const float BrickSize = BrickCells * VoxelSize;
+		return Origin + FVec3(BricksX * BrickSize, BricksY * BrickSize, BricksZ * BrickSize);
+	}
+
+	bool FSdfVolume::Locate(const FVec3& Point, int32_t& OutBrick, float& OutX, float& OutY, float& OutZ) const
+	{
+		const float U = (Point.X - Origin.X) * InvVoxelSize;
+		const float V = (Point.Y - Origin.Y) * InvVoxelSize;
+		const float W = (Point.Z - Origin.Z) * InvVoxelSize;
+
+		// Written so a NaN fails too
+		if (!(U >= 0.f && V >= 0.f && W >= 0.f
+			&& U < static_cast<float>(BricksX * BrickCells) && V < static_cast<float>(BricksY * BrickCells) && W < static_cast<float>(BricksZ * BrickCells)))
+		{
+			return false;
+		}
+
+		const int32_t BrickX = std::min(static_cast<int32_t>(U * (1.f / BrickCells)), BricksX - 1);
+		const int32_t BrickY = std::min(static_cast<int32_t>(V * (1.f / BrickCells)), BricksY - 1);
+		const int32_t BrickZ = std::min(static_cast<int32_t>(W * (1.f / BrickCells)), BricksZ - 1);
+
+		OutBrick = (BrickZ * BricksY + BrickY) * BricksX + BrickX;
+		OutX = std::clamp(U - static_cast<float>(BrickX * BrickCells), 0.f, static_cast<float>(BrickCells));
+		OutY = std::clamp(V - static_cast<float>(BrickY * BrickCells), 0.f, static_cast<float>(BrickCells));
+		OutZ = std::clamp(W - static_cast<float>(BrickZ * BrickCells), 0.f, static_cast<float>(BrickCells));
+		return true;
+	}
+
+	float FSdfVolume::Sample(const FVec3& Point) const
+	{
+		FVec3 Normal;
+		return SampleGradient(Point, Normal);
+	}
+
+	float FSdfVolume::SampleGradient(const FVec3& Point, FVec3& OutNormal) const
+	{
+		OutNormal = FVec3();
+
+		int32_t Brick = 0;
+		float X = 0.f;
+		float Y = 0.f;
+		float Z = 0.f;
+		if (!Locate(Point, Brick, X, Y, Z))
+		{
+			return FarDistance;
+		}
+
+		const int32_t Entry = BrickGrid[Brick];
+		if (Entry < 0)
+		{
+			return Entry == FarInside ? -FarDistance : FarDistance;
+		}
+
+		const int32_t CellX = std::min(static_cast<int32_t>(X), BrickCells - 1);
+		const int32_t CellY = std::min(static_cast<int32_t>(Y), BrickCells - 1);
+		const int32_t CellZ = std::min(static_cast<int32_t>(Z), BrickCells - 1);
+		const float FX = X - static_cast<float>(CellX);
+		const float FY = Y - static_cast<float>(CellY);
+		const float FZ = Z - static_cast<float>(CellZ);
+
+		const uint8_t* Cell = Samples.data() + static_cast<size_t>(Entry) * BrickVolume + (CellZ * BrickSamples + CellY) * BrickSamples + CellX;
+		float C[8];
+		for (int32_t Corner = 0; Corner < 8; ++Corner)
+		{
+			C[Corner] = Cell[CornerOffsets[Corner]];
+		}
+
+		// Same order of operations as SampleBatch
+		const float X00 = Lerp(C[0], C[1], FX);
+		const float X10 = Lerp(C[2], C[3], FX);
+		const float X01 = Lerp(C[4], C[5], FX);
+		const float X11 = Lerp(C[6], C[7], FX);
+		const float Y0 = Lerp(X00, X10, FY);
+		const float Y1 = Lerp(X01, X11, FY);
+		const float Quantized = Lerp(Y0, Y1, FZ);
+
+		// Gradient of the trilinear blend; its scale does not matter, only its direction
+		const FVec3 Gradient(
+			Lerp(Lerp(C[1] - C[0], C[3] - C[2], FY), Lerp(C[5] - C[4], C[7] - C[6], FY), FZ),
+			Lerp(Lerp(C[2] - C[0], C[3] - C[1], FX), Lerp(C[6] - C[4], C[7] - C[5], FX), FZ),
+			Lerp(Lerp(C[4] - C[0], C[5] - C[1], FX), Lerp(C[6] - C[2], C[7] - C[3], FX), FY));
+		OutNormal = Gradient.GetSafeNormal();
+
+		return Quantized * QuantumScale - FarDistance;
+	}
+
+	void FSdfVolume::SampleBatch(const float* X, const float* Y, const float* Z, float* OutDistances, int32_t Num) const
+	{
+		int32_t Index = 0;
+
+#if SPARTA_MOVEMENT_AVX2
+		if (!BrickGrid.empty())
+		{
+			const __m256 OriginX = _mm256_set1_ps(Origin.X);
+			const __m256 OriginY = _mm256_set1_ps(Origin.Y);
+			const __m256 OriginZ = _mm256_set1_ps(Origin.Z);
+			const __m256 Inv = _mm256_set1_ps(InvVoxelSize);
+			const __m256 Zero = _mm256_setzero_ps();
+			const __m256 LimitX = _mm256_set1_ps(static_cast<float>(BricksX * BrickCells));
+			const __m256 LimitY = _mm256_set1_ps(static_cast<float>(BricksY * BrickCells));
+			const __m256 LimitZ = _mm256_set1_ps(static_cast<float>(BricksZ * BrickCells));
+			const __m256 LastBrickX = _mm256_set1_ps(static_cast<float>(BricksX - 1));
+			const __m256 LastBrickY = _mm256_set1_ps(static_cast<float>(BricksY - 1));
+			const __m256 LastBrickZ = _mm256_set1_ps(static_cast<float>(BricksZ - 1));
+			const __m256 Cells = _mm256_set1_ps(static_cast<float>(BrickCells));
+			const __m256 InvCells = _mm256_set1_ps(1.f / BrickCells);
+			const __m256 LastCell = _mm256_set1_ps(static_cast<float>(BrickCells - 1));
+			const __m256 Stride = _mm256_set1_ps(static_cast<float>(BrickSamples));
+			const __m256 Scale = _mm256_set1_ps(QuantumScale);
+			const __m256 Far = _mm256_set1_ps(FarDistance);
+			const __m256i ByteMask = _mm256_set1_epi32(0xFF);
+			const __m256i Outside = _mm256_set1_epi32(FarOutside);
+			const __m256i Inside = _mm256_set1_epi32(FarInside);
+			const __m256i NoBrick = _mm256_set1_epi32(-1);
+			const __m256i AllFar = _mm256_set1_epi32(0xFF);
+			const int* Grid = BrickGrid.data();
+			const int* Bytes = reinterpret_cast<const int*>(Samples.data());
+
+			for (; Index + 8 <= Num; Index += 8)
+			{
+				const __m256 U = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(X + Index), OriginX), Inv);
+				const __m256 V = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(Y + Index), OriginY), Inv);
+				const __m256 W = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(Z + Index), OriginZ), Inv);
+				const __m256 InBounds = _mm256_and_ps(
+					_mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(U, Zero, _CMP_GE_OQ), _mm256_cmp_ps(U, LimitX, _CMP_LT_OQ)),
+						_mm256_and_ps(_mm256_cmp_ps(V, Zero, _CMP_GE_OQ), _mm256_cmp_ps(V, LimitY, _CMP_LT_OQ))),
+					_mm256_and_ps(_mm256_cmp_ps(W, Zero, _CMP_GE_OQ), _mm256_cmp_ps(W, LimitZ, _CMP_LT_OQ)));
+
+				// Out-of-bounds lanes are clamped so their conversions stay defined; their gathers are masked off
+				const __m256 UC = _mm256_min_ps(_mm256_max_ps(U, Zero), LimitX);
+				const __m256 VC = _mm256_min_ps(_mm256_max_ps(V, Zero), LimitY);
+				const __m256 WC = _mm256_min_ps(_mm256_max_ps(W, Zero), LimitZ);
+				const __m256 BrickX = _mm256_min_ps(_mm256_round_ps(_mm256_mul_ps(UC, InvCells), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), LastBrickX);
+				const __m256 BrickY = _mm256_min_ps(_mm256_round_ps(_mm256_mul_ps(VC, InvCells), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), LastBrickY);
+				const __m256 BrickZ = _mm256_min_ps(_mm256_round_ps(_mm256_mul_ps(WC, InvCells), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), LastBrickZ);
+				const __m256 LX = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(UC, _mm256_mul_ps(BrickX, Cells)), Zero), Cells);
+				const __m256 LY = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(VC, _mm256_mul_ps(BrickY, Cells)), Zero), Cells);
+				const __m256 LZ = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(WC, _mm256_mul_ps(BrickZ, Cells)), Zero), Cells);
+				const __m256 CellX = _mm256_min_ps(_mm256_round_ps(LX, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), LastCell);
+				const __m256 CellY = _mm256_min_ps(_mm256_round_ps(LY, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), LastCell);
+				const __m256 CellZ = _mm256_min_ps(_mm256_round_ps(LZ, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), LastCell);
+				const __m256 FX = _mm256_sub_ps(LX, CellX);
+				const __m256 FY = _mm256_sub_ps(LY, CellY);
+				const __m256 FZ = _mm256_sub_ps(LZ, CellZ);
+
+				const __m256i Brick = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(BrickZ, _mm256_set1_ps(static_cast<float>(BricksY))), BrickY),
+					_mm256_set1_ps(static_cast<float>(BricksX))), BrickX));
+				const __m256i Offset = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(CellZ, Stride), CellY), Stride), CellX));
+
+				const __m256i Entry = _mm256_mask_i32gather_epi32(Outside, Grid, Brick, _mm256_castps_si256(InBounds), 4);
+				const __m256i Stored = _mm256_cmpgt_epi32(Entry, NoBrick);
+				// Far bricks read as all-255 or all-0 corners, which blend to exactly +-FarDistance
+				const __m256i Fill = _mm256_andnot_si256(_mm256_cmpeq_epi32(Entry, Inside), AllFar);
+				const __m256i Base = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(Entry, Stored), 9), Offset);
+
+				__m256 C[8];
+				for (int32_t Corner = 0; Corner < 8; ++Corner)
+				{
+					const __m256i Gathered = _mm256_mask_i32gather_epi32(Fill, Bytes, _mm256_add_epi32(Base, _mm256_set1_epi32(CornerOffsets[Corner])), Stored, 1);
+					C[Corner] = _mm256_cvtepi32_ps(_mm256_and_si256(Gathered, ByteMask));
+				}
+
+				const __m256 X00 = Lerp8(C[0], C[1], FX);
+				const __m256 X10 = Lerp8(C[2], C[3], FX);
+				const __m256 X01 = Lerp8(C[4], C[5], FX);
+				const __m256 X11 = Lerp8(C[6], C[7], FX);
+				const __m256 Quantized = Lerp8(Lerp8(X00, X10, FY), Lerp8(X01, X11, FY), FZ);
+				_mm256_storeu_ps(OutDistances + Index, _mm256_sub_ps(_mm256_mul_ps(Quantized, Scale), Far));
+			}
+		}
+#elif SPARTA_MOVEMENT_SSE2
+		if (!BrickGrid.empty())
+		{
+			const __m128 OriginX = _mm_set1_ps(Origin.X);
+			const __m128 OriginY = _mm_set1_ps(Origin.Y);
+			const __m128 OriginZ = _mm_set1_ps(Origin.Z);
+			const __m128 Inv = _mm_set1_ps(InvVoxelSize);
+			const __m128 Zero = _mm_setzero_ps();
+			const __m128 LimitX = _mm_set1_ps(static_cast<float>(BricksX * BrickCells));
+			const __m128 LimitY = _mm_set1_ps(static_cast<float>(BricksY * BrickCells));
+			const __m128 LimitZ = _mm_set1_ps(static_cast<float>(BricksZ * BrickCells));
+			const __m128 LastBrickX = _mm_set1_ps(static_cast<float>(BricksX - 1));
+			const __m128 LastBrickY = _mm_set1_ps(static_cast<float>(BricksY - 1));
+			const __m128 LastBrickZ = _mm_set1_ps(static_cast<float>(BricksZ - 1));
+			const __m128 Cells = _mm_set1_ps(static_cast<float>(BrickCells));
+			const __m128 InvCells = _mm_set1_ps(1.f / BrickCells);
+			const __m128 LastCell = _mm_set1_ps(static_cast<float>(BrickCells - 1));
+			const __m128 Stride = _mm_set1_ps(static_cast<float>(BrickSamples));
+			const __m128 Scale = _mm_set1_ps(QuantumScale);
+			const __m128 Far = _mm_set1_ps(FarDistance);
+
+			alignas(16) int32_t Bricks[4];
+			alignas(16) int32_t Offsets[4];
+			alignas(16) float C[8][4];
+
+			for (; Index + 4 <= Num; Index += 4)
+			{
+				const __m128 U = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(X + Index), OriginX), Inv);
+				const __m128 V = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(Y + Index), OriginY), Inv);
+				const __m128 W = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(Z + Index), OriginZ), Inv);
+				const int32_t InBounds = _mm_movemask_ps(_mm_and_ps(
+					_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(U, Zero), _mm_cmplt_ps(U, LimitX)), _mm_and_ps(_mm_cmpge_ps(V, Zero), _mm_cmplt_ps(V, LimitY))),
+					_mm_and_ps(_mm_cmpge_ps(W, Zero), _mm_cmplt_ps(W, LimitZ))));
+
+				// Out-of-bounds lanes are clamped so their conversions stay defined; they never index anything
+				const __m128 UC = _mm_min_ps(_mm_max_ps(U, Zero), LimitX);
+				const __m128 VC = _mm_min_ps(_mm_max_ps(V, Zero), LimitY);
+				const __m128 WC = _mm_min_ps(_mm_max_ps(W, Zero), LimitZ);
+				const __m128 BrickX = _mm_min_ps(Trunc4(_mm_mul_ps(UC, InvCells)), LastBrickX);
+				const __m128 BrickY = _mm_min_ps(Trunc4(_mm_mul_ps(VC, InvCells)), LastBrickY);
+				const __m128 BrickZ = _mm_min_ps(Trunc4(_mm_mul_ps(WC, InvCells)), LastBrickZ);
+				const __m128 LX = _mm_min_ps(_mm_max_ps(_mm_sub_ps(UC, _mm_mul_ps(BrickX, Cells)), Zero), Cells);
+				const __m128 LY = _mm_min_ps(_mm_max_ps(_mm_sub_ps(VC, _mm_mul_ps(BrickY, Cells)), Zero), Cells);
+				const __m128 LZ = _mm_min_ps(_mm_max_ps(_mm_sub_ps(WC, _mm_mul_ps(BrickZ, Cells)), Zero), Cells);
+				const __m128 CellX = _mm_min_ps(Trunc4(LX), LastCell);
+				const __m128 CellY = _mm_min_ps(Trunc4(LY), LastCell);
+				const __m128 CellZ = _mm_min_ps(Trunc4(LZ), LastCell);
+				const __m128 FX = _mm_sub_ps(LX, CellX);
+				const __m128 FY = _mm_sub_ps(LY, CellY);
+				const __m128 FZ = _mm_sub_ps(LZ, CellZ);
+
+				_mm_store_si128(reinterpret_cast<__m128i*>(Bricks), _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(BrickZ, _mm_set1_ps(static_cast<float>(BricksY))), BrickY),
+					_mm_set1_ps(static_cast<float>(BricksX))), BrickX)));
+				_mm_store_si128(reinterpret_cast<__m128i*>(Offsets), _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(CellZ, Stride), CellY), Stride), CellX)));
+
+				// No gather in SSE2: corners are fetched a lane at a time, far bricks as all-255 or all-0 corners
+				for (int32_t Lane = 0; Lane < 4; ++Lane)
+				{
+					const int32_t Entry = ((InBounds >> Lane) & 1) ? BrickGrid[Bricks[Lane]] : FarOutside;
+					if (Entry >= 0)
+					{
+						const uint8_t* Cell = Samples.data() + static_cast<size_t>(Entry) * BrickVolume + Offsets[Lane];
+						for (int32_t Corner = 0; Corner < 8; ++Corner)
+						{
+							C[Corner][Lane] = Cell[CornerOffsets[Corner]];
+						}
+					}
+					else
+					{
+						const float Fill = Entry == FarInside ? 0.f : 255.f;
+						for (int32_t Corner = 0; Corner < 8; ++Corner)
+						{
+							C[Corner][Lane] = Fill;
+						}
+					}
+				}
+
+				const __m128 X00 = Lerp4(_mm_load_ps(C[0]), _mm_load_ps(C[1]), FX);
+				const __m128 X10 = Lerp4(_mm_load_ps(C[2]), _mm_load_ps(C[3]), FX);
+				const __m128 X01 = Lerp4(_mm_load_ps(C[4]), _mm_load_ps(C[5]), FX);
+				const __m128 X11 = Lerp4(_mm_load_ps(C[6]), _mm_load_ps(C[7]), FX);
+				const __m128 Quantized = Lerp4(Lerp4(X00, X10, FY), Lerp4(X01, X11, FY), FZ);
+				_mm_storeu_ps(OutDistances + Index, _mm_sub_ps(_mm_mul_ps(Quantized, Scale), Far));
+			}
+		}
+#endif
+
+		for (; Index < Num; ++Index)
+		{
+			OutDistances[Index] = Sample(FVec3(X[Index], Y[Index], Z[Index]));
+		}
+	}
+
+	FSdfVolume BakeSdf(const ISdfBakeSource& Source, const FSdfBakeSettings& Settings, FSdfBakeStats* OutStats)
+	{
+		using FClock = std::chrono::steady_clock;
+		const FClock::time_point StartTime = FClock::now();
+
+		FSdfVolume Volume;
+		FSdfBakeStats Stats;
+
+		const float VoxelSize = std::max(Settings.VoxelSize, 0.01f);
+		// The padded block must stay within the neighbouring bricks
+		const int32_t Band = std::clamp(Settings.BandVoxels, 1, FSdfVolume::BrickCells);
+		const FVec3 Extent = Settings.Max - Settings.Min;
+		const float BrickSize = FSdfVolume::BrickCells * VoxelSize;
+		const int32_t BricksX = std::max(static_cast<int32_t>(std::ceil(Extent.X / BrickSize)), 1);
+		const int32_t BricksY = std::max(static_cast<int32_t>(std::ceil(Extent.Y / BrickSize)), 1);
+		const int32_t BricksZ = std::max(static_cast<int32_t>(std::ceil(Extent.Z / BrickSize)), 1);
+		if (static_cast<int64_t>(BricksX) * BricksY * BricksZ >= MaxBricks)
+		{
+			if (OutStats)
+			{
+				*OutStats = Stats;
+			}
+			return Volume;
+		}
+
+		Volume.Origin = Settings.Min;
+		Volume.VoxelSize = VoxelSize;
+		Volume.InvVoxelSize = 1.f / VoxelSize;
+		Volume.FarDistance = Band * VoxelSize;
+		Volume.QuantumScale = 2.f * Volume.FarDistance / 255.f;
+		Volume.BricksX = BricksX;
+		Volume.BricksY = BricksY;
+		Volume.BricksZ = BricksZ;
+		Volume.BrickGrid.assign(static_cast<size_t>(BricksX) * BricksY * BricksZ, FSdfVolume::FarOutside);
+
+		FOccupancyGrid Occupancy(Source, Settings.Min, VoxelSize, BricksX, BricksY, BricksZ);
+
+		const float SurfaceOffset = Source.TestsWholeVoxel() ? 0.f : 0.5f;
+		const int32_t BlockSize = FSdfVolume::BrickSamples + 2 * Band;
+		const size_t BlockVolume = static_cast<size_t>(BlockSize) * BlockSize * BlockSize;
+		std::vector<uint8_t> Solid(BlockVolume);
+		std::vector<float> ToSolid(BlockVolume);
+		std::vector<float> ToEmpty(BlockVolume);
+		FDistanceTransformScratch Scratch;
+		uint8_t Quantized[BrickVolume];
+
+		for (int32_t BrickZ = 0; BrickZ < BricksZ; ++BrickZ)
+		{
+			for (int32_t BrickY = 0; BrickY < BricksY; ++BrickY)
+			{
+				for (int32_t BrickX = 0; BrickX < BricksX; ++BrickX)
+				{
+					const size_t GridIndex = (static_cast<size_t>(BrickZ) * BricksY + BrickY) * BricksX + BrickX;
+					const int32_t FirstX = BrickX * FSdfVolume::BrickCells - Band;
+					const int32_t FirstY = BrickY * FSdfVolume::BrickCells - Band;
+					const int32_t FirstZ = BrickZ * FSdfVolume::BrickCells - Band;
+
+					// All of the padded block on one side: nothing to voxelize
+					int32_t UniformEntry = FOccupancyGrid::Unknown;
+					if (Occupancy.IsUniform(FirstX, FirstY, FirstZ, BlockSize, UniformEntry))
+					{
+						Volume.BrickGrid[GridIndex] = UniformEntry == FOccupancyGrid::AllSolid ? FSdfVolume::FarInside : FSdfVolume::FarOutside;
+						++Stats.NumSkippedBricks;
+						continue;
+					}
+
+					Occupancy.FillBlock(FirstX, FirstY, FirstZ, BlockSize, Solid.data());
+					for (size_t Sample = 0; Sample < BlockVolume; ++Sample)
+					{
+						ToSolid[Sample] = Solid[Sample] ? 0.f : NotASeed;
+						ToEmpty[Sample] = Solid[Sample] ? NotASeed : 0.f;
+					}
+					DistanceTransformBlock(ToSolid, BlockSize, Band, Scratch);
+					DistanceTransformBlock(ToEmpty, BlockSize, Band, Scratch);
+
+					// Point tests put the surface halfway between the samples on either side of it
+					bool bAllOutside = true;
+					bool bAllInside = true;
+					int32_t Out = 0;
+					for (int32_t Z = 0; Z < FSdfVolume::BrickSamples; ++Z)
+					{
+						for (int32_t Y = 0; Y < FSdfVolume::BrickSamples; ++Y)
+						{
+							for (int32_t X = 0; X < FSdfVolume::BrickSamples; ++X, ++Out)
+							{
+								const size_t Padded = (static_cast<size_t>(Z + Band) * BlockSize + (Y + Band)) * BlockSize + (X + Band);
+								const float Distance = Solid[Padded]
+									? -(std::sqrt(ToEmpty[Padded]) - SurfaceOffset) * VoxelSize
+									: (std::sqrt(ToSolid[Padded]) - SurfaceOffset) * VoxelSize;
+								const float Clamped = std::clamp(Distance, -Volume.FarDistance, Volume.FarDistance);
+								const int32_t Value = static_cast<int32_t>((Clamped + Volume.FarDistance) / Volume.QuantumScale + 0.5f);
+								Quantized[Out] = static_cast<uint8_t>(std::clamp(Value, 0, 255));
+								bAllOutside &= Quantized[Out] == 255;
+								bAllInside &= Quantized[Out] == 0;
+							}
+						}
+					}
+
+					if (bAllOutside || bAllInside)
+					{
+						Volume.BrickGrid[GridIndex] = bAllInside ? FSdfVolume::FarInside : FSdfVolume::FarOutside;
+						++Stats.NumDroppedBricks;
+						continue;
+					}
+
+					Volume.BrickGrid[GridIndex] = Stats.NumBricks++;
+					Volume.Samples.insert(Volume.Samples.end(), Quantized, Quantized + BrickVolume);
+				}
+			}
+		}
+
+		// A 32-bit gather at the last sample reads three bytes past it
+		Volume.Samples.resize(Volume.Samples.size() + 3, 0);
+		Volume.Samples.shrink_to_fit();
+
+		Stats.NumSolidQueries = Occupancy.NumSolidQueries;
+		Stats.Seconds = std::chrono::duration<double>(FClock::now() - StartTime).count();
+		if (OutStats)
+		{
+			*OutStats = Stats;
+		}
+		return Volume;
+	}
+
+	void TraceFloorBatch(const FSdfVolume& Volume, const FVec3* Starts, const float* Distances, float* OutFloorZ, bool* OutHits, int32_t Num)
+	{
+		// Blocks of ProbeBatchSize probes on the stack, so a batch never allocates however many probes it gets
+		FFloorProbe Probes[ProbeBatchSize];
+		int32_t Active[ProbeBatchSize];
+		float X[ProbeBatchSize];
+		float Y[ProbeBatchSize];
+		float Z[ProbeBatchSize];
+		float Sampled[ProbeBatchSize];
+
+		for (int32_t BlockBegin = 0; BlockBegin < Num; BlockBegin += ProbeBatchSize)
+		{
+			const int32_t BlockSize = std::min(Num - BlockBegin, ProbeBatchSize);
+			for (int32_t Index = 0; Index < BlockSize; ++Index)
+			{
+				Probes[Index].Begin(Starts[BlockBegin + Index], Distances[BlockBegin + Index], Volume.GetVoxelSize());
+				Active[Index] = Index;
+			}
+
+			int32_t NumActive = BlockSize;
+			while (NumActive > 0)
+			{
+				for (int32_t Slot = 0; Slot < NumActive; ++Slot)
+				{
+					const FFloorProbe& Probe = Probes[Active[Slot]];
+					X[Slot] = Probe.X;
+					Y[Slot] = Probe.Y;
+					Z[Slot] = Probe.Z;
+				}
+
+				Volume.SampleBatch(X, Y, Z, Sampled, NumActive);
+
+				int32_t Kept = 0;
+				for (int32_t Slot = 0; Slot < NumActive; ++Slot)
+				{
+					if (!Probes[Active[Slot]].Advance(Sampled[Slot]))
+					{
+						Active[Kept++] = Active[Slot];
+					}
+				}
+				NumActive = Kept;
+			}
+
+			for (int32_t Index = 0; Index < BlockSize; ++Index)
+			{
+				bool& bHit = OutHits[BlockBegin + Index];
+				bHit = Probes[Index].Phase == FFloorProbe::Hit;
+				if (bHit)
+				{
+					OutFloorZ[BlockBegin + Index] = Probes[Index].FloorZ;
+				}
+			}
+		}
+	}
+
+	bool FSdfWorld::TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const
+	{
+		FFloorProbe Probe;
+		Probe.Begin(Start, Distance, Volume.GetVoxelSize());
+		while (!Probe.Advance(Volume.Sample(FVec3(Probe.X, Probe.Y, Probe.Z))))
+		{
+		}
+
+		if (Probe.Phase != FFloorProbe::Hit)
+		{
+			return false;
+		}
+		OutFloorZ = Probe.FloorZ;
+		return true;
+	}
+
+	float FSdfWorld::SampleCapsule(const FVec3& Center, float Radius, float HalfHeight, FVec3& OutPoint) const
+	{
+		// Points along the core segment no farther apart than the radius
+		const float SegmentHalf = std::max(HalfHeight - Radius, 0.f);
+		const int32_t NumPoints = SegmentHalf > 0.f ? 1 + static_cast<int32_t>(std::ceil(2.f * SegmentHalf / std::max(Radius, 1.f))) : 1;
+
+		float Nearest = std::numeric_limits<float>::max();
+		for (int32_t Point = 0; Point < NumPoints; ++Point)
+		{
+			const float Alpha = NumPoints > 1 ? static_cast<float>(Point) / static_cast<float>(NumPoints - 1) : 0.5f;
+			const FVec3 Position(Center.X, Center.Y, Center.Z - SegmentHalf + 2.f * SegmentHalf * Alpha);
+			const float Distance = Volume.Sample(Position);
+			if (Distance < Nearest)
+			{
+				Nearest = Distance;
+				OutPoint = Position;
+			}
+		}
+		return Nearest;
+	}
+
+	int32_t FSdfWorld::OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const
+	{
+		const float SegmentHalf = std::max(HalfHeight - Radius, 0.f);
+		const int32_t NumPoints = SegmentHalf > 0.f ? 1 + static_cast<int32_t>(std::ceil(2.f * SegmentHalf / std::max(Radius, 1.f))) : 1;
+
+		int32_t NumContacts = 0;
+		for (int32_t Point = 0; Point < NumPoints; ++Point)
+		{
+			const float Alpha = NumPoints > 1 ? static_cast<float>(Point) / static_cast<float>(NumPoints - 1) : 0.5f;
+			const FVec3 Position(Center.X, Center.Y, Center.Z - SegmentHalf + 2.f * SegmentHalf * Alpha);
+
+			FVec3 Normal;
+			const float Distance = Volume.SampleGradient(Position, Normal);
+			// At the far distance the field is clamped and says nothing about where the surface is
+			if (Distance >= Radius || Distance >= Volume.GetFarDistance() || Normal.IsNearlyZero())
+			{
+				continue;
+			}
+
+			FWallContact Contact;
+			Contact.ImpactPoint = Position - Normal * Distance;
+			Contact.Normal = Normal;
+			Contact.Distance = std::max(Distance, 0.f);
+			Contact.Penetration = Radius - Distance;
+
+			// Points along a capsule see the same wall: keep its deepest contact only
+			int32_t Same = -1;
+			for (int32_t Kept = 0; Kept < NumContacts; ++Kept)
+			{
+				if (OutContacts[Kept].Normal.Dot(Normal) > SameContactNormalDot)
+				{
+					Same = Kept;
+					break;
+				}
+			}
+			if (Same >= 0)
+			{
+				if (OutContacts[Same].Penetration < Contact.Penetration)
+				{
+					OutContacts[Same] = Contact;
+				}
+			}
+			else if (NumContacts < MaxContacts)
+			{
+				OutContacts[NumContacts++] = Contact;
+			}
+		}
+
+		int32_t Nearest = 0;
+		for (int32_t Kept = 1; Kept < NumContacts; ++Kept)
+		{
+			if (OutContacts[Kept].Distance < OutContacts[Nearest].Distance)
+			{
+				Nearest = Kept;
+			}
+		}
+		if (Nearest != 0)
+		{
+			std::swap(OutContacts[0], OutContacts[Nearest]);
+		}
+
+		return NumContacts;
+	}
+
+	bool FSdfWorld::SweepCapsule(const FVec3& Start, const FVec3& End, float Radius, float HalfHeight, FSweepHit& OutHit) const
+	{
+		const float Tolerance = SweepHitTolerance * Volume.GetVoxelSize();
+		const FVec3 Delta = End - Start;
+		const float Length = Delta.Size();
+
+		FVec3 Point;
+		float Clearance = SampleCapsule(Start, Radius, HalfHeight, Point) - Radius;
+		if (Clearance < -Tolerance)
+		{
+			FVec3 Normal;
+			Volume.SampleGradient(Point, Normal);
+			if (!Normal.IsNearlyZero())
+			{
+				OutHit = FSweepHit();
+				OutHit.Time = 0.f;
+				OutHit.Normal = Normal;
+				OutHit.bStartPenetrating = true;
+				OutHit.Penetration = -Clearance;
+				return true;
+			}
+		}
+
+		if (Length < 1.e-4f)
+		{
+			return false;
+		}
+
+		const FVec3 Direction = Delta * (1.f / Length);
+		float Time = 0.f;
+		for (int32_t Step = 0; Step < SweepMaxSamples; ++Step)
+		{
+			float Advance = Clearance;
+			if (Clearance <= Tolerance)
+			{
+				// Touching: a hit if the move goes into the surface, else keep going along it
+				FVec3 Normal;
+				Volume.SampleGradient(Point, Normal);
+				if (Normal.Dot(Direction) < -SweepMinApproach)
+				{
+					OutHit = FSweepHit();
+					OutHit.Time = Time;
+					OutHit.Normal = Normal;
+					return true;
+				}
+				Advance = Tolerance;
+			}
+
+			Time += Advance / Length;
+			if (Time >= 1.f)
+			{
+				return false;
+			}
+			Clearance = SampleCapsule(Start + Delta * Time, Radius, HalfHeight, Point) - Radius;
+		}
+
+		// Still creeping along a surface: stop here rather than risk going through it
+		Volume.SampleGradient(Point, OutHit.Normal);
+		OutHit.Time = Time;
+		OutHit.bStartPenetrating = false;
+		OutHit.Penetration = 0.f;
+		return true;
+	}
+}
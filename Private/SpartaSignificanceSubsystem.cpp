@@ -0,0 +1,195 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaSignificanceSubsystem.h"
+#include "SpartaMovementDebug.h"
+
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarSpartaSignificanceEnabled(
+	TEXT("Sparta.Significance.Enabled"),
+	1,
+	TEXT("1: SpartaPawn/SpartaDrone tick rate and pipeline follow their distance and visibility to the nearest viewer.\n")
+	TEXT("0: everything runs at full rate. Read at BeginPlay."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaSignificanceFullDistance(
+	TEXT("Sparta.Significance.FullDistance"),
+	3000.f,
+	TEXT("Visible actors closer than this to a viewer run every frame."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaSignificanceReducedDistance(
+	TEXT("Sparta.Significance.ReducedDistance"),
+	8000.f,
+	TEXT("Actors closer than this, or hidden ones within FullDistance, run at ReducedInterval. Beyond it they run analytic-only."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaSignificanceReducedInterval(
+	TEXT("Sparta.Significance.ReducedInterval"),
+	0.1f,
+	TEXT("Seconds between steps of reduced-rate actors."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaSignificanceAnalyticInterval(
+	TEXT("Sparta.Significance.AnalyticInterval"),
+	0.5f,
+	TEXT("Seconds between steps of analytic-only actors."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaSignificanceUpdateInterval(
+	TEXT("Sparta.Significance.UpdateInterval"),
+	0.25f,
+	TEXT("Seconds between re-sorting actors into buckets."),
+	ECVF_Default);
+
+bool USpartaSignificanceSubsystem::IsEnabled()
+{
+	return CVarSpartaSignificanceEnabled.GetValueOnGameThread() != 0;
+}
+
+float USpartaSignificanceSubsystem::GetTickInterval(ESpartaSignificance Significance)
+{
+	switch (Significance)
+	{
+	case ESpartaSignificance::Reduced:
+		return CVarSpartaSignificanceReducedInterval.GetValueOnGameThread();
+	case ESpartaSignificance::Analytic:
+		return CVarSpartaSignificanceAnalyticInterval.GetValueOnGameThread();
+	default:
+		return 0.f;
+	}
+}
+
+float USpartaSignificanceSubsystem::ConsumeStepTime(const UWorld* World, double& LastStepTime, float FrameDeltaTime)
+{
+	const double Now = World->GetTimeSeconds();
+	const float StepTime = LastStepTime >= 0.0 ? static_cast<float>(Now - LastStepTime) : FrameDeltaTime;
+	LastStepTime = Now;
+	return StepTime;
+}
+
+void USpartaSignificanceSubsystem::RegisterActor(AActor* Actor, FOnSpartaSignificanceChanged OnChanged)
+{
+	if (!Actor)
+	{
+		return;
+	}
+
+	GatherViewers();
+
+	FEntry& Entry = Entries.AddDefaulted_GetRef();
+	Entry.Actor = Actor;
+	Entry.OnChanged = MoveTemp(OnChanged);
+	Entry.Significance = Evaluate(Actor);
+	Entry.OnChanged.ExecuteIfBound(Entry.Significance);
+}
+
+void USpartaSignificanceSubsystem::UnregisterActor(AActor* Actor)
+{
+	Entries.RemoveAllSwap([Actor](const FEntry& Entry) { return Entry.Actor.Get() == Actor; });
+}
+
+int32 USpartaSignificanceSubsystem::GetNumInBucket(ESpartaSignificance Significance) const
+{
+	int32 Count = 0;
+	for (const FEntry& Entry : Entries)
+	{
+		Count += Entry.Significance == Significance ? 1 : 0;
+	}
+	return Count;
+}
+
+void USpartaSignificanceSubsystem::GatherViewers()
+{
+	UWorld* World = GetWorld();
+	bCheckRendered = World->GetNetMode() != NM_DedicatedServer;
+
+	ViewLocations.Reset();
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		if (const APlayerController* PlayerController = It->Get())
+		{
+			FVector ViewLocation;
+			FRotator ViewRotation;
+			PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+			ViewLocations.Add(ViewLocation);
+		}
+	}
+}
+
+ESpartaSignificance USpartaSignificanceSubsystem::Evaluate(const AActor* Actor) const
+{
+	const APawn* Pawn = Cast<APawn>(Actor);
+	if (Pawn && Pawn->IsPlayerControlled())
+	{
+		return ESpartaSignificance::Full;
+	}
+
+	const FVector Location = Actor->GetActorLocation();
+	float MinDistSq = TNumericLimits<float>::Max();
+	for (const FVector& ViewLocation : ViewLocations)
+	{
+		MinDistSq = FMath::Min(MinDistSq, static_cast<float>(FVector::DistSquared(Location, ViewLocation)));
+	}
+
+	const float FullDistance = CVarSpartaSignificanceFullDistance.GetValueOnGameThread();
+	const float ReducedDistance = CVarSpartaSignificanceReducedDistance.GetValueOnGameThread();
+	const bool bVisible = !bCheckRendered || Actor->WasRecentlyRendered(0.2f);
+
+	if (bVisible && MinDistSq <= FMath::Square(FullDistance))
+	{
+		return ESpartaSignificance::Full;
+	}
+	if (MinDistSq <= FMath::Square(ReducedDistance))
+	{
+		return ESpartaSignificance::Reduced;
+	}
+	return ESpartaSignificance::Analytic;
+}
+
+void USpartaSignificanceSubsystem::Tick(float DeltaTime)
+{
+	SpartaMovementDebug::FScopedFrameTiming Timing(SpartaMovementDebug::GetFrameTimings().SignificanceSubsystem);
+
+	TimeSinceUpdate += DeltaTime;
+	if (TimeSinceUpdate < CVarSpartaSignificanceUpdateInterval.GetValueOnGameThread() || Entries.Num() == 0)
+	{
+		return;
+	}
+	TimeSinceUpdate = 0.f;
+
+	GatherViewers();
+
+	for (int32 Index = Entries.Num() - 1; Index >= 0; --Index)
+	{
+		FEntry& Entry = Entries[Index];
+		const AActor* Actor = Entry.Actor.Get();
+		if (!Actor)
+		{
+			Entries.RemoveAtSwap(Index);
+			continue;
+		}
+
+		const ESpartaSignificance Significance = Evaluate(Actor);
+		if (Significance != Entry.Significance)
+		{
+			Entry.Significance = Significance;
+			Entry.OnChanged.ExecuteIfBound(Significance);
+		}
+	}
+}
+
+TStatId USpartaSignificanceSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USpartaSignificanceSubsystem, STATGROUP_Tickables);
+}
+
+void USpartaSignificanceSubsystem::Deinitialize()
+{
+	Entries.Reset();
+
+	Super::Deinitialize();
+}
@@ -0,0 +1,484 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SpartaWorldQuery.h"
+#include "SpartaMovementDebug.h"
+#include "SpartaMovementSubsystem.h"
+
+#include "Engine/World.h"
+#include "Components/PrimitiveComponent.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarSpartaMovementAsyncQueries(
+	TEXT("Sparta.Movement.AsyncQueries"),
+	1,
+	TEXT("1: full-rate SpartaPawns and SpartaDrones submit their floor probe and wall query as async traces and decide on last frame's results.\n")
+	TEXT("A result that is not there or was made too far away falls back to a blocking query.\n")
+	TEXT("0: every query blocks."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpartaMovementAsyncMaxDrift(
+	TEXT("Sparta.Movement.AsyncMaxDrift"),
+	25.f,
+	TEXT("How far (cm) a query may be from where last frame's async one was made for its result to be used instead."),
+	ECVF_Default);
+
+void FSpartaQueryBuffers::Init(const AActor* Owner)
+{
+	QueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(SpartaMovement), false, Owner); // 자기 자신 무시
+
+	ObjectQueryParams = FCollisionObjectQueryParams();
+	ObjectQueryParams.AddObjectTypesToQuery(ECC_WorldDynamic);
+	ObjectQueryParams.AddObjectTypesToQuery(ECC_WorldStatic);
+
+	DynamicObjectQueryParams = FCollisionObjectQueryParams();
+	DynamicObjectQueryParams.AddObjectTypesToQuery(ECC_WorldDynamic);
+
+	// The subsystem's volume and BVH are rebuilt in place, so the pointers stay good for the world's life
+	const UWorld* World = Owner ? Owner->GetWorld() : nullptr;
+	const USpartaMovementSubsystem* Subsystem = World ? World->GetSubsystem<USpartaMovementSubsystem>() : nullptr;
+	StaticSdf = Subsystem ? &Subsystem->GetStaticSdf() : nullptr;
+	StaticBvh = Subsystem ? &Subsystem->GetStaticBvh() : nullptr;
+
+	HitResults.Reset();
+	HitResults.Reserve(ReservedHits);
+
+	BatchedFloor = FBatchedFloor();
+
+	AsyncFloor = FSpartaAsyncQuery();
+	AsyncWall = FSpartaAsyncQuery();
+	AsyncResult.OutHits.Reset();
+	AsyncResult.OutHits.Reserve(ReservedHits);
+}
+
+FSpartaWorldQuery::FSpartaWorldQuery(UWorld* InWorld, FSpartaQueryBuffers& InBuffers, SpartaMovement::FFloorHeightCache* InFloorCache, ESpartaQueryMode InMode)
+	: World(InWorld),
+	Buffers(InBuffers),
+	FloorCache(InFloorCache),
+	Mode(InMode)
+{}
+
+bool FSpartaWorldQuery::IsAsyncEnabled()
+{
+	return CVarSpartaMovementAsyncQueries.GetValueOnGameThread() != 0;
+}
+
+FSpartaAsyncQueryStats& FSpartaWorldQuery::GetAsyncStats()
+{
+	static FSpartaAsyncQueryStats Stats;
+	return Stats;
+}
+
+FSpartaTraceCounts& FSpartaWorldQuery::GetTraceCounts()
+{
+	static FSpartaTraceCounts Counts;
+	return Counts;
+}
+
+static void NoteAsyncSubmitted(FSpartaAsyncQuery& Query, const FVector& Offset)
+{
+	Query.Submitted = Query.Requested;
+	Query.Submitted.Start += Offset;
+	Query.SubmitTime = FPlatformTime::Seconds();
+	Query.SubmitFrame = GFrameCounter;
+	Query.bCompletionSeen = false;
+	Query.bRequested = false;
+
+	FSpartaAsyncQueryStats& Stats = FSpartaWorldQuery::GetAsyncStats();
+	++Stats.Submitted;
+	++Stats.FrameQueueDepth;
+}
+
+void FSpartaWorldQuery::SubmitAsyncQueries(UWorld* World, FSpartaQueryBuffers& Buffers, const FVector& Offset)
+{
+	FSpartaAsyncQueryStats& Stats = GetAsyncStats();
+	if (Stats.QueueDepthFrame != GFrameCounter)
+	{
+		if (Stats.FrameQueueDepth > 0)
+		{
+			Stats.QueueDepth = Stats.FrameQueueDepth;
+			Stats.MaxQueueDepth = FMath::Max(Stats.MaxQueueDepth, Stats.FrameQueueDepth);
+		}
+		Stats.FrameQueueDepth = 0;
+		Stats.QueueDepthFrame = GFrameCounter;
+	}
+
+	FSpartaAsyncQuery& Floor = Buffers.AsyncFloor;
+	if (Floor.bRequested)
+	{
+		NoteAsyncSubmitted(Floor, Offset);
+		const FVector Start = Floor.Submitted.Start;
+		Floor.Handle = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Start, Start - FVector(0.f, 0.f, Floor.Submitted.Size), ECC_Visibility, Buffers.QueryParams);
+	}
+
+	FSpartaAsyncQuery& Wall = Buffers.AsyncWall;
+	if (Wall.bRequested)
+	{
+		NoteAsyncSubmitted(Wall, Offset);
+		const FVector Center = Wall.Submitted.Start;
+		Wall.Handle = World->AsyncSweepByObjectType(EAsyncTraceType::Multi, Center, Center, FQuat::Identity, Buffers.ObjectQueryParams,
+			FCollisionShape::MakeCapsule(Wall.Submitted.Size, Wall.Submitted.HalfHeight), Buffers.QueryParams);
+	}
+}
+
+bool FSpartaWorldQuery::QueryAsyncResult(FSpartaAsyncQuery& Query, const FSpartaAsyncQuery::FShape& Shape) const
+{
+	// This frame's query goes out for the next frame, whatever becomes of last frame's
+	Query.Requested = Shape;
+	Query.bRequested = true;
+
+	FSpartaAsyncQueryStats& Stats = GetAsyncStats();
+
+	// Handles live for the frame after the one they were submitted in
+	if (!Query.Handle.IsValid() || !World->IsTraceHandleValid(Query.Handle, false))
+	{
+		Stats.Cold.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	if (!World->QueryTraceData(Query.Handle, Buffers.AsyncResult))
+	{
+		Stats.Late.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	if (!Query.bCompletionSeen)
+	{
+		Query.bCompletionSeen = true;
+		Stats.Completed.fetch_add(1, std::memory_order_relaxed);
+		Stats.LatencyMicros.fetch_add(static_cast<uint64>((FPlatformTime::Seconds() - Query.SubmitTime) * 1.e6), std::memory_order_relaxed);
+		Stats.LatencyFrames.fetch_add(GFrameCounter - Query.SubmitFrame, std::memory_order_relaxed);
+	}
+
+	const float MaxDrift = CVarSpartaMovementAsyncMaxDrift.GetValueOnAnyThread();
+	if (FVector::DistSquared(Query.Submitted.Start, Shape.Start) > FMath::Square(MaxDrift)
+		|| !FMath::IsNearlyEqual(Query.Submitted.HalfHeight, Shape.HalfHeight))
+	{
+		Stats.Stale.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+bool FSpartaWorldQuery::TraceFloorAsync(const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ, bool& bOutHit) const
+{
+	FSpartaAsyncQuery::FShape Shape;
+	Shape.Start = ToVector(Start);
+	Shape.Size = Distance;
+	if (!QueryAsyncResult(Buffers.AsyncFloor, Shape))
+	{
+		return false;
+	}
+
+	const FHitResult* Hit = Buffers.AsyncResult.OutHits.FindByPredicate([](const FHitResult& Candidate) { return Candidate.bBlockingHit; });
+
+	// Measured against this frame's probe: a hit further down than it reaches is a miss,
+	// and a miss of a shorter probe says nothing about the rest
+	bOutHit = Hit && Hit->Location.Z >= Start.Z - Distance;
+	if (!bOutHit && Buffers.AsyncFloor.Submitted.Size < Distance)
+	{
+		GetAsyncStats().Stale.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	if (bOutHit)
+	{
+		OutFloorZ = Hit->Location.Z;
+		Buffers.bNearMovable |= !Hit->GetComponent() || Hit->GetComponent()->Mobility != EComponentMobility::Static;
+	}
+	GetAsyncStats().Used.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool FSpartaWorldQuery::OverlapCapsuleAsync(const FVector& Center, float Radius, float HalfHeight) const
+{
+	FSpartaAsyncQuery::FShape Shape;
+	Shape.Start = Center;
+	Shape.Size = Radius;
+	Shape.HalfHeight = HalfHeight;
+	if (!QueryAsyncResult(Buffers.AsyncWall, Shape))
+	{
+		return false;
+	}
+	if (!FMath::IsNearlyEqual(Buffers.AsyncWall.Submitted.Size, Radius))
+	{
+		GetAsyncStats().Stale.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// Copying into the reserved array does not allocate
+	Buffers.HitResults = Buffers.AsyncResult.OutHits;
+	GetAsyncStats().Used.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool FSpartaWorldQuery::TraceFloor(const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ) const
+{
+	if (FloorCache)
+	{
+		return Mode != ESpartaQueryMode::Immediate
+			? FloorCache->TraceFloorConcurrent(Start, Distance, OutFloorZ, *this, Buffers.FloorFill)
+			: FloorCache->TraceFloor(Start, Distance, OutFloorZ, *this);
+	}
+
+	bool bCacheable = false;
+	return TraceFloorSample(Start, Distance, OutFloorZ, bCacheable);
+}
+
+bool FSpartaWorldQuery::TraceFloorSample(const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ, bool& bOutCacheable) const
+{
+	if (const SpartaMovement::FFloorBvh* Bvh = GetStaticBvh())
+	{
+		float StaticFloorZ = 0.f;
+		bool bStaticHit = false;
+		if (!TakeBatchedFloor(Start, Distance, StaticFloorZ, bStaticHit))
+		{
+			bStaticHit = Bvh->TraceDown(Start, Distance, StaticFloorZ);
+		}
+		return TraceFloorDynamic(bStaticHit, StaticFloorZ, Start, Distance, OutFloorZ, bOutCacheable);
+	}
+	if (const SpartaMovement::FSdfVolume* Sdf = GetStaticSdf())
+	{
+		float StaticFloorZ = 0.f;
+		bool bStaticHit = false;
+		if (!TakeBatchedFloor(Start, Distance, StaticFloorZ, bStaticHit))
+		{
+			bStaticHit = SpartaMovement::FSdfWorld(*Sdf).TraceFloor(Start, Distance, StaticFloorZ);
+		}
+		return TraceFloorDynamic(bStaticHit, StaticFloorZ, Start, Distance, OutFloorZ, bOutCacheable);
+	}
+
+	if (Mode == ESpartaQueryMode::Async)
+	{
+		// Made elsewhere and a frame ago, never a cache sample
+		bOutCacheable = false;
+
+		bool bAsyncHit = false;
+		if (TraceFloorAsync(Start, Distance, OutFloorZ, bAsyncHit))
+		{
+			return bAsyncHit;
+		}
+	}
+
+	const FVector TraceStart = ToVector(Start);
+	const FVector TraceEnd = TraceStart - FVector(0.f, 0.f, Distance);
+
+	FHitResult& HitResult = Buffers.FloorHit;
+	++GetTraceCounts().FloorTraces;
+	bool bHit = World->LineTraceSingleByChannel(HitResult, TraceStart, TraceEnd, ECC_Visibility, Buffers.QueryParams);
+
+	SPARTA_MOVEMENT_DRAW(Draw_Floor, DrawDebugLine(World, TraceStart, TraceEnd, bHit ? FColor::Green : FColor::Red, false, 1.f, 0, 2.f));
+
+	// Only static geometry may be cached, everything else can move without telling us.
+	// A miss is not cached either: something movable may show up there.
+	const UPrimitiveComponent* HitComponent = HitResult.GetComponent();
+	bOutCacheable = bHit && HitComponent && HitComponent->Mobility == EComponentMobility::Static;
+	Buffers.bNearMovable |= bHit && !bOutCacheable;
+
+	if (bHit)
+	{
+		OutFloorZ = HitResult.Location.Z;
+
+		SPARTA_MOVEMENT_DRAW(Draw_Floor, DrawDebugSphere(World, HitResult.Location, 5.f, 12, FColor::Blue, false, 1.f));
+	}
+
+	return bHit;
+}
+
+bool FSpartaWorldQuery::TakeBatchedFloor(const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ, bool& bOutHit) const
+{
+	FSpartaQueryBuffers::FBatchedFloor& Batched = Buffers.BatchedFloor;
+	if (!Batched.bValid)
+	{
+		return false;
+	}
+	Batched.bValid = false;
+
+	// Exactly the probe that was batched, or nothing: the batch answers like the single trace would
+	if (Batched.Start.X != Start.X || Batched.Start.Y != Start.Y || Batched.Start.Z != Start.Z || Batched.Distance != Distance)
+	{
+		return false;
+	}
+
+	bOutHit = Batched.bHit;
+	if (bOutHit)
+	{
+		OutFloorZ = Batched.FloorZ;
+	}
+	return true;
+}
+
+const SpartaMovement::FSdfVolume* FSpartaWorldQuery::GetStaticSdf() const
+{
+	return Buffers.StaticSdf && !Buffers.StaticSdf->IsEmpty() && USpartaMovementSubsystem::IsSdfEnabled() ? Buffers.StaticSdf : nullptr;
+}
+
+const SpartaMovement::FFloorBvh* FSpartaWorldQuery::GetStaticBvh() const
+{
+	return Buffers.StaticBvh && !Buffers.StaticBvh->IsEmpty() && USpartaMovementSubsystem::IsFloorBvhEnabled() ? Buffers.StaticBvh : nullptr;
+}
+
+bool FSpartaWorldQuery::TraceFloorDynamic(bool bStaticHit, float StaticFloorZ, const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ, bool& bOutCacheable) const
+{
+	const FVector TraceStart = ToVector(Start);
+	const FVector TraceEnd = TraceStart - FVector(0.f, 0.f, Distance);
+
+	FHitResult& HitResult = Buffers.FloorHit;
+	++GetTraceCounts().FloorTraces;
+	const bool bDynamicHit = World->LineTraceSingleByObjectType(HitResult, TraceStart, TraceEnd, Buffers.DynamicObjectQueryParams, Buffers.QueryParams);
+
+	SPARTA_MOVEMENT_DRAW(Draw_Floor, DrawDebugLine(World, TraceStart, TraceEnd, bStaticHit || bDynamicHit ? FColor::Green : FColor::Red, false, 1.f, 0, 2.f));
+
+	// Whatever is on top is the floor. Only the static floor may be cached.
+	const bool bDynamicOnTop = bDynamicHit && (!bStaticHit || HitResult.Location.Z > StaticFloorZ);
+	bOutCacheable = bStaticHit && !bDynamicOnTop;
+	Buffers.bNearMovable |= bDynamicOnTop;
+	if (!bStaticHit && !bDynamicHit)
+	{
+		return false;
+	}
+
+	OutFloorZ = bDynamicOnTop ? static_cast<float>(HitResult.Location.Z) : StaticFloorZ;
+
+	SPARTA_MOVEMENT_DRAW(Draw_Floor, DrawDebugSphere(World, FVector(TraceStart.X, TraceStart.Y, OutFloorZ), 5.f, 12, FColor::Blue, false, 1.f));
+	return true;
+}
+
+int32_t FSpartaWorldQuery::OverlapCapsule(const SpartaMovement::FVec3& Center, float Radius, float HalfHeight, SpartaMovement::FWallContact* OutContacts, int32_t MaxContacts) const
+{
+	const FVector Location = ToVector(Center);
+	const FCollisionShape CollisionShape = FCollisionShape::MakeCapsule(Radius, HalfHeight);
+
+	// With a baked field physics only looks for dynamic geometry, and static contacts are added from the field below
+	const SpartaMovement::FSdfVolume* Sdf = GetStaticSdf();
+
+	TArray<FHitResult>& HitResults = Buffers.HitResults;
+	if (Sdf || Mode != ESpartaQueryMode::Async || !OverlapCapsuleAsync(Location, Radius, HalfHeight))
+	{
+		HitResults.Reset();
+		++GetTraceCounts().WallOverlaps;
+		World->SweepMultiByObjectType(HitResults, Location, Location, FQuat::Identity, Sdf ? Buffers.DynamicObjectQueryParams : Buffers.ObjectQueryParams,
+			CollisionShape, Buffers.QueryParams);
+	}
+
+	// Push-out sums over all contacts, so only the nearest one has to come first.
+	// With more blocking hits than MaxContacts the farthest kept contact is replaced, which keeps the nearest MaxContacts.
+	int32_t NumContacts = 0;
+	int32_t Farthest = 0;
+	for (int32 Index = 0; Index < HitResults.Num(); ++Index)
+	{
+		const FHitResult& Hit = HitResults[Index];
+		if (!Hit.bBlockingHit)
+		{
+			continue;
+		}
+
+		const bool bMovable = !Hit.GetComponent() || Hit.GetComponent()->Mobility != EComponentMobility::Static;
+		Buffers.bNearMovable |= bMovable;
+
+		int32_t Slot = NumContacts;
+		if (NumContacts == MaxContacts)
+		{
+			if (MaxContacts == 0 || Hit.Distance >= OutContacts[Farthest].Distance)
+			{
+				continue;
+			}
+			Slot = Farthest;
+		}
+		else
+		{
+			++NumContacts;
+		}
+
+		SpartaMovement::FWallContact& Contact = OutContacts[Slot];
+		Contact.ImpactPoint = ToVec3(Hit.ImpactPoint);
+		Contact.Normal = ToVec3(Hit.ImpactNormal);
+		Contact.Distance = Hit.Distance;
+		Contact.Penetration = Hit.bStartPenetrating ? Hit.PenetrationDepth : 0.f;
+		Contact.bMovable = bMovable;
+		Contact.HitIndex = Index;
+
+		if (NumContacts == MaxContacts)
+		{
+			Farthest = 0;
+			for (int32_t Kept = 1; Kept < NumContacts; ++Kept)
+			{
+				if (OutContacts[Kept].Distance > OutContacts[Farthest].Distance)
+				{
+					Farthest = Kept;
+				}
+			}
+		}
+	}
+
+	if (Sdf && NumContacts < MaxContacts)
+	{
+		NumContacts += SpartaMovement::FSdfWorld(*Sdf).OverlapCapsule(Center, Radius, HalfHeight, OutContacts + NumContacts, MaxContacts - NumContacts);
+	}
+
+	int32_t Nearest = 0;
+	for (int32_t Kept = 1; Kept < NumContacts; ++Kept)
+	{
+		if (OutContacts[Kept].Distance < OutContacts[Nearest].Distance)
+		{
+			Nearest = Kept;
+		}
+	}
+	if (Nearest != 0)
+	{
+		Swap(OutContacts[0], OutContacts[Nearest]);
+	}
+
+	return NumContacts;
+}
+
+bool FSpartaWorldQuery::SweepCapsule(const SpartaMovement::FVec3& Start, const SpartaMovement::FVec3& End, float Radius, float HalfHeight, SpartaMovement::FSweepHit& OutHit) const
+{
+	++Buffers.NumSweeps;
+
+	const SpartaMovement::FSdfVolume* Sdf = GetStaticSdf();
+
+	FHitResult& Hit = Buffers.SweepHit;
+	++GetTraceCounts().Sweeps;
+	const bool bHit = World->SweepSingleByObjectType(Hit, ToVector(Start), ToVector(End), FQuat::Identity,
+		Sdf ? Buffers.DynamicObjectQueryParams : Buffers.ObjectQueryParams, FCollisionShape::MakeCapsule(Radius, HalfHeight), Buffers.QueryParams);
+
+	// Static geometry from the field; it answers when it stops the capsule first
+	SpartaMovement::FSweepHit StaticHit;
+	if (Sdf && SpartaMovement::FSdfWorld(*Sdf).SweepCapsule(Start, End, Radius, HalfHeight, StaticHit) && (!bHit || StaticHit.Time < Hit.Time))
+	{
+		SPARTA_MOVEMENT_DRAW(Draw_Sweeps, DrawDebugCapsule(World, ToVector(Start + (End - Start) * StaticHit.Time), HalfHeight, Radius, FQuat::Identity, FColor::Orange, false, 1.f));
+		OutHit = StaticHit;
+		return true;
+	}
+
+	SPARTA_MOVEMENT_DRAW(Draw_Sweeps, DrawDebugCapsule(World, bHit ? Hit.Location : ToVector(End), HalfHeight, Radius, FQuat::Identity, bHit ? FColor::Orange : FColor::Cyan, false, 1.f));
+	if (!bHit)
+	{
+		return false;
+	}
+
+	// Hit.Normal is the capsule's normal at the contact, which is what to slide along
+	OutHit.Time = Hit.Time;
+	OutHit.Normal = ToVec3(Hit.Normal);
+	OutHit.bStartPenetrating = Hit.bStartPenetrating;
+	OutHit.Penetration = Hit.bStartPenetrating ? Hit.PenetrationDepth : 0.f;
+	return true;
+}
+
+void FSpartaWorldQuery::OnWallContact(const SpartaMovement::FWallContact& Contact) const
+{
+#if SPARTA_MOVEMENT_DEBUG
+	if (!Buffers.HitResults.IsValidIndex(Contact.HitIndex))
+	{
+		return;
+	}
+
+	const FHitResult& Hit = Buffers.HitResults[Contact.HitIndex];
+
+	// 디버그 시각화
+	SPARTA_MOVEMENT_DRAW(Draw_Walls, DrawDebugCapsule(World, Hit.ImpactPoint + FVector(0, 0, 80.0f), 100.0f, 50.0f, FQuat::Identity, FColor::Red, false, 2.0f));
+
+	SPARTA_MOVEMENT_LOG(Verbose, TEXT("충돌한 액터: %s"), *GetNameSafe(Hit.GetActor()));
+	SPARTA_MOVEMENT_LOG(Verbose, TEXT("법선: %s"), *Hit.ImpactNormal.ToString());
+	SPARTA_MOVEMENT_LOG(Verbose, TEXT("거리: %f"), Hit.Distance);
+#endif
+}
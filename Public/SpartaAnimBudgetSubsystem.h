@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SpartaSignificanceSubsystem.h"
+#include "SpartaAnimBudgetSubsystem.generated.h"
+
+/**
+ * Skeletal mesh of ASpartaPawn and ASpartaDrone. Times its own ticks for USpartaAnimBudgetSubsystem and takes the
+ * update rate settings the subsystem hands out. Update rate optimizations are always on; with the budget off the
+ * subsystem sets them to update every frame.
+ */
+UCLASS(ClassGroup = (Rendering), meta = (BlueprintSpawnableComponent))
+class ASSIGNMENT_7_7_API USpartaSkeletalMeshComponent : public USkeletalMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	USpartaSkeletalMeshComponent(const FObjectInitializer& ObjectInitializer = FObjectInitializer::Get());
+
+	/** The owner's bucket. Analytic meshes update at the longest interval whatever their screen size. */
+	void SetSignificance(ESpartaSignificance NewSignificance);
+
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void FinalizeBoneTransform() override;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	friend class USpartaAnimBudgetSubsystem;
+
+	ESpartaSignificance Significance = ESpartaSignificance::Full;
+	/** What was set up before the budget took over, put back when it lets go */
+	TEnumAsByte<EVisibilityBasedAnimTickOption> UnbudgetedTickOption;
+	/** USpartaAnimBudgetSubsystem settings generation last applied, -1 for none */
+	int32 AppliedGeneration = -1;
+};
+
+/**
+ * Shares a per-frame game thread animation budget, Sparta.Anim.BudgetMs, across every USpartaSkeletalMeshComponent.
+ * The engine's update rate optimizations pick each mesh's interval from its screen size against a ladder of
+ * thresholds; the subsystem scales that ladder up while the meshes cost more than the budget and back down when they
+ * cost less. Skipped frames are interpolated up to Sparta.Anim.InterpolateInterval. Off-screen meshes do not tick
+ * their pose or refresh bones at all.
+ * Parallel pose evaluation runs on workers and is not counted against the budget.
+ */
+UCLASS()
+class ASSIGNMENT_7_7_API USpartaAnimBudgetSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/** Sparta.Anim.Budget */
+	static bool IsEnabled();
+
+	/** Totals over all budgeted meshes, logged by Sparta.Anim.Stats */
+	struct FAnimStats
+	{
+		uint64 Frames = 0;
+		uint64 MeshFrames = 0;
+		/** Mesh ticks that updated the pose, and ticks of meshes that were not rendered recently */
+		uint64 PoseUpdates = 0;
+		uint64 OffScreen = 0;
+		double Seconds = 0.0;
+	};
+	static FAnimStats& GetStats();
+
+	void RegisterMesh(USpartaSkeletalMeshComponent* Mesh);
+	void UnregisterMesh(USpartaSkeletalMeshComponent* Mesh);
+
+	/** Multiplier on the screen size thresholds, 1 with nothing to save */
+	float GetThresholdScale() const { return ThresholdScale; }
+
+	/**
+	 * Spawns Count copies of the first local player's pawn class in a grid in front of it, measures animation time for
+	 * Seconds with the budget off and Seconds with it on, logs both and removes the copies
+	 */
+	void StartStress(int32 Count, float Seconds);
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual void Deinitialize() override;
+
+private:
+	/** Once a frame, after the meshes ticked: FrameSeconds is what they cost together */
+	void UpdateBudget(double FrameSeconds);
+	void ApplySettings(USpartaSkeletalMeshComponent* Mesh) const;
+	void TickStress(float DeltaTime);
+	void EndStress();
+
+	TArray<TWeakObjectPtr<USpartaSkeletalMeshComponent>> Meshes;
+
+	float ThresholdScale = 1.f;
+	/** Animation time per frame, smoothed over a few frames */
+	float SmoothedMs = 0.f;
+	/** Bumped whenever the settings meshes take change, along with what they were made from */
+	int32 Generation = 0;
+	bool bAppliedEnabled = false;
+	float AppliedScale = 1.f;
+	float AppliedFullRateScreenSize = 0.f;
+	int32 AppliedMaxInterval = 0;
+	int32 AppliedInterpolateInterval = 0;
+	/** GetStats().Seconds at the last tick */
+	double LastSeconds = 0.0;
+
+	/** Each stress phase settles for a second, then measures for StressSeconds */
+	enum class EStressPhase : uint8
+	{
+		None,
+		Unbudgeted,
+		Budgeted,
+	};
+	EStressPhase StressPhase = EStressPhase::None;
+	TArray<TWeakObjectPtr<AActor>> StressActors;
+	float StressSeconds = 0.f;
+	float StressPhaseTime = 0.f;
+	bool bStressMeasuring = false;
+	int32 StressPreviousBudget = 0;
+	FAnimStats StressStart;
+	/** Per frame, with the budget off */
+	double StressUnbudgetedMs = 0.0;
+	double StressUnbudgetedPoseUpdates = 0.0;
+};
@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SpartaGameMode.h"
+#include "SpartaBenchmarkGameMode.generated.h"
+
+class ASpartaPawn;
+class ASpartaDrone;
+
+/**
+ * Capacity test: spawns NumPawns pawns and NumDrones drones around the player start, each driven by an
+ * ASpartaBotController, runs WarmupFrames and then NumFrames more, and writes per-frame and summary CSVs to
+ * Saved/SpartaBenchmarks: frame time percentiles, game thread ms per subsystem and physics queries per frame.
+ * Quits when done. Map options override the settings, for example from a headless build:
+ *
+ *   Project Map?game=/Script/Assignment_7_7.SpartaBenchmarkGameMode?Pawns=500?Drones=100?Frames=3600 -game -nullrhi -benchmark -fps=60
+ *
+ * -benchmark -fps=60 steps the game at a fixed 60 Hz, so every run simulates the same thing. Nothing is rendered
+ * under -nullrhi, so the significance subsystem puts bots in the Reduced bucket at best; add
+ * -ExecCmds="Sparta.Significance.Enabled 0" to measure everything at full rate.
+ */
+UCLASS()
+class ASSIGNMENT_7_7_API ASpartaBenchmarkGameMode : public ASpartaGameMode
+{
+	GENERATED_BODY()
+
+public:
+	ASpartaBenchmarkGameMode();
+
+	/** ?Pawns= */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark", meta = (ClampMin = "0"))
+	int32 NumPawns = 200;
+
+	/** ?Drones= */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark", meta = (ClampMin = "0"))
+	int32 NumDrones = 50;
+
+	/** Measured frames, after the warmup. ?Frames= */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark", meta = (ClampMin = "1"))
+	int32 NumFrames = 1800;
+
+	/** Frames to let the bots spawn, land and spread out before measuring. ?Warmup= */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark", meta = (ClampMin = "0"))
+	int32 WarmupFrames = 120;
+
+	/** Bot I scripts from Seed + I. ?Seed= */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark")
+	int32 Seed = 1;
+
+	/** Distance between bots in the spawn grid */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark", meta = (ClampMin = "1.0"))
+	float SpawnSpacing = 300.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark")
+	TSubclassOf<ASpartaPawn> BotPawnClass;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark")
+	TSubclassOf<ASpartaDrone> BotDroneClass;
+
+	/** File name prefix under Saved/SpartaBenchmarks. ?BenchName= */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark")
+	FString BenchmarkName = TEXT("SpartaBenchmark");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Benchmark")
+	bool bQuitWhenDone = true;
+
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+	virtual void StartPlay() override;
+	virtual void Tick(float DeltaSeconds) override;
+
+private:
+	/** Counters read once a frame; a frame's sample is the difference between two reads */
+	struct FCounters
+	{
+		double Time = 0.0;
+		double MovementSeconds = 0.0;
+		double SignificanceSeconds = 0.0;
+		double PawnSeconds = 0.0;
+		double DroneSeconds = 0.0;
+		double AnimSeconds = 0.0;
+		uint64 FloorTraces = 0;
+		uint64 WallOverlaps = 0;
+		uint64 Sweeps = 0;
+		uint64 AsyncQueries = 0;
+
+		static FCounters Read();
+	};
+
+	enum EColumn
+	{
+		Column_FrameMs,
+		Column_MovementMs,
+		Column_SignificanceMs,
+		Column_PawnTickMs,
+		Column_DroneTickMs,
+		Column_AnimMs,
+		Column_FloorTraces,
+		Column_WallOverlaps,
+		Column_Sweeps,
+		Column_AsyncQueries,
+		Column_Num
+	};
+
+	void SpawnBots();
+	void AddSample(const FCounters& Previous, const FCounters& Current);
+	void WriteResults() const;
+
+	FCounters LastCounters;
+	int32 FrameIndex = 0;
+	bool bDone = false;
+	/** One array per column, one entry per measured frame */
+	TArray<float> Samples[Column_Num];
+};
@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Controller.h"
+#include "SpartaBotController.generated.h"
+
+class ASpartaPawn;
+class ASpartaDrone;
+
+/**
+ * Drives an ASpartaPawn or ASpartaDrone with scripted input, for ASpartaBenchmarkGameMode. Every frame it calls the
+ * pawn's input handlers with the FInputActionValues the player controllers' input actions would send: axis values
+ * while held, then a released value, and jump and sprint as started and completed events. The script is a run of
+ * segments of random length, each holding one set of inputs; the same seed gives the same inputs frame for frame.
+ */
+UCLASS()
+class ASSIGNMENT_7_7_API ASpartaBotController : public AController
+{
+	GENERATED_BODY()
+
+public:
+	ASpartaBotController();
+
+	void SetSeed(int32 Seed) { Stream.Initialize(Seed); }
+
+	virtual void Tick(float DeltaTime) override;
+
+protected:
+	virtual void OnPossess(APawn* InPawn) override;
+
+private:
+	/** Picks the inputs held for the next segment */
+	void StartSegment();
+	void DrivePawn(ASpartaPawn* SpartaPawn);
+	void DriveDrone(ASpartaDrone* Drone);
+
+	FRandomStream Stream;
+	int32 SegmentFrames = 0;
+	bool bSegmentStarted = false;
+
+	FVector2D MoveInput = FVector2D::ZeroVector;
+	FVector2D LookInput = FVector2D::ZeroVector;
+	float MoveUpInput = 0.0f;
+	bool bSprint = false;
+	bool bWasSprinting = false;
+	bool bJump = false;
+	/** Frames until the jump started is released, 0 with none held */
+	int32 JumpFramesLeft = 0;
+};
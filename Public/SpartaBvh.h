@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Bounding volume hierarchy over static floor triangles, answering downward floor probes one at a time or in packets
+// of rays traversed together. Engine-free, like SpartaMovementCore.h. USpartaMovementSubsystem builds one from static
+// meshes when Sparta.Movement.FloorBvh is set; RunBvhBenchmark (SpartaMovementBenchmark.h) tunes the build.
+
+#include "SpartaMovementCore.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace SpartaMovement
+{
+	struct FBvhBuildSettings
+	{
+		/** Nodes with more triangles than this are always split. Past 4, fewer nodes beat cheaper leaves: see RunBvhBenchmark. */
+		int32_t MaxLeafTriangles = 8;
+		/** Centroid bins per axis the SAH split is picked from */
+		int32_t NumBins = 16;
+		/** SAH costs of stepping into a node and of testing a triangle, relative to each other */
+		float TraversalCost = 1.f;
+		float IntersectionCost = 1.f;
+		/**
+		 * Weigh nodes by their XY footprint, the chance a vertical ray enters them, instead of their surface area,
+		 * the chance for rays in every direction
+		 */
+		bool bFootprintCost = true;
+	};
+
+	struct FBvhBuildStats
+	{
+		int32_t NumTriangles = 0;
+		/** Walls: vertical triangles, which a vertical ray only ever grazes */
+		int32_t NumDroppedTriangles = 0;
+		int32_t NumNodes = 0;
+		int32_t NumLeaves = 0;
+		int32_t MaxDepth = 0;
+		/** Expected cost of a probe under the build's cost model, in IntersectionCost units */
+		double SahCost = 0.0;
+		double Seconds = 0.0;
+	};
+
+	/**
+	 * Binned-SAH BVH over the triangles of a mesh, for vertical rays only: a ray going down through (X, Y)
+	 * stops on a triangle whose XY projection holds the point, so the triangle test is three edge functions and a plane.
+	 * Triangles sharing an edge use exactly opposite edge functions, so probes never fall through the seam.
+	 * Either side of a triangle stops a probe, as meshes wind their triangles either way; walls, which a vertical ray
+	 * only grazes, are left out of the tree.
+	 */
+	class FFloorBvh
+	{
+	public:
+		/** Triangle list: three indices into Vertices per triangle. Replaces what was built before. */
+		void Build(const FVec3* Vertices, const int32_t* Indices, int32_t NumIndices, const FBvhBuildSettings& Settings = FBvhBuildSettings(), FBvhBuildStats* OutStats = nullptr);
+
+		bool IsEmpty() const { return Nodes.empty(); }
+
+		/** Highest floor from Start down to Start.Z - Distance. A floor a millimetre over Start still counts. */
+		bool TraceDown(const FVec3& Start, float Distance, float& OutFloorZ) const;
+
+		/**
+		 * TraceDown for Num probes, GetPacketWidth at a time: each packet walks the tree once, entering a node if any of
+		 * its probes does. Packets are taken in the order given; see SortProbesForCoherence. OutFloorZ is left alone for
+		 * probes that miss.
+		 */
+		void TraceDownBatch(const FVec3* Starts, const float* Distances, float* OutFloorZ, bool* OutHits, int32_t Num) const;
+
+		/** Rays per packet: 8 with AVX2, 4 with SSE2, else 1 */
+		static int32_t GetPacketWidth();
+
+		size_t GetMemoryBytes() const { return Nodes.size() * sizeof(FNode) + Triangles.size() * sizeof(FTriangle); }
+
+	private:
+		/** Leaves have Count triangles from First; inner nodes have Count 0 and their children at First and First + 1 */
+		struct FNode
+		{
+			float MinX, MinY, MinZ;
+			int32_t First;
+			float MaxX, MaxY, MaxZ;
+			int32_t Count;
+		};
+
+		/** Inside where all of Ex * X + Ey * Y + E0 >= 0; the floor there is Z = Px * X + Py * Y + P0 */
+		struct FTriangle
+		{
+			float EdgeX[3];
+			float EdgeY[3];
+			float Edge0[3];
+			float PlaneX, PlaneY, Plane0;
+		};
+
+		template <typename TLanes>
+		void TracePacket(const FVec3* Starts, const float* Distances, float* OutFloorZ, bool* OutHits, int32_t Num) const;
+
+		std::vector<FNode> Nodes;
+		std::vector<FTriangle> Triangles;
+	};
+
+	/**
+	 * Orders Num probes so that probes close together end up in the same packet and go down the same branches: Morton
+	 * order of their starts' XY on a Cell-sized grid. OutKeys gets one key per probe, sorted, with the probe's index in
+	 * the low 32 bits. Reusing OutKeys keeps this from allocating.
+	 */
+	void SortProbesForCoherence(const FVec3* Starts, int32_t Num, float Cell, std::vector<uint64_t>& OutKeys);
+
+	/** IMovementWorld answering floor probes from an FFloorBvh and everything else from Inner */
+	class FBvhFloorWorld : public IMovementWorld
+	{
+	public:
+		FBvhFloorWorld(const FFloorBvh& InBvh, const IMovementWorld& InInner) : Bvh(InBvh), Inner(InInner) {}
+
+		virtual bool TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const override { return Bvh.TraceDown(Start, Distance, OutFloorZ); }
+		virtual int32_t OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const override
+		{
+			return Inner.OverlapCapsule(Center, Radius, HalfHeight, OutContacts, MaxContacts);
+		}
+		virtual bool SweepCapsule(const FVec3& Start, const FVec3& End, float Radius, float HalfHeight, FSweepHit& OutHit) const override
+		{
+			return Inner.SweepCapsule(Start, End, Radius, HalfHeight, OutHit);
+		}
+
+	private:
+		const FFloorBvh& Bvh;
+		const IMovementWorld& Inner;
+	};
+}
@@ -4,10 +4,13 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Pawn.h"
+#include "SpartaMovementNet.h"
+#include "SpartaMovementRecording.h"
+#include "SpartaWorldQuery.h"
+#include "SpartaSignificanceSubsystem.h"
+#include "SpartaPlayerCameraManager.h"
 #include "SpartaDrone.generated.h"
 
-class USpringArmComponent;
-class UCameraComponent;
 class UCapsuleComponent;
 
 struct FInputActionValue;
@@ -29,29 +32,85 @@ public:
     UPROPERTY(VisibleAnywhere, Category = "Components")
     USkeletalMeshComponent* SkeletalMeshComp;
 
-    /** Spring Arm Component */
-    UPROPERTY(VisibleAnywhere, Category = "Components")
-    USpringArmComponent* SpringArmComp;
-
-    /** Camera Component */
-    UPROPERTY(VisibleAnywhere, Category = "Components")
-    UCameraComponent* CameraComp;
+    /** Where ASpartaPlayerCameraManager's camera rig puts the camera while a local player looks through this drone */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera")
+    FSpartaCameraRigSettings CameraRig;
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Drone")
     float MaxDroneEnginePower;
 
-    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Drone")
-    float DroneEnginePower;
-
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Drone")
     float GravityAccel;
 
+    /** Step the flight simulation at FixedStepRate instead of once per frame; rendering interpolates between steps */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Drone|Simulation")
+    bool bUseFixedStep = false;
+
+    /** Simulation steps per second in fixed-step mode */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Drone|Simulation", meta = (ClampMin = "1.0"))
+    float FixedStepRate = 60.0f;
+
+    /** Steps run at most per frame. Time beyond that is dropped, so a hitch cannot snowball. */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Drone|Simulation", meta = (ClampMin = "1"))
+    int32 MaxSubsteps = 4;
+
+    /** Totals over all drones, logged by Sparta.Drone.SweepStats */
+    struct FSweepStats
+    {
+        uint64 DroneFrames = 0;
+        /** Swept moves the drone made when every input event and gravity moved it on its own */
+        uint64 UncoalescedMoves = 0;
+        /** Swept moves made */
+        uint64 Moves = 0;
+        /** Sweep queries issued, a slide can take more than one per move */
+        uint64 Sweeps = 0;
+    };
+
+    static FSweepStats& GetSweepStats();
+
+    /** Engine power decayed to the current world time */
+    UFUNCTION(BlueprintCallable, Category = "Drone")
+    float GetEnginePower() const;
+
+    /** Sets the engine power as of now, clamped to [0, MaxDroneEnginePower]; it decays from there */
+    UFUNCTION(BlueprintCallable, Category = "Drone")
+    void SetEnginePower(float NewEnginePower);
+
+    /** Starts streaming this drone's input and steps into a movement recording, see SpartaMovementRecording.h */
+    void StartRecording();
+    /** Ends the recording and hands it over, null if none was running */
+    TUniquePtr<SpartaMovement::FMovementRecorder> StopRecording();
+
+    /**
+     * This drone's movement in wire form, see SpartaMovementNet.h. No velocity: drones move by offsets. ClientMoveSnapshot
+     * leaves the rotation out as well, the owning client turns the drone itself.
+     */
+    SpartaMovement::FNetMoveState GetNetMoveState() const;
+    /** Takes a snapshot's transform and engine power, as a teleport */
+    void ApplyNetMoveState(const SpartaMovement::FNetMoveState& NetState);
+
+    /** Client to server, every frame the owning client steps the drone: its newest inputs, like ASpartaPawn::ServerMove */
+    UFUNCTION(Server, Unreliable)
+    void ServerMove(const TArray<uint8>& Packet);
+
+    /** Server to owning client: the drone's state after the newest input stepped, like ASpartaPawn::ClientMoveSnapshot */
+    UFUNCTION(Client, Unreliable)
+    void ClientMoveSnapshot(const TArray<uint8>& Packet);
+
 protected:
-    FVector CumulativeUpOffset = FVector::ZeroVector;
+    /** Feeds the input handlers below like an enhanced input binding would */
+    friend class ASpartaBotController;
 
 	virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
     virtual void Tick(float DeltaTime) override;
+    virtual void PossessedBy(AController* NewController) override;
+    virtual void UnPossessed() override;
+    virtual void PostNetReceiveRole() override;
     virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
+    virtual void NotifyHit(UPrimitiveComponent* MyComp, AActor* Other, UPrimitiveComponent* OtherComp, bool bSelfMoved,
+        FVector HitLocation, FVector HitNormal, FVector NormalImpulse, const FHitResult& Hit) override;
+    virtual void NotifyActorBeginOverlap(AActor* OtherActor) override;
 
 	UFUNCTION()
 	void MoveUp(const FInputActionValue& value);
@@ -67,29 +126,110 @@ protected:
     void LookYaw(const FInputActionValue& value);
 
 private:	
-    FRotator TargetRotation;
-
-    void SetGravity(float DeltaTime);
-    void ReduceEnginePower(float DeltaTime);
-    void UpdateCamera(float DeltaTime);
-    void ApplyTiltEffect(float DeltaTime);
-    void RestoreTilt(float DeltaTime);
-    bool IsGrounded();
-
-    float MinYaw = -360.0f;
-    float MaxYaw = 360.0f;
-
-    float MinPitch = -45.0f;
-    float MaxPitch = 45.0f;
-
-    float YawSpeed = 50.0f;
-    float PitchSpeed = 50.0f;
-
-    float ReducingPower = 100.0f;
-
-    float CurrentMoveAxisValue;
-    float CurrentMoveForwardAxis;
-
-    bool bIsGrounded = false;
-    FRotator AccumulatedRotation;
+    /**
+     * Tunables and simulation state, stepped by SpartaMovement::StepDrone. MaxDroneEnginePower, GravityAccel and the
+     * capsule size are copied into MoveParams before every step. MoveState.Location is only current during a step:
+     * the actor, or the fixed-step state, holds the drone's location.
+     */
+    SpartaMovement::FDroneMoveParams MoveParams;
+    SpartaMovement::FDroneMoveState MoveState;
+
+    void UpdateMoveParams();
+
+    /**
+     * Engine power, rotation layers, the move and the ground check for the step from StartTime (world seconds), from
+     * InOutLocation. Leaves the actor alone: the caller writes the transform it ends on once.
+     */
+    void StepSimulation(double StartTime, float DeltaTime, FVector& InOutLocation, FQuat& OutRotation);
+    void TickFixedStep(float DeltaTime);
+    /** Clears MoveState.Input once the frame's steps have used it */
+    void ConsumeInputCommand();
+
+    /** The actor transform write, counted in SpartaMovementDebug::GetTransformStats */
+    void CommitTransform(const FVector& Location, const FQuat& Rotation);
+
+    /** Starts every rotation layer over from Rotation, for a teleport */
+    void ResetRotationLayers(const FQuat& Rotation);
+
+    /** Ground probe hit and query params, reused every tick */
+    FSpartaQueryBuffers QueryBuffers;
+
+    /**
+     * Networked movement, like ASpartaPawn's: a drone a remote player controls is stepped by that player's inputs
+     * alone, each a SpartaMovement::FNetDroneInput built from what the input handlers left in MoveState. Its engine
+     * power decays on NetTicks, the inputs' own clock, so client and server agree on it.
+     */
+    enum class ENetMoveRole : uint8
+    {
+        Local,
+        Predicting,
+        ServerDriven,
+        Simulated,
+    };
+    ENetMoveRole NetMoveRole = ENetMoveRole::Local;
+
+    void UpdateNetMoveRole();
+    bool IsNetStepped() const { return NetMoveRole == ENetMoveRole::Predicting || NetMoveRole == ENetMoveRole::ServerDriven; }
+    /** World time, or NetTicks while stepped by inputs: what MoveState.EnginePowerTime is in */
+    double GetMoveTime() const;
+    /** One input through SpartaMovement::StepDroneInput, snapped to the wire grid, on MoveState */
+    void StepNetInput(const SpartaMovement::FNetDroneInput& Input);
+    void TickNetPrediction(float DeltaTime);
+    SpartaMovement::FQuantizedMoveState GetQuantizedNetState() const;
+
+    /** Sum of the DeltaTime of every input stepped, in their 1/10000 s */
+    uint64 NetTicks = 0;
+    /** What the last input step returned */
+    SpartaMovement::FQuat4 NetRotation;
+
+    /**
+     * Predicting: MoveState and NetTicks after each input, indexed like NetInputBuffer. The rotation layers are not
+     * on the wire, so a correction starts over from the state saved for the input the server acknowledged.
+     */
+    struct FNetSavedMove
+    {
+        SpartaMovement::FDroneMoveState State;
+        uint64 Ticks = 0;
+    };
+    TArray<FNetSavedMove> NetSavedMoves;
+    void SaveNetMove(uint16 Sequence);
+
+    SpartaMovement::TNetInputBuffer<SpartaMovement::FNetDroneInput> NetInputBuffer;
+    SpartaMovement::FNetSnapshotReceiver NetSnapshotReceiver;
+    SpartaMovement::TNetInputQueue<SpartaMovement::FNetDroneInput> NetInputQueue;
+    SpartaMovement::FNetSnapshotSender NetSnapshotSender;
+    double LastNetSnapshotTime = -1.0;
+    std::vector<uint8_t> NetBytes;
+
+    /** Set while recording */
+    TUniquePtr<SpartaMovement::FMovementRecorder> Recorder;
+
+    void RecordInput(SpartaMovement::ERecordTag Tag, const float* Values = nullptr);
+
+    /** Fixed-step state: the last two simulated transforms, rendering lerps between them */
+    float StepAccumulator = 0.0f;
+    bool bHasSimState = false;
+    FVector SimLocation = FVector::ZeroVector;
+    FVector PrevSimLocation = FVector::ZeroVector;
+    FQuat SimRotation = FQuat::Identity;
+    FQuat PrevSimRotation = FQuat::Identity;
+
+    /** Bucket from USpartaSignificanceSubsystem. Analytic moves without sweeps and checks the ground against Z = 0. */
+    ESpartaSignificance Significance = ESpartaSignificance::Full;
+    /** World time of the last tick, see USpartaSignificanceSubsystem::ConsumeStepTime */
+    double LastStepTime = -1.0;
+
+    void SetSignificance(ESpartaSignificance NewSignificance);
+
+    /** Asleep: landed and still for StepsToSleep ticks, not ticked until something wakes it */
+    bool bIsAsleep = false;
+    int32 RestSteps = 0;
+    int32 StepsToSleep = 30;
+
+    /** Landed, and the drone did not move or turn this tick. Engine power left on does not count. */
+    bool IsAtRest(const FVector& PreviousLocation, const FQuat& PreviousRotation) const;
+    void GoToSleep();
+    /** Input, hits, overlaps and floor changes under the drone call this */
+    void WakeUp();
+    void OnFloorInvalidated(const FBox& Bounds);
 };
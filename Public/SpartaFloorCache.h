@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Floor-height cache shared by all pawns. Engine-free, like SpartaMovementCore.h.
+
+#include "SpartaMovementCore.h"
+
+#include <vector>
+
+namespace SpartaMovement
+{
+	struct FFloorCacheStats
+	{
+		uint64_t Lookups = 0;
+		/** Answered by bilinear lookup, no trace */
+		uint64_t CacheHits = 0;
+		/** Traces issued to fill grid samples */
+		uint64_t SampleTraces = 0;
+		/** Real traces at the pawn position: ledge, moving floor or no floor */
+		uint64_t FallbackTraces = 0;
+	};
+
+	/** A probe a concurrent reader could not answer from the cache, replayed on the owning thread to fill the corners */
+	struct FFloorFillRequest
+	{
+		FVec3 Start;
+		float Distance = 0.f;
+		bool bPending = false;
+	};
+
+	/**
+	 * Grid of floor heights sampled at cell corners, filled lazily from traces.
+	 * A lookup bilinearly interpolates the four corners around the query. It falls back to a real
+	 * trace at the query position when the corners disagree by more than LedgeHeight (a ledge or step),
+	 * when a corner sits on geometry that can move, or when there is no floor.
+	 *
+	 * Chunks come from a pool: once Reserve covers the area the pawns roam, lookups never allocate.
+	 */
+	class FFloorHeightCache
+	{
+	public:
+		explicit FFloorHeightCache(float InCellSize = 50.f);
+
+		float CellSize;
+		/** Corners further apart than this in Z are treated as a ledge */
+		float LedgeHeight = 25.f;
+		/** Samples are traced from this far above the query, so slopes do not start below the surface */
+		float SampleLift = 50.f;
+		/** Frames before a sample on moving geometry is traced again */
+		uint32_t UncacheableRetryFrames = 30;
+		/** Corner traces one lookup may issue. Corners past the budget make the lookup fall back and fill on later frames. */
+		int32_t MaxSampleTracesPerLookup = 1;
+
+		/** Cached version of IMovementWorld::TraceFloor. Sampler provides the uncached probes. */
+		bool TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ, const IMovementWorld& Sampler);
+
+		/**
+		 * TraceFloor for worker threads: reads the cache and never writes it, so any number may run while nothing else
+		 * touches the cache. Corners that would need a trace make it fall back to a real probe and set OutFill;
+		 * pass that to Fill afterwards. Not counted in the stats.
+		 */
+		bool TraceFloorConcurrent(const FVec3& Start, float Distance, float& OutFloorZ, const IMovementWorld& Sampler, FFloorFillRequest& OutFill) const;
+
+		/** Fills the corners a concurrent lookup missed and clears the request */
+		void Fill(FFloorFillRequest& Request, const IMovementWorld& Sampler);
+
+		/** Drop every sample inside the XY rectangle */
+		void Invalidate(float MinX, float MinY, float MaxX, float MaxY);
+		/** Drop every sample. The pool keeps its memory. */
+		void Reset();
+
+		/** Pre-allocate room for MaxChunks chunks of ChunkSize x ChunkSize samples */
+		void Reserve(int32_t MaxChunks);
+		int32_t GetNumChunks() const { return static_cast<int32_t>(Chunks.size()); }
+
+		/** Call once per frame */
+		void AdvanceFrame() { ++Frame; }
+
+		const FFloorCacheStats& GetStats() const { return Stats; }
+		void ResetStats() { Stats = FFloorCacheStats(); }
+
+	private:
+		enum ESampleFlags : uint8_t
+		{
+			SF_Valid = 1 << 0,
+			SF_Hit = 1 << 1,
+			SF_Cacheable = 1 << 2,
+		};
+
+		struct FSample
+		{
+			float FloorZ = 0.f;
+			/** Top of the traced segment: the sample holds for queries starting between FloorZ and StartZ */
+			float StartZ = 0.f;
+			uint32_t Frame = 0;
+			uint8_t Flags = 0;
+		};
+
+		static constexpr int32_t ChunkSize = 16;
+
+		struct FChunk
+		{
+			FSample Samples[ChunkSize * ChunkSize];
+		};
+
+		/** Index into the pool, -1 if the chunk was never touched */
+		int32_t FindChunk(uint64_t Key) const;
+		int32_t FindOrAddChunk(uint64_t Key);
+		void Rehash(size_t NumSlots);
+
+		/** Flat index of the sample, stays valid when the pool grows (references do not) */
+		size_t FindOrAddSample(int32_t SampleX, int32_t SampleY);
+		FSample& GetSample(size_t FlatIndex) { return Chunks[FlatIndex / (ChunkSize * ChunkSize)].Samples[FlatIndex % (ChunkSize * ChunkSize)]; }
+		bool NeedsTrace(const FSample& Sample, float StartZ) const;
+		/** nullptr if its chunk was never touched */
+		const FSample* FindSample(int32_t SampleX, int32_t SampleY) const;
+		/** Bilinear floor from four usable corners (X-major order). False if they disagree or the floor is out of reach. */
+		bool InterpolateCorners(const FSample* const Corners[4], float FracX, float FracY, const FVec3& Start, float Distance, float& OutFloorZ) const;
+
+		std::vector<FChunk> Chunks;
+		/** Open-addressed chunk key -> pool index table, power-of-two sized, at most half full */
+		std::vector<uint64_t> SlotKeys;
+		std::vector<int32_t> SlotChunks;
+		uint32_t Frame = 1;
+		FFloorCacheStats Stats;
+	};
+}
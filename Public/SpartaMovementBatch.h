@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Structure-of-arrays storage for many pawns, stepped in one loop. Engine-free, like SpartaMovementCore.h.
+
+#include "SpartaMovementCore.h"
+
+#include <vector>
+
+namespace SpartaMovement
+{
+	enum EPawnBodyFlags : uint8_t
+	{
+		PBF_None = 0,
+		PBF_Jumping = 1 << 0,
+		PBF_Sprinting = 1 << 1,
+	};
+
+	/** Movement state of every registered pawn, one array per field. Index i across all arrays is one pawn. */
+	struct FPawnBodies
+	{
+		std::vector<float> PosX;
+		std::vector<float> PosY;
+		std::vector<float> PosZ;
+		std::vector<float> VelX;
+		std::vector<float> VelY;
+		std::vector<float> VelZ;
+		std::vector<float> FloorZ;
+		std::vector<float> Yaw;
+		std::vector<uint8_t> Flags;
+
+		int32_t Num() const { return static_cast<int32_t>(PosX.size()); }
+
+		void Reserve(int32_t Capacity);
+
+		/** Appends a body and returns its index */
+		int32_t Add(const FPawnMoveState& State);
+
+		/** Removes a body by moving the last one into its slot. Returns the old index of the moved body, or -1. */
+		int32_t RemoveAtSwap(int32_t Index);
+
+		void Swap(int32_t A, int32_t B);
+
+		void Load(int32_t Index, FPawnMoveState& OutState) const;
+		void Store(int32_t Index, const FPawnMoveState& State);
+	};
+
+	/** Engine power and height of many drones, one array per field */
+	struct FDroneBodies
+	{
+		std::vector<float> PosZ;
+		std::vector<float> EnginePower;
+		std::vector<float> MaxEnginePower;
+
+		int32_t Num() const { return static_cast<int32_t>(PosZ.size()); }
+	};
+
+	/**
+	 * Gravity, integration and floor clamp for all bodies. Same math as Integrate().
+	 * Runs 8 bodies per instruction with AVX2, 4 with SSE2, and falls back to the scalar loop otherwise.
+	 */
+	void IntegrateBodies(FPawnBodies& Bodies, float Gravity, float DeltaTime);
+	/** Bodies [Begin, End) only, each by its own step: DeltaTimes[i] for body i */
+	void IntegrateBodies(FPawnBodies& Bodies, float Gravity, const float* DeltaTimes, int32_t Begin, int32_t End);
+	void IntegrateBodiesScalar(FPawnBodies& Bodies, float Gravity, float DeltaTime);
+
+	/** Closed-form fall (ComputeDroneFallOffset) with the Z = 0 ground clamp, then power decay. Same math as ASpartaDrone's unpowered step. */
+	void IntegrateDroneBodies(FDroneBodies& Bodies, float GravityAccel, float ReducingPower, float DeltaTime);
+	void IntegrateDroneBodiesScalar(FDroneBodies& Bodies, float GravityAccel, float ReducingPower, float DeltaTime);
+
+	/** "AVX2", "SSE2" or "Scalar": the path IntegrateBodies was compiled with */
+	const char* GetIntegratorPathName();
+}
@@ -0,0 +1,284 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Headless benchmark for the movement core. Engine-free, like SpartaMovementCore.h.
+//
+// In-game it runs through the "Sparta.Movement.Bench" console command.
+// On Linux it builds standalone, without the editor:
+//   g++ -O2 -std=c++17 -DSPARTA_MOVEMENT_STANDALONE=1 -IPublic Private/SpartaMovementCore.cpp Private/SpartaMovementBatch.cpp
+//       Private/SpartaFloorCache.cpp Private/SpartaMovementRecording.cpp Private/SpartaMovementNet.cpp Private/SpartaPawnBroadphase.cpp
+//       Private/SpartaSdf.cpp Private/SpartaBvh.cpp Private/SpartaMovementBenchmark.cpp -o SpartaMovementBench
+//   ./SpartaMovementBench [NumPawns] [NumFrames] [TickRateHz]
+//   ./SpartaMovementBench record <File> [NumFrames] [drone]  one synthetic pawn, or drone, into a movement recording
+//   ./SpartaMovementBench replay <File> [Repeat] [resync]  see SpartaMovementRecording.h
+//   ./SpartaMovementBench net [NumClients] [LatencyMs] [LossPercent] [Seconds]  replicated movement over a lossy loopback
+//   ./SpartaMovementBench sdf [VoxelSize] [NumQueries]   SDF queries against the analytic ones, see RunSdfBenchmark
+//   ./SpartaMovementBench bvh [MaxLeafTriangles] [NumBins] [NumProbes] [surface]  floor BVH build and probes, see RunBvhBenchmark
+// Add -pthread on Linux; the parallel runs use std::thread.
+// Exits 1 when a check fails (allocating frames, SIMD, broadphase, SDF batch or BVH mismatches), 2 when a replay diverges.
+
+#include "SpartaMovementCore.h"
+#include "SpartaMovementBatch.h"
+#include "SpartaFloorCache.h"
+#include "SpartaSdf.h"
+#include "SpartaBvh.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace SpartaMovement
+{
+	class FMovementRecorder;
+
+	/** Heightfield with a lattice of boxes standing on it. Also bakes into an SDF: solid is under the heightfield or in a box. */
+	class FSyntheticWorld : public IMovementWorld, public ISdfBakeSource
+	{
+	public:
+		float Amplitude = 150.f;
+		float Frequency = 0.002f;
+		float BoxSpacing = 800.f;
+		float BoxHalfExtent = 150.f;
+		float BoxHeight = 120.f;
+
+		/** Optional, answers TraceFloor from the cache when set */
+		FFloorHeightCache* FloorCache = nullptr;
+
+		/** Number of real floor probes */
+		mutable std::atomic<uint64_t> FloorTraces{0};
+
+		float HeightAt(float X, float Y) const;
+
+		virtual bool TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const override;
+		virtual bool TraceFloorSample(const FVec3& Start, float Distance, float& OutFloorZ, bool& bOutCacheable) const override;
+		virtual int32_t OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const override;
+		virtual bool SweepCapsule(const FVec3& Start, const FVec3& End, float Radius, float HalfHeight, FSweepHit& OutHit) const override;
+
+		/** Tests the center point only */
+		virtual bool IsSolid(const FVec3& Center, float HalfSize) const override;
+		virtual ESdfRegion ClassifyRegion(const FVec3& Min, const FVec3& Max) const override;
+
+		/**
+		 * The world as a triangle mesh over [-HalfExtent, HalfExtent] in X and Y: the heightfield on a Spacing grid
+		 * and every box as six faces
+		 */
+		void Triangulate(float HalfExtent, float Spacing, std::vector<FVec3>& OutVertices, std::vector<int32_t>& OutIndices) const;
+
+	private:
+		bool HasBox(int32_t CellX, int32_t CellY) const;
+	};
+
+	struct FBenchmarkConfig
+	{
+		int32_t NumPawns = 500;
+		int32_t NumFrames = 600;
+		int32_t WarmupFrames = 60;
+		float DeltaTime = 1.f / 60.f;
+		uint32_t Seed = 1;
+		bool bUseFloorCache = true;
+		bool bUseCollisionCoherence = true;
+		/** Walk moves go through SlidePawn; off, they are applied directly and CheckCollision pushes the pawn back out */
+		bool bUseSweep = true;
+		/** Floor cache pool, enough for the +-10000 spawn square and some drift */
+		int32_t FloorCacheChunks = 2048;
+		/**
+		 * 0: every pawn steps in turn, filling the floor cache as it goes.
+		 * N: pawns step on N threads (the caller's included) against a read-only floor cache, then one serial commit
+		 * pass fills the cache. Same frame structure as USpartaMovementSubsystem's parallel mode.
+		 */
+		int32_t NumThreads = 0;
+	};
+
+	struct FBenchmarkResult
+	{
+		double NsPerPawnTick = 0.0;
+		/** Heap allocations per frame (all pawns), only measured in the standalone build */
+		double AllocationsPerTick = 0.0;
+		/** Measured frames that allocated at all; 0 means ticking is allocation-free after warmup */
+		int32_t AllocatingFrames = 0;
+		bool bAllocationsCounted = false;
+		/** Real floor probes per frame (all pawns) */
+		double FloorTracesPerTick = 0.0;
+		/** Wall queries run and skipped by coherence per frame (all pawns) */
+		double WallQueriesPerTick = 0.0;
+		double WallQueriesSkippedPerTick = 0.0;
+		/** Wall contacts pawns had walked into, per frame (all pawns). Tunneling and jitter show up here. */
+		double DepenetrationsPerTick = 0.0;
+		/** Wall-clock time of a whole frame (all pawns) */
+		double MsPerFrame = 0.0;
+		uint64_t PawnTicks = 0;
+		/** Sum of final positions, so the optimizer cannot drop the work and runs can be compared */
+		double Checksum = 0.0;
+	};
+
+	/** Incremented by the standalone build's global operator new */
+	extern std::atomic<uint64_t> GBenchmarkAllocations;
+
+	/** Step Config.NumPawns pawns over Config.NumFrames frames against FSyntheticWorld */
+	FBenchmarkResult RunPawnBenchmark(const FBenchmarkConfig& Config);
+
+	struct FIntegratorBenchmarkResult
+	{
+		const char* PathName = "";
+		double ScalarNsPerBody = 0.0;
+		double SimdNsPerBody = 0.0;
+		double DroneScalarNsPerBody = 0.0;
+		double DroneSimdNsPerBody = 0.0;
+		/** Largest difference between the scalar and SIMD results, should be 0 */
+		float MaxError = 0.f;
+	};
+
+	/** IntegrateBodies/IntegrateDroneBodies against their scalar versions on NumBodies bodies */
+	FIntegratorBenchmarkResult RunIntegratorBenchmark(int32_t NumBodies = 10000, int32_t Iterations = 1000);
+
+	struct FBroadphaseBenchmarkResult
+	{
+		/** Hash update and contact search, per pawn per frame */
+		double HashNsPerPawn = 0.0;
+		/** Every pair tested, per pawn per frame */
+		double BruteForceNsPerPawn = 0.0;
+		double ContactsPerFrame = 0.0;
+		/** Share of hash updates that changed cell */
+		double RelinkRatio = 0.0;
+		/** Frames where the hash and the brute force found different pairs; should be 0 */
+		int32_t MismatchedFrames = 0;
+		bool bAllocationFree = false;
+	};
+
+	/**
+	 * NumPawns pawns milling about a square sized for Density pawns per square meter, separated every frame
+	 * through FPawnSpatialHash, against finding the same contacts by testing every pair
+	 */
+	FBroadphaseBenchmarkResult RunBroadphaseBenchmark(int32_t NumPawns = 2000, int32_t NumFrames = 300, float Density = 0.25f);
+
+	struct FSdfBenchmarkResult
+	{
+		float VoxelSize = 0.f;
+		double BakeSeconds = 0.0;
+		int32_t NumBricks = 0;
+		size_t MemoryBytes = 0;
+		uint64_t NumSolidQueries = 0;
+
+		/** Per query: the analytic FSyntheticWorld answer, FSdfWorld, and for floor probes TraceFloorBatch */
+		double AnalyticFloorNs = 0.0;
+		double SdfFloorNs = 0.0;
+		double SdfBatchFloorNs = 0.0;
+		double AnalyticOverlapNs = 0.0;
+		double SdfOverlapNs = 0.0;
+		double AnalyticSweepNs = 0.0;
+		double SdfSweepNs = 0.0;
+
+		/** Floor height off the analytic one, cm, where both hit */
+		double FloorMeanError = 0.0;
+		double FloorP99Error = 0.0;
+		/** Deepest wall contact: penetration off the analytic one (cm) and normal (degrees), where both found one */
+		double PenetrationMeanError = 0.0;
+		double NormalMeanErrorDegrees = 0.0;
+		/** Sweeps: hit distance off the analytic one, cm, where both hit */
+		double SweepMeanError = 0.0;
+		/**
+		 * Queries where one side hit or touched and the other did not, beyond a voxel's tolerance. Near box
+		 * corners the analytic sweep is conservative (square corners) and the SDF is not.
+		 */
+		int32_t FloorMismatches = 0;
+		int32_t ContactMismatches = 0;
+		int32_t SweepMismatches = 0;
+		/** SDF sweeps stopped by the heightfield, which the analytic sweep does not see; not compared */
+		int32_t SweepGroundHits = 0;
+		/** Largest difference between FSdfVolume::SampleBatch and Sample, should be ~0 */
+		float MaxBatchError = 0.f;
+	};
+
+	/**
+	 * Bakes FSyntheticWorld over a 48 m square into an SDF of VoxelSize voxels, then answers NumQueries floor probes,
+	 * pawn wall overlaps and pawn sweeps from it and analytically, for the error and the cost of each. The analytic
+	 * queries are far cheaper than the engine's sweeps; in-game, Sparta.Movement.CompareSdf measures against those.
+	 */
+	FSdfBenchmarkResult RunSdfBenchmark(float VoxelSize = 20.f, int32_t NumQueries = 20000);
+
+	struct FBvhBenchmarkResult
+	{
+		FBvhBuildSettings Settings;
+		FBvhBuildStats Build;
+		size_t MemoryBytes = 0;
+		int32_t PacketWidth = 0;
+
+		/** Per probe: analytic, one TraceDown at a time through FBvhFloorWorld, and TraceDownBatch as generated and sorted */
+		double AnalyticNs = 0.0;
+		double SingleNs = 0.0;
+		double PacketNs = 0.0;
+		/** Sorting included */
+		double SortedPacketNs = 0.0;
+
+		/** Floor height off the analytic one, cm, where both hit: the heightfield's triangulation error */
+		double MeanError = 0.0;
+		double MaxError = 0.0;
+		/** Probes the BVH and the analytic world disagree on hitting */
+		int32_t Mismatches = 0;
+		/** Packet answers different from the single-ray ones, should be 0 */
+		int32_t PacketMismatches = 0;
+	};
+
+	/**
+	 * Builds an FFloorBvh with Settings over FSyntheticWorld triangulated on a 25 cm grid across a 48 m square, then
+	 * answers NumProbes pawn floor probes from it and analytically: the build and traversal numbers to tune the
+	 * leaf size and SAH costs with.
+	 */
+	FBvhBenchmarkResult RunBvhBenchmark(const FBvhBuildSettings& Settings = FBvhBuildSettings(), int32_t NumProbes = 100000);
+
+	/** Records one benchmark pawn over Config.NumFrames frames, so the replayer can be tried without the game */
+	void RecordSyntheticPawn(FMovementRecorder& Recorder, const FBenchmarkConfig& Config);
+
+	/** Same for one drone flying on scripted stick input */
+	void RecordSyntheticDrone(FMovementRecorder& Recorder, const FBenchmarkConfig& Config);
+
+	struct FNetLoopbackConfig
+	{
+		/** Each client drives one pawn and receives every pawn's state */
+		int32_t NumClients = 32;
+		float Seconds = 30.f;
+		float DeltaTime = 1.f / 60.f;
+		/** Server snapshots per second */
+		float SnapshotRate = 20.f;
+		/** One-way, both directions, milliseconds */
+		float LatencyMs = 50.f;
+		float JitterMs = 10.f;
+		/** Fraction of packets dropped, both directions */
+		float PacketLoss = 0.05f;
+		/** Inputs resent in every input packet, so a lost packet does not lose an input */
+		int32_t InputRedundancy = 3;
+		/** Off, every snapshot is sent against the zero state */
+		bool bDeltaCompression = true;
+		uint32_t Seed = 1;
+	};
+
+	struct FNetLoopbackResult
+	{
+		/** Snapshot payload per replicated pawn per receiving client per second. Packet headers not counted. */
+		double DownBytesPerActorPerSecond = 0.0;
+		/** Input payload per client per second */
+		double UpBytesPerClientPerSecond = 0.0;
+		double BitsPerActorState = 0.0;
+		uint64_t SnapshotsSent = 0;
+		uint64_t SnapshotsReceived = 0;
+		/** Received snapshots that were encoded against an acknowledged one */
+		uint64_t DeltaSnapshotsReceived = 0;
+		/** Inputs the server never got and stepped the previous one for instead */
+		uint64_t InputsLost = 0;
+		/** Own-pawn states clients compared with their prediction, and how many did not match */
+		uint64_t PredictionsChecked = 0;
+		uint64_t Corrections = 0;
+		/** Distance between predicted and server location at the corrected input, cm */
+		float MaxCorrection = 0.f;
+		double MeanCorrection = 0.0;
+		/** Sum of final server positions */
+		double Checksum = 0.0;
+	};
+
+	/**
+	 * Server and clients in one process over a simulated link with latency, jitter and loss. Clients predict their
+	 * pawn from their own inputs and reconcile against snapshots by replaying the inputs the server has not seen yet.
+	 */
+	FNetLoopbackResult RunNetLoopback(const FNetLoopbackConfig& Config);
+}
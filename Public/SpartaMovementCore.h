@@ -0,0 +1,396 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Engine-independent kinematic core for ASpartaPawn and ASpartaDrone.
+// Nothing in here may include engine headers: the same sources are compiled into the
+// game module and into the standalone Linux benchmark (see SpartaMovementBenchmark.h).
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+/** Set to 1 when building the movement sources outside the engine */
+#ifndef SPARTA_MOVEMENT_STANDALONE
+#define SPARTA_MOVEMENT_STANDALONE 0
+#endif
+
+namespace SpartaMovement
+{
+	struct FVec3
+	{
+		float X = 0.f;
+		float Y = 0.f;
+		float Z = 0.f;
+
+		FVec3() = default;
+		FVec3(float InX, float InY, float InZ) : X(InX), Y(InY), Z(InZ) {}
+
+		FVec3 operator+(const FVec3& V) const { return FVec3(X + V.X, Y + V.Y, Z + V.Z); }
+		FVec3 operator-(const FVec3& V) const { return FVec3(X - V.X, Y - V.Y, Z - V.Z); }
+		FVec3 operator*(float S) const { return FVec3(X * S, Y * S, Z * S); }
+		FVec3& operator+=(const FVec3& V) { X += V.X; Y += V.Y; Z += V.Z; return *this; }
+
+		float Dot(const FVec3& V) const { return X * V.X + Y * V.Y + Z * V.Z; }
+		FVec3 Cross(const FVec3& V) const { return FVec3(Y * V.Z - Z * V.Y, Z * V.X - X * V.Z, X * V.Y - Y * V.X); }
+		float SizeSquared() const { return Dot(*this); }
+		float Size() const { return std::sqrt(SizeSquared()); }
+		bool IsNearlyZero(float Tolerance = 1.e-4f) const
+		{
+			return std::fabs(X) <= Tolerance && std::fabs(Y) <= Tolerance && std::fabs(Z) <= Tolerance;
+		}
+		/** Unit vector, or zero if too short to normalize */
+		FVec3 GetSafeNormal() const
+		{
+			const float SizeSq = SizeSquared();
+			return SizeSq > 1.e-8f ? *this * (1.f / std::sqrt(SizeSq)) : FVec3();
+		}
+	};
+
+	/** Rotation quaternion with FQuat's conventions: A * B rotates by B, then by A */
+	struct FQuat4
+	{
+		float X = 0.f;
+		float Y = 0.f;
+		float Z = 0.f;
+		float W = 1.f;
+
+		FQuat4() = default;
+		FQuat4(float InX, float InY, float InZ, float InW) : X(InX), Y(InY), Z(InZ), W(InW) {}
+
+		FQuat4 operator*(const FQuat4& Q) const
+		{
+			return FQuat4(
+				W * Q.X + X * Q.W + Y * Q.Z - Z * Q.Y,
+				W * Q.Y - X * Q.Z + Y * Q.W + Z * Q.X,
+				W * Q.Z + X * Q.Y - Y * Q.X + Z * Q.W,
+				W * Q.W - X * Q.X - Y * Q.Y - Z * Q.Z);
+		}
+
+		float Dot(const FQuat4& Q) const { return X * Q.X + Y * Q.Y + Z * Q.Z + W * Q.W; }
+
+		FVec3 RotateVector(const FVec3& V) const
+		{
+			const FVec3 Axis(X, Y, Z);
+			const FVec3 T = Axis.Cross(V) * 2.f;
+			return V + T * W + Axis.Cross(T);
+		}
+
+		/** Same as FQuat::Equals: q and -q are the same rotation */
+		bool Equals(const FQuat4& Q, float Tolerance = 1.e-4f) const
+		{
+			return (std::fabs(X - Q.X) <= Tolerance && std::fabs(Y - Q.Y) <= Tolerance && std::fabs(Z - Q.Z) <= Tolerance && std::fabs(W - Q.W) <= Tolerance)
+				|| (std::fabs(X + Q.X) <= Tolerance && std::fabs(Y + Q.Y) <= Tolerance && std::fabs(Z + Q.Z) <= Tolerance && std::fabs(W + Q.W) <= Tolerance);
+		}
+	};
+
+	/** Same as FQuat(FRotator(Pitch, Yaw, Roll)), degrees */
+	FQuat4 MakeQuat(float Pitch, float Yaw, float Roll);
+
+	/** Same as FQuat::Slerp: the short way round, normalized */
+	FQuat4 SlerpQuat(const FQuat4& A, const FQuat4& B, float Alpha);
+
+	/** Same as FMath::QInterpTo */
+	FQuat4 InterpQuat(const FQuat4& Current, const FQuat4& Target, float DeltaTime, float InterpSpeed);
+
+	/** Same as FMath::FInterpTo */
+	float InterpFloat(float Current, float Target, float DeltaTime, float InterpSpeed);
+
+	/** Tunables of the pawn movement. Defaults are the values ASpartaPawn has always used. */
+	struct FPawnMoveParams
+	{
+		float Gravity = -980.f;
+		float WalkingSpeed = 600.f;
+		float SprintSpeed = 1200.f;
+		float JumpVelocity = 600.f;
+		float JumpCutVelocity = 300.f;
+		float RotationInterpSpeed = 5.f;
+
+		float CapsuleRadius = 50.f;
+		float CapsuleHalfHeight = 50.f;
+
+		/** Wall probe is lifted so the floor does not register as a wall */
+		float CollisionZOffset = 80.f;
+		/** Contacts whose normal.Z is above this are ground, not walls */
+		float GroundNormalZ = 0.7f;
+
+		/** Steps lower than this are walked over: the move sweep starts this far above the feet and the floor clamp lifts the pawn */
+		float MaxStepHeight = 30.f;
+		/** Sweeps per move; each hit slides the rest of the move along the surface */
+		int32_t MaxSlideIterations = 4;
+		/** Moves stop this far short of a hit, so the next sweep does not start inside it */
+		float SlideSkinDistance = 0.1f;
+
+		/** The wall query is inflated by this much; while nothing is within it, the query can be skipped */
+		float CollisionSafeMargin = 20.f;
+		/** A skipped wall query is re-run after this many frames regardless, to catch fast movers */
+		int32_t MaxCoherentCollisionFrames = 10;
+
+		/** Floor probe length = clamp(|Velocity.Z| * Scale, Min, Max) */
+		float FloorTraceSpeedScale = 0.1f;
+		float MinFloorTraceDistance = 500.f;
+		float MaxFloorTraceDistance = 10000.f;
+
+		/** Speed (cm/s) and per-step drift (cm) below which a grounded pawn counts as at rest */
+		float RestTolerance = 0.1f;
+		/** Consecutive steps at rest before the pawn goes to sleep and stops ticking */
+		int32_t StepsToSleep = 30;
+	};
+
+	/** Simulation state of one pawn */
+	struct FPawnMoveState
+	{
+		FVec3 Location;
+		FVec3 Velocity;
+		float Yaw = 0.f;
+		float CurrentFloorZ = 0.f;
+		bool bIsJumping = false;
+		bool bIsSprinting = false;
+	};
+
+	struct FSweepHit
+	{
+		/** Fraction of the move done before the hit, 0..1 */
+		float Time = 1.f;
+		/** Points away from the blocker */
+		FVec3 Normal;
+		/** The shape overlapped the blocker before moving; Normal and Penetration give the way out */
+		bool bStartPenetrating = false;
+		float Penetration = 0.f;
+	};
+
+	struct FWallContact
+	{
+		FVec3 ImpactPoint;
+		FVec3 Normal;
+		float Distance = 0.f;
+		/** How deep the queried capsule overlaps the blocker */
+		float Penetration = 0.f;
+		/** The blocker can move, so results near it cannot be reused */
+		bool bMovable = false;
+		/** Opaque index the world implementation can use to map back to its own hit data */
+		int32_t HitIndex = -1;
+	};
+
+	/** World queries the movement code needs. Implemented over UWorld in-game and over a synthetic world in the benchmark. */
+	class IMovementWorld
+	{
+	public:
+		virtual ~IMovementWorld() = default;
+
+		/** Downward probe from Start. Returns true and the floor height if something is hit within Distance. */
+		virtual bool TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const = 0;
+
+		/**
+		 * Uncached downward probe, used to fill FFloorHeightCache.
+		 * bOutCacheable is false when the result can change without an invalidation (the floor can move).
+		 */
+		virtual bool TraceFloorSample(const FVec3& Start, float Distance, float& OutFloorZ, bool& bOutCacheable) const
+		{
+			bOutCacheable = true;
+			return TraceFloor(Start, Distance, OutFloorZ);
+		}
+
+		/**
+		 * Zero-length capsule query at Center. Writes at most MaxContacts contacts, the nearest ones;
+		 * the nearest of all comes first, the order of the rest is unspecified. Returns the number written.
+		 */
+		virtual int32_t OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const = 0;
+
+		/**
+		 * Vertical capsule swept from Start to End (centers). Returns true and the first blocking hit.
+		 * Worlds without blocking geometry keep the default.
+		 */
+		virtual bool SweepCapsule(const FVec3& /*Start*/, const FVec3& /*End*/, float /*Radius*/, float /*HalfHeight*/, FSweepHit& /*OutHit*/) const
+		{
+			return false;
+		}
+
+		/** Called for every contact that was resolved as a wall. Debug hook, no-op by default. */
+		virtual void OnWallContact(const FWallContact& /*Contact*/) const {}
+	};
+
+	constexpr int32_t MaxWallContacts = 8;
+
+	/**
+	 * Per-pawn memory of the last wall query. When the inflated query found nothing within the safe margin,
+	 * the pawn cannot touch a static wall until it has moved further than the remaining clearance.
+	 */
+	struct FCollisionCoherence
+	{
+		FVec3 LastCenter;
+		/** Distance the pawn may move from LastCenter without a new query, negative when the query must run */
+		float FreeDistance = -1.f;
+		int32_t FramesSinceQuery = 0;
+
+		void Invalidate() { FreeDistance = -1.f; }
+	};
+
+	struct FCollisionQueryStats
+	{
+		std::atomic<uint64_t> Executed{0};
+		std::atomic<uint64_t> Skipped{0};
+		/** Wall contacts the pawn had already moved into and had to be pushed out of */
+		std::atomic<uint64_t> Depenetrations{0};
+	};
+
+	/** Wall queries executed vs. skipped by coherence, and depenetrations, over all pawns */
+	FCollisionQueryStats& GetCollisionQueryStats();
+
+	float ComputeFloorTraceDistance(float VelocityZ, const FPawnMoveParams& Params);
+
+	/** Refresh State.CurrentFloorZ. Keeps the previous value if the probe misses. Returns whether the probe hit. */
+	bool UpdateFloorZ(FPawnMoveState& State, const FPawnMoveParams& Params, const IMovementWorld& World);
+
+	/**
+	 * Push the pawn out of every wall it overlaps, by the overlap depth. Returns the number of wall contacts resolved.
+	 * Moves go through SlidePawn, so this only catches walls that moved into the pawn.
+	 * With Coherence, the query is skipped while the pawn stays inside the free space found last time.
+	 */
+	int32_t CheckCollision(FPawnMoveState& State, const FPawnMoveParams& Params, const IMovementWorld& World, FCollisionCoherence* Coherence = nullptr);
+
+	/** Gravity, integration and floor clamp. Resets the jump state on landing. */
+	void Integrate(FPawnMoveState& State, const FPawnMoveParams& Params, float DeltaTime);
+
+	/** Standing on the floor, not jumping, not moving, and moved no further than RestTolerance from PreviousLocation this step */
+	bool IsAtRest(const FPawnMoveState& State, const FPawnMoveParams& Params, const FVec3& PreviousLocation);
+
+	/** Full per-frame update, in the same order ASpartaPawn::Tick always ran it */
+	void TickPawn(FPawnMoveState& State, const FPawnMoveParams& Params, const IMovementWorld& World, float DeltaTime, FCollisionCoherence* Coherence = nullptr);
+
+	/** World-space move direction for a 2D input relative to the control yaw (degrees) */
+	FVec3 ComputeMoveDirection(float ControlYaw, float InputX, float InputY);
+
+	float ComputeMoveSpeed(const FPawnMoveState& State, const FPawnMoveParams& Params);
+
+	/**
+	 * Move Center by Delta with a capsule sweep, stopping at the time of impact and sliding the rest of the
+	 * move along the contact normal; between two walls along their crease. Runs at most MaxIterations sweeps,
+	 * so a fast move cannot tunnel however long it is. Returns the number of blocking hits.
+	 */
+	int32_t SlideMove(FVec3& Center, const FVec3& Delta, float Radius, float HalfHeight, const IMovementWorld& World, int32_t MaxIterations, float SkinDistance);
+
+	/** Capsule the pawn moves with: from MaxStepHeight above the feet to the top of the wall probe. Center is relative to the pawn location. */
+	void GetPawnSweepCapsule(const FPawnMoveParams& Params, float& OutCenterZOffset, float& OutHalfHeight);
+
+	/** SlideMove for the pawn's walk displacement */
+	int32_t SlidePawn(FPawnMoveState& State, const FPawnMoveParams& Params, const FVec3& Delta, const IMovementWorld& World);
+
+	/** Frame displacement for walk input. Also turns State.Yaw towards the move direction. */
+	FVec3 ComputeWalkDisplacement(FPawnMoveState& State, const FPawnMoveParams& Params, float ControlYaw, float InputX, float InputY, float DeltaTime);
+
+	/** Same as FMath::RInterpTo restricted to yaw */
+	float InterpYaw(float Current, float Target, float DeltaTime, float InterpSpeed);
+
+	bool StartJump(FPawnMoveState& State, const FPawnMoveParams& Params);
+	void StopJump(FPawnMoveState& State, const FPawnMoveParams& Params);
+
+	/** Drone gravity for one step: full gravity at zero engine power, none at max power. Negative Z offset. */
+	float ComputeDroneGravityOffset(float EnginePower, float MaxEnginePower, float GravityAccel, float DeltaTime);
+
+	/** Engine power after DeltaTime of decay. The decay is linear, so this is exact for any DeltaTime and power can be evaluated lazily. */
+	float DecayEnginePower(float EnginePower, float ReducingPower, float DeltaTime);
+
+	/**
+	 * Drone height change over Elapsed seconds starting at EnginePower, in closed form: ComputeDroneGravityOffset integrated
+	 * while the power decays by DecayEnginePower. Does not depend on how Elapsed is split into steps. Negative Z offset.
+	 */
+	float ComputeDroneFallOffset(float EnginePower, float MaxEnginePower, float GravityAccel, float ReducingPower, float Elapsed);
+
+	/** Tunables of the drone movement. Defaults are the values ASpartaDrone has always used. */
+	struct FDroneMoveParams
+	{
+		float MaxEnginePower = 1200.f;
+		/** Engine power lost per second */
+		float ReducingPower = 100.f;
+		float GravityAccel = 980.f;
+		/** Engine power every step with up/down input adds, up to MaxEnginePower */
+		float EnginePowerPerStep = 10.f;
+
+		/** Look input turns the target rotation by this many degrees per second and axis unit */
+		float PitchSpeed = 50.f;
+		float YawSpeed = 50.f;
+		float MinPitch = -45.f;
+		float MaxPitch = 45.f;
+
+		/** Lean into the move input, degrees at full axis */
+		float MaxTiltAngle = 20.f;
+		float MaxPitchAngle = 10.f;
+		float HeadingInterpSpeed = 5.f;
+		float TiltInterpSpeed = 5.f;
+		/** How fast a grounded drone levels out */
+		float RestoreInterpSpeed = 3.f;
+
+		float CapsuleRadius = 55.f;
+		float CapsuleHalfHeight = 96.f;
+		/** Sweeps per move, see SlideMove */
+		int32_t MaxSlideIterations = 4;
+		float SlideSkinDistance = 0.1f;
+		/** Grounded while the floor is within this far below the drone */
+		float GroundProbeDistance = 10.f;
+	};
+
+	/** Axis values the input handlers collected since the last step. The step turns them into one move. */
+	struct FDroneInputCommand
+	{
+		float MoveUp = 0.f;
+		float MoveForward = 0.f;
+		float MoveRight = 0.f;
+
+		void Reset() { *this = FDroneInputCommand(); }
+	};
+
+	/** Simulation state of one drone */
+	struct FDroneMoveState
+	{
+		FVec3 Location;
+
+		/**
+		 * Rotation layers, combined into the drone's rotation once per step by StepDroneRotation: the heading eases
+		 * toward the target rotation, the tilt toward leaning into the move input in the drone's own frame, and while
+		 * grounded RestoreAlpha eases toward 1 and blends the drone level around its heading.
+		 */
+		FQuat4 HeadingLayer;
+		FQuat4 TiltLayer;
+		float RestoreAlpha = 0.f;
+
+		/** Where the look input points the drone, degrees */
+		float TargetPitch = 0.f;
+		float TargetYaw = 0.f;
+		float TargetRoll = 0.f;
+
+		/** Engine power at EnginePowerTime (world seconds); it decays from there without stepping, see DecayEnginePower */
+		float EnginePower = 0.f;
+		double EnginePowerTime = 0.0;
+
+		FDroneInputCommand Input;
+		/** Last forward and right axes; the tilt keeps leaning into them after the input stops */
+		float TiltForward = 0.f;
+		float TiltRight = 0.f;
+
+		bool bIsGrounded = false;
+	};
+
+	/** Engine power at Time, decayed from State.EnginePowerTime */
+	float GetDroneEnginePower(const FDroneMoveState& State, const FDroneMoveParams& Params, double Time);
+
+	/** Decays the engine power up to Time and moves the stamp there */
+	void RestampDroneEnginePower(FDroneMoveState& State, const FDroneMoveParams& Params, double Time);
+
+	/** Eases the rotation layers one step and returns the drone's rotation */
+	FQuat4 StepDroneRotation(FDroneMoveState& State, const FDroneMoveParams& Params, float DeltaTime);
+
+	/** State.Input plus gravity as one displacement. Up/down input also spools the engine up. */
+	FVec3 ComputeDroneMoveOffset(FDroneMoveState& State, const FDroneMoveParams& Params, float DeltaTime);
+
+	/**
+	 * Full step from StartTime (world seconds), in the order ASpartaDrone always ran it: engine power, rotation layers,
+	 * one swept move and the ground check. Without a World the move is not swept and the ground is the plane Z = 0.
+	 * Returns the drone's rotation. Leaves State.Input alone; the caller resets it once a frame's steps have used it.
+	 */
+	FQuat4 StepDrone(FDroneMoveState& State, const FDroneMoveParams& Params, const IMovementWorld* World, double StartTime, float DeltaTime);
+
+	/** Look input: turns the target rotation by AxisValue over DeltaSeconds. Returns false for a zero axis. */
+	bool TurnDronePitch(FDroneMoveState& State, const FDroneMoveParams& Params, float AxisValue, float DeltaSeconds);
+	bool TurnDroneYaw(FDroneMoveState& State, const FDroneMoveParams& Params, float AxisValue, float DeltaSeconds);
+}
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Logging and debug drawing for the movement hot path.
+// Go through the macros below, not UE_LOG/DrawDebug* directly: in Shipping and Test builds they
+// compile to nothing, arguments included, and otherwise drawing is off until Sparta.Movement.DebugDraw asks for it.
+//
+//   log LogSpartaMovement Verbose        wall contacts
+//   log LogSpartaMovement VeryVerbose    per-input drone logs
+//   Sparta.Movement.DebugDraw 7          floor probes (1) + wall contacts (2) + move sweeps (4)
+//   Sparta.Movement.TransformStats       actor transform writes and component updates per agent per frame
+//   ASpartaBenchmarkGameMode             frame time percentiles, game thread time per part and trace counts to CSV
+
+#include "CoreMinimal.h"
+#include "DrawDebugHelpers.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogSpartaMovement, Log, All);
+
+#ifndef SPARTA_MOVEMENT_DEBUG
+#define SPARTA_MOVEMENT_DEBUG (!(UE_BUILD_SHIPPING || UE_BUILD_TEST))
+#endif
+
+namespace SpartaMovementDebug
+{
+	enum EDrawChannel : int32
+	{
+		Draw_Floor = 1 << 0,
+		Draw_Walls = 1 << 1,
+		Draw_Sweeps = 1 << 2,
+	};
+
+	/** Sparta.Movement.DebugDraw has the channel's bit set */
+	ASSIGNMENT_7_7_API bool IsDrawEnabled(EDrawChannel Channel);
+
+	/** Totals over every SpartaPawn and SpartaDrone, game thread only */
+	struct FTransformStats
+	{
+		/** Frames, summed over agents */
+		uint64 AgentFrames = 0;
+		/** Transform writes movement asked for */
+		uint64 Writes = 0;
+		/** Writes that reached the actor; fewer than Writes when Sparta.Movement.DeferredTransforms merges them */
+		uint64 Commits = 0;
+		/** Scene components whose world transform was updated, children included. Stays 0 without SPARTA_MOVEMENT_DEBUG. */
+		uint64 ComponentUpdates = 0;
+	};
+
+	ASSIGNMENT_7_7_API FTransformStats& GetTransformStats();
+
+	/**
+	 * Counts every world transform update of Actor's scene components into ComponentUpdates. Call once, at BeginPlay,
+	 * and only under SPARTA_MOVEMENT_DEBUG: it adds a delegate broadcast to every component move.
+	 */
+	ASSIGNMENT_7_7_API void TrackTransformUpdates(AActor* Actor);
+
+	/** Game thread seconds spent in each part of the movement frame, totals. Animation is in USpartaAnimBudgetSubsystem::GetStats. */
+	struct FFrameTimings
+	{
+		double MovementSubsystem = 0.0;
+		double SignificanceSubsystem = 0.0;
+		/** Pawns ticking themselves, outside the movement subsystem's batch */
+		double PawnTicks = 0.0;
+		double DroneTicks = 0.0;
+	};
+
+	ASSIGNMENT_7_7_API FFrameTimings& GetFrameTimings();
+
+	/** Adds the time until the end of the scope to Seconds */
+	struct FScopedFrameTiming
+	{
+		explicit FScopedFrameTiming(double& InSeconds) : Seconds(InSeconds), StartTime(FPlatformTime::Seconds()) {}
+		~FScopedFrameTiming() { Seconds += FPlatformTime::Seconds() - StartTime; }
+
+		double& Seconds;
+		double StartTime;
+	};
+}
+
+#if SPARTA_MOVEMENT_DEBUG
+
+#define SPARTA_MOVEMENT_LOG(Verbosity, Format, ...) UE_LOG(LogSpartaMovement, Verbosity, Format, ##__VA_ARGS__)
+
+/** Evaluates Draw (a DrawDebug* call) only while the channel is on. Queries run on movement workers do not draw. */
+#define SPARTA_MOVEMENT_DRAW(Channel, Draw) \
+	do { if (IsInGameThread() && SpartaMovementDebug::IsDrawEnabled(SpartaMovementDebug::Channel)) { Draw; } } while (0)
+
+#else
+
+#define SPARTA_MOVEMENT_LOG(Verbosity, Format, ...) do { } while (0)
+#define SPARTA_MOVEMENT_DRAW(Channel, Draw) do { } while (0)
+
+#endif
@@ -0,0 +1,453 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Wire format for replicated movement: quantized pawn/drone state, delta-compressed against a snapshot the
+// receiver has acknowledged, and the input commands clients predict with, plus both ends of the input stream and
+// the snapshot stream. Engine-free, like SpartaMovementCore.h. ASpartaPawn and ASpartaDrone send it through their
+// ServerMove and ClientMoveSnapshot RPCs; RunNetLoopback (SpartaMovementBenchmark.h) drives the same code over a
+// simulated lossy link.
+
+#include "SpartaMovementCore.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace SpartaMovement
+{
+	/** Appends bits, low bit first, to a byte vector the caller owns and reuses */
+	class FNetBitWriter
+	{
+	public:
+		explicit FNetBitWriter(std::vector<uint8_t>& InBytes) : Bytes(InBytes) { Bytes.clear(); }
+
+		void WriteBits(uint32_t Value, int32_t NumBits);
+		void WriteBool(bool bValue) { WriteBits(bValue ? 1u : 0u, 1); }
+		/** Zigzag, then 4, 9, 13 or 32 bits behind a 2-bit size class: small deltas are cheap */
+		void WriteSigned(int32_t Value);
+
+		int32_t GetNumBits() const { return NumBits; }
+
+	private:
+		std::vector<uint8_t>& Bytes;
+		int32_t NumBits = 0;
+	};
+
+	class FNetBitReader
+	{
+	public:
+		FNetBitReader(const uint8_t* InData, size_t InSize) : Data(InData), Size(InSize) {}
+
+		uint32_t ReadBits(int32_t NumBits);
+		bool ReadBool() { return ReadBits(1) != 0; }
+		int32_t ReadSigned();
+
+		/** Read past the end; everything read since is zero */
+		bool IsOverflowed() const { return bOverflowed; }
+
+	private:
+		const uint8_t* Data;
+		size_t Size;
+		size_t BitPos = 0;
+		bool bOverflowed = false;
+	};
+
+	/** What a client needs to show or predict a pawn or drone */
+	struct FNetMoveState
+	{
+		FVec3 Location;
+		FVec3 Velocity;
+		/** Degrees */
+		float Yaw = 0.f;
+		float Pitch = 0.f;
+		float Roll = 0.f;
+		/** Drones only */
+		float EnginePower = 0.f;
+		bool bIsJumping = false;
+		bool bIsSprinting = false;
+	};
+
+	/** Wire resolution. Location 1/8 cm, velocity 1/16 cm/s, rotation 360/65536 degrees, engine power 1/16. */
+	constexpr float NetLocationQuantum = 0.125f;
+	constexpr float NetVelocityQuantum = 0.0625f;
+	constexpr float NetEnginePowerQuantum = 0.0625f;
+
+	/** FNetMoveState on the wire grid. Equal states compare equal, which is what prediction checks against. */
+	struct FQuantizedMoveState
+	{
+		int32_t Location[3] = {0, 0, 0};
+		int32_t Velocity[3] = {0, 0, 0};
+		uint16_t Rotation[3] = {0, 0, 0};
+		int32_t EnginePower = 0;
+		uint8_t Flags = 0;
+
+		bool operator==(const FQuantizedMoveState& Other) const;
+		bool operator!=(const FQuantizedMoveState& Other) const { return !(*this == Other); }
+	};
+
+	FQuantizedMoveState QuantizeMoveState(const FNetMoveState& State);
+	FNetMoveState DequantizeMoveState(const FQuantizedMoveState& State);
+
+	/**
+	 * State as changes against Baseline: one bit per unchanged field group, a small signed delta per changed component.
+	 * Without a baseline it is written against the zero state, so the same code sends full snapshots.
+	 */
+	void WriteMoveState(FNetBitWriter& Writer, const FQuantizedMoveState& State, const FQuantizedMoveState* Baseline);
+	void ReadMoveState(FNetBitReader& Reader, FQuantizedMoveState& OutState, const FQuantizedMoveState* Baseline);
+
+	/** FPawnMoveState fields that replicate, and back. CurrentFloorZ is re-probed every step and does not. */
+	FNetMoveState ToNetMoveState(const FPawnMoveState& State);
+	void ApplyNetMoveState(const FNetMoveState& NetState, FPawnMoveState& OutState);
+
+	/**
+	 * Round State to what the wire carries. The server does it after every step, so a client that predicts with
+	 * the same inputs and also snaps ends up bit-identical and never has to correct.
+	 */
+	void SnapToNetGrid(FPawnMoveState& State);
+
+	/** One step of client input. Quantized before the client uses it, so client and server step on the same values. */
+	struct FNetPawnInput
+	{
+		uint16_t Sequence = 0;
+		/** Move axes, -127..127 for -1..1 */
+		int8_t MoveX = 0;
+		int8_t MoveY = 0;
+		uint16_t ControlYaw = 0;
+		/** 1/10000 s */
+		uint16_t DeltaTime = 0;
+		bool bJump = false;
+		/** Jump released: cuts a rising jump short, see SpartaMovement::StopJump */
+		bool bJumpRelease = false;
+		bool bSprint = false;
+
+		void Set(float InMoveX, float InMoveY, float InControlYaw, float InDeltaTime, bool bInJump, bool bInJumpRelease, bool bInSprint);
+		float GetMoveX() const { return MoveX / 127.f; }
+		float GetMoveY() const { return MoveY / 127.f; }
+		float GetControlYaw() const { return ControlYaw * (360.f / 65536.f); }
+		float GetDeltaTime() const { return DeltaTime * 1.e-4f; }
+		/** A lost input is stepped as the one before it, without its jump press or release */
+		void ClearPresses() { bJump = false; bJumpRelease = false; }
+	};
+
+	/**
+	 * Input packets carry the newest input and the few before it, newest first. Each is written against the one
+	 * written just before it (Newer): its sequence is implied, and a held input costs one bit.
+	 */
+	void WriteInput(FNetBitWriter& Writer, const FNetPawnInput& Input, const FNetPawnInput* Newer);
+	void ReadInput(FNetBitReader& Reader, FNetPawnInput& OutInput, const FNetPawnInput* Newer);
+
+	/** Jump, jump cut, sprint and walk input, then TickPawn: the step client and server both run for Input */
+	void StepPawnInput(FPawnMoveState& State, const FPawnMoveParams& Params, const FNetPawnInput& Input, const IMovementWorld& World);
+
+	/**
+	 * FDroneMoveState fields that replicate to the owning client, engine power decayed to Time. Not the rotation: it
+	 * follows from the target rotation in the inputs and the rotation layers, which the client keeps for itself.
+	 */
+	FNetMoveState ToNetMoveState(const FDroneMoveState& State, const FDroneMoveParams& Params, double Time);
+	/** Location and engine power as of Time */
+	void ApplyNetMoveState(const FNetMoveState& NetState, FDroneMoveState& OutState, double Time);
+	/** Like the pawn's SnapToNetGrid: location and engine power, restamped to Time */
+	void SnapToNetGrid(FDroneMoveState& State, const FDroneMoveParams& Params, double Time);
+
+	/**
+	 * One step of drone input, like FNetPawnInput. Look input goes as the target rotation it has turned to, and the
+	 * tilt axes as the drone holds them, so the server does not depend on which input events reached which step.
+	 */
+	struct FNetDroneInput
+	{
+		uint16_t Sequence = 0;
+		/** -127..127 for -1..1 */
+		int8_t MoveUp = 0;
+		int8_t MoveForward = 0;
+		int8_t MoveRight = 0;
+		int8_t TiltForward = 0;
+		int8_t TiltRight = 0;
+		uint16_t TargetPitch = 0;
+		uint16_t TargetYaw = 0;
+		/** 1/10000 s */
+		uint16_t DeltaTime = 0;
+
+		/** From the input command, tilt and target rotation the input handlers have left in State */
+		void Set(const FDroneMoveState& State, float InDeltaTime);
+		float GetDeltaTime() const { return DeltaTime * 1.e-4f; }
+		/** A lost input is stepped as the one before it; drones have no one-shot presses to leave out */
+		void ClearPresses() {}
+	};
+
+	void WriteInput(FNetBitWriter& Writer, const FNetDroneInput& Input, const FNetDroneInput* Newer);
+	void ReadInput(FNetBitReader& Reader, FNetDroneInput& OutInput, const FNetDroneInput* Newer);
+
+	/** Input into State, then StepDrone from StartTime: the step client and server both run for Input */
+	FQuat4 StepDroneInput(FDroneMoveState& State, const FDroneMoveParams& Params, const FNetDroneInput& Input, const IMovementWorld& World, double StartTime);
+
+	/** Sequence A is after B, across the 16-bit wrap */
+	inline bool IsSequenceNewer(uint16_t A, uint16_t B) { return static_cast<int16_t>(static_cast<uint16_t>(A - B)) > 0; }
+
+	/** Inputs kept for resending and replay, and snapshots kept as baselines. Powers of two, so ring slots survive the sequence wrap. */
+	constexpr int32_t NetInputHistory = 256;
+	constexpr int32_t NetSnapshotHistory = 32;
+	/** The input count of an input packet is 4 bits */
+	constexpr int32_t NetMaxInputsPerPacket = 15;
+	/**
+	 * Longest step one input may take, in its 1/10000 s, like CharacterMovement's MaxMoveDeltaTime. Inputs are made
+	 * no longer; a client hitch beyond it is dropped.
+	 */
+	constexpr int32_t NetMaxInputDeltaTime = 1250;
+	/** Server time a client may bank while its packets are late, 1/10000 s: inputs beyond it step shorter */
+	constexpr int32_t NetMaxStepTimeBank = 5000;
+	/** Server time is granted this much faster, for each input's time rounding to 1/10000 s and for clock drift */
+	constexpr double NetStepTimeTolerance = 0.02;
+	/** Inputs the server makes up for lost ones, at most, per packet it receives */
+	constexpr int32_t NetMaxLostInputsPerPacket = NetMaxInputsPerPacket;
+
+	/**
+	 * Client end of a predicted actor's input stream: each input it has made, and the state it predicted after it,
+	 * until the server's snapshots have caught up with it. InputType is FNetPawnInput or FNetDroneInput.
+	 */
+	template <typename InputType>
+	class TNetInputBuffer
+	{
+	public:
+		/** Starts the next input, sequenced. The caller fills it in, steps it and hands the result to SetPredicted. */
+		InputType& AddInput()
+		{
+			InputType& Input = Inputs[NextInput % NetInputHistory];
+			Input = InputType();
+			Input.Sequence = NextInput++;
+			NumMade = std::min(NumMade + 1, NetInputHistory);
+			return Input;
+		}
+
+		void SetPredicted(uint16_t Sequence, const FQuantizedMoveState& State) { PredictedAfter[Sequence % NetInputHistory] = State; }
+
+		/** Input packet: the newest snapshot received, if any, then the newest input and up to Redundancy - 1 before it */
+		void WriteInputPacket(FNetBitWriter& Writer, const uint16_t* NewestSnapshot, int32_t Redundancy) const
+		{
+			Writer.WriteBool(NewestSnapshot != nullptr);
+			if (NewestSnapshot)
+			{
+				Writer.WriteBits(*NewestSnapshot, 16);
+			}
+
+			// Bounded by the inputs made, not by the sequence, which wraps back to 0
+			const uint16_t Newest = static_cast<uint16_t>(NextInput - 1);
+			const int32_t NumInputs = std::min(std::max(1, std::min(Redundancy, NetMaxInputsPerPacket)), NumMade);
+			Writer.WriteBits(static_cast<uint32_t>(NumInputs), 4);
+			for (int32_t Back = 0; Back < NumInputs; ++Back)
+			{
+				WriteInput(Writer, Inputs[static_cast<uint16_t>(Newest - Back) % NetInputHistory],
+					Back > 0 ? &Inputs[static_cast<uint16_t>(Newest - Back + 1) % NetInputHistory] : nullptr);
+			}
+		}
+
+		uint16_t GetNewestInput() const { return static_cast<uint16_t>(NextInput - 1); }
+		const InputType& GetInput(uint16_t Sequence) const { return Inputs[Sequence % NetInputHistory]; }
+
+		/** The prediction for Sequence is still kept; older ones have been overwritten */
+		bool IsInHistory(uint16_t Sequence) const { return static_cast<uint16_t>(NextInput - 1 - Sequence) < NetInputHistory; }
+		const FQuantizedMoveState& GetPredicted(uint16_t Sequence) const { return PredictedAfter[Sequence % NetInputHistory]; }
+
+		/**
+		 * Reconciles with the server's state after AckedInput, which must be in history. Returns false when the
+		 * prediction for it held. Otherwise Apply(ServerState) resets the predicted state, and Step(Input) steps every
+		 * input after AckedInput again, in order, returning the state it now predicts after each.
+		 */
+		template <typename ApplyFunc, typename StepFunc>
+		bool Reconcile(uint16_t AckedInput, const FQuantizedMoveState& ServerState, ApplyFunc&& Apply, StepFunc&& Step)
+		{
+			if (ServerState == PredictedAfter[AckedInput % NetInputHistory])
+			{
+				return false;
+			}
+
+			Apply(ServerState);
+			PredictedAfter[AckedInput % NetInputHistory] = ServerState;
+			for (uint16_t Sequence = static_cast<uint16_t>(AckedInput + 1); Sequence != NextInput; ++Sequence)
+			{
+				PredictedAfter[Sequence % NetInputHistory] = Step(Inputs[Sequence % NetInputHistory]);
+			}
+			return true;
+		}
+
+	private:
+		uint16_t NextInput = 1;
+		/** Inputs made so far, saturating at the history size */
+		int32_t NumMade = 0;
+		InputType Inputs[NetInputHistory];
+		/** Indexed like Inputs */
+		FQuantizedMoveState PredictedAfter[NetInputHistory];
+	};
+
+	/**
+	 * Server end of a predicted actor's input stream: inputs as they arrive, stepped in order. Nothing in a packet is
+	 * trusted: inputs too far ahead are dropped, each input's time is clamped, and all of them together never step
+	 * more than the server's own time allows, so a client cannot speed up its actor or flood the server with steps.
+	 */
+	template <typename InputType>
+	class TNetInputQueue
+	{
+	public:
+		/**
+		 * Grants the client the server time since the last call, Now in seconds; the first call grants none. Call it as
+		 * each packet arrives, before stepping.
+		 */
+		void AdvanceServerTime(double Now)
+		{
+			if (LastServerTime >= 0.0)
+			{
+				const double Granted = std::max(Now - LastServerTime, 0.0) * (1.e4 * (1.0 + NetStepTimeTolerance));
+				StepTimeBank = std::min(StepTimeBank + Granted, static_cast<double>(NetMaxStepTimeBank));
+			}
+			LastServerTime = Now;
+		}
+
+		/**
+		 * Reads a packet from TNetInputBuffer::WriteInputPacket. Inputs already stepped are dropped, and so are inputs
+		 * more than NetInputHistory ahead of them, which no client that waits for its snapshots can have made.
+		 */
+		void ReadInputPacket(FNetBitReader& Reader)
+		{
+			LostSincePacket = 0;
+			if (Reader.ReadBool())
+			{
+				const uint16_t Ack = static_cast<uint16_t>(Reader.ReadBits(16));
+				if (!Reader.IsOverflowed() && (!bHasAck || IsSequenceNewer(Ack, AckedSnapshot)))
+				{
+					AckedSnapshot = Ack;
+					bHasAck = true;
+				}
+			}
+
+			const int32_t NumInputs = static_cast<int32_t>(Reader.ReadBits(4));
+			InputType Input;
+			for (int32_t Index = 0; Index < NumInputs; ++Index)
+			{
+				const InputType Newer = Input;
+				ReadInput(Reader, Input, Index > 0 ? &Newer : nullptr);
+				if (!Reader.IsOverflowed() && IsSequenceNewer(Input.Sequence, LastProcessedInput)
+					&& static_cast<uint16_t>(Input.Sequence - LastProcessedInput) <= NetInputHistory)
+				{
+					Inputs[Input.Sequence % NetInputHistory] = Input;
+					bHasInput[Input.Sequence % NetInputHistory] = true;
+					NewestReceivedInput = IsSequenceNewer(Input.Sequence, NewestReceivedInput) ? Input.Sequence : NewestReceivedInput;
+				}
+			}
+		}
+
+		/**
+		 * The next input to step, in order. One that cannot arrive any more, because every packet that could carry it
+		 * (Redundancy of them) was lost, is replaced by the one before it, and bOutLost is set; up to
+		 * NetMaxLostInputsPerPacket of those per packet read. Returns false when the next input has not arrived yet
+		 * and still may. Its DeltaTime is clamped to NetMaxInputDeltaTime and to the server time banked.
+		 */
+		bool PopInput(InputType& OutInput, int32_t Redundancy, bool& bOutLost)
+		{
+			const uint16_t Next = static_cast<uint16_t>(LastProcessedInput + 1);
+			bOutLost = false;
+			if (bHasInput[Next % NetInputHistory] && Inputs[Next % NetInputHistory].Sequence == Next)
+			{
+				OutInput = Inputs[Next % NetInputHistory];
+			}
+			else if (LostSincePacket < NetMaxLostInputsPerPacket
+				&& IsSequenceNewer(NewestReceivedInput, static_cast<uint16_t>(Next + Redundancy - 1)))
+			{
+				OutInput = LastInput;
+				OutInput.Sequence = Next;
+				OutInput.ClearPresses();
+				bOutLost = true;
+				++LostSincePacket;
+			}
+			else
+			{
+				return false;
+			}
+
+			const int32_t Allowed = std::min(NetMaxInputDeltaTime, static_cast<int32_t>(StepTimeBank));
+			OutInput.DeltaTime = static_cast<uint16_t>(std::min<int32_t>(OutInput.DeltaTime, Allowed));
+			StepTimeBank -= OutInput.DeltaTime;
+
+			bHasInput[Next % NetInputHistory] = false;
+			LastInput = OutInput;
+			LastProcessedInput = Next;
+			return true;
+		}
+
+		/** Newest input stepped; a snapshot taken now is the state after it */
+		uint16_t GetLastProcessedInput() const { return LastProcessedInput; }
+		/** Newest snapshot the client has acknowledged, null before the first */
+		const uint16_t* GetAckedSnapshot() const { return bHasAck ? &AckedSnapshot : nullptr; }
+
+	private:
+		InputType Inputs[NetInputHistory];
+		bool bHasInput[NetInputHistory] = {};
+		uint16_t LastProcessedInput = 0;
+		uint16_t NewestReceivedInput = 0;
+		InputType LastInput;
+		uint16_t AckedSnapshot = 0;
+		bool bHasAck = false;
+		int32_t LostSincePacket = 0;
+		/** Server time the client may still step, 1/10000 s; starts full so the first packet steps at once */
+		double StepTimeBank = NetMaxStepTimeBank;
+		double LastServerTime = -1.0;
+	};
+
+	/**
+	 * Snapshot packets open with their sequence, the acknowledged snapshot they are a delta against, if any, and the
+	 * receiver's newest input the server had stepped when it took them. The states follow.
+	 */
+	struct FNetSnapshotHeader
+	{
+		uint16_t Sequence = 0;
+		bool bHasBaseline = false;
+		uint16_t Baseline = 0;
+		uint16_t AckedInput = 0;
+	};
+
+	void WriteSnapshotHeader(FNetBitWriter& Writer, const FNetSnapshotHeader& Header);
+	void ReadSnapshotHeader(FNetBitReader& Reader, FNetSnapshotHeader& OutHeader);
+
+	/** One actor's snapshots by sequence, kept as delta baselines: the ones a server sent, or the ones a client received */
+	class FNetSnapshotRing
+	{
+	public:
+		void Add(uint16_t Sequence, const FQuantizedMoveState& State);
+		/** Null once it has been overwritten */
+		const FQuantizedMoveState* Find(uint16_t Sequence) const;
+
+	private:
+		FQuantizedMoveState States[NetSnapshotHistory];
+		uint16_t Sequences[NetSnapshotHistory] = {};
+		bool bValid[NetSnapshotHistory] = {};
+	};
+
+	/** Server end of one actor's snapshot stream to its owning client */
+	class FNetSnapshotSender
+	{
+	public:
+		/** State after AckedInput, as a delta against AckedSnapshot while that is still kept */
+		void WriteSnapshot(FNetBitWriter& Writer, const FQuantizedMoveState& State, uint16_t AckedInput, const uint16_t* AckedSnapshot);
+
+	private:
+		uint16_t Sequence = 0;
+		FNetSnapshotRing Sent;
+	};
+
+	/** Client end of FNetSnapshotSender's stream */
+	class FNetSnapshotReceiver
+	{
+	public:
+		/**
+		 * Reads a snapshot. Returns true when it is newer than any before: OutState is then the server's state after
+		 * OutAckedInput, to reconcile the prediction with. Late and damaged snapshots return false.
+		 */
+		bool ReadSnapshot(FNetBitReader& Reader, FQuantizedMoveState& OutState, uint16_t& OutAckedInput);
+		/** For the input packets to acknowledge, null before the first */
+		const uint16_t* GetNewestSnapshot() const { return bHasSnapshot ? &NewestSnapshot : nullptr; }
+
+	private:
+		FNetSnapshotRing Received;
+		uint16_t NewestSnapshot = 0;
+		bool bHasSnapshot = false;
+	};
+}
@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Input/state recorder and headless replayer for the movement code. Engine-free, like SpartaMovementCore.h.
+//
+// A recording is one actor's input events, the world query answers its steps got, and its state after every
+// step, in a compact binary log. In-game: "Sparta.Record.Start", "Sparta.Record.Stop" and "Sparta.Replay".
+// Standalone: ./SpartaMovementBench replay <File> [Repeat] [resync]
+
+#include "SpartaMovementCore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SpartaMovement
+{
+	enum class ERecordedActor : uint8_t
+	{
+		Pawn,
+		Drone,
+	};
+
+	/** Record types. Input events carry a timestamp and GetNumRecordValues floats. */
+	enum class ERecordTag : uint8_t
+	{
+		/** InputX, InputY, ControlYaw, DeltaSeconds: the move ASpartaPawn::Move applied */
+		PawnMove = 1,
+		/** LookX, LookY */
+		PawnLook,
+		PawnJumpStart,
+		/** 1 while still pressed */
+		PawnJumpStop,
+		PawnSprintStart,
+		PawnSprintStop,
+		DroneMoveUp,
+		DroneMoveForward,
+		DroneMoveRight,
+		/** AxisValue, DeltaSeconds: the frame time the look turned by */
+		DroneLookPitch,
+		DroneLookYaw,
+		/** The steps so far used the move axes; they were cleared */
+		DroneInputConsumed,
+
+		/** Exact start time, DeltaTime and EStepFlags, then the step's world answers, then a state record */
+		StepBegin,
+		PawnState,
+		DroneState,
+
+		FloorAnswer,
+		OverlapAnswer,
+		SweepAnswer,
+	};
+
+	/** How a recorded step ran */
+	enum EStepFlags : uint8_t
+	{
+		/** Floor and wall queries ran; without it the step only integrated (analytic significance) */
+		StepQueriesWorld = 1 << 0,
+		StepCollisionCoherence = 1 << 1,
+	};
+
+	/** Number of float values an input record carries */
+	int32_t GetNumRecordValues(ERecordTag Tag);
+
+	/** Appends records for one actor. Times are world seconds; input times are stored as microsecond deltas. */
+	class FMovementRecorder
+	{
+	public:
+		void BeginPawn(const FPawnMoveParams& Params, const FPawnMoveState& State, double Time);
+		void BeginDrone(const FDroneMoveParams& Params, const FDroneMoveState& State, double Time);
+
+		/** Values holds GetNumRecordValues(Tag) floats */
+		void RecordInput(ERecordTag Tag, double Time, const float* Values = nullptr);
+
+		void BeginStep(double Time, float DeltaTime, uint8_t Flags);
+		void EndPawnStep(const FPawnMoveState& State);
+		void EndDroneStep(const FDroneMoveState& State);
+
+		void RecordFloor(bool bHit, float FloorZ);
+		void RecordOverlap(const FWallContact* Contacts, int32_t NumContacts);
+		void RecordSweep(bool bHit, const FSweepHit& Hit);
+
+		const std::vector<uint8_t>& GetData() const { return Data; }
+
+	private:
+		void WriteTime(double Time);
+		void WriteByte(uint8_t Value) { Data.push_back(Value); }
+		void WriteFloat(float Value);
+		void WriteVec3(const FVec3& Value);
+		void WritePawnState(const FPawnMoveState& State);
+		void WriteDroneState(const FDroneMoveState& State);
+		void WriteQuat(const FQuat4& Value);
+		/** Tunables go in raw; a replay refuses a log whose layout does not match */
+		void WriteParams(const void* Params, uint16_t Size);
+
+		std::vector<uint8_t> Data;
+		double LastTime = 0.0;
+	};
+
+	/** IMovementWorld that forwards to another one and records every answer */
+	class FRecordingWorld : public IMovementWorld
+	{
+	public:
+		FRecordingWorld(const IMovementWorld& InInner, FMovementRecorder& InRecorder) : Inner(InInner), Recorder(InRecorder) {}
+
+		virtual bool TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const override;
+		virtual int32_t OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const override;
+		virtual bool SweepCapsule(const FVec3& Start, const FVec3& End, float Radius, float HalfHeight, FSweepHit& OutHit) const override;
+		virtual void OnWallContact(const FWallContact& Contact) const override { Inner.OnWallContact(Contact); }
+
+	private:
+		const IMovementWorld& Inner;
+		FMovementRecorder& Recorder;
+	};
+
+	struct FReplayResult
+	{
+		/** Null if the log was read to the end, else what was wrong with it */
+		const char* Error = nullptr;
+		ERecordedActor Actor = ERecordedActor::Pawn;
+		/** Both actors step in the core, so every log that reads is re-simulated */
+		bool bResimulated = false;
+		int32_t NumInputs = 0;
+		int32_t NumSteps = 0;
+		/** Recorded span, first to last timestamp */
+		double RecordedSeconds = 0.0;
+		/** First step whose replayed location is off the recorded one by more than the tolerance, -1 if none */
+		int32_t FirstDivergentStep = -1;
+		float MaxLocationError = 0.f;
+		/** Queries the replay made that the recording has no answer for at that point: control flow diverged */
+		int32_t QueryMismatches = 0;
+		/** Wall-clock time of one pass over the log, divided by its steps */
+		double NsPerStep = 0.0;
+		/** Sum of final positions of the last pass */
+		double Checksum = 0.0;
+	};
+
+	/**
+	 * Re-runs a recording through the movement code Repeat times, as fast as it goes, against the recorded
+	 * world answers. With bResync every step starts from the recorded state instead of the replayed one,
+	 * so one divergence does not drag every later step along.
+	 */
+	FReplayResult ReplayRecording(const uint8_t* Data, size_t Size, int32_t Repeat = 1, bool bResync = false);
+}
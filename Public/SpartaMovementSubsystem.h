@@ -0,0 +1,214 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SpartaBvh.h"
+#include "SpartaMovementBatch.h"
+#include "SpartaFloorCache.h"
+#include "SpartaPawnBroadphase.h"
+#include "SpartaSdf.h"
+#include "SpartaSignificanceSubsystem.h"
+#include "SpartaMovementSubsystem.generated.h"
+
+class ASpartaPawn;
+
+/** Bounds whose floor changed; pawns and drones asleep over it wake up */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSpartaFloorInvalidated, const FBox&);
+
+/**
+ * Steps the movement of every registered ASpartaPawn in one pass per frame.
+ * Pawn state lives here in structure-of-arrays form while the pawn is registered;
+ * registered pawns do not tick themselves.
+ * Bodies are kept grouped by significance bucket, so each bucket is one contiguous range that is
+ * stepped at its own rate, and the analytic bucket without any world queries.
+ * Sleeping pawns sit in one more range after the buckets, which is never stepped.
+ * Networked pawns sit in a last range: they step themselves, once per input, and tick for it.
+ * After the buckets, overlapping pawns are pushed apart, found through a spatial hash over every body.
+ */
+UCLASS()
+class ASSIGNMENT_7_7_API USpartaMovementSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/** Sparta.Movement.Batched */
+	static bool IsBatchingEnabled();
+
+	/** Sparta.Movement.CollisionCoherence */
+	static bool IsCollisionCoherenceEnabled();
+
+	/** Sparta.Movement.Sdf. Any thread: queries check it to leave a baked field unused once it is turned off. */
+	static bool IsSdfEnabled();
+
+	/** Sparta.Movement.FloorBvh. Any thread, like IsSdfEnabled. */
+	static bool IsFloorBvhEnabled();
+
+	/** Sparta.Movement.DeferredTransforms */
+	static bool IsDeferredTransformsEnabled();
+
+	/** Seconds between snapshots, from Sparta.Movement.NetSnapshotRate */
+	static float GetNetSnapshotInterval();
+
+	/** Sparta.Movement.NetInputRedundancy, clamped to what an input packet can carry */
+	static int32 GetNetInputRedundancy();
+
+	/** Takes over the pawn's movement state and assigns its handle. The pawn stops ticking itself. */
+	void RegisterPawn(ASpartaPawn* Pawn);
+	/** Hands the movement state back to the pawn */
+	void UnregisterPawn(ASpartaPawn* Pawn);
+
+	void LoadState(int32 Handle, SpartaMovement::FPawnMoveState& OutState) const;
+	void StoreState(int32 Handle, const SpartaMovement::FPawnMoveState& State);
+
+	int32 GetNumPawns() const { return Pawns.Num(); }
+
+	/** Moves the pawn's body into the bucket's range. Registered pawns start as Full. Sleeping pawns stay asleep. */
+	void SetPawnSignificance(ASpartaPawn* Pawn, ESpartaSignificance Significance);
+
+	/** Moves the pawn's body out of the stepped ranges, or back into its bucket's */
+	void SetPawnAsleep(ASpartaPawn* Pawn, bool bAsleep);
+
+	/**
+	 * Moves the pawn's body into the networked range, where only the pawn's own input steps move it and the pawn
+	 * ticks again, or back into its bucket's. Asleep and significance changes leave it there.
+	 */
+	void SetPawnNetStepped(ASpartaPawn* Pawn, bool bNetStepped);
+
+	/** The pawn has a pending transform for FlushPendingTransforms to write. Registered or not, once per flush. */
+	void AddPendingTransform(ASpartaPawn* Pawn);
+
+	int32 GetNumSleepingPawns() const { return RangeEnds[SleepRange] - RangeEnds[SleepRange - 1]; }
+
+	/** Broadcast by InvalidateFloorCache and when levels stream in or out */
+	FOnSpartaFloorInvalidated OnFloorInvalidated;
+
+	/** Floor-height cache shared by all pawns of this world, nullptr when Sparta.Movement.FloorCache is 0 */
+	SpartaMovement::FFloorHeightCache* GetFloorCache();
+
+	/** Drops cached floor heights under Bounds. Call when static geometry there changes. */
+	void InvalidateFloorCache(const FBox& Bounds);
+
+	/**
+	 * Distance field of the world's static geometry, which pawn and drone queries use instead of static physics.
+	 * Empty unless Sparta.Movement.Sdf is set. Always the same object: rebakes replace its contents.
+	 */
+	const SpartaMovement::FSdfVolume& GetStaticSdf() const { return StaticSdf; }
+
+	/**
+	 * Bakes GetStaticSdf from the static primitives the world has now, with Sparta.Movement.SdfVoxelSize.
+	 * Done at BeginPlay and when levels stream in or out while Sparta.Movement.Sdf is set; static actors destroyed
+	 * in between stay in the field until then. Game thread only.
+	 */
+	void BakeStaticSdf();
+
+	/**
+	 * Triangles of the world's static meshes, which pawn and drone floor probes use instead of static physics.
+	 * Empty unless Sparta.Movement.FloorBvh is set. Always the same object, like GetStaticSdf.
+	 */
+	const SpartaMovement::FFloorBvh& GetStaticBvh() const { return StaticBvh; }
+
+	/**
+	 * Builds GetStaticBvh from LOD0 of the static meshes the world has now, with Sparta.Movement.FloorBvhLeafSize.
+	 * Meshes whose vertices are not kept on the CPU are skipped and counted in the log. Done when BakeStaticSdf is.
+	 * Game thread only.
+	 */
+	void BuildStaticBvh();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual void Deinitialize() override;
+
+private:
+	void OnLevelChanged(ULevel* Level, UWorld* World);
+	void OnActorDestroyed(AActor* Actor);
+
+	/** Swaps two bodies with everything indexed alongside them, and fixes both handles */
+	void SwapBodies(int32 A, int32 B);
+	int32 GetRange(int32 Index) const;
+	void MoveToRange(ASpartaPawn* Pawn, int32 Range);
+	/**
+	 * Queries (unless analytic), integrates and writes back bodies [Begin, End) of the Significance bucket.
+	 * With Sparta.Movement.Parallel the queries and integration run in chunks on worker threads;
+	 * floor cache fills, async query submissions and transforms are committed on the game thread afterwards.
+	 */
+	void StepBodies(int32 Begin, int32 End, ESpartaSignificance Significance);
+
+	/**
+	 * Traces the static floor under bodies [Begin, End) all at once, through Bvh, or Sdf without one: sorted into
+	 * packets of neighbours for the BVH, in chunks on worker threads with bParallel. Each result goes to the pawn's
+	 * FSpartaQueryBuffers::BatchedFloor, where the step's own floor probe finds it.
+	 */
+	void BatchFloorProbes(int32 Begin, int32 End, const SpartaMovement::FFloorBvh* Bvh, const SpartaMovement::FSdfVolume* Sdf, int32 ChunkSize, bool bParallel);
+
+	/**
+	 * Separates overlapping pawns, asleep and networked ones included, through SlidePawn so walls stop the push, and fills their OverlappingActors.
+	 * Runs once per frame after the buckets, on every body's current position.
+	 */
+	void ResolvePawnContacts();
+
+	/** Writes every pending pawn transform, at the end of Tick: after input, the buckets and ResolvePawnContacts have all moved pawns */
+	void FlushPendingTransforms();
+
+	SpartaMovement::FFloorHeightCache FloorCache;
+
+	SpartaMovement::FSdfVolume StaticSdf;
+
+	SpartaMovement::FFloorBvh StaticBvh;
+
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+	FDelegateHandle ActorDestroyedHandle;
+
+	/** Pawns[i] owns body i of Bodies */
+	UPROPERTY(Transient)
+	TArray<ASpartaPawn*> Pawns;
+
+	SpartaMovement::FPawnBodies Bodies;
+
+	/** Time each body has not been stepped for, the step it gets when its bucket runs */
+	TArray<float> PendingTimes;
+
+	/** One range per bucket, then the sleeping pawns, then the networked ones */
+	static constexpr int32 SleepRange = static_cast<int32>(ESpartaSignificance::Num);
+	static constexpr int32 NetRange = SleepRange + 1;
+
+	/** Range r owns bodies [RangeEnds[r - 1], RangeEnds[r]), the first one starts at 0 */
+	int32 RangeEnds[NetRange + 1] = {};
+
+	bool IsNetStepped(const ASpartaPawn* Pawn) const;
+	/** Time since each bucket last ran */
+	float BucketTimes[SleepRange] = {};
+
+	/** Pawns that settled during this tick, put to sleep once the ranges are no longer being walked */
+	TArray<ASpartaPawn*> SettledPawns;
+
+	/** Every body's capsule, indexed like Bodies */
+	SpartaMovement::FPawnSpatialHash PawnHash;
+	std::vector<SpartaMovement::FPawnContact> PawnContacts;
+	/** BatchFloorProbes scratch, kept so batches do not allocate once it has grown to the largest bucket */
+	struct FFloorProbeBatch
+	{
+		/** In body order */
+		TArray<SpartaMovement::FVec3> Starts;
+		std::vector<uint64_t> Keys;
+		/** In Keys order */
+		TArray<SpartaMovement::FVec3> SortedStarts;
+		TArray<float> SortedDistances;
+		TArray<float> FloorZ;
+		TArray<bool> Hits;
+	};
+	FFloorProbeBatch FloorProbes;
+
+	/** Pawns whose OverlappingActors is not empty */
+	TArray<ASpartaPawn*> OverlappingPawns;
+	/** Separation each overlapping pawn takes this frame, indexed like Bodies; only entries of OverlappingPawns are valid */
+	TArray<SpartaMovement::FVec3> ContactPushes;
+
+	/** Pawns with a pending transform. Destroyed pawns are nulled out. */
+	UPROPERTY(Transient)
+	TArray<ASpartaPawn*> PendingTransformPawns;
+};
@@ -4,11 +4,16 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Pawn.h"
+#include "SpartaMovementCore.h"
+#include "SpartaMovementNet.h"
+#include "SpartaMovementRecording.h"
+#include "SpartaWorldQuery.h"
+#include "SpartaSignificanceSubsystem.h"
+#include "SpartaPlayerCameraManager.h"
 #include "SpartaPawn.generated.h"
 
-class USpringArmComponent;
-class UCameraComponent;
 class UCapsuleComponent;
+class USpartaMovementSubsystem;
 
 //class USkeletalMeshComponent;
 
@@ -22,6 +27,27 @@ class ASSIGNMENT_7_7_API ASpartaPawn : public APawn
 public:
 	ASpartaPawn();
 
+	/** Starts streaming this pawn's input, world query answers and steps into a movement recording, see SpartaMovementRecording.h */
+	void StartRecording();
+	/** Ends the recording and hands it over, null if none was running */
+	TUniquePtr<SpartaMovement::FMovementRecorder> StopRecording();
+
+	/** What a movement snapshot carries for this pawn, see SpartaMovementNet.h */
+	SpartaMovement::FNetMoveState GetNetMoveState() const;
+	/** Takes a snapshot's state, as a teleport */
+	void ApplyNetMoveState(const SpartaMovement::FNetMoveState& NetState);
+
+	/**
+	 * Client to server, every frame the owning client steps the pawn: its newest inputs, see
+	 * SpartaMovement::TNetInputBuffer::WriteInputPacket. The server steps the ones it has not yet, in order.
+	 */
+	UFUNCTION(Server, Unreliable)
+	void ServerMove(const TArray<uint8>& Packet);
+
+	/** Server to owning client: the pawn's state after the newest input stepped, see SpartaMovement::FNetSnapshotSender */
+	UFUNCTION(Client, Unreliable)
+	void ClientMoveSnapshot(const TArray<uint8>& Packet);
+
     /** Collision Component (Capsule, Root) */
     UPROPERTY(VisibleAnywhere, Category = "Components")
     UCapsuleComponent* CapsuleComp;
@@ -30,18 +56,21 @@ public:
     UPROPERTY(VisibleAnywhere, Category = "Components")
     USkeletalMeshComponent* SkeletalMeshComp;
 
-    /** Spring Arm Component */
-    UPROPERTY(VisibleAnywhere, Category = "Components")
-    USpringArmComponent* SpringArmComp;
-
-    /** Camera Component */
-    UPROPERTY(VisibleAnywhere, Category = "Components")
-    UCameraComponent* CameraComp;
+    /** Where ASpartaPlayerCameraManager's camera rig puts the camera while a local player looks through this pawn */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera")
+    FSpartaCameraRigSettings CameraRig;
 
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void Tick(float DeltaTime) override;
+	virtual void PossessedBy(AController* NewController) override;
+	virtual void UnPossessed() override;
+	virtual void PostNetReceiveRole() override;
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
+	virtual void NotifyHit(UPrimitiveComponent* MyComp, AActor* Other, UPrimitiveComponent* OtherComp, bool bSelfMoved,
+		FVector HitLocation, FVector HitNormal, FVector NormalImpulse, const FHitResult& Hit) override;
+	virtual void NotifyActorBeginOverlap(AActor* OtherActor) override;
 
 	UFUNCTION()
 	void Move(const FInputActionValue& value);
@@ -57,30 +86,114 @@ protected:
 	void StopSprint(const FInputActionValue& value);
 	
 private:
-	float CurrentSpeed;
-	float SprintSpeed;
-	float WalkingSpeed;
-
-	float CurrentFloorZ;
-	float Gravity;
-	bool bIsJumping;
-	bool bIsSprinting;
-	FVector Velocity;
-
-	FVector LastLocation;
-	bool bIsMoving;
-
-	// Collision
-	float CapsuleRadius;
-	float CapsuleHalfHeight;
-	FVector BlockedPosition;
+	friend class USpartaMovementSubsystem;
+	/** Feeds the input handlers above like an enhanced input binding would */
+	friend class ASpartaBotController;
+
+	/** Kinematic state and tunables, stepped by the engine-free SpartaMovement core */
+	SpartaMovement::FPawnMoveParams MoveParams;
+	SpartaMovement::FPawnMoveState MoveState;
+	SpartaMovement::FCollisionCoherence CollisionCoherence;
+	/** Hit arrays and query params reused by every floor and wall query */
+	FSpartaQueryBuffers QueryBuffers;
+
+	/** Set while USpartaMovementSubsystem owns MoveState; MoveState is then only a scratch copy */
+	USpartaMovementSubsystem* MovementSubsystem = nullptr;
+	int32 MovementHandle = INDEX_NONE;
+
+	/** Bucket from USpartaSignificanceSubsystem. Analytic skips the floor and wall queries. */
+	ESpartaSignificance Significance = ESpartaSignificance::Full;
+	/** World time of the last self-tick step, see USpartaSignificanceSubsystem::ConsumeStepTime */
+	double LastStepTime = -1.0;
+
+	void SetSignificance(ESpartaSignificance NewSignificance);
+
+	/** Asleep: at rest for MoveParams.StepsToSleep steps, not ticked or stepped until something wakes it */
+	bool bIsAsleep = false;
+	int32 RestSteps = 0;
+
+	/** Counts steps at rest; steps whose queries found something movable do not count. Returns true once the pawn should go to sleep. */
+	bool NoteStep(bool bAtRest);
+	void GoToSleep();
+	/** Input, hits, overlaps and floor changes under the pawn call this */
+	void WakeUp();
+	void OnFloorInvalidated(const FBox& Bounds);
+
+	void PullMoveState();
+	void PushMoveState();
+
+	/**
+	 * Where movement has put the actor this frame. With Sparta.Movement.DeferredTransforms, MoveActorTo only records
+	 * it and USpartaMovementSubsystem writes it once, through FlushPendingTransform, after everything that moves pawns
+	 * has run. Movement code reads the actor's place through GetMoveLocation and GetMoveRotation to see its own moves.
+	 */
+	FVector PendingLocation = FVector::ZeroVector;
+	FRotator PendingRotation = FRotator::ZeroRotator;
+	bool bHasPendingTransform = false;
+
+	FVector GetMoveLocation() const { return bHasPendingTransform ? PendingLocation : GetActorLocation(); }
+	FRotator GetMoveRotation() const { return bHasPendingTransform ? PendingRotation : GetActorRotation(); }
+	void MoveActorTo(const FVector& Location, const FRotator& Rotation);
+	void MoveActorTo(const FVector& Location) { MoveActorTo(Location, GetMoveRotation()); }
+	/** Writes the pending transform as one move: children and overlaps update once for all of the frame's moves */
+	void FlushPendingTransform();
+
+	/**
+	 * Networked movement, see SpartaMovementNet.h. A pawn a remote player controls is stepped by that player's inputs
+	 * alone, on the server as ServerMove brings them and on the client as it makes them; ClientMoveSnapshot corrects
+	 * the client. Other clients follow the engine's replicated movement.
+	 */
+	enum class ENetMoveRole : uint8
+	{
+		/** Not networked, or the server's or listen server's own pawn: steps itself, as always */
+		Local,
+		/** Autonomous proxy: predicts its own inputs and sends them */
+		Predicting,
+		/** Server, remote player: steps the inputs ServerMove brings and sends snapshots back */
+		ServerDriven,
+		/** Simulated proxy: placed by replicated movement, never stepped */
+		Simulated,
+	};
+	ENetMoveRole NetMoveRole = ENetMoveRole::Local;
+
+	/**
+	 * From the actor's roles. While networked every input is its own step, so the pawn ticks and its body waits in
+	 * the movement subsystem's networked range, still pushed apart from other pawns; a simulated proxy leaves it.
+	 */
+	void UpdateNetMoveRole();
+	/** One input through SpartaMovement::StepPawnInput, snapped to the wire grid, on MoveState */
+	void StepNetInput(const SpartaMovement::FNetPawnInput& Input);
+	/** Predicting: the frame's input, stepped, buffered and sent */
+	void TickNetPrediction(float DeltaTime);
+	/** Puts the actor where MoveState is, facing its yaw */
+	void MoveActorToState();
+
+	/** Predicting: input events since the last tick, sent as one FNetPawnInput */
+	FVector2D NetMoveInput = FVector2D::ZeroVector;
+	float NetControlYaw = 0.0f;
+	bool bNetJump = false;
+	bool bNetJumpRelease = false;
+	bool bNetSprint = false;
+
+	SpartaMovement::TNetInputBuffer<SpartaMovement::FNetPawnInput> NetInputBuffer;
+	SpartaMovement::FNetSnapshotReceiver NetSnapshotReceiver;
+	SpartaMovement::TNetInputQueue<SpartaMovement::FNetPawnInput> NetInputQueue;
+	SpartaMovement::FNetSnapshotSender NetSnapshotSender;
+	/** ServerDriven: world time of the last snapshot sent */
+	double LastNetSnapshotTime = -1.0;
+	/** Packet bytes, reused */
+	std::vector<uint8_t> NetBytes;
+
+	/** Set while recording */
+	TUniquePtr<SpartaMovement::FMovementRecorder> Recorder;
+
+	void RecordInput(SpartaMovement::ERecordTag Tag, const float* Values = nullptr);
+
+	/** Other pawns whose capsule overlaps this one, filled by USpartaMovementSubsystem every frame */
 	TSet<AActor*> OverlappingActors;
 
-	void UpdateFloorZ();
 	void MovementByActorWorldOffset(const FVector2D moveInput);
-	void SetActorRotate(FVector MoveDirection);
 
 	// 浹 
 	// void OnCustomCollision(AActor* OtherActor, const FHitResult& HitResult);
-	bool CheckCollision();
 };
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Pawn-pawn broadphase: a uniform grid over pawn capsules. Engine-free, like SpartaMovementCore.h.
+
+#include "SpartaMovementCore.h"
+
+#include <vector>
+
+namespace SpartaMovement
+{
+	/** Two pawn capsules that overlap. A < B. */
+	struct FPawnContact
+	{
+		int32_t A = -1;
+		int32_t B = -1;
+		/**
+		 * Horizontal move of B away from A that separates them; A moving by the opposite does the same.
+		 * Pawns are kept apart sideways only, so pushes never fight gravity and the floor clamp.
+		 */
+		FVec3 Separation;
+	};
+
+	/**
+	 * Upright capsules on a uniform XY grid, with cells hashed into a fixed table of buckets.
+	 * Every body sits on its bucket's intrusive list and is only relinked when it crosses into another cell, so
+	 * updating every body each frame costs a cell computation per body. Nothing allocates once Reserve covers
+	 * the body count.
+	 * Cells are kept at least as wide as the widest capsule, so every overlap is within the 3x3 cells around a body.
+	 * Indices follow FPawnBodies: Add appends, RemoveAtSwap and Swap move bodies the same way.
+	 */
+	class FPawnSpatialHash
+	{
+	public:
+		/** NumBuckets is rounded up to a power of two */
+		explicit FPawnSpatialHash(float InCellSize = 100.f, int32_t InNumBuckets = 4096);
+
+		void Reserve(int32_t Capacity);
+
+		int32_t Num() const { return static_cast<int32_t>(Centers.size()); }
+
+		/** Appends a capsule and returns its index. Widens the cells, relinking everything, if it does not fit. */
+		int32_t Add(const FVec3& Center, float Radius, float HalfHeight);
+		void RemoveAtSwap(int32_t Index);
+		void Swap(int32_t A, int32_t B);
+
+		/** Moves the capsule's center. Relinks it only when its cell changed. */
+		void Update(int32_t Index, const FVec3& Center);
+
+		/** Appends every overlapping pair once */
+		void FindContacts(std::vector<FPawnContact>& OutContacts) const;
+
+		float GetCellSize() const { return CellSize; }
+
+		/** Updates made and how many of them changed cell */
+		uint64_t NumUpdates = 0;
+		uint64_t NumRelinks = 0;
+
+	private:
+		int32_t GetBucket(int32_t CellX, int32_t CellY) const;
+		void Link(int32_t Index);
+		void Unlink(int32_t Index);
+		void SetCellSize(float InCellSize);
+
+		float CellSize;
+		float InvCellSize;
+		uint32_t BucketMask;
+
+		std::vector<FVec3> Centers;
+		std::vector<float> Radii;
+		std::vector<float> HalfHeights;
+		std::vector<int32_t> CellXs;
+		std::vector<int32_t> CellYs;
+		std::vector<int32_t> Next;
+		std::vector<int32_t> Prev;
+		/** First body of each bucket's list, -1 when empty */
+		std::vector<int32_t> Heads;
+	};
+
+	/** Same as one FindContacts, by testing every pair. Reference for the benchmark. */
+	void FindContactsBruteForce(const FVec3* Centers, const float* Radii, const float* HalfHeights, int32_t Num, std::vector<FPawnContact>& OutContacts);
+}
@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Camera/PlayerCameraManager.h"
+#include "SpartaPlayerCameraManager.generated.h"
+
+/** Where the camera rig puts the camera behind a pawn or drone. Same meaning as the USpringArmComponent settings. */
+USTRUCT(BlueprintType)
+struct FSpartaCameraRigSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera", meta = (ClampMin = "0.0"))
+	float ArmLength = 300.0f;
+
+	/** Offset of the arm's pivot from the actor, in world space */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera")
+	FVector TargetOffset = FVector::ZeroVector;
+
+	/** Offset of the camera from the end of the arm, in the arm's space */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera")
+	FVector SocketOffset = FVector::ZeroVector;
+
+	/** Point the arm along the controller's view rotation instead of the actor's rotation */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera")
+	bool bUsePawnControlRotation = true;
+
+	/** Speed the pivot trails the actor at, 0 for no lag */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera", meta = (ClampMin = "0.0"))
+	float LocationLagSpeed = 0.0f;
+
+	/** Speed the arm's rotation trails its target at, 0 for no lag */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera", meta = (ClampMin = "0.0"))
+	float RotationLagSpeed = 0.0f;
+
+	/** Pull the camera in front of whatever blocks the arm */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera")
+	bool bDoCollisionTest = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera", meta = (ClampMin = "0.0"))
+	float ProbeSize = 12.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera")
+	TEnumAsByte<ECollisionChannel> ProbeChannel = ECC_Camera;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Camera", meta = (ClampMin = "5.0", ClampMax = "170.0"))
+	float FieldOfView = 90.0f;
+};
+
+/**
+ * One spring arm and camera per local player instead of one per pawn. The rig follows the view target when it is an
+ * ASpartaPawn or ASpartaDrone, taking the target's CameraRig settings; anything else gets the engine's view.
+ * It runs in the camera manager's update, after every actor has ticked and written its transform, so lag, smoothing
+ * and the collision probe see this frame's positions and only ever run for the actor someone looks through.
+ */
+UCLASS()
+class ASSIGNMENT_7_7_API ASpartaPlayerCameraManager : public APlayerCameraManager
+{
+	GENERATED_BODY()
+
+public:
+	/** The rig settings of Target, null if the rig does not follow it */
+	static const FSpartaCameraRigSettings* GetRigSettings(const AActor* Target);
+
+	/** Totals over all local players, logged by Sparta.Movement.CameraStats */
+	struct FRigStats
+	{
+		uint64 Frames = 0;
+		/** Frames the rig placed the camera, and the collision probes it ran for them */
+		uint64 RigUpdates = 0;
+		uint64 Probes = 0;
+	};
+	static FRigStats& GetRigStats();
+
+protected:
+	virtual void UpdateViewTarget(FTViewTarget& OutVT, float DeltaTime) override;
+
+private:
+	void UpdateRig(FTViewTarget& OutVT, const FSpartaCameraRigSettings& Rig, float DeltaTime);
+
+	/** Rig state carried between frames; dropped when the view target changes */
+	TWeakObjectPtr<const AActor> RigTarget;
+	FVector RigPivot = FVector::ZeroVector;
+	FQuat RigRotation = FQuat::Identity;
+};
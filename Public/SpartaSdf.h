@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Signed distance field of static level geometry, and movement queries answered from it instead of physics
+// queries. Engine-free, like SpartaMovementCore.h. USpartaMovementSubsystem bakes one at load when
+// Sparta.Movement.Sdf is set; RunSdfBenchmark (SpartaMovementBenchmark.h) checks it against analytic queries.
+
+#include "SpartaMovementCore.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace SpartaMovement
+{
+	/** Region of the bake, as the source sees it */
+	enum class ESdfRegion : uint8_t
+	{
+		/** No geometry anywhere in it */
+		Empty,
+		/** All of it inside geometry */
+		Solid,
+		/** Anything else, or the source cannot tell */
+		Mixed,
+	};
+
+	/** The geometry BakeSdf voxelizes */
+	class ISdfBakeSource
+	{
+	public:
+		virtual ~ISdfBakeSource() = default;
+
+		/** Whether Center, or with TestsWholeVoxel the voxel of half size HalfSize around it, is inside geometry */
+		virtual bool IsSolid(const FVec3& Center, float HalfSize) const = 0;
+
+		/**
+		 * IsSolid is true for any voxel geometry touches, which keeps walls thinner than a voxel. The bake then puts
+		 * the surface on the boundary samples instead of halfway to the next one.
+		 */
+		virtual bool TestsWholeVoxel() const { return false; }
+
+		/** Lets the baker skip whole bricks without calling IsSolid for their voxels */
+		virtual ESdfRegion ClassifyRegion(const FVec3& /*Min*/, const FVec3& /*Max*/) const { return ESdfRegion::Mixed; }
+	};
+
+	struct FSdfBakeSettings
+	{
+		FVec3 Min;
+		FVec3 Max;
+		float VoxelSize = 20.f;
+		/** Distances are exact up to this many voxels from the surface and clamped beyond; bricks farther out are not stored */
+		int32_t BandVoxels = 3;
+	};
+
+	struct FSdfBakeStats
+	{
+		int32_t NumBricks = 0;
+		/** Bricks the source classified as empty or solid, and bricks voxelized but not kept because no surface was near */
+		int32_t NumSkippedBricks = 0;
+		int32_t NumDroppedBricks = 0;
+		uint64_t NumSolidQueries = 0;
+		double Seconds = 0.0;
+	};
+
+	/**
+	 * Signed distance to static geometry, negative inside, in bricks of 8x8x8 samples one voxel apart. Neighbouring
+	 * bricks share their border samples, so every trilinear sample reads a single brick. Only bricks near the surface
+	 * are stored; the rest are flagged as far outside or far inside in the top-level grid and read as +-GetFarDistance.
+	 * Samples are one byte each, spanning -GetFarDistance..GetFarDistance: a hundredth of a voxel is well under the
+	 * error of the bake itself. Outside the baked bounds everything is far outside.
+	 */
+	class FSdfVolume
+	{
+	public:
+		static constexpr int32_t BrickSamples = 8;
+		static constexpr int32_t BrickCells = BrickSamples - 1;
+
+		bool IsEmpty() const { return BrickGrid.empty(); }
+
+		float Sample(const FVec3& Point) const;
+		/** Sample, and the unit gradient of the trilinear interpolation: away from the nearest surface */
+		float SampleGradient(const FVec3& Point, FVec3& OutNormal) const;
+
+		/** Sample for Num points given as separate X, Y and Z arrays: 8 lanes at a time with AVX2, 4 with SSE2 */
+		void SampleBatch(const float* X, const float* Y, const float* Z, float* OutDistances, int32_t Num) const;
+
+		float GetVoxelSize() const { return VoxelSize; }
+		float GetFarDistance() const { return FarDistance; }
+		FVec3 GetMin() const { return Origin; }
+		FVec3 GetMax() const;
+		int32_t GetNumBricks() const { return static_cast<int32_t>(Samples.size() / (BrickSamples * BrickSamples * BrickSamples)); }
+		size_t GetMemoryBytes() const { return BrickGrid.size() * sizeof(int32_t) + Samples.size(); }
+
+	private:
+		friend FSdfVolume BakeSdf(const ISdfBakeSource& Source, const FSdfBakeSettings& Settings, FSdfBakeStats* OutStats);
+
+		/** BrickGrid entries that are not brick indices */
+		static constexpr int32_t FarOutside = -1;
+		static constexpr int32_t FarInside = -2;
+
+		/** False outside the bounds; else the brick and the position inside it, 0..BrickCells on each axis */
+		bool Locate(const FVec3& Point, int32_t& OutBrick, float& OutX, float& OutY, float& OutZ) const;
+
+		FVec3 Origin;
+		float VoxelSize = 1.f;
+		float InvVoxelSize = 1.f;
+		float FarDistance = 0.f;
+		float QuantumScale = 0.f;
+		int32_t BricksX = 0;
+		int32_t BricksY = 0;
+		int32_t BricksZ = 0;
+		/** Brick index, FarOutside or FarInside, X fastest */
+		std::vector<int32_t> BrickGrid;
+		/** 512 samples per brick, X fastest, plus padding so a 32-bit gather at the last sample stays inside */
+		std::vector<uint8_t> Samples;
+	};
+
+	/**
+	 * Voxelizes Settings' bounds through Source. Each sample is the exact distance to the nearest sample of the other
+	 * side (separable Euclidean distance transform over the brick and the band around it), less half a voxel for
+	 * point-testing sources, so the surface sits between the solid and the empty sample. Every IsSolid call is made once.
+	 */
+	FSdfVolume BakeSdf(const ISdfBakeSource& Source, const FSdfBakeSettings& Settings, FSdfBakeStats* OutStats = nullptr);
+
+	/**
+	 * Floor probes for Num points at once, each with its own distance, the same answers as FSdfWorld::TraceFloor:
+	 * each round samples every probe still going through one SampleBatch, a block of probes at a time. Does not
+	 * allocate. OutFloorZ is left alone for probes that miss.
+	 */
+	void TraceFloorBatch(const FSdfVolume& Volume, const FVec3* Starts, const float* Distances, float* OutFloorZ, bool* OutHits, int32_t Num);
+
+	/**
+	 * IMovementWorld over an FSdfVolume alone. Floor probes sphere-trace down; capsule overlaps and sweeps sample the
+	 * field along the capsule's core segment. Every contact is static: bMovable is false and HitIndex -1.
+	 */
+	class FSdfWorld : public IMovementWorld
+	{
+	public:
+		explicit FSdfWorld(const FSdfVolume& InVolume) : Volume(InVolume) {}
+
+		/** A start up to a voxel under the surface still finds it: trilinear error can put a pawn standing on it there */
+		virtual bool TraceFloor(const FVec3& Start, float Distance, float& OutFloorZ) const override;
+		/** Contacts whose normals differ, the deepest for each */
+		virtual int32_t OverlapCapsule(const FVec3& Center, float Radius, float HalfHeight, FWallContact* OutContacts, int32_t MaxContacts) const override;
+		/** Conservative advancement: steps by the clearance until it is under a twentieth of a voxel */
+		virtual bool SweepCapsule(const FVec3& Start, const FVec3& End, float Radius, float HalfHeight, FSweepHit& OutHit) const override;
+
+	private:
+		/** Smallest distance over the capsule's core segment and where on it */
+		float SampleCapsule(const FVec3& Center, float Radius, float HalfHeight, FVec3& OutPoint) const;
+
+		const FSdfVolume& Volume;
+	};
+}
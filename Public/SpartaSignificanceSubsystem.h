@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SpartaSignificanceSubsystem.generated.h"
+
+/** How much simulation an actor gets. Buckets are ordered from most to least. */
+UENUM()
+enum class ESpartaSignificance : uint8
+{
+	/** Every frame, full pipeline */
+	Full,
+	/** Sparta.Significance.ReducedInterval, full pipeline */
+	Reduced,
+	/** Sparta.Significance.AnalyticInterval, integration only: no traces or sweeps */
+	Analytic,
+
+	Num UMETA(Hidden)
+};
+
+DECLARE_DELEGATE_OneParam(FOnSpartaSignificanceChanged, ESpartaSignificance);
+
+/**
+ * Sorts registered pawns and drones into significance buckets by distance to the nearest viewer
+ * and whether they were rendered recently. Player-controlled actors are always Full.
+ * Actors apply the bucket themselves when told, see ASpartaPawn/ASpartaDrone::SetSignificance.
+ */
+UCLASS()
+class ASSIGNMENT_7_7_API USpartaSignificanceSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/** Sparta.Significance.Enabled */
+	static bool IsEnabled();
+
+	/** Seconds between steps of an actor in the bucket, 0 for every frame */
+	static float GetTickInterval(ESpartaSignificance Significance);
+
+	/**
+	 * Time to step for an actor that last stepped at LastStepTime (world seconds, negative if never).
+	 * With a tick interval the engine's DeltaTime is not what the actor missed, so it is measured here.
+	 */
+	static float ConsumeStepTime(const UWorld* World, double& LastStepTime, float FrameDeltaTime);
+
+	/** OnChanged runs right away with the initial bucket, then on every change */
+	void RegisterActor(AActor* Actor, FOnSpartaSignificanceChanged OnChanged);
+	void UnregisterActor(AActor* Actor);
+
+	int32 GetNumInBucket(ESpartaSignificance Significance) const;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual void Deinitialize() override;
+
+private:
+	struct FEntry
+	{
+		TWeakObjectPtr<AActor> Actor;
+		FOnSpartaSignificanceChanged OnChanged;
+		ESpartaSignificance Significance = ESpartaSignificance::Full;
+	};
+
+	void GatherViewers();
+	ESpartaSignificance Evaluate(const AActor* Actor) const;
+
+	TArray<FEntry> Entries;
+	TArray<FVector> ViewLocations;
+	/** No rendering to go by, on a dedicated server */
+	bool bCheckRendered = true;
+	float TimeSinceUpdate = 0.f;
+};
@@ -0,0 +1,216 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WorldCollision.h"
+#include "SpartaMovementCore.h"
+#include "SpartaFloorCache.h"
+#include "SpartaBvh.h"
+#include "SpartaSdf.h"
+
+class UWorld;
+class AActor;
+
+/** How an FSpartaWorldQuery answers */
+enum class ESpartaQueryMode : uint8
+{
+	/** Blocking queries; floor cache misses are filled on the spot. Game thread only. */
+	Immediate,
+	/** Blocking queries that may run on a worker thread: the floor cache is only read, misses are left in Buffers.FloorFill */
+	Concurrent,
+	/**
+	 * Concurrent, and the floor probe and wall query are answered by the async ones submitted for the same buffers last frame,
+	 * when those have completed and were made close enough to this frame's. Otherwise they block as in Concurrent.
+	 * This frame's go out with FSpartaWorldQuery::SubmitAsyncQueries.
+	 */
+	Async,
+};
+
+/** One async query of a pawn or drone: the one asked for this frame, and the one in flight since last frame */
+struct FSpartaAsyncQuery
+{
+	struct FShape
+	{
+		FVector Start = FVector::ZeroVector;
+		/** Floor probe: trace distance. Wall query: capsule radius. */
+		float Size = 0.f;
+		float HalfHeight = 0.f;
+	};
+
+	FTraceHandle Handle;
+	FShape Submitted;
+	double SubmitTime = 0.0;
+	uint64 SubmitFrame = 0;
+	/** The latency of Handle has gone into the stats */
+	bool bCompletionSeen = false;
+
+	FShape Requested;
+	bool bRequested = false;
+};
+
+/** Sparta.Movement.AsyncStats */
+struct FSpartaAsyncQueryStats
+{
+	std::atomic<uint64> Submitted{0};
+	/** Queries answered by last frame's async result */
+	std::atomic<uint64> Used{0};
+	/** Blocking fallbacks: the result had not completed yet */
+	std::atomic<uint64> Late{0};
+	/** Blocking fallbacks: the result was made too far from this frame's query, or with another shape */
+	std::atomic<uint64> Stale{0};
+	/** Blocking fallbacks: nothing was submitted last frame, or it has expired */
+	std::atomic<uint64> Cold{0};
+
+	/** Submission to the first query that found the result, summed over results */
+	std::atomic<uint64> Completed{0};
+	std::atomic<uint64> LatencyMicros{0};
+	std::atomic<uint64> LatencyFrames{0};
+
+	/** Async queries we added to the engine's queue in the last frame that submitted any, and the most in one frame. Game thread only. */
+	uint32 QueueDepth = 0;
+	uint32 MaxQueueDepth = 0;
+	uint32 FrameQueueDepth = 0;
+	uint64 QueueDepthFrame = 0;
+};
+
+/** Blocking physics queries issued by FSpartaWorldQuery, from any thread. Async ones are in FSpartaAsyncQueryStats::Submitted. */
+struct FSpartaTraceCounts
+{
+	std::atomic<uint64> FloorTraces{0};
+	std::atomic<uint64> WallOverlaps{0};
+	std::atomic<uint64> Sweeps{0};
+};
+
+/**
+ * Query state a pawn or drone keeps for its whole life, so its per-tick queries do not allocate.
+ * Init at BeginPlay.
+ */
+struct ASSIGNMENT_7_7_API FSpartaQueryBuffers
+{
+	/** Ignores the owner */
+	FCollisionQueryParams QueryParams;
+	/** WorldDynamic + WorldStatic, what the wall query has always looked for */
+	FCollisionObjectQueryParams ObjectQueryParams;
+	/** WorldDynamic alone: what is left for physics when static geometry is answered by StaticSdf or StaticBvh */
+	FCollisionObjectQueryParams DynamicObjectQueryParams;
+
+	/**
+	 * The world's baked static geometry, see USpartaMovementSubsystem::GetStaticSdf. Queries go to physics for
+	 * everything while it is empty, which it stays unless Sparta.Movement.Sdf is set.
+	 */
+	const SpartaMovement::FSdfVolume* StaticSdf = nullptr;
+
+	/**
+	 * The world's static mesh triangles, see USpartaMovementSubsystem::GetStaticBvh. Floor probes read static
+	 * geometry from it, before StaticSdf, while it holds a build and Sparta.Movement.FloorBvh is set.
+	 */
+	const SpartaMovement::FFloorBvh* StaticBvh = nullptr;
+
+	/**
+	 * Hits of the last wall query. The engine's multi-query API only takes the default allocator,
+	 * so instead of an inline allocator the array is reserved once and only ever Reset.
+	 */
+	TArray<FHitResult> HitResults;
+	FHitResult FloorHit;
+	FHitResult SweepHit;
+
+	/** Sweeps issued through these buffers since the owner last read it, for stats */
+	uint32 NumSweeps = 0;
+
+	/**
+	 * Set by a query that found something movable: a wall contact that is not static, or a floor that may not be
+	 * cached. The owner clears it before a step that queries the world; while it is set the owner does not sleep,
+	 * since nothing would wake it when that thing moves.
+	 */
+	bool bNearMovable = false;
+
+	/**
+	 * The static floor under the owner, traced ahead of time with the rest of its bucket, see
+	 * USpartaMovementSubsystem::BatchFloorProbes. A floor probe from the same Start over the same Distance takes it
+	 * instead of tracing StaticBvh or StaticSdf itself.
+	 */
+	struct FBatchedFloor
+	{
+		SpartaMovement::FVec3 Start;
+		float Distance = 0.f;
+		float FloorZ = 0.f;
+		bool bHit = false;
+		bool bValid = false;
+	};
+	FBatchedFloor BatchedFloor;
+
+	/** Set by a concurrent query that missed the floor cache, see FFloorHeightCache::TraceFloorConcurrent */
+	SpartaMovement::FFloorFillRequest FloorFill;
+
+	/** See ESpartaQueryMode::Async */
+	FSpartaAsyncQuery AsyncFloor;
+	FSpartaAsyncQuery AsyncWall;
+	/** Async results are copied out into this; its hits are reserved like HitResults */
+	FTraceDatum AsyncResult;
+
+	static constexpr int32 ReservedHits = 16;
+
+	void Init(const AActor* Owner);
+};
+
+/**
+ * SpartaMovement::IMovementWorld on top of the engine collision scene.
+ * Cheap to construct: pawns build one on the stack every tick around their FSpartaQueryBuffers.
+ * A concurrent or async query may run on a worker thread, next to others with their own buffers: it only reads the
+ * floor cache and leaves misses in Buffers.FloorFill for the game thread.
+ */
+class ASSIGNMENT_7_7_API FSpartaWorldQuery : public SpartaMovement::IMovementWorld
+{
+public:
+	/** With a floor cache, TraceFloor is answered from the cache where possible */
+	FSpartaWorldQuery(UWorld* InWorld, FSpartaQueryBuffers& InBuffers, SpartaMovement::FFloorHeightCache* InFloorCache = nullptr, ESpartaQueryMode InMode = ESpartaQueryMode::Immediate);
+
+	virtual bool TraceFloor(const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ) const override;
+	virtual bool TraceFloorSample(const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ, bool& bOutCacheable) const override;
+	virtual int32_t OverlapCapsule(const SpartaMovement::FVec3& Center, float Radius, float HalfHeight, SpartaMovement::FWallContact* OutContacts, int32_t MaxContacts) const override;
+	virtual bool SweepCapsule(const SpartaMovement::FVec3& Start, const SpartaMovement::FVec3& End, float Radius, float HalfHeight, SpartaMovement::FSweepHit& OutHit) const override;
+	virtual void OnWallContact(const SpartaMovement::FWallContact& Contact) const override;
+
+	static FVector ToVector(const SpartaMovement::FVec3& V) { return FVector(V.X, V.Y, V.Z); }
+	static SpartaMovement::FVec3 ToVec3(const FVector& V) { return SpartaMovement::FVec3(static_cast<float>(V.X), static_cast<float>(V.Y), static_cast<float>(V.Z)); }
+	static FQuat ToQuat(const SpartaMovement::FQuat4& Q) { return FQuat(Q.X, Q.Y, Q.Z, Q.W); }
+	static SpartaMovement::FQuat4 ToQuat4(const FQuat& Q) { return SpartaMovement::FQuat4(static_cast<float>(Q.X), static_cast<float>(Q.Y), static_cast<float>(Q.Z), static_cast<float>(Q.W)); }
+
+	/** Sparta.Movement.AsyncQueries */
+	static bool IsAsyncEnabled();
+
+	/**
+	 * Sends the async queries an Async query recorded in Buffers since the last call, moved by Offset:
+	 * how far the owner went between querying and this call. Game thread only, once per frame.
+	 */
+	static void SubmitAsyncQueries(UWorld* World, FSpartaQueryBuffers& Buffers, const FVector& Offset = FVector::ZeroVector);
+
+	static FSpartaAsyncQueryStats& GetAsyncStats();
+	static FSpartaTraceCounts& GetTraceCounts();
+
+private:
+	/** Records Shape for the next submission, then copies last frame's result into Buffers.AsyncResult if it is there and made near Shape */
+	bool QueryAsyncResult(FSpartaAsyncQuery& Query, const FSpartaAsyncQuery::FShape& Shape) const;
+	bool TraceFloorAsync(const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ, bool& bOutHit) const;
+	/** Fills Buffers.HitResults from last frame's wall query */
+	bool OverlapCapsuleAsync(const FVector& Center, float Radius, float HalfHeight) const;
+
+	/**
+	 * Buffers.StaticSdf if it holds a bake and Sparta.Movement.Sdf is set.
+	 * Async queries are not made while it answers: the field answers at once.
+	 */
+	const SpartaMovement::FSdfVolume* GetStaticSdf() const;
+	/** Buffers.BatchedFloor if it was traced for this probe. Clears it either way: it is good for one probe. */
+	bool TakeBatchedFloor(const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ, bool& bOutHit) const;
+	/** Buffers.StaticBvh if it holds a build and Sparta.Movement.FloorBvh is set. Like the field, it keeps floor probes off async queries. */
+	const SpartaMovement::FFloorBvh* GetStaticBvh() const;
+	/** A static floor found without physics, then a blocking line trace for dynamic geometry: the higher floor of the two */
+	bool TraceFloorDynamic(bool bStaticHit, float StaticFloorZ, const SpartaMovement::FVec3& Start, float Distance, float& OutFloorZ, bool& bOutCacheable) const;
+
+	UWorld* World;
+	/** FWallContact::HitIndex points into Buffers.HitResults */
+	FSpartaQueryBuffers& Buffers;
+	SpartaMovement::FFloorHeightCache* FloorCache;
+	ESpartaQueryMode Mode;
+};